@@ -7,6 +7,8 @@ CONFIG += static
 
 SOURCES += \
     edt.c \
-    edt_help.c
+    edt_help.c \
+    edt_gzip.c
 
 INCLUDEPATH	+=./
+LIBS += -lpthread
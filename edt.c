@@ -83,12 +83,93 @@
 /*
 *  MODIFICATION HISTORY:
 *
+*	19-OCT-2026	agent	The terminal is read by read() in blocks into a ring buffer (in_ring),
+*				in_getc() takes keys from it instead of getchar() a byte at a time;
+*				the scanf() and getchar() of the keypad setup go through it as well.
+*
+*	19-OCT-2026	agent	Keys are decoded by a byte trie compiled from the keypad table by
+*				key_compile(), one step per byte instead of rescanning the table; a
+*				sequence whose next byte is not there within KEY_TIMEOUT ms is let go,
+*				so a lone ESC no longer eats the key after it.
+*
+*	19-OCT-2026	agent	Bracketed paste is on in screen mode: text pasted between ESC[200~ and
+*				ESC[201~ is put in as it is by paste_text(), with no key decoding and
+*				a single redraw at the end.
+*
+*	19-OCT-2026	agent	Keys typed ahead are applied without drawing (scr_defer), the screen is
+*				drawn once when no more input is waiting (typeahead()).
+*
+*	19-OCT-2026	agent	Screen mode sets the terminal raw by termios (term_raw()) rather than
+*				running stty four times; the settings found at start are put back on
+*				leaving it, at exit and on fatal signals (term_restore()).
+*
+*	19-OCT-2026	agent	resize() asks the terminal by ioctl(TIOCGWINSZ) instead of running
+*				"stty size"; a SIGWINCH lays the screen out for the new size while
+*				edt_getc() waits for a key (screen_winch()).
+*
+*	19-OCT-2026	agent	Horizontal scrolling: text from column hscroll on is shown, the view
+*				follows the cursor by half screens (hview_fit()) and is kept per buffer.
+*				scr_compose() seeks the first column shown by the column checkpoints and
+*				skips the rest of a long line from its last one (col_eol()).
+*
+*	19-OCT-2026	agent	Display columns of the last lines visited are cached as checkpoints every
+*				COL_STEP characters (col_of(), col_seek()); compute_curse_col(), spew_line()
+*				and the up/down arrows count from the nearest one instead of the line start,
+*				move_pt_xxx_line() find the ends of a known line from them.
+*
+*	19-OCT-2026	agent	Top row of the frame is kept as a pointer (tframe_pt), a redraw no longer
+*				counts lines from the top of the buffer.
+*
+*	19-OCT-2026	agent	Screen mode output is collected in a frame sized buffer (out_buf) and sent
+*				by one write() before the next key is read, messages go there too by
+*				out_printf(); scr_*() build escapes from precomputed strings.
+*
+*	19-OCT-2026	agent	Screen redraw keeps a model of the text rows on the terminal and sends
+*				only the cells which differ (lines shifted by ESC[L/ESC[M), Gold ^W
+*				still repaints all of the screen.
+*
+*	19-OCT-2026	agent	Encoding mode: the key is applied by a block kernel working on
+*				vectors of ENC_VW bytes, the same on load and save; load subtracts
+*				the key mod 256, the exact inverse of the save.
+*
+*	19-OCT-2026	agent	SCZ is back: scz_routines.c works on flat arrays instead of the linked
+*				lists, a .scz file (or one found so by its magic) is loaded/saved so.
+*
+*	19-OCT-2026	agent	-view: read-only window around file.gz:N of a big gzip'd file, taken
+*				through an access points index (.gzi) built on the first open.
+*
+*	19-OCT-2026	agent	In-process gzip (edt_gzip.c) instead of running gunzip/gzip: a file
+*				is inflated while loaded (found by its magic), saved deflated.
+*
+*	19-OCT-2026	agent	'w' saves in a forked process working on a copy-on-write snapshot of
+*				the buffer, progress is shown on the message line.
+*
+*	19-OCT-2026	agent	Incremental save: text nodes track changes against the file on the
+*				disk, a save patches only changed extents in place (via .ptc redo log).
+*
+*	19-OCT-2026	agent	copy_backup() uses reflink (FICLONE), copy_file_range() or sendfile()
+*				instead of getc()/putc().
+*
+*	19-OCT-2026	agent	Files are saved into a temp file which is fsync()-ed and renamed over
+*				the target, .bak is a hard link to the old file.
+*
+*	19-OCT-2026	agent	write_file()/write_buffer() gather the buffer into 64K blocks going out
+*				by writev(), newlines are counted a word at a time.
+*
+*	19-OCT-2026	agent	Added -recover: headless replay of the journal, periodic checkpoints
+*				(.ckp) of the buffer and editing state with journal truncation.
+*
+*	19-OCT-2026	agent	Journal is written by a dedicated thread from a lock-free ring buffer,
+*				every batch is fsync()-ed.
+*
 *	27-SEP-2018	RRL	Reformating C 'pupil-style' to something more readable.
 *
 *	28-SEP-2017	RRL	Removed SCZ-related stuff.
 *
 */
 
+#define	_GNU_SOURCE				/* copy_file_range() */
+
 #include	<stdio.h>
 #include	<stdlib.h>
 #include	<string.h>
@@ -100,6 +181,20 @@
 #include	<string.h>
 #include	<limits.h>
 #include	<errno.h>
+#include	<pthread.h>
+#include	<semaphore.h>
+#include	<stdatomic.h>
+#include	<sys/uio.h>
+#include	<libgen.h>
+#include	<sys/ioctl.h>
+#include	<sys/sendfile.h>
+#include	<linux/fs.h>
+#include	<sys/mman.h>
+#include	<sys/wait.h>
+#include	<poll.h>
+#include	<signal.h>
+#include	<termios.h>
+#include	<stdarg.h>
 
 #define	EDT$K_VERSION	2.0
 
@@ -137,22 +232,99 @@ int functkeys_table[19][8]=	/* Key-pad return codes table. Sets default values h
 	{ 1018, 0, EDT$K_ESC, 91, 68,  -1, -1, -1 },  /*Left-Arrow*/
 };
 
-FILE	*infile, *outfile, *jou_outfile;
-char	jou_buf[64];
+/* Bracketed paste: the terminal sends pasted text between these two, it is taken as text */
+#define	EDT$K_PASTE	1019
+char	paste_begin[] = "\033[200~", paste_end[] = "\033[201~";
+
+FILE	*infile, *outfile;
+
+/*
+ * Journal: keystrokes are pushed by the editor into a single-producer/single-consumer
+ * ring buffer, a writer thread drains it with write() and fsync(), so a slow disk
+ * never stalls the keystroke handling.
+ */
+#define	JOU_RING_SZ	(64 * 1024)		/* Must be a power of 2 */
+
+unsigned char	jou_ring[JOU_RING_SZ];
+atomic_ulong	jou_head, jou_tail;		/* Producer and consumer positions */
+atomic_int	jou_stop;
+sem_t		jou_sem;
+pthread_t	jou_tid;
+int		jou_fd = -1;
+int		jou_seq = 0;			/* Checkpoint generation, see journal header */
+long		jou_size = 0, jou_count = 0;	/* Journal size, bytes since last checkpoint */
+char		jou_fname[PATH_MAX], ckp_fname[PATH_MAX];
+
+/*
+ * Crash recovery: the journal starts with a "EDT-JOU <seq>" line, a checkpoint file (.ckp)
+ * holds a snapshot of the main buffer and of the editing state, so '-recover' replays
+ * only the journal written since the last checkpoint.
+ */
+#define	JOU_CKP_BYTES	(64 * 1024)		/* Journal bytes between checkpoints */
+
+unsigned char	*rcv_buf = NULL;		/* Journal being replayed, NULL - not recovering */
+long		rcv_pos, rcv_len;
+int		rcv_stdout = -1, recover_mode = 0, screen_mode = 0;
 
 typedef	struct __text__
 	{
 	char	ch;
+	unsigned char	flags;		/* TXT$M_xxx, fit into the padding */
+	unsigned short	ck;		/* Column checkpoint number + 1, see col_of() */
+	unsigned	del;		/* Number of on-disk bytes deleted just before this one */
 	struct	__text__ *prv, *nxt;
 } TEXT;
 
+#define	TXT$M_NEW	1		/* Not on the disk: inserted since load/save */
+#define	TXT$M_MOD	2		/* On the disk, but changed in place */
+
+#define	TXT_MODIFY(pt)	((pt)->flags |= TXT$M_MOD)
+
+/*
+ * The file as it has been loaded/saved last time, for the incremental save
+ */
+struct stat	disk_st;
+int		disk_valid = 0;
+char		disk_fname[PATH_MAX];
+
+/*
+ * The main file has been found compressed (gzip'd or SCZ) by its magic, it is saved so
+ * whatever its name is
+ */
+char		cz_fname[PATH_MAX];
+int		cz_format;
+
+/*
+ * The main buffer has only a part of the file (a view, or it could not be read in full):
+ * the file is not written over, by whatever name, see write_kept()
+ */
+struct stat	keep_st;
+int		keep_valid = 0;
+
+/*
+ * Background save: a forked child writes its copy-on-write image of the buffer, the
+ * state is shared through an anonymous mapping.
+ */
+typedef	struct __bg_save__ {
+	volatile long	done, total;		/* Progress, characters */
+	int		err;
+	long		nln, nch;
+	int		disk_valid;		/* Disk image after the save, see disk_image() */
+	struct stat	disk_st;
+	char		fname[PATH_MAX], disk_fname[PATH_MAX];
+} BG_SAVE;
+
+BG_SAVE		*bg_save = NULL;
+pid_t		bg_pid = 0;
+int		bg_child = 0;
+
 TEXT	*EOB, *txt_head, *txt_free, *txt_tmp, *curse_pt, *new_curse_pt,
 	*free_nil, *paste_buffer, *word_buf, *line_buf, *format_buffer;
 
 typedef struct __buf_lis__ {
 	struct __text__ *txt_head, *curse_pt, *EOB;
 
-	int curse_row, last_row;
+	int curse_row, last_row, hscroll;
 	char buff_name[256];
 
 	struct __buf_lis__ *nxt;
@@ -173,6 +345,10 @@ int	rel_curse_row, rel_curse_col;
 
 /* Top and bottom of screen in file coordinates */
 int	tframe_row;
+TEXT	*tframe_pt = NULL;	/* First character of tframe_row, NULL - find it by frame_top() */
+
+/* First text column shown, a multiple of 8 so tabs stay in place; see hview_fit() */
+int	hscroll = 0;
 
 /* Top and bottom of work area in file coordinates */
 
@@ -187,6 +363,7 @@ int	direction;		/* 1=forward, -1=backward */
 
 /* Special Modes */
 int	read_only = 0,	/* read-only mode */
+	view_mode = 0,	/* -view: a part of a big gzip'd file, read-only */
 	encode_mode = 0;
 
 char	*psswd;
@@ -209,6 +386,156 @@ extern	void	help_keypad_setup(void);
 extern	void	help_long(void);
 extern	void	help_quick(void);
 
+/*
+ * GZIP-Externals, see edt_gzip.c
+ */
+typedef	struct __gz_stream__ GZ_STREAM;
+
+extern	int	gz_inflate_fd(int fd, int (*put)(void *ctx, unsigned char *buf, long len), void *ctx);
+extern	GZ_STREAM *gz_deflate_open(int fd, int level);
+extern	int	gz_deflate_write(GZ_STREAM *z, const unsigned char *buf, long len);
+extern	int	gz_deflate_close(GZ_STREAM *z);
+
+typedef	struct __gz_index__ GZ_INDEX;
+
+extern	GZ_INDEX *gz_index_open(int fd, char *sidecar);
+extern	void	gz_index_close(GZ_INDEX *x);
+extern	unsigned long long gz_index_lines(GZ_INDEX *x);
+extern	int	gz_index_read(GZ_INDEX *x, int fd, unsigned long long line, long len,
+			int (*put)(void *ctx, unsigned char *buf, long len), void *ctx);
+
+#define	GZ_LEVEL	6
+
+#include	"scz_routines.c"
+
+/*
+ * Formats of a file on the disk
+ */
+#define	CZ_PLAIN	0
+#define	CZ_GZIP		1
+#define	CZ_SCZ		2
+
+void	aux_file_name(char *fname_in, char *ext, char *fname);
+
+/*
+ * Journal routines
+ */
+void	jou_put(const char *buf, int len);
+void	jou_putc(char ch);
+int	edt_getc(void);
+int	typeahead(void);
+int	in_getc(void);
+void	in_word(char *buf, int max);
+
+/*
+ * Screen output, see out_buf
+ */
+int	out_printf(const char *fmt, ...);
+
+
+
+/*
+ * Key decoder: the keypad table and the start of a bracketed paste are compiled by
+ * key_compile() into a byte trie, key_next[node][byte] is the node a byte leads to (0 - none,
+ * the root is node 0) and key_code[node] the key code of a sequence ending there. A key is
+ * decoded in one step per byte. A byte which does not follow within KEY_TIMEOUT ms ends the
+ * sequence, so a lone ESC is told from the start of a key; the timeout goes to the journal
+ * as a NUL, and a NUL inside a sequence ends it the same way while replaying.
+ */
+#define	KEY_SEQLEN	6			/* Bytes of a sequence in a functkeys_table row */
+#define	KEY_NODES	(20 * KEY_SEQLEN + 1)	/* 19 keys and the paste start */
+#define	KEY_TIMEOUT	100			/* ms */
+
+short	key_next[KEY_NODES][256], key_code[KEY_NODES];
+int	key_nodes = 1;
+
+/* The node after byte ch from node, a new one if need be, -1 if the byte can't be there */
+int	key_edge	(int node, int ch)
+{
+	if ( (node < 0) || (ch < 1) || (ch > 255) )
+		return	-1;
+
+	if ( !key_next[node][ch] )
+		{
+		if ( key_nodes == KEY_NODES )
+			return	-1;
+
+		key_next[node][ch] = key_nodes++;
+		}
+
+	return	key_next[node][ch];
+}
+
+/* Build the trie anew, after the keypad table has been set up or changed */
+void	key_compile	(void)
+{
+int	k, i, node;
+
+	memset(key_next, 0, sizeof(key_next));
+	memset(key_code, 0, sizeof(key_code));
+	key_nodes = 1;
+
+	for (k = 0; k < 19; k++)
+		{
+		for (node = 0, i = 2; (i < 2 + KEY_SEQLEN) && (functkeys_table[k][i] != -1); i++)
+			node = key_edge(node, functkeys_table[k][i]);
+
+		if ( node > 0 )
+			key_code[node] = functkeys_table[k][0];
+		}
+
+	for (node = 0, i = 0; paste_begin[i]; i++)
+		node = key_edge(node, paste_begin[i]);
+
+	if ( node > 0 )
+		key_code[node] = EDT$K_PASTE;
+}
+
+/* A next byte of a sequence, NUL if none comes in time */
+int	key_getc	(void)
+{
+struct pollfd pfd = { 0, POLLIN, 0 };
+int	n;
+
+	if ( !rcv_buf && !typeahead() )
+		{
+		while ( (0 > (n = poll(&pfd, 1, KEY_TIMEOUT))) && (errno == EINTR) );
+
+		if ( !n )
+			{
+			jou_putc('\0');
+			return	'\0';
+			}
+		}
+
+	return	edt_getc();
+}
+
+/*
+ * Decode the key which starts with ch: its key code, or 0 with *last the byte to be taken
+ * as typed (ch itself, or the byte on which a sequence went wrong), or -1 if the sequence
+ * was cut short.
+ */
+int	key_decode	(int ch, int *last)
+{
+int	node = 0, next;
+
+	while ( (ch != EOF) && (next = key_next[node][ch & 0xff]) )
+		{
+		if ( key_code[node = next] )
+			{
+			*last = ch;
+			return	key_code[node];
+			}
+
+		ch = key_getc();
+		}
+
+	*last = ch;
+
+	return	(node && ((ch == '\0') || (ch == EOF))) ? -1 : 0;
+}
+
 
 
 void read_line( FILE *infile, char *line, int maxlen )	/* Like fgets, but more descriptive name, */
@@ -229,7 +556,7 @@ int	i = 0, change = 0;
 char	seq[100];
 
 	do	{
-		seq[i++] = getchar();
+		seq[i++] = in_getc();
 	} while (seq[i-1] != '\n' );
 
 	for (i = 0; seq[i] == functkeys_table[k][i+2]; i++ );
@@ -239,22 +566,22 @@ char	seq[100];
 
 	if  ( !change )
 		{
-		printf("	(Unchanged.)\n");
+		out_printf("	(Unchanged.)\n");
 		return;
 		}
 
-	printf("	(Previously assumed to be: ");
+	out_printf("	(Previously assumed to be: ");
 
 	for (i = 0; functkeys_table[k][i+2] !=-1; i++ )
-		printf("<%d> ", functkeys_table[k][i+2]);
+		out_printf("<%d> ", functkeys_table[k][i+2]);
 
 	if ( seq[0] == '\n' )
 		{
-		printf("\n	(Unchanged)\n");
+		out_printf("\n	(Unchanged)\n");
 		return;
 		}
 
-	printf(")\n	(Setting to: ");
+	out_printf(")\n	(Setting to: ");
 
 	for ( i = 0; seq[i] != '\n'; i++)
 		functkeys_table[k][i+2] = seq[i];
@@ -262,9 +589,9 @@ char	seq[100];
 	functkeys_table[k][i+2] = -1;
 
 	for (i = 2; functkeys_table[k][i] != -1; i++ )
-		printf("<%d> ", functkeys_table[k][i]);
+		out_printf("<%d> ", functkeys_table[k][i]);
 
-	printf(")\n");
+	out_printf(")\n");
 }
 
 
@@ -396,7 +723,7 @@ int j = 0, k, m, n;
 
 					if (k > n)
 						{
-						printf("xml_Parse: String ends prematurely after ampersand '%s'.\n",phrase);
+						out_printf("xml_Parse: String ends prematurely after ampersand '%s'.\n",phrase);
 						return;
 						}
 
@@ -414,7 +741,7 @@ int j = 0, k, m, n;
 
 					if ( k > n)
 						{
-						printf("xml_Parse: String ends prematurely after ampersand '%s'.\n",phrase);
+						out_printf("xml_Parse: String ends prematurely after ampersand '%s'.\n",phrase);
 						return;
 						}
 					n = n - 5;
@@ -431,7 +758,7 @@ int j = 0, k, m, n;
 
 					if ( k > n)
 						{
-						printf("xml_Parse: String ends prematurely after ampersand '%s'.\n",phrase);
+						out_printf("xml_Parse: String ends prematurely after ampersand '%s'.\n",phrase);
 						return;
 						}
 
@@ -450,7 +777,7 @@ int j = 0, k, m, n;
 
 					if (k > n)
 						{
-						printf("xml_Parse: String ends prematurely after ampersand '%s'.\n",phrase);
+						out_printf("xml_Parse: String ends prematurely after ampersand '%s'.\n",phrase);
 						return;
 						}
 
@@ -462,7 +789,7 @@ int j = 0, k, m, n;
 					break;
 
 				default:
-					printf("xml_Parse: Unexpected char (%c) follows ampersand (&) in xml.\n", phrase[j+1]);
+					out_printf("xml_Parse: Unexpected char (%c) follows ampersand (&) in xml.\n", phrase[j+1]);
 					j++;
 				}
 			}
@@ -511,7 +838,7 @@ int	j = 0, k = 0;
 	/* Sequence up to first quote.  Expect only white-space and equals-sign. */
 	for(j = 0; (tag[j] != '\0') && (tag[j] != '\"'); j++ )
 		if ((tag[j]!=' ') && (tag[j]!='\t') && (tag[j]!='\n') && (tag[j]!='\r') && (tag[j]!='='))
-			printf("xml error: unexpected char before attribute value quote '%s'\n", tag);
+			out_printf("xml error: unexpected char before attribute value quote '%s'\n", tag);
 
 
 	if (tag[j] == '\0')
@@ -522,7 +849,7 @@ int	j = 0, k = 0;
 
 	if ( tag[j++] != '\"' )
 		{
-		printf("xml error: missing attribute value quote '%s'\n", tag);
+		out_printf("xml error: missing attribute value quote '%s'\n", tag);
 		*tag = *value = '\0';
 		return;
 		}
@@ -533,7 +860,7 @@ int	j = 0, k = 0;
 	value[k] = '\0';
 
 	if (tag[j] != '\"')
-		printf("xml error: unclosed attribute value quote '%s'\n", tag);
+		out_printf("xml error: unclosed attribute value quote '%s'\n", tag);
 	else	j++;
 
 	xml_restore_escapes( value );
@@ -657,78 +984,78 @@ int	i = 0, k, m, n, codes[40];
 char	ans[400], tmpwrd[200], *cptr;
 FILE	*infile;
 
-	printf("\nKeyPad Configuration:\n");
-	printf("\n");
-	printf("	---------------------------------------------\n");
-	printf("	|          |          |          |          |\n");
-	printf("	|  (Alt    |          |  Search  |   Cut    |\n");
-	printf("	|   Gold)  |          |  /Find   |   Line   |\n");
-	printf("	|          |          |          |   (Fwd)  |\n");
-	printf("	---------------------------------------------\n");
-	printf("	|          |          |          |          |\n");
-	printf("	|  Gold    | Jump by  | Replace  |   Cut    |\n");
-	printf("	|  (func)  | 16-lines |          |   Word   |\n");
-	printf("	|   (7)    |   (8)    |   (9)    |   (Fwd)  |\n");
-	printf("	|          |          |          |          |\n");
-	printf("	---------------------------------|	    |\n");
-	printf("	|          |          |          |          |\n");
-	printf("	| Set Dir  |  Set Dir | Cut/Paste|          |\n");
-	printf("	| Forward  |  Bckward | Buffer   |          |\n");
-	printf("	|   (4)    |   (5)    |   (6)    |          |\n");
-	printf("	|          |          |          |          |\n");
-	printf("	---------------------------------------------\n");
-	printf("	|          |          |          |          |\n");
-	printf("	| Jump by  | Jump to  | Enter    |          |\n");
-	printf("	|  Word    | End Line | Ascii Val|  Cut     |\n");
-	printf("	|   (1)    |   (2)    |   (3)    |  Char    |\n");
-	printf("	|          |          |          |          |\n");
-	printf("	---------------------------------|  (Fwd)   |\n");
-	printf("	|                     |          |          |\n");
-	printf("	|     Jump to         | Set Mark |          |\n");
-	printf("	|  Beginning of Line  |(Canc Gld)|          |\n");
-	printf("	|         (0)         |    (.)   |          |\n");
-	printf("	|                     |          |          |\n");
-	printf("	---------------------------------------------\n");
-	printf("\n(Continue?) "); getchar();
-	printf("\n");
-	printf("\nKeyPad Configuration:\n");
-	printf(" This is a two-step process.  The first step finds the 'raw X-key-codes'\n");
-	printf(" of each of your key-pad's keys.  It will be skipped if you are not in\n");
-	printf(" an environment where X-window calls can execute, such as a telnet window.\n");
-	printf(" Otherwise, a small window will appear.  BE CAREFULL!!!  What you type\n");
-	printf(" will affect your keyboard.\n\nStep 1:\n");
-	printf(" Type each of the following keys in exact order into that window:\n");
+	out_printf("\nKeyPad Configuration:\n");
+	out_printf("\n");
+	out_printf("	---------------------------------------------\n");
+	out_printf("	|          |          |          |          |\n");
+	out_printf("	|  (Alt    |          |  Search  |   Cut    |\n");
+	out_printf("	|   Gold)  |          |  /Find   |   Line   |\n");
+	out_printf("	|          |          |          |   (Fwd)  |\n");
+	out_printf("	---------------------------------------------\n");
+	out_printf("	|          |          |          |          |\n");
+	out_printf("	|  Gold    | Jump by  | Replace  |   Cut    |\n");
+	out_printf("	|  (func)  | 16-lines |          |   Word   |\n");
+	out_printf("	|   (7)    |   (8)    |   (9)    |   (Fwd)  |\n");
+	out_printf("	|          |          |          |          |\n");
+	out_printf("	---------------------------------|	    |\n");
+	out_printf("	|          |          |          |          |\n");
+	out_printf("	| Set Dir  |  Set Dir | Cut/Paste|          |\n");
+	out_printf("	| Forward  |  Bckward | Buffer   |          |\n");
+	out_printf("	|   (4)    |   (5)    |   (6)    |          |\n");
+	out_printf("	|          |          |          |          |\n");
+	out_printf("	---------------------------------------------\n");
+	out_printf("	|          |          |          |          |\n");
+	out_printf("	| Jump by  | Jump to  | Enter    |          |\n");
+	out_printf("	|  Word    | End Line | Ascii Val|  Cut     |\n");
+	out_printf("	|   (1)    |   (2)    |   (3)    |  Char    |\n");
+	out_printf("	|          |          |          |          |\n");
+	out_printf("	---------------------------------|  (Fwd)   |\n");
+	out_printf("	|                     |          |          |\n");
+	out_printf("	|     Jump to         | Set Mark |          |\n");
+	out_printf("	|  Beginning of Line  |(Canc Gld)|          |\n");
+	out_printf("	|         (0)         |    (.)   |          |\n");
+	out_printf("	|                     |          |          |\n");
+	out_printf("	---------------------------------------------\n");
+	out_printf("\n(Continue?) "); in_getc();
+	out_printf("\n");
+	out_printf("\nKeyPad Configuration:\n");
+	out_printf(" This is a two-step process.  The first step finds the 'raw X-key-codes'\n");
+	out_printf(" of each of your key-pad's keys.  It will be skipped if you are not in\n");
+	out_printf(" an environment where X-window calls can execute, such as a telnet window.\n");
+	out_printf(" Otherwise, a small window will appear.  BE CAREFULL!!!  What you type\n");
+	out_printf(" will affect your keyboard.\n\nStep 1:\n");
+	out_printf(" Type each of the following keys in exact order into that window:\n");
 
 	// tmpnam(tname);
 	mkstemp(tname);
 
 	sprintf(ans,"xev > %s", tname);
-	printf("	(%s)\n",ans);
-	printf("   Gold (usually keypad 7): \n");
-	printf("   Gold alternate (usually num-lock): \n");
-	printf("   Search (usually keypad *): \n");
-	printf("   Delete-Line (usually keypad  - ): \n");
-	printf("   Jump by Page (usually keypad 8): \n");
-	printf("   Replace (usually keypad 9): \n");
-	printf("   Forward (usually keypad 4): \n");
-	printf("   Backward (usually keypad 5): \n");
-	printf("   Cut (usually keypad 6): \n");
-	printf("   Delete Word (usually keypad  + ): \n");
-	printf("   Jump by Word (usually keypad 1): \n");
-	printf("   Jump to EOL (usually keypad 2): \n");
-	printf("   Enter Ascii (usually keypad 3): \n");
-	printf("   Jump to BOL (usually keypad 0): \n");
-	printf("   Mark (usually keypad  . ): \n");
-	printf("   Delete Char (usually keypad  <Enter> ): \n");
-	printf("   Space-bar (press this several times!!!)\n");
-	printf(" Now, after typing the above keys, exit the small window.\n");
+	out_printf("	(%s)\n",ans);
+	out_printf("   Gold (usually keypad 7): \n");
+	out_printf("   Gold alternate (usually num-lock): \n");
+	out_printf("   Search (usually keypad *): \n");
+	out_printf("   Delete-Line (usually keypad  - ): \n");
+	out_printf("   Jump by Page (usually keypad 8): \n");
+	out_printf("   Replace (usually keypad 9): \n");
+	out_printf("   Forward (usually keypad 4): \n");
+	out_printf("   Backward (usually keypad 5): \n");
+	out_printf("   Cut (usually keypad 6): \n");
+	out_printf("   Delete Word (usually keypad  + ): \n");
+	out_printf("   Jump by Word (usually keypad 1): \n");
+	out_printf("   Jump to EOL (usually keypad 2): \n");
+	out_printf("   Enter Ascii (usually keypad 3): \n");
+	out_printf("   Jump to BOL (usually keypad 0): \n");
+	out_printf("   Mark (usually keypad  . ): \n");
+	out_printf("   Delete Char (usually keypad  <Enter> ): \n");
+	out_printf("   Space-bar (press this several times!!!)\n");
+	out_printf(" Now, after typing the above keys, exit the small window.\n");
 
 	system(ans);
 
-	printf("\n");
+	out_printf("\n");
 
 	if ( !(infile = fopen(tname,"r")) )
-		printf("Could not get key-codes.  Proceeding to next step with existing codes.\n");
+		out_printf("Could not get key-codes.  Proceeding to next step with existing codes.\n");
 	else
 	{
 	for (m=0; m!=20; m++) codes[m] = -1;
@@ -744,7 +1071,7 @@ FILE	*infile;
 	for (m=0; m!=20; m++) if (codes[m] == k) n = 0;
 	if ((n) && (strstr(ans,"space")==0) && (strstr(ans,"Return")==0))
 	{
-	codes[i] = k;  i = i + 1;  printf("	Keycode[%d] = %d\n", i-1, k);
+	codes[i] = k;  i = i + 1;  out_printf("	Keycode[%d] = %d\n", i-1, k);
 	next_word( ans, tmpwrd, delimiters ); next_word( ans, tmpwrd, delimiters ); next_word( ans, tmpwrd, delimiters );
 	cptr = (char *)strstr(tmpwrd,")"); if (cptr!=0) cptr[0] = '\0';
 	restore[i-1] = (char *)strdup(tmpwrd);
@@ -756,9 +1083,9 @@ FILE	*infile;
 	remove(tname);
 	if (i < 16)
 	{
-	printf("Error:  Wrong number of keys pressed (%d, should have been 16).\n", i);
-	printf("Continue to second step (y) or abort (n) ? ");
-	scanf("%s",tmpwrd); if (tmpwrd[0]!='y') return;
+	out_printf("Error:  Wrong number of keys pressed (%d, should have been 16).\n", i);
+	out_printf("Continue to second step (y) or abort (n) ? ");
+	in_word(tmpwrd, sizeof(tmpwrd)); if (tmpwrd[0]!='y') return;
 	}
 	else
 	{
@@ -781,37 +1108,38 @@ FILE	*infile;
 	}
 	}
 
-	printf("\nStep 2:");
-	printf("\n Now I will learn the actual values returned by the keys.\n");
-	printf("	(Press each of the following keys, followed by <Enter> or <Return>.\n");
-	printf("	(Pressing <Return> only, will not change the key's setting.)\n");
-	printf("	(Each keypad and arrow key should produce multiple (2-4) strange characters.\n");
-	printf("	 If not, the key may need to be re-assigned to a function-key with xmodmap.)\n\n");
+	out_printf("\nStep 2:");
+	out_printf("\n Now I will learn the actual values returned by the keys.\n");
+	out_printf("	(Press each of the following keys, followed by <Enter> or <Return>.\n");
+	out_printf("	(Pressing <Return> only, will not change the key's setting.)\n");
+	out_printf("	(Each keypad and arrow key should produce multiple (2-4) strange characters.\n");
+	out_printf("	 If not, the key may need to be re-assigned to a function-key with xmodmap.)\n\n");
 
 	i = 0;
 
-	printf(" Gold (usually keypad-7): ");  	edt_setkey( i++ );
-	printf(" Search (usually keypad-*): ");  	edt_setkey( i++ );
-	printf(" Delete-Line (usually keypad- - ): "); edt_setkey( i++ );
-	printf(" Jump by Page (usually keypad-8): ");  	edt_setkey( i++ );
-	printf(" Replace (usually keypad-9): ");  	edt_setkey( i++ );
-	printf(" Forward (usually keypad-4): ");  	edt_setkey( i++ );
-	printf(" Backward (usually keypad-5): ");  	edt_setkey( i++ );
-	printf(" Cut (usually keypad-6): ");	  	edt_setkey( i++ );
-	printf(" Delete Word (usually keypad- + ): "); edt_setkey( i++ );
-	printf(" Jump by Word (usually keypad-1): ");  	edt_setkey( i++ );
-	printf(" Jump to EOL (usually keypad-2): ");  	edt_setkey( i++ );
-	printf(" Enter Ascii (usually keypad-3): ");  	edt_setkey( i++ );
-	printf(" Jump to BOL (usually keypad-0): ");  	edt_setkey( i++ );
-	printf(" Mark (usually keypad- . ): ");  	edt_setkey( i++ );
-	printf(" Delete Char (usually keypad- <Enter> ): ");  	edt_setkey( i++ );
-	printf(" Up-Arrow: ");			  	edt_setkey( i++ );
-	printf(" Down-Arrow: ");  			edt_setkey( i++ );
-	printf(" Right-Arrow: keypad-): ");  		edt_setkey( i++ );
-	printf(" Left-Arrow: keypad-): ");  		edt_setkey( i++ );
-	printf("\nSave keypad configuration to 'edt_keypad.xml' (y/n) ? ");
-
-	scanf("%s",ans);
+	out_printf(" Gold (usually keypad-7): ");  	edt_setkey( i++ );
+	out_printf(" Search (usually keypad-*): ");  	edt_setkey( i++ );
+	out_printf(" Delete-Line (usually keypad- - ): "); edt_setkey( i++ );
+	out_printf(" Jump by Page (usually keypad-8): ");  	edt_setkey( i++ );
+	out_printf(" Replace (usually keypad-9): ");  	edt_setkey( i++ );
+	out_printf(" Forward (usually keypad-4): ");  	edt_setkey( i++ );
+	out_printf(" Backward (usually keypad-5): ");  	edt_setkey( i++ );
+	out_printf(" Cut (usually keypad-6): ");	  	edt_setkey( i++ );
+	out_printf(" Delete Word (usually keypad- + ): "); edt_setkey( i++ );
+	out_printf(" Jump by Word (usually keypad-1): ");  	edt_setkey( i++ );
+	out_printf(" Jump to EOL (usually keypad-2): ");  	edt_setkey( i++ );
+	out_printf(" Enter Ascii (usually keypad-3): ");  	edt_setkey( i++ );
+	out_printf(" Jump to BOL (usually keypad-0): ");  	edt_setkey( i++ );
+	out_printf(" Mark (usually keypad- . ): ");  	edt_setkey( i++ );
+	out_printf(" Delete Char (usually keypad- <Enter> ): ");  	edt_setkey( i++ );
+	out_printf(" Up-Arrow: ");			  	edt_setkey( i++ );
+	out_printf(" Down-Arrow: ");  			edt_setkey( i++ );
+	out_printf(" Right-Arrow: keypad-): ");  		edt_setkey( i++ );
+	out_printf(" Left-Arrow: keypad-): ");  		edt_setkey( i++ );
+	key_compile();
+	out_printf("\nSave keypad configuration to 'edt_keypad.xml' (y/n) ? ");
+
+	in_word(ans, sizeof(ans));
 
 	if ( *ans == 'y' )
 		{
@@ -868,9 +1196,9 @@ FILE	*infile;
 
 		fclose(outfile);
 
-		printf("\n Saved edt_keypad.xml\n\n");
-		printf(" Set environment variable EDT_KEYPAD_SETUP to point to that file.\n");
-		printf(" (Make permanent by setting it in your .cshrc or .bash.)\n\n");
+		out_printf("\n Saved edt_keypad.xml\n\n");
+		out_printf(" Set environment variable EDT_KEYPAD_SETUP to point to that file.\n");
+		out_printf(" (Make permanent by setting it in your .cshrc or .bash.)\n\n");
 		}
 }
 
@@ -887,12 +1215,12 @@ char	word[MAXSTR];
 		{
 		if (j == 7)
 			{
-			printf("Error: Keycode too long for %s = '%s'.\n", name, value );
+			out_printf("Error: Keycode too long for %s = '%s'.\n", name, value );
 			return;
 			}
 
 		if ( sscanf(word,"%d", &(keycode[j++])) != 1 )
-			printf("ERROR: Reading keypad setup for %s as '%s'\n", name, word );
+			out_printf("ERROR: Reading keypad setup for %s as '%s'\n", name, word );
 
 		Xml_Next_Word( value, word, MAXSTR, " \t," );
 		}
@@ -923,11 +1251,11 @@ const char	keyname[20][20]={"Gold", "Find", "Delete_Line", "Jump_Page", "Replace
  stupfile = (char *)getenv("EDT_KEYPAD_SETUP");
  if (stupfile==0)
   {
-   printf("\nWarning:  EDT_KEYPAD_SETUP  not set.  (Type help_config for more info.)\n\n");
+   out_printf("\nWarning:  EDT_KEYPAD_SETUP  not set.  (Type help_config for more info.)\n\n");
    return;
   }
  infile = fopen(stupfile,"r");
- if (infile==0) {printf("ERROR: Could not open KeyPad Setup File EDT_KEYPAD_SETUP='%s'\n",stupfile); return;}
+ if (infile==0) {out_printf("ERROR: Could not open KeyPad Setup File EDT_KEYPAD_SETUP='%s'\n",stupfile); return;}
 
  for (i=0; i!=19; i++) 	/* Pre-Initialize key-pad table. */
   for (j=2; j!=8; j++)
@@ -943,16 +1271,16 @@ const char	keyname[20][20]={"Gold", "Find", "Delete_Line", "Jump_Page", "Replace
 	{ /*key_set*/
 	  xml_grab_attrib( tag, name, functname, MAXSTR );
 	  if (strcmp(name,"function") != 0)
-	   printf("Error: Reading keypad setup, expected 'function' in key_set tag, but found '%s',\n",name);
+	   out_printf("Error: Reading keypad setup, expected 'function' in key_set tag, but found '%s',\n",name);
 
 	  xml_grab_attrib( tag, name, value, MAXSTR );
 	  if (strcmp(name,"key") != 0)
-	   printf("Error: Reading keypad setup, expected 'key' in key_set tag, but found '%s',\n",name);
-	  if (sscanf(value,"%d", &keyval) != 1) printf("Error: Reading keypad setup, key value %s not integer.\n", value);
+	   out_printf("Error: Reading keypad setup, expected 'key' in key_set tag, but found '%s',\n",name);
+	  if (sscanf(value,"%d", &keyval) != 1) out_printf("Error: Reading keypad setup, key value %s not integer.\n", value);
 
 	  xml_grab_attrib( tag, name, mapto, MAXSTR );
 	  if (strcmp(name,"mapto") != 0)
-	   printf("Error: Reading keypad setup, expected 'mapto' in key_set tag, but found '%s',\n",name);
+	   out_printf("Error: Reading keypad setup, expected 'mapto' in key_set tag, but found '%s',\n",name);
 
 	  if (mapto[0] != '\0')
 	   {
@@ -962,17 +1290,17 @@ const char	keyname[20][20]={"Gold", "Find", "Delete_Line", "Jump_Page", "Replace
 
 	  xml_grab_attrib( tag, name, value, MAXSTR );
 	  if (strcmp(name,"returns") != 0)
-	   printf("Error: Reading keypad setup, expected 'returns' in key_set tag, but found '%s',\n",name);
+	   out_printf("Error: Reading keypad setup, expected 'returns' in key_set tag, but found '%s',\n",name);
 	  j = 0;
 	  while ((j < 19) && (strcasecmp(functname, keyname[j]) != 0)) j++;
-	  if (j == 19) printf("Error: Reading keypad setup, '%s' unknown.\n", functname);
+	  if (j == 19) out_printf("Error: Reading keypad setup, '%s' unknown.\n", functname);
 	  else set_functkeycode( functname, value, functkeys_table[j] );
 	  setnum++;
 	} /*key_set*/
 
       xml_parse( infile, tag, content, MAXSTR, &line_num );
     } /*file*/
-    if (setnum < 4) printf("Error: Did not read keypad setups.\n");
+    if (setnum < 4) out_printf("Error: Did not read keypad setups.\n");
   } /*xml_setupfile*/
  else
   { /*oldstyle_setupfile*/
@@ -981,13 +1309,13 @@ const char	keyname[20][20]={"Gold", "Find", "Delete_Line", "Jump_Page", "Replace
       read_line( infile, line, 200 );
       if (strstr(line,"xmodmap")!=0) system(line);
       else
-      if (strstr(line,"<key_") != 0) {printf("Error: XML keypad setup file must have .xml suffix. Must rename it."); return;}
+      if (strstr(line,"<key_") != 0) {out_printf("Error: XML keypad setup file must have .xml suffix. Must rename it."); return;}
      }
     while ((!feof(infile)) && (strstr(line,"Key_Returns:")==0));
     for (i=0; i!=19; i++)
      for (j=0; j!=8; j++)
       if (fscanf(infile,"%d ", &functkeys_table[i][j])!=1)
-	printf("ERROR: Reading keypad setup %d %d\n", i, j);
+	out_printf("ERROR: Reading keypad setup %d %d\n", i, j);
   } /*oldstyle_setupfile*/
 
  fclose(infile);
@@ -1005,11 +1333,11 @@ void restore_keypad_setup()
  stupfile = (char *)getenv("EDT_KEYPAD_SETUP");
  if (stupfile==0)
   {
-   printf("\nWarning:  EDT_KEYPAD_SETUP  not set.  (Type help_config for more info.)\n\n");
+   out_printf("\nWarning:  EDT_KEYPAD_SETUP  not set.  (Type help_config for more info.)\n\n");
    return;
   }
  infile = fopen(stupfile,"r");
- if (infile==0) {printf("ERROR: Could not open KeyPad Setup File EDT_KEYPAD_SETUP='%s'\n",stupfile); return;}
+ if (infile==0) {out_printf("ERROR: Could not open KeyPad Setup File EDT_KEYPAD_SETUP='%s'\n",stupfile); return;}
 
  if (strstr(stupfile,".xml") != 0)
   { /*xml_setupfile*/
@@ -1021,12 +1349,12 @@ void restore_keypad_setup()
 	{ /*key_set*/
 	  xml_grab_attrib( tag, name, value, MAXSTR );
 	  if (strcmp(name,"key") != 0)
-	   printf("Error: Reading keypad setup, expected 'key' in key_set tag, but found '%s',\n",name);
-	  if (sscanf(value,"%d", &keyval) != 1) printf("Error: Reading keypad setup, key value %s not integer.\n", value);
+	   out_printf("Error: Reading keypad setup, expected 'key' in key_set tag, but found '%s',\n",name);
+	  if (sscanf(value,"%d", &keyval) != 1) out_printf("Error: Reading keypad setup, key value %s not integer.\n", value);
 
 	  xml_grab_attrib( tag, name, mapto, MAXSTR );
 	  if (strcmp(name,"mapto") != 0)
-	   printf("Error: Reading keypad setup, expected 'mapto' in key_set tag, but found '%s',\n",name);
+	   out_printf("Error: Reading keypad setup, expected 'mapto' in key_set tag, but found '%s',\n",name);
 	  sprintf(cmd,"xmodmap xmodmap -e \"keycode %d = %s\"", keyval, mapto );
 	  system( cmd );
 	  setnum++;
@@ -1034,7 +1362,7 @@ void restore_keypad_setup()
 
       xml_parse( infile, tag, content, MAXSTR, &line_num );
     } /*file*/
-    if (setnum == 0) printf("Error: Did not read any keypad restores.\n");
+    if (setnum == 0) out_printf("Error: Did not read any keypad restores.\n");
   } /*xml_setupfile*/
  else
   { /*oldstyle_setupfile*/
@@ -1078,6 +1406,10 @@ int	i, frblksz = 256;
 	tmp_pt = txt_free;
 	txt_free = txt_free->nxt;
 
+	tmp_pt->flags = 0;
+	tmp_pt->ck = 0;
+	tmp_pt->del = 0;
+
 	return tmp_pt;
 }
 
@@ -1091,6 +1423,8 @@ void dispose_ch( struct __text__ *tmp_pt )
 	txt_free->prv = 0;
 }
 
+void	col_edit	(TEXT *pt);
+
 /* Inserts character infront of current pointer */
 void insert_char( char ch, struct __text__ *(*tmp_txt) )
 {
@@ -1100,14 +1434,21 @@ TEXT	*tmp_pt;
 
 	tmp_pt = new_ch();
 	tmp_pt->ch = ch;
+	tmp_pt->flags = TXT$M_NEW;
 
 	if (*tmp_txt == txt_head)
 		{
-		printf("ERROR: pt was on head!\n");
+		out_printf("ERROR: pt was on head!\n");
 		exit(1);
 		}
 	else	(*tmp_txt)->prv->nxt = tmp_pt;
 
+	/* The top row of the frame gets a new first character */
+	if ( *tmp_txt == tframe_pt )
+		tframe_pt = NULL;
+
+	col_edit( *tmp_txt );
+
 	tmp_pt->prv = (*tmp_txt)->prv;
 	tmp_pt->nxt = *tmp_txt;
 	(*tmp_txt)->prv = tmp_pt;
@@ -1132,6 +1473,15 @@ void delete_char( struct __text__ *tmp_txt )
 
 	if ( (tmp_txt != EOB) && (tmp_txt != txt_head) )
 		{
+		/* First character of the top row of the frame or the new line before it */
+		if ( (tmp_txt == tframe_pt) || (tmp_txt->nxt == tframe_pt) )
+			tframe_pt = NULL;
+
+		col_edit( tmp_txt );
+
+		/* Pass the count of deleted on-disk bytes to the next one */
+		tmp_txt->nxt->del += tmp_txt->del + !(tmp_txt->flags & TXT$M_NEW);
+
 		tmp_txt->nxt->prv = tmp_txt->prv;
 		tmp_txt->prv->nxt = tmp_txt->nxt;
 		dispose_ch( tmp_txt );
@@ -1140,1856 +1490,2984 @@ void delete_char( struct __text__ *tmp_txt )
 
 
 
-void load_file()
+/*
+ * Encoding mode: the key is added to the text on save and subtracted on load, mod 256.
+ * It is expanded into a pattern of ENC_VW bytes past its length, so a block goes by
+ * vectors of ENC_VW bytes from any position in the key.
+ */
+#define	ENC_VW		64
+#define	ENC_KEYMAX	256
+
+typedef	unsigned char	ENC_VEC	__attribute__ ((vector_size (ENC_VW)));
+
+static	unsigned char	enc_key[ENC_KEYMAX + ENC_VW];
+static	char		enc_psswd[ENC_KEYMAX];
+static	int		enc_pwl;
+
+static	void	enc_expand	(void)
 {
-char	ch;
-TEXT	*tmp_txt;
-int	i = 0, j = 0, pwi, pwl, chp;
+int	i;
 
-	tmp_txt = curse_pt;	/* keep inserting at eob */
+	if ( enc_pwl && !strcmp(enc_psswd, psswd) )
+		return;
 
-	if (encode_mode)
-		{
-		pwi = 0;  pwl = strlen(psswd);
+	strncpy(enc_psswd, psswd, ENC_KEYMAX - 1);
 
-		while (!feof(infile))
-			{
-			chp = getc(infile);
+	if ( !(enc_pwl = strlen(enc_psswd)) )
+		enc_psswd[enc_pwl++] = 0;	/* Empty key: nothing is changed */
 
-			if ( 0 > (chp = chp - psswd[pwi]) )
-				chp = chp + 255;
+	for (i = 0; i < enc_pwl + ENC_VW; i++)
+		enc_key[i] = enc_psswd[i % enc_pwl];
+}
 
-			if ( pwl == (pwi += 1) )
-				pwi = 0;
+/*
+ * Apply the key to len bytes from src to dst (can be the same), dec - subtract it;
+ * *pwi is a position in the key to continue from
+ */
+void	crypt_block	(unsigned char *dst, const unsigned char *src, long len, int *pwi, int dec)
+{
+ENC_VEC	v, k;
+int	pos;
+long	i = 0;
 
-			if ( !feof(infile) )
-				{
-				if ( chp == '\n')
-					{
-					last_row++;
-					j++;
-					}
+	enc_expand();
+	pos = *pwi % enc_pwl;
 
-				insert_char( chp, &tmp_txt );
-				i++;
-				}
-			}
-		}
-	else	{
-		while (!feof(infile))
-			{
-			ch = getc(infile);
+	for ( ; i + ENC_VW <= len; i += ENC_VW)
+		{
+		memcpy(&v, src + i, ENC_VW);
+		memcpy(&k, enc_key + pos, ENC_VW);
 
-			if (!feof(infile))
-				{
-				if (ch == '\n')
-					{
-					last_row++;
-					j++;
-					}
+		v = dec ? v - k : v + k;
 
-				insert_char( ch, &tmp_txt );	   i = i + 1;
-				}
-			}
+		memcpy(dst + i, &v, ENC_VW);
+
+		pos = (pos + ENC_VW) % enc_pwl;
 		}
 
-	if ( (EOB->prv != txt_head) && (EOB->prv->ch != '\n') )
+	for ( ; i < len; i++)
 		{
-		printf("MISSING <CR> INSERTED at [EOF]\n");
-		insert_char( '\n', &EOB );
-		last_row++;
+		dst[i] = dec ? src[i] - enc_key[pos] : src[i] + enc_key[pos];
+
+		if ( ++pos == enc_pwl )
+			pos = 0;
 		}
 
-	printf("	(%d-lines	%d-characters read-in to buffer '%s').\n", j, i, active_buffer_name);
+	*pwi = pos;
 }
 
-void print_char( char ch )
+void	encode_block	(unsigned char *buf, long len, int *pwi)
 {
-	if (ch == 127)
-		printf("<DEL>");
-	else if ( ch == 9 )
-		printf("%c", ch);
-	else if ( ch < 32 )
-		{
-		if (ch == 12)
-			printf("<FF>");
-		else if (ch < EDT$K_ESC)
-			printf("^%c", ch + 64);
-		else if (ch == EDT$K_ESC)
-			printf("<ESC>");
-		else	printf("#");
-		}
-	else	printf("%c", ch);
+	crypt_block(buf, buf, len, pwi, 0);
 }
 
 
-/* This routine returns the space used on the screen by a character. */
-int	spaces	( char ch, int rel_col )
+/*
+ * Loading sink: the bytes read from a file or inflated from a gzip'd one go here
+ */
+typedef	struct __load__ {
+	TEXT	*pt;		/* Insert point */
+	long	nln, nch;
+	int	pwi;		/* Password position in the encoding mode */
+} LOAD;
+
+int	load_bytes	(void *ctx, unsigned char *buf, long len)
 {
-	if (ch == 9)
-		return (rel_col / 8 ) * 8 + 8 - rel_col;
-	else	if (ch == 127)
-		return 5;
-	else	if (ch == 12)
-		return 4;
-	else	if (ch == EDT$K_ESC)
-		return 5;
-	else	if (ch < EDT$K_ESC)
-		return 2;
+LOAD	*ld = ctx;
+unsigned char dec[64 * 1024];
+long	i;
 
-	return 1;
-}
+	/* The data can't be changed in place: it is the window of the inflater */
+	for ( ; encode_mode && (len > (long) sizeof(dec)); buf += sizeof(dec), len -= sizeof(dec))
+		load_bytes(ctx, buf, sizeof(dec));
 
+	if ( encode_mode )
+		{
+		crypt_block(dec, buf, len, &ld->pwi, 1);
+		buf = dec;
+		}
 
+	for (i = 0; i < len; i++)
+		{
+		if ( buf[i] == '\n' )
+			{
+			last_row++;
+			ld->nln++;
+			}
 
+		insert_char( buf[i], &ld->pt );
+		}
 
-void resize(int verb)
-{
+	ld->nch += len;
 
- FILE *infile1;
- int i;
- // tmpnam(fn);
- // sprintf(cstrng,"stty size > %s", fn);
- // system(cstrng);
- // iz1 = fopen(fn,"r");
- infile1 = popen("stty size","r");
- if (infile1==0) printf("Error: Getting size.\n");
- else
-  {
-   if (fscanf(infile1,"%d",&i)!=1) printf("Error: Getting row size.\n"); else nrows = i;
-   if (fscanf(infile1,"%d",&i)!=1) printf("Error: Getting col size.\n"); else ncols = i-1;
-   if (verb) printf("Window_Size set to %d-rows, %d-cols\n", nrows, ncols );
-   // fclose(infile1);
-   // remove(fn);
-   pclose(infile1);
-  }
+	return	0;
 }
 
 
-
-
-void display_screen( int position_cursor )
-/* Input: new row position */
+/*
+ * A new line is added at the end of the loaded text if it is missing
+ */
+void	load_finish	(void)
 {
- int row, col, rel_col, bottom;
- struct __text__ *tmp_pt;
-
- printf("%c[2J%c[H", EDT$K_ESC, EDT$K_ESC );
- row = 0;  tmp_pt = txt_head->nxt;
- while (row<tframe_row)
-  {
-   if (tmp_pt->ch == 10) row = row + 1;
-   tmp_pt = tmp_pt->nxt;
-  }
-
- bottom = tframe_row + nrows - 3;
- col = 0;  rel_col = 0;
- while ((row<=bottom) && (tmp_pt!=EOB))
-  {
-   col = col + 1;
-   rel_col = rel_col + spaces(tmp_pt->ch, rel_col);
-   if (tmp_pt->ch != 10)
-    {
-     if (rel_col < ncols) print_char( tmp_pt->ch );
-    }
-   else
-    { row = row + 1; col = 0;  rel_col = 0;
-      if (row<=bottom) printf("%c%c", 10,13);
-    }
-   tmp_pt = tmp_pt->nxt;
-  }
-
- if (tmp_pt==EOB)
-  {
-   if ((row<=bottom) && (col!=0)) printf("%c%c", 10, 13 );
-   printf("[EOB %s]", active_buffer_name);
-  }
+	if ( (EOB->prv != txt_head) && (EOB->prv->ch != '\n') )
+		{
+		out_printf("MISSING <CR> INSERTED at [EOF]\n");
+		insert_char( '\n', &EOB );
+		last_row++;
+		}
+}
 
- if (rel_curse_col+1>ncols) rel_curse_col = ncols;
 
- if (position_cursor)
-  printf("%c[%d;%dH", EDT$K_ESC, rel_curse_row+1, rel_curse_col+1 );
+/*
+ * Is the file gzip'd: check a magic at the start of it
+ */
+int	is_gzip	(int fd)
+{
+unsigned char magic[2];
 
+	return	(2 == pread(fd, magic, 2, 0)) && (magic[0] == 0x1f) && (magic[1] == 0x8b);
 }
 
 
-
-/* Gets curser pointing to proper position on screen */
-void reposition_cursor( )
+/*
+ * Is the file SCZ compressed: it must be a chain of segments from its start, each one the
+ * magic, its size, the data (the header of the first iteration if it is compressed), a
+ * checksum and the continuation marker, and the last one must end at the end of the file
+ */
+int	is_scz	(int fd)
 {
-int	rel_col;
+unsigned char hdr[6], tr[2];
+struct stat st;
+off_t	off = 0;
+long	len;
 
-	rel_curse_row = curse_row - tframe_row;
+	if ( fstat(fd, &st) )
+		return	0;
 
-	if (rel_curse_col+1 > ncols)
-		rel_col = ncols;
-	else	rel_col = rel_curse_col+1;
+	for (;;)
+		{
+		if ( (6 != pread(fd, hdr, 6, off)) || (hdr[0] != 101) || (hdr[1] != 98) )
+			return	0;
 
-	printf("%c[%d;%dH", EDT$K_ESC, rel_curse_row+1, rel_col );
-}
+		len = (hdr[3] << 16) | (hdr[4] << 8) | hdr[5];
 
+		if ( (off + 6 + len + 2 > st.st_size) || (2 != pread(fd, tr, 2, off + 6 + len)) )
+			return	0;
 
+		/* Forcing char, the number of phrases, 3 bytes each, and the boundary marker */
+		if ( hdr[2] && ( (len < 3) || (2 != pread(fd, hdr, 2, off + 6))
+				|| (len < 3 + 3 * hdr[1]) || (1 != pread(fd, hdr, 1, off + 6 + 2 + 3 * hdr[1]))
+				|| (hdr[0] != 91) ) )
+			return	0;
 
-/* Gets curser pointing to given position in file */
-void position_curser( int nrow, int ncol )
-{
-int row, col;
-struct __text__ *tmp_pt;
+		off += 6 + len + 2;
 
-	row = 0;
-	tmp_pt = txt_head->nxt;
+		if ( tr[1] == ']' )
+			return	off == st.st_size;
 
-	for (row = 0; (row < nrow) && (tmp_pt->nxt != EOB); tmp_pt = tmp_pt->nxt )
-		if (tmp_pt->ch == '\n')
-			row++;
+		if ( tr[1] != '[' )
+			return	0;
+		}
+}
 
-	for  (col = 0; (col < ncol) && (tmp_pt->nxt != EOB) && (tmp_pt->ch != '\n');
-	      col++, tmp_pt = tmp_pt->nxt );
 
-	curse_pt = tmp_pt;
-	curse_row = row;
+/*
+ * Format of the file by the magic
+ */
+int	file_format	(int fd)
+{
+	return	is_gzip(fd) ? CZ_GZIP : is_scz(fd) ? CZ_SCZ : CZ_PLAIN;
 }
 
 
-/* Leaves cursor pointing to end of previous line. */
-void move_pt_up_line( TEXT **tmp_pt )
+/*
+ * Read the infile into the current buffer, a compressed file is expanded on the fly.
+ * Returns the format of the file: CZ_PLAIN, CZ_GZIP or CZ_SCZ, -1 - it could not be
+ * read in full.
+ */
+int	load_file	(void)
 {
-	do	{
-		if ( (*tmp_pt) != txt_head->nxt )
-			*tmp_pt = (*tmp_pt)->prv;
-	} while ( ((*tmp_pt)->ch != '\n') && ((*tmp_pt) != txt_head->nxt) );
-}
+LOAD	ld = {0};
+unsigned char buf[64 * 1024], *data;
+int	fd = fileno(infile), fmt, err = 0;
+long	n;
 
-/* Leaves cursor pointing to first char in current line. */
-void move_pt_begin_of_line( TEXT **tmp_pt )
-{
-	if ( (*tmp_pt) == txt_head )
+	ld.pt = curse_pt;	/* keep inserting at eob */
+
+	if ( (fmt = file_format(fd)) == CZ_GZIP )
 		{
-		printf("ERROR1: ON TXT_HEAD\n");
-		exit(1);
+		if ( (err = gz_inflate_fd(fd, load_bytes, &ld)) )
+			out_printf("%cERROR inflating gzip'd file (%s), %ld-characters are read.\n", EDT$K_BELL,
+				(err < 0) ? "corrupted data" : strerror(err), ld.nch);
+		}
+	else if ( fmt == CZ_SCZ )
+		{
+		if ( !Scz_Decompress_Fd2Buffer(fd, &data, &n) )
+			{
+			out_printf("%cERROR decompressing SCZ file.\n", EDT$K_BELL);
+			err = 1;
+			}
+		else	{
+			load_bytes(&ld, data, n);
+			free(data);
+			}
 		}
+	else	{
+		while ( 0 != (n = read(fd, buf, sizeof(buf))) )
+			{
+			if ( n < 0 )
+				{
+				if ( errno == EINTR )
+					continue;
+
+				out_printf("%cERROR reading file (%s).\n", EDT$K_BELL, strerror(errno));
+				err = 1;
+				break;
+				}
 
-	*tmp_pt = (*tmp_pt)->prv;
+			load_bytes(&ld, buf, n);
+			}
+		}
 
-	while ( ((*tmp_pt)->ch != '\n') && ((*tmp_pt) != txt_head) )
-		*tmp_pt = (*tmp_pt)->prv;
+	load_finish();
+	out_printf("	(%ld-lines	%ld-characters read-in to buffer '%s').\n", ld.nln, ld.nch, active_buffer_name);
 
-	*tmp_pt = (*tmp_pt)->nxt;
+	return	err ? -1 : fmt;
 }
 
-/* Leaves cursor pointing to beginning of next line. */
-void move_pt_down_line( TEXT **tmp_pt )
+
+/*
+ * View mode: only a part of a big gzip'd file around the line is loaded, it is found by
+ * the access points index kept in a .gzi file next to it (see edt_gzip.c); the first
+ * open builds it. The line past the end is set to the last one. Returns the first line
+ * loaded, 0 - not a gzip'd file, -1 - error.
+ */
+#define	VIEW_BYTES	(4 * 1024 * 1024)
+#define	VIEW_BEFORE	1000		/* Lines of the context before the line */
+
+long	view_file	(char *fname, int *line)
 {
-	 while ( ((*tmp_pt)->ch != '\n') && ((*tmp_pt) != EOB) )
-		*tmp_pt = (*tmp_pt)->nxt;
+LOAD	ld = {0};
+GZ_INDEX *x;
+char	sidecar[PATH_MAX];
+long	lines, from;
+int	fd = fileno(infile), err;
 
-	 if ( (*tmp_pt) != EOB)
-		 *tmp_pt = (*tmp_pt)->nxt;
+	if ( !is_gzip(fd) )
+		return	0;
+
+	aux_file_name(fname, ".gzi", sidecar);
+
+	if ( !(x = gz_index_open(fd, sidecar)) )
+		{
+		out_printf("%cERROR inflating gzip'd file '%s'.\n", EDT$K_BELL, fname);
+		return	-1;
+		}
+
+	if ( *line > (lines = gz_index_lines(x)) )
+		{
+		out_printf("ONLY %ld LINES in FILE.\n", lines);
+		*line = lines ? lines : 1;
+		}
+
+	from = (*line > VIEW_BEFORE) ? *line - VIEW_BEFORE : 1;
+
+	ld.pt = curse_pt;
+
+	if ( (err = gz_index_read(x, fd, from, VIEW_BYTES, load_bytes, &ld)) )
+		out_printf("%cERROR inflating gzip'd file (%s), %ld-characters are read.\n", EDT$K_BELL,
+			(err < 0) ? "corrupted data" : strerror(err), ld.nch);
+
+	gz_index_close(x);
+
+	load_finish();
+	out_printf("	(%ld-lines	%ld-characters from line %ld of %ld viewed in buffer '%s').\n",
+		ld.nln, ld.nch, from, lines, active_buffer_name);
+
+	return	from;
 }
 
-/* Leaves cursor pointing to end of current line. */
-void move_pt_end_of_line( TEXT **tmp_pt )
+/* How a character looks on the screen, TAB is only moving the cursor */
+char	*char_glyph	( char ch, char *glyph )
 {
-	while ( ((*tmp_pt)->ch != '\n') && (*tmp_pt != EOB) )
-		*tmp_pt = (*tmp_pt)->nxt;
-}
+	if (ch == 127)
+		strcpy(glyph, "<DEL>");
+	else if ( ch < 32 )
+		{
+		if (ch == 12)
+			strcpy(glyph, "<FF>");
+		else if (ch < EDT$K_ESC)
+			sprintf(glyph, "^%c", ch + 64);
+		else if (ch == EDT$K_ESC)
+			strcpy(glyph, "<ESC>");
+		else	strcpy(glyph, "#");
+		}
+	else	{
+		glyph[0] = ch;
+		glyph[1] = '\0';
+		}
 
+	return	glyph;
+}
 
-/* Moves curser right x-columns */
-void move_right( TEXT **tmp_pt, int x )
+void print_char( char ch )
 {
-int	i = 0;
+char	glyph[8];
 
-	for ( i = 0; (i != x) && ((*tmp_pt)->nxt!=EOB); i++, *tmp_pt = (*tmp_pt)->nxt);
+	if ( ch == 9 )
+		out_printf("%c", ch);
+	else	out_printf("%s", char_glyph(ch, glyph));
 }
 
-void spew_line( TEXT *tmp_pt )
+
+/* This routine returns the space used on the screen by a character. */
+int	spaces	( char ch, int rel_col )
 {
-TEXT	*tmp_pt2 = tmp_pt;
-int	rel_col = 0;
+	if (ch == 9)
+		return (rel_col / 8 ) * 8 + 8 - rel_col;
+	else	if (ch == 127)
+		return 5;
+	else	if (ch == 12)
+		return 4;
+	else	if (ch == EDT$K_ESC)
+		return 5;
+	else	if (ch < EDT$K_ESC)
+		return 2;
 
-	move_pt_begin_of_line( &tmp_pt2 );
+	return 1;
+}
 
 
-	while (tmp_pt2 != tmp_pt)
-		{
-		rel_col = spaces( tmp_pt2->ch, rel_col ) + rel_col;
-		tmp_pt2 = tmp_pt2->nxt;
-		}
 
-	if (tmp_pt == EOB)
-		printf("[EOB %s]", active_buffer_name);
-	 else	{
-		if ( (tmp_pt->ch!=10) && (rel_col<ncols) )
-			print_char(tmp_pt->ch);
+/*
+ * Screen output: while in the screen mode everything for the terminal is put in out_buf,
+ * big enough for a frame, which goes out by a single write() when the next key is to be
+ * read (out_flush()). Messages go to the same buffer by out_printf(), so they stay in order.
+ * Escapes are put together from precomputed strings instead of printf().
+ */
+#define	OUT_BUFSZ	(256 * 1024)
+#define	OUT_NDEC	1000
+
+char	out_buf[OUT_BUFSZ];
+int	out_len = 0, out_active = 0;
+char	out_dec[OUT_NDEC][4];		/* "1" .. "999" */
+int	out_declen[OUT_NDEC];
+
+#define	OUT_STR(s)	out_put(s, sizeof(s) - 1)
+
+#define	OUT_CLREOL	"\033[K"
+#define	OUT_INSLINE	"\033[L"
+#define	OUT_DELLINE	"\033[M"
+#define	OUT_UP		"\033[A"
+#define	OUT_REVINDEX	"\033M"
+#define	OUT_NEWLINE	"\n\r"
+#define	OUT_HOME	"\033[H"
+#define	OUT_CLEAR	"\033[2J\033[H"
+
+/* Write all of it to the terminal */
+void	out_write	(const char *buf, int len)
+{
+int	n;
 
-		while ( (tmp_pt->nxt != EOB) && (tmp_pt->ch != '\n') && (rel_col < ncols) )
+	while ( len > 0 )
+		{
+		if ( 0 > (n = write(1, buf, len)) )
 			{
-			rel_col = spaces( tmp_pt->ch, rel_col ) + rel_col;
-			tmp_pt = tmp_pt->nxt;
-
-			if ( (tmp_pt->ch != '\n') && (rel_col<ncols) )
-				print_char(tmp_pt->ch);
+			if ( errno == EINTR )
+				continue;
+			break;
 			}
+
+		buf += n;
+		len -= n;
 		}
 }
 
+void	out_flush	(void)
+{
+	out_write(out_buf, out_len);
+	out_len = 0;
 
+	fflush(stdout);
+}
 
-void	compute_curse_col( TEXT *cursor_ptr )
+void	out_setup	(void)
 {
-TEXT	*tmp_pt = cursor_ptr;
-int	i = 0, rel_col = 0;
+int	i;
 
-	move_pt_begin_of_line( &tmp_pt );
+	fflush(stdout);
+	out_active = 1;
+
+	if ( !out_declen[0] )
+		for (i = 0; i < OUT_NDEC; i++)
+			out_declen[i] = sprintf(out_dec[i], "%d", i);
+}
+
+void	out_leave	(void)
+{
+	out_flush();
+	out_active = 0;
+}
 
-	for  (; tmp_pt != cursor_ptr; tmp_pt = tmp_pt->nxt, i++)
+void	out_put	(const char *buf, int len)
+{
+	if ( !out_active )
 		{
-		if ( tmp_pt->ch == 9 )
-			rel_col = (rel_col / 8 ) * 8 + 8;
-		else	if (tmp_pt->ch == 127)
-			rel_col += 5;
-		else	if (tmp_pt->ch == 12)
-			rel_col += 4;
-		else	if (tmp_pt->ch == EDT$K_ESC)
-			rel_col += 5;
-		else	if (tmp_pt->ch < EDT$K_ESC)
-			rel_col += 2;
-		else	rel_col++;
+		fwrite(buf, 1, len, stdout);
+		return;
 		}
 
-	rel_curse_col = rel_col;
-}
+	if ( len > OUT_BUFSZ - out_len )
+		out_flush();
 
+	if ( len > OUT_BUFSZ )
+		out_write(buf, len);
+	else	{
+		memcpy(out_buf + out_len, buf, len);
+		out_len += len;
+		}
+}
 
-void  adjust_screen_parameters()
+/* printf() to the screen output, or to stdout out of the screen mode */
+int	out_printf	(const char *fmt, ...)
 {
-	compute_curse_col(curse_pt);
-	last_curse_col =  rel_curse_col;
+va_list	ap;
+char	*big;
+int	n;
 
-	if (curse_row < tframe_row + 6)    /* If cursor is above work area */
-		{ /*above*/
-		if ( 0 > (tframe_row = curse_row - 6) )
-			tframe_row = 0;    /* If new top row is above TOB, set */
-		} /*above*/
-	else if (curse_row > tframe_row + nrows - 10)
-		{ /*below*/                          /* If cursor is below work area */
-		tframe_row = curse_row - nrows + 10;
-				  /* If new bottom row is below EOB, set to EOB */
-		if (tframe_row + nrows - 3 > last_row)
-			tframe_row = last_row - nrows + 3;
+	va_start(ap, fmt);
 
-		if (tframe_row < 0)
-			tframe_row = 0;
-		} /*below*/
+	if ( !out_active )
+		n = vprintf(fmt, ap);
+	else if ( (n = vsnprintf(out_buf + out_len, OUT_BUFSZ - out_len, fmt, ap)) < OUT_BUFSZ - out_len )
+		out_len += (n > 0) ? n : 0;
+	else	{
+		/* Did not fit: formatted again, on its own */
+		va_end(ap);
+		va_start(ap, fmt);
 
-	rel_curse_row = curse_row - tframe_row;
-}
+		if ( (big = malloc(n + 1)) )
+			{
+			vsnprintf(big, n + 1, fmt, ap);
+			out_put(big, n);
+			free(big);
+			}
+		}
 
-/**/
+	va_end(ap);
 
-/* Use this when a line deletion has caused screen to scroll up */
-/* (Call this after deleting the line on the screen, but before */
-/*  actually deleting any characters from the file, or changing */
-/*  any of the row or column, or last_row pointers.)		*/
-void REPLACE_BOTTOM_LINE( int fswitch )
+	return	n;
+}
+
+void	out_num	(int n)
 {
-int	i, bottom_row;
-TEXT	*tmp_pt1;
+char	num[16];
 
-	/*get pointer to 1st char in bottom line of current screen*/
-	if ( ! (last_row > (bottom_row = tframe_row + nrows - 3)) )
-		return;
+	if ( (n >= 0) && (n < OUT_NDEC) )
+		out_put(out_dec[n], out_declen[n]);
+	else	out_put(num, sprintf(num, "%d", n));
+}
 
-	tmp_pt1 = curse_pt;
+/* ESC [ <n> <final> */
+void	out_csi	(int n, char final)
+{
+	OUT_STR("\033[");
+	out_num(n);
+	out_put(&final, 1);
+}
 
-	if (curse_row < bottom_row)
-		for (i=curse_row; i!=bottom_row; i++) move_pt_down_line( &tmp_pt1 );
-	else	for (i=curse_row; i!=bottom_row; i--) move_pt_up_line( &tmp_pt1 );
 
-	if (bottom_row>last_row)
-		bottom_row = last_row;
 
-	printf("%c[%d;1H", EDT$K_ESC, nrows-2 );
 
-	if (fswitch)
-		move_pt_down_line( &tmp_pt1 );
+/*
+ * Terminal modes: the settings found at start are kept in term_orig, screen mode puts the
+ * terminal raw with no echo (as "stty raw -echo" did) by tcsetattr(). The settings are put
+ * back on leaving screen mode, at exit, and on a signal which ends the editor.
+ */
+struct termios	term_orig;
+int		term_saved = 0, term_is_raw = 0;
+pid_t		term_pid;
 
-	spew_line( tmp_pt1 );
+void	term_restore	(void)
+{
+	if ( term_is_raw && (getpid() == term_pid) )
+		{
+		write(1, "\033[?2004l", 8);		/* Bracketed paste off */
+		tcsetattr(0, TCSADRAIN, &term_orig);
+		term_is_raw = 0;
+		}
 }
 
+void	term_signal	(int sig)
+{
+	term_restore();
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
 
-
-void scroll_window_up( int old_tframe_row )
+void	term_setup	(void)
 {
-int i;
-TEXT	*tmp_pt1;
+static	int	sigs[] = { SIGHUP, SIGINT, SIGQUIT, SIGTERM, SIGSEGV, SIGBUS, SIGABRT, 0 };
+int	i;
 
-  /*get pointer to 1st char in top line of current screen*/
-  tmp_pt1 = curse_pt;
-  if (curse_row<old_tframe_row)
-   for (i=curse_row+1; i!=old_tframe_row; i++) move_pt_down_line( &tmp_pt1 );
-  else
-   for (i=curse_row+1; i!=old_tframe_row; i--) move_pt_up_line( &tmp_pt1 );
-  for (i=old_tframe_row; i>tframe_row; i--)    /* scroll up by        */
-   {						/*  inserting lines at top */
-    printf("%c[H%cM", EDT$K_ESC, EDT$K_ESC);
-    move_pt_begin_of_line( &tmp_pt1 );
-    spew_line( tmp_pt1 );
-    move_pt_up_line( &tmp_pt1 );
-   }
-}
+	if ( tcgetattr(0, &term_orig) )
+		return;
 
+	term_saved = 1;
+	term_pid = getpid();
+	atexit(term_restore);
 
-void scroll_window_down( int old_tframe_row )
+	for (i = 0; sigs[i]; i++)
+		signal(sigs[i], term_signal);
+}
+
+void	term_raw	(void)
 {
- int i, bottom_row, new_bottom_row;
- struct __text__ *tmp_pt1;
+struct termios	t;
 
- /*get pointer to 1st char in bottom line of current screen*/
- bottom_row = old_tframe_row + nrows - 3;
- if (bottom_row>last_row) bottom_row = last_row;
- tmp_pt1 = curse_pt;
- if (curse_row < bottom_row)
-  for (i=curse_row; i!=bottom_row; i++) move_pt_down_line( &tmp_pt1 );
- else
-  for (i=curse_row; i!=bottom_row; i--) move_pt_up_line( &tmp_pt1 );
- new_bottom_row = tframe_row + nrows - 3;
- if (new_bottom_row>last_row) new_bottom_row = last_row;
- for (i=bottom_row; i!=new_bottom_row; i++)     /*scroll up by     */
-  {				 	     /* inserting lines at bottom */
-   printf("%c[%d;1H%cE", EDT$K_ESC, nrows-2, EDT$K_ESC);
-   move_pt_down_line( &tmp_pt1 );
-   spew_line( tmp_pt1 );
-  }
-}
+	if ( !term_saved || term_is_raw )
+		return;
 
+	t = term_orig;
+	t.c_iflag &= ~(IGNBRK | BRKINT | IGNPAR | PARMRK | INPCK | ISTRIP | INLCR | IGNCR | ICRNL
+			| IXON | IXOFF | IUCLC | IXANY | IMAXBEL);
+	t.c_oflag &= ~OPOST;
+	t.c_lflag &= ~(ICANON | ISIG | XCASE | ECHO);
+	t.c_cc[VMIN] = 1;
+	t.c_cc[VTIME] = 0;
 
+	if ( !tcsetattr(0, TCSADRAIN, &t) )
+		{
+		term_is_raw = 1;
+		out_printf("%c[?2004h", EDT$K_ESC);		/* Bracketed paste on */
+		}
+}
 
-void ADJUST_DISPLAY()
-/* Input:  curse_row, (the prevaling tframe_row), and last_row */
-{
- int old_tframe_row;
 
- old_tframe_row = tframe_row;
 
- if (curse_row < old_tframe_row + 6)	/* If cursor is above work area */
-  { /*above*/
-   tframe_row = curse_row - 6;
-   if (tframe_row<0) tframe_row = 0;	/* If new top row is above TOB, */
-					/*			set to TOB */
-   if (tframe_row != old_tframe_row)
-   { /*ok*/
-    if (old_tframe_row - tframe_row < nrows - 6)
-     { /*1*/	/* Scroll-up until new tframe */
-      scroll_window_up( old_tframe_row );
-     } /*1*/
-    else
-     /*redraw_screen_at_new_location*/
-     display_screen(0);
-   } /*ok*/
+/*
+ * Display columns of the last few lines the cursor was on: checkpoints of the character
+ * and its column every COL_STEP characters from the line start, so a column is counted
+ * from the nearest checkpoint at or before it, and the start or end of a long line is
+ * found from there. A character knows its checkpoint by ->ck, which is trusted only if
+ * the checkpoint points back at it; an edit in a line drops the checkpoints behind it
+ * (col_edit()).
+ */
+#define	COL_STEP	128
+#define	COL_MAXCK	65535
+#define	COL_LINES	4
 
-  } /*above*/
- else
-  if (curse_row > old_tframe_row + nrows - 10)
-   { /*below*/				/* If cursor is below work area */
-    tframe_row = curse_row - nrows + 10;
-				/* If new bottom row is below EOB, set to EOB */
-    if (tframe_row + nrows - 3 > last_row) tframe_row = last_row - nrows + 3;
-    if (tframe_row<0) tframe_row = 0;
+typedef	struct __col_ck__
+	{
+	TEXT	*pt;
+	int	col;
+} COL_CK;
 
-    if (tframe_row != old_tframe_row)
-    {
-     if (abs(tframe_row - old_tframe_row) < nrows - 5)
-      { /*2*/	/* Scroll-down until new bottom row */
-       if (tframe_row > old_tframe_row)
+typedef	struct __col_line__
 	{
-	 /* if (curse_pt!=EOB) if (curse_pt->nxt!=EOB) */
-	  scroll_window_down( old_tframe_row );
-	}
-       else
-	scroll_window_up( old_tframe_row );
-      } /*2*/
-     else
-      /*redraw_screen_at_new_location*/
-      display_screen(0);
-    }
+	TEXT	*line;			/* First character of the line */
+	COL_CK	*ck;
+	int	n, max;			/* Valid and allocated checkpoints */
+} COL_LINE;
 
-   } /*below*/
+COL_LINE	col_lines[COL_LINES];
+int		col_next = 0;
 
- reposition_cursor();
-} /*ADJUST_DISPLAY*/
+/* Line of a checkpoint at pt, its number in *k */
+COL_LINE	*col_ckof	(TEXT *pt, int *k)
+{
+COL_LINE	*cl;
 
+	if ( pt->ck )
+		for (cl = col_lines; cl != col_lines + COL_LINES; cl++)
+			if ( (pt->ck <= cl->n) && (cl->ck[pt->ck - 1].pt == pt) )
+				{
+				*k = pt->ck - 1;
+				return	cl;
+				}
 
-/**/
+	return	NULL;
+}
 
-/*Device Dependent Screen Operations*/
-/*for vt100*/
-void INSERT_CHAR_INLINE( char ch )
+void	col_add	(COL_LINE *cl, TEXT *pt, int col)
 {
- if (ch==10)			/* If inserting a new line: */
-  {
-    curse_row = curse_row + 1;
-    last_row = last_row + 1;
-    if (curse_row-tframe_row<nrows-2)  /* If not at very bottom of screen */
-     printf("%c[K%c%c",EDT$K_ESC,10,13); /* Erase to EOLN and move cursor */
-					/*  to 1st position on next line */
-    if (curse_row-tframe_row<nrows-3)  /* If not at bottom of screen */
-    {
-     printf("%c[L",EDT$K_ESC);			 /* Insert New Line */
-    }
-    else
-     printf("%c[K", EDT$K_ESC);
-
-    if (curse_row-tframe_row<nrows-2)  /* If not at very bottom of screen */
-     spew_line( curse_pt );	/* Spew line from the new char */
-  }
- else
-  {
-   printf("%c[K", EDT$K_ESC);	/* Clr to EOLN */
-   if (curse_pt==EOB)
-   {
-    insert_char( 10, &curse_pt );
-    curse_pt = curse_pt->prv;
-    if (curse_row-tframe_row<nrows-3)  /* If not at bottom of screen */
-     {
-      printf("%c[K\n\r[EOB %s]%c[A%c[%luD",EDT$K_ESC, active_buffer_name, EDT$K_ESC, EDT$K_ESC, 6 + strlen(active_buffer_name) );
-     }
-    else printf("%c[K", EDT$K_ESC);
-    last_row = last_row + 1;
-    ch = 10;
-   }
-   spew_line( curse_pt->prv );	/* Spew line from the new char */
-  }
- compute_curse_col(curse_pt);
- reposition_cursor();
- last_curse_col = rel_curse_col;
- if (ch==10) ADJUST_DISPLAY();
-}
+	if ( cl->n == COL_MAXCK )
+		return;
 
-/*END Device Dependent Screen Operations*/
-/*for vt100*/
+	if ( cl->n == cl->max )
+		{
+		cl->max = 2 * cl->max + 64;
+		cl->ck = (COL_CK *)realloc( cl->ck, cl->max * sizeof(COL_CK) );
+		}
 
+	cl->ck[cl->n].pt = pt;
+	cl->ck[cl->n].col = col;
+	pt->ck = ++cl->n;
+}
 
-/**/
+/* Forget all the lines, after changes not seen by col_edit() */
+void	col_reset	(void)
+{
+int	i;
 
+	for (i = 0; i != COL_LINES; i++)
+		col_lines[i].n = 0;
+}
 
-void DELETE_CHAR_BACKWARD()
+/*
+ * Nearest checkpoint at or before the character, its number in *k; the line is taken
+ * in place of another one if it has none.
+ */
+COL_LINE	*col_find	(TEXT *pt, int *k)
 {
- struct __text__ *tmp_pt;
- int do_delete;
- char tmp_ch;
+COL_LINE	*cl;
 
- if (curse_pt != txt_head->nxt)
-  {
-   if ((curse_pt==EOB) && (curse_pt->prv!=txt_head->nxt))
-    if ((curse_pt->prv->prv->ch!=10) && (curse_pt->prv!=txt_head->nxt))
-    {
-     curse_pt = curse_pt->prv;
-     curse_row = curse_row - 1;
-     compute_curse_col(curse_pt);
-     reposition_cursor();
-     last_curse_col = rel_curse_col;
-     do_delete = 0;
-    }
-    else
-     do_delete = 1;
-   else
-    do_delete = 1;
+	for ( ; !(cl = col_ckof(pt, k)); pt = pt->prv)
+		if ( (pt->prv == txt_head) || (pt->prv->ch == '\n') )
+			{
+			cl = col_lines + col_next;
+			col_next = (col_next + 1) % COL_LINES;
+
+			cl->line = pt;
+			cl->n = 0;
+			col_add( cl, pt, 0 );
+			*k = 0;
+			break;
+			}
 
-   if (do_delete)
-   {
-    tmp_pt = curse_pt->prv;
-    tmp_ch = tmp_pt->ch;
-    ch_buf = tmp_ch;
-    if (tmp_ch == 10)	/* If deleting a <CR>: */
-    {
-     printf("%c[M", EDT$K_ESC);
-     REPLACE_BOTTOM_LINE(1);
-     curse_row = curse_row - 1;  rel_curse_row = rel_curse_row - 1;
-     last_row = last_row - 1;
-    }
-    delete_char( tmp_pt );
-    compute_curse_col(curse_pt);
-    reposition_cursor();
-    printf("%c[K", EDT$K_ESC);		/* clear to EOLN */
-    spew_line( curse_pt );
-    reposition_cursor();
-    last_curse_col = rel_curse_col;
-    if (tmp_ch == 10)	/* If deleting a <CR>: */
-     ADJUST_DISPLAY();
-   }
-  }
- else
-  {
-    printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-    printf("%c%c[%d;1H%c[7mBackup past top of buffer%c[m%c[1;1H",
-	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
-    printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
-    message_pending = 1;
-    reposition_cursor();
-  }
+	return	cl;
 }
 
+/* Counts checkpoint n on, one is added at every COL_STEP characters past the last one */
+#define	COL_STEP_ON(cl, n, pt, col)	\
+	if ( !(++(n) % COL_STEP) && ((n) / COL_STEP == (cl)->n) ) col_add( cl, pt, col )
 
+int	col_of	(TEXT *pt)
+{
+COL_LINE	*cl;
+TEXT	*tmp_pt;
+int	k, n, col;
 
+	cl = col_find( pt, &k );
 
-void DELETE_CHAR_FORWARD()
-{
- struct __text__ *tmp_pt;
- char tmp_ch;
+	for (tmp_pt = cl->ck[k].pt, col = cl->ck[k].col, n = k * COL_STEP; tmp_pt != pt; )
+		{
+		col += spaces( tmp_pt->ch, col );
+		tmp_pt = tmp_pt->nxt;
+		COL_STEP_ON( cl, n, tmp_pt, col );
+		}
 
- if (curse_pt != EOB)
-  {
-    tmp_pt = curse_pt;
-    curse_pt = curse_pt->nxt;
-    tmp_ch = tmp_pt->ch;
-    ch_buf = tmp_ch;
-    if ((tmp_ch==10) && (curse_pt==EOB) && (tmp_pt->prv!=txt_head)
-	&& (tmp_pt->prv->ch!=10))
-    {
-     curse_row = curse_row + 1;
-    }
-    else
-    {
-     if (tmp_ch == 10)	/* If deleting a <CR>: */
-     {
-      printf("\n\r%c[M", EDT$K_ESC);
-      REPLACE_BOTTOM_LINE(0);
-      last_row = last_row - 1;
-     }
-     delete_char( tmp_pt );
-    }
-    compute_curse_col(curse_pt);
-    reposition_cursor();
-    printf("%c[K", EDT$K_ESC);		/* clear to EOLN */
-    spew_line( curse_pt );
-    reposition_cursor();
-    last_curse_col = rel_curse_col;
-    if (tmp_ch == 10)	/* If deleting a <CR>: */
-     ADJUST_DISPLAY();
-  }
- else
-  {
-    printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-    printf("%c%c[%d;1H%c[7mAdvance past top of buffer%c[m%c[1;1H",
-	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
-    printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
-    message_pending = 1;
-    reposition_cursor();
-  }
+	return	col;
 }
 
+/*
+ * Last character of the line beginning at pt which is at or before the column, or the
+ * end of the line; its column is returned in *rel_col.
+ */
+TEXT	*col_seek	(TEXT *pt, int col, int *rel_col)
+{
+COL_LINE	*cl;
+int	lo, hi, mid, n, w, c;
 
+	cl = col_find( pt, &lo );
 
+	for (hi = cl->n - 1; lo < hi; )
+		{
+		mid = (lo + hi + 1) / 2;
 
-void DELETE_WORD_FORWARD()
-{
- struct __text__ *tmp_pt;
+		if ( cl->ck[mid].col <= col )
+			lo = mid;
+		else	hi = mid - 1;
+		}
 
-if (!Gold)
-{ /*!Gold*/
- if (curse_pt != EOB)
-  {
+	pt = cl->ck[lo].pt;
+	c = cl->ck[lo].col;
+	n = lo * COL_STEP;
 
-   /* Free anything on word_buf. */
-   while (word_buf!=0) { txt_tmp = word_buf; word_buf = word_buf->nxt; dispose_ch( txt_tmp ); }
+	while ( (pt != EOB) && (pt->ch != '\n') && (c + (w = spaces( pt->ch, c )) <= col) )
+		{
+		c += w;
+		pt = pt->nxt;
+		COL_STEP_ON( cl, n, pt, c );
+		}
 
-   if ((curse_pt->ch==10) || (curse_pt->ch=='	'))
-    {
-     push_buffer( curse_pt->ch, &word_buf );
-     DELETE_CHAR_FORWARD();
-    }
-   else
-    { /*Not_starting_at_CR_or_TAB*/
-     /* Find EOW */
-     tmp_pt = curse_pt;
-     /* while not white_space, advance */
-     while ((tmp_pt!=EOB) && (tmp_pt->ch!=10) && (tmp_pt->ch!=' ')
-			&& (tmp_pt->ch!='	'))   tmp_pt = tmp_pt->nxt;
-     while ((tmp_pt!=EOB) && (tmp_pt->ch==' '))  tmp_pt = tmp_pt->nxt;
-     tmp_pt = tmp_pt->prv;
+	*rel_col = c;
+	return	pt;
+}
 
-     /* push and delete from EOW upto and including curse_pt. */
-     while (tmp_pt!=curse_pt)
-      {
-       push_buffer( tmp_pt->ch, &word_buf );
-       tmp_pt = tmp_pt->prv;
-       delete_char( tmp_pt->nxt );
-      }
-     push_buffer( curse_pt->ch, &word_buf );
-     curse_pt = curse_pt->prv;
-     delete_char( curse_pt->nxt );
-     curse_pt = curse_pt->nxt;
+/* First character of the line of pt; a known line is not walked back through */
+TEXT	*col_bol	(TEXT *pt)
+{
+COL_LINE	*cl;
+int	k;
 
-     compute_curse_col(curse_pt);
-     reposition_cursor();
-     printf("%c[K", EDT$K_ESC);         /* clear to EOLN */
-     spew_line( curse_pt );
-     reposition_cursor();
-     last_curse_col = rel_curse_col;
-    } /*Not_starting_at_CR_or_TAB*/
+	for ( ; (pt->prv != txt_head) && (pt->prv->ch != '\n'); pt = pt->prv)
+		if ( (cl = col_ckof(pt, &k)) )
+			return	cl->line;
 
-  }
- else
-  {
-    printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-    printf("%c%c[%d;1H%c[7mAdvance past top of buffer%c[m%c[1;1H",
-	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
-    printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
-    message_pending = 1;
-    reposition_cursor();
-  }
- } /*!Gold*/
-else
- { /*Gold*/	/* Undelete word */
+	return	pt;
+}
 
-  tmp_pt = curse_pt->prv;
+/*
+ * End (new line, EOB) of the line of pt; a known line is gone on from its last checkpoint,
+ * adding the ones which are missing.
+ */
+TEXT	*col_eol	(TEXT *pt)
+{
+COL_LINE	*cl = NULL;
+TEXT	*tmp_pt;
+int	i, k, n, col;
 
-  if (word_buf!=0)
-  { /*word_buf_not_empty*/
+	for (i = 0, tmp_pt = pt; (i <= COL_STEP) && (tmp_pt->ch != '\n') && (tmp_pt != EOB); i++, tmp_pt = tmp_pt->prv)
+		if ( (cl = col_ckof(tmp_pt, &k)) || (tmp_pt->prv == txt_head) || (tmp_pt->prv->ch == '\n') )
+			break;
 
-   txt_tmp = word_buf;
-   while (txt_tmp!=0)
-    {
-     insert_char( txt_tmp->ch, &curse_pt );
-     txt_tmp = txt_tmp->nxt;
-    }
+	if ( !cl )
+		{
+		while ( (pt->ch != '\n') && (pt != EOB) )
+			pt = pt->nxt;
 
-  if (curse_pt->prv->ch == 10)
-  {
-    last_row = last_row + 1;
-    if (curse_row-tframe_row<nrows-2)	/* If not at very bottom of screen */
-     printf("%c[K\n\r",EDT$K_ESC); 	/* Erase to EOLN and move cursor */
-					/*  to 1st position on next line */
-    if (curse_row-tframe_row < nrows-3)	/* If not at bottom of screen */
-    {
-     printf("%c[L",EDT$K_ESC);                  /* Insert New Line */
-    }
-    else
-     printf("%c[K", EDT$K_ESC);
+		return	pt;
+		}
 
-    if (curse_row-tframe_row<nrows-2)  /* If not at very bottom of screen */
-     spew_line( curse_pt );     /* Spew line from the new char */
-    if (curse_row-tframe_row < nrows-2) printf("%c[A",EDT$K_ESC);
+	k = cl->n - 1;
+	pt = cl->ck[k].pt;
+	col = cl->ck[k].col;
+	n = k * COL_STEP;
 
-  }
-  else
-  if (curse_pt==EOB)
-   {
-    insert_char( 10, &curse_pt );
-    curse_pt = curse_pt->prv;
-    if (curse_row-tframe_row<nrows-3)  /* If not at bottom of screen */
-    {
-     printf("%c[K\n\r[EOB %s]%c[A%c[%luD",EDT$K_ESC, active_buffer_name, EDT$K_ESC, EDT$K_ESC, 6 + strlen(active_buffer_name) );
-    }
-    else printf("%c[K", EDT$K_ESC);
-    last_row = last_row + 1;
+	while ( (pt->ch != '\n') && (pt != EOB) )
+		{
+		col += spaces( pt->ch, col );
+		pt = pt->nxt;
+		COL_STEP_ON( cl, n, pt, col );
+		}
 
-   }
+	return	pt;
+}
 
-   curse_pt = tmp_pt->nxt;
-   compute_curse_col(curse_pt);
-   reposition_cursor();
-   last_curse_col = rel_curse_col;
+/* A character is inserted before pt, or pt is deleted or changed in place */
+void	col_edit	(TEXT *pt)
+{
+COL_LINE	*cl;
+TEXT	*tmp_pt;
+int	i, k;
 
-   printf("%c[K", EDT$K_ESC);  /* Clr to EOLN */
-   spew_line( curse_pt );  /* Spew line from the new char */
-   reposition_cursor();
-   ADJUST_DISPLAY();
+	for (cl = col_lines; cl != col_lines + COL_LINES; cl++)
+		if ( cl->n && ((pt == cl->line) || (pt->nxt == cl->line)) )
+			cl->n = 0;
 
-  } /*word_buf_not_empty*/
+	for (i = 0, tmp_pt = pt; i <= COL_STEP; i++, tmp_pt = tmp_pt->prv)
+		{
+		if ( (cl = col_ckof(tmp_pt, &k)) )
+			{
+			cl->n = (tmp_pt == pt) ? k : k + 1;
+			return;
+			}
 
-  Gold = 0;
- } /*Gold*/
+		if ( (tmp_pt->prv == txt_head) || (tmp_pt->prv->ch == '\n') )
+			return;
+		}
 }
 
 
 
-void DELETE_LINE_FORWARD()
-{
- struct __text__ *tmp_pt;
+/*
+ * Model of the text rows (the scrolling region) of the screen: scr_cur is what the
+ * terminal shows, scr_new is the frame display_screen() wants there, a byte per cell.
+ * Everything drawn into the region goes through scr_*() so scr_cur keeps up with the
+ * terminal, a redraw sends only the cells which differ. While scr_defer is set nothing
+ * is drawn: the keys typed ahead are applied to the text only, and display_screen() is
+ * called once after the last of them.
+ */
+char	*scr_cur = NULL, *scr_new = NULL;
+int	scr_rows = 0, scr_cols = 0,	/* Size of the model */
+	scr_valid = 0,			/* scr_cur is what the terminal shows */
+	scr_defer = 0,			/* Keys are typed ahead, the screen is left as it is */
+	scr_row, scr_col;		/* Terminal cursor */
 
-if (!Gold)
-{ /*!Gold*/
- if (curse_pt != EOB)
-  {
+#define	SCR_CELL(b, r, c)	((b)[(r) * scr_cols + (c)])
+#define	SCR_GAP		6	/* Equal cells rewritten rather than jumped over */
 
-   /* Free anything on line_buf. */
-   while (line_buf!=0) { txt_tmp = line_buf; line_buf = line_buf->nxt; dispose_ch( txt_tmp ); }
+/* Size the model by the screen, the terminal contents are unknown */
+void	scr_setup	(void)
+{
+	if ( (scr_rows != nrows - 2) || (scr_cols != ncols + 1) )
+		{
+		scr_rows = (nrows > 2) ? nrows - 2 : 1;
+		scr_cols = (ncols > 0) ? ncols + 1 : 1;
 
-   /* Find EOL */
-   tmp_pt = curse_pt;
-   while ((tmp_pt!=EOB) && (tmp_pt->ch!=10)) tmp_pt = tmp_pt->nxt;
+		scr_cur = realloc(scr_cur, scr_rows * scr_cols);
+		scr_new = realloc(scr_new, scr_rows * scr_cols);
+		}
 
-   /* push and delete from EOL upto and including curse_pt. */
-   while (tmp_pt!=curse_pt)
-    {
-     push_buffer( tmp_pt->ch, &line_buf );
-     tmp_pt = tmp_pt->prv;
-     delete_char( tmp_pt->nxt );
-    }
-   push_buffer( curse_pt->ch, &line_buf );
-   curse_pt = curse_pt->prv;
-   delete_char( curse_pt->nxt );
-   curse_pt = curse_pt->nxt;
+	scr_valid = 0;
+}
 
-   printf("\n\r%c[M", EDT$K_ESC);
-   REPLACE_BOTTOM_LINE(0);
-   last_row = last_row - 1;
+void	scr_goto	(int row, int col)
+{
+	if ( scr_defer )
+		return;
 
-   compute_curse_col(curse_pt);
-   reposition_cursor();
-   printf("%c[K", EDT$K_ESC);         /* clear to EOLN */
-   spew_line( curse_pt );
-   reposition_cursor();
-   last_curse_col = rel_curse_col;
-  }
- else
-  {
-    printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-    printf("%c%c[%d;1H%c[7mAdvance past top of buffer%c[m%c[1;1H",
-	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
-    printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
-    message_pending = 1;
-    reposition_cursor();
-  }
- } /*!Gold*/
-else
- { /*Gold*/     /* Undelete line */
-  tmp_pt = curse_pt->prv;
+	if ( !row && !col )
+		OUT_STR(OUT_HOME);
+	else if ( !col )
+		out_csi(row + 1, 'H');
+	else	{
+		out_csi(row + 1, ';');
+		out_num(col + 1);
+		OUT_STR("H");
+		}
 
-  if (line_buf!=0)
-  { /*line_buf_not_empty*/
+	scr_row = row;
+	scr_col = col;
+}
 
-   txt_tmp = line_buf;
-   while (txt_tmp!=0)
-    {
-     insert_char( txt_tmp->ch, &curse_pt );
-     txt_tmp = txt_tmp->nxt;
-    }
+/* A glyph byte is put at the cursor; running off the right edge would wrap the line */
+void	scr_cell	(char ch)
+{
+	if ( scr_col >= scr_cols )
+		scr_valid = 0;
+	else if ( scr_cur && (scr_row >= 0) && (scr_row < scr_rows) )
+		SCR_CELL(scr_cur, scr_row, scr_col) = ch;
 
-   last_row = last_row + 1;
+	scr_col++;
+}
 
-   if (curse_row-tframe_row < nrows-2)	/* If not at very bottom of screen */
-    {
-     printf("%c[K\n\r",EDT$K_ESC);	/* Erase to EOLN and move cursor */
-					/*  to 1st position on next line */
-     if (curse_row-tframe_row < nrows-3)  /* If not at bottom of screen */
-       printf("%c[L",EDT$K_ESC);        /* Insert New Line */
-     else
-       printf("%c[K", EDT$K_ESC);
+void	scr_char	(char ch)
+{
+char	glyph[8], *cp;
 
-     spew_line( curse_pt );     /* Spew line from the new char */
-    }
+	if ( scr_defer )
+		return;
 
-   if (curse_pt==EOB)
-    {
-     curse_pt = curse_pt->prv;
-    }
+	if ( ch == 9 )
+		{
+		out_put(&ch, 1);
+		scr_col = (scr_col / 8) * 8 + 8;
 
-   curse_pt = tmp_pt->nxt;
-   compute_curse_col(curse_pt);
-   reposition_cursor();
-   last_curse_col = rel_curse_col;
+		if ( scr_col >= scr_cols )
+			scr_col = scr_cols - 1;
 
-   printf("%c[K", EDT$K_ESC);  /* Clr to EOLN */
-   spew_line( curse_pt );  /* Spew line from the new char */
-   reposition_cursor();
-   ADJUST_DISPLAY();
+		return;
+		}
 
-  } /*line_buf_not_empty*/
-  Gold = 0;
- } /*Gold*/
+	for (cp = char_glyph(ch, glyph); *cp; cp++)
+		scr_cell(*cp);
+
+	out_put(glyph, cp - glyph);
 }
 
+void	scr_eob	(void)
+{
+char	*cp;
 
+	if ( scr_defer )
+		return;
 
+	OUT_STR("[EOB ");
+	out_put(active_buffer_name, strlen(active_buffer_name));
+	OUT_STR("]");
 
+	scr_cell('[');
 
-void left_arrow()
-{
-  if (curse_pt!=txt_head->nxt)
-   {
-    curse_pt = curse_pt->prv;
-    if (curse_pt->ch==10) curse_row = curse_row - 1;
-    compute_curse_col(curse_pt);
-    last_curse_col = rel_curse_col;
-    reposition_cursor();
-    if (curse_pt->ch==10) ADJUST_DISPLAY();
-   }
-  else
-   {
-    printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-    printf("%c%c[%d;1H%c[7mBackup past top of buffer%c[m%c[1;1H",
-	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
-    printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
-    message_pending = 1;
-    reposition_cursor();
-   }
+	for (cp = "EOB "; *cp; cp++)
+		scr_cell(*cp);
+
+	for (cp = active_buffer_name; *cp; cp++)
+		scr_cell(*cp);
+
+	scr_cell(']');
 }
 
+/* Blank the cells of a row from col on */
+void	scr_blank	(int row, int col)
+{
+	if ( scr_cur && (row >= 0) && (row < scr_rows) && (col < scr_cols) )
+		memset(&SCR_CELL(scr_cur, row, col), ' ', scr_cols - col);
+}
 
-void up_arrow()
+void	scr_clreol	(void)
 {
-  curse_row = curse_row - 1;
-  if (curse_row < 0)
-   {
-    curse_row = 0;
-    printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-    printf("%c%c[%d;1H%c[7mBackup past top of buffer%c[m%c[1;1H",
-	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
-    printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
-    reposition_cursor();
-    message_pending = 1;
-   }
-  else
-   {
-    /*Get curser to end of previous line, Then to begining of that line, */
-    /* then try to move to last_curse_col */
-    move_pt_up_line( &curse_pt );
-    move_pt_begin_of_line( &curse_pt );
-    rel_curse_col = 0;
-    while ((curse_pt->nxt!=EOB) && (curse_pt->ch!=10) &&
-					(rel_curse_col<last_curse_col))
-     {
-      if (curse_pt->ch != 9)
-       rel_curse_col = rel_curse_col + 1;
-      else
-       rel_curse_col = (rel_curse_col/8)*8 + 8;
-      curse_pt = curse_pt->nxt;
-     }
-    if (rel_curse_col>last_curse_col)
-     if (curse_pt!=txt_head->nxt)
-      {
-	curse_pt = curse_pt->prv;
-	compute_curse_col(curse_pt);
-      }
-    reposition_cursor();
-    ADJUST_DISPLAY();
-   }
+	if ( scr_defer )
+		return;
+
+	OUT_STR(OUT_CLREOL);
+	scr_blank(scr_row, scr_col);
 }
 
+/* Rows from..to-1 of the region move by n up (n < 0) or down, the freed rows are blank */
+void	scr_shift	(int from, int to, int n)
+{
+int	k = abs(n);
 
+	if ( !scr_cur || (from < 0) || (from >= to) )
+		return;
 
-void right_arrow()
+	if ( k > to - from )
+		k = to - from;
+
+	if ( n < 0 )
+		{
+		memmove(&SCR_CELL(scr_cur, from, 0), &SCR_CELL(scr_cur, from + k, 0), (to - from - k) * scr_cols);
+		memset(&SCR_CELL(scr_cur, to - k, 0), ' ', k * scr_cols);
+		}
+	else	{
+		memmove(&SCR_CELL(scr_cur, from + k, 0), &SCR_CELL(scr_cur, from, 0), (to - from - k) * scr_cols);
+		memset(&SCR_CELL(scr_cur, from, 0), ' ', k * scr_cols);
+		}
+}
+
+/* LF + CR, scrolls the region up at its bottom row */
+void	scr_newline	(void)
 {
+	if ( scr_defer )
+		return;
 
-  if (curse_pt!=EOB)
-   {
-    if (curse_pt->ch==10) curse_row = curse_row + 1;
-    curse_pt = curse_pt->nxt;
-    compute_curse_col(curse_pt);
-    last_curse_col = rel_curse_col;
-    reposition_cursor();
-    if (curse_pt->prv->ch==10) ADJUST_DISPLAY();
-   }
-  else
-   {
-    printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-    printf("%c%c[%d;1H%c[7mAdvance past bottom of buffer%c[m%c[1;1H",
-	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
-    printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
-    reposition_cursor();
-    message_pending = 1;
-   }
+	OUT_STR(OUT_NEWLINE);
+
+	if ( scr_row == scr_rows - 1 )
+		scr_shift(0, scr_rows, -1);
+	else	scr_row++;
+
+	scr_col = 0;
 }
 
+/* Reverse index, scrolls the region down at its top row */
+void	scr_revindex	(void)
+{
+	if ( scr_defer )
+		return;
 
-void down_arrow()
+	OUT_STR(OUT_REVINDEX);
+
+	if ( !scr_row )
+		scr_shift(0, scr_rows, 1);
+	else if ( scr_row > 0 )
+		scr_row--;
+}
+
+void	scr_insline	(void)
 {
-  /*Get curser to begining of next line, Then try to move to last_curse_col */
-  if (curse_pt==EOB)
-   {
-    printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-    printf("%c%c[%d;1H%c[7mAdvance past bottom of buffer%c[m%c[1;1H",
-	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
-    printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
-    reposition_cursor();
-    message_pending = 1;
-   }
-  else
-  {
-   curse_row = curse_row + 1;
-   move_pt_end_of_line( &curse_pt );
-   curse_pt = curse_pt->nxt;
-    rel_curse_col = 0;
-    while ((curse_pt!=EOB) && (curse_pt->ch!=10) &&
-					(rel_curse_col<last_curse_col))
-     {
-      if (curse_pt->ch != 9)
-       rel_curse_col = rel_curse_col + 1;
-      else
-       rel_curse_col = (rel_curse_col/8)*8 + 8;
-      curse_pt = curse_pt->nxt;
-     }
-    if (rel_curse_col>last_curse_col)
-     if (curse_pt!=txt_head->nxt)
-      {
-	curse_pt = curse_pt->prv;
-	compute_curse_col(curse_pt);
-      }
-    reposition_cursor();
-    ADJUST_DISPLAY();
-  }
+	if ( scr_defer )
+		return;
+
+	OUT_STR(OUT_INSLINE);
+
+	if ( scr_row < scr_rows )
+		scr_shift(scr_row, scr_rows, 1);
+
+	scr_col = 0;
 }
 
+void	scr_delline	(void)
+{
+	if ( scr_defer )
+		return;
 
+	OUT_STR(OUT_DELLINE);
 
+	if ( scr_row < scr_rows )
+		scr_shift(scr_row, scr_rows, -1);
 
+	scr_col = 0;
+}
 
-char cap_ch( char ch )	/* Like toupper. */
+void	scr_up	(void)
 {
- if ((ch>96) && (ch<123)) ch = ch - 32;
- return ch;
+	if ( scr_defer )
+		return;
+
+	OUT_STR(OUT_UP);
+
+	if ( scr_row > 0 )
+		scr_row--;
 }
 
+void	scr_left	(int n)
+{
+	if ( scr_defer )
+		return;
+
+	out_csi(n, 'D');
 
+	if ( 0 > (scr_col -= n) )
+		scr_col = 0;
+}
 
 
+/*
+ * First character of the top row of the frame: tframe_pt is kept by ADJUST_DISPLAY() and
+ * the scrolling, dropped by edits next to it; it is found again from the cursor, which
+ * is always on the frame, so this costs the screen size at most.
+ */
+void	move_pt_up_line(TEXT **tmp_pt);
+void	move_pt_begin_of_line(TEXT **tmp_pt);
 
-/* This routine determines if curse_pt is aligned at the start of a match to the search-string in the text buffer. */
-/* Returns '1' if so, else returns '0'. */
-int srch_match()
+TEXT	*frame_top	(void)
 {
- int i;
- char s_strng[512];
- struct __text__ *tmp_pt1;
+TEXT	*tmp_pt = curse_pt;
+int	row;
 
-  if (srch_caps)        /* Capitolize the search string */
-  {
-   i=0;
-   while (srch_strng[i] != EDT$K_ESC)
-    {s_strng[i] = cap_ch( srch_strng[i] ); i = i + 1;}
-   s_strng[i] = EDT$K_ESC;
-  }
+	if ( tframe_pt )
+		return	tframe_pt;
 
-  tmp_pt1 = curse_pt;
+	move_pt_begin_of_line(&tmp_pt);
 
-  i = 0;
-  if (srch_caps)
-  {
-   while ((tmp_pt1 != EOB) && (s_strng[i] == cap_ch(tmp_pt1->ch)) && (srch_strng[i] != EDT$K_ESC))
-    { i = i + 1;  tmp_pt1 = tmp_pt1->nxt; }
-  }
-  else
-  {
-   while ((tmp_pt1 != EOB) && (srch_strng[i] == tmp_pt1->ch) && (srch_strng[i] != EDT$K_ESC))
-    { i = i + 1;  tmp_pt1 = tmp_pt1->nxt; }
-  }
-  if ((srch_strng[i] == EDT$K_ESC) && (tmp_pt1 != curse_pt)) return 1; else return 0;
+	for (row = curse_row; (row > tframe_row) && (tmp_pt != txt_head->nxt); row--)
+		{
+		move_pt_up_line(&tmp_pt);
+		move_pt_begin_of_line(&tmp_pt);
+		}
+
+	return	tframe_pt = tmp_pt;
 }
 
 
+/*
+ * First character of the line beginning at pt which is shown in the view, or the end of
+ * the line; its column in *rel_col. The line is sought by its checkpoints if it is known.
+ */
+TEXT	*scr_hseek	(TEXT *pt, int *rel_col)
+{
+int	k;
 
+	if ( hscroll && col_ckof(pt, &k) )
+		{
+		pt = col_seek( pt, hscroll, rel_col );
 
-void CAPITOLIZE_CHAR()
-{
- char ch;
- int ch_index, still_online;
- struct __text__ *tmp_pt1;
-
- if ((Mark) && (mark_pt1!=curse_pt))
- {
-   /* First decide direction to change-caps in. */
-   if ((mark_row<curse_row) || ((curse_row==mark_row) && (mark_col<last_curse_col)))
-     { /*change_backward*/  /* Change back-up to mark, from left of cursor. */
-       tmp_pt1 = curse_pt->prv;  /* Cursor stays where it is. */
-       still_online = 1;
-       while (tmp_pt1!=mark_pt1->prv)
-	{
-	 if ((tmp_pt1->ch>64) && (tmp_pt1->ch<91)) tmp_pt1->ch = tmp_pt1->ch + 32;
-	 else
-	 if ((tmp_pt1->ch>96) && (tmp_pt1->ch<123)) tmp_pt1->ch = tmp_pt1->ch - 32;
-	 if (tmp_pt1->ch==10) still_online = 0;
-	 tmp_pt1 = tmp_pt1->prv;
-	 if (tmp_pt1==txt_head) {printf("SEVERE_ERROR: BOB\n"); /* tmp_pt1=mark_pt1->prv; */}
-	}
-       display_screen(1);
-     } /*change_backward*/
-    else
-     { /*change_forward*/   /* Change back-up to cursor, from mark. */
-       tmp_pt1 = mark_pt1->prv;
-       while (tmp_pt1!=curse_pt->prv)
-	{
-	 if ((tmp_pt1->ch>64) && (tmp_pt1->ch<91)) tmp_pt1->ch = tmp_pt1->ch + 32;
-	 else
-	 if ((tmp_pt1->ch>96) && (tmp_pt1->ch<123)) tmp_pt1->ch = tmp_pt1->ch - 32;
-	 if (tmp_pt1->ch==10) still_online = 0;
-	 tmp_pt1 = tmp_pt1->prv;
-	 if (tmp_pt1==txt_head) {printf("SEVERE_ERROR: BOB\n"); /* tmp_pt1=mark_pt1; */}
-	}
-       display_screen(1);
-     } /*change_forward*/
-    // Mark = 0;  	/* Safe to keep marked. */
- }
- else
- /* Check if you are positioned at front of match to search_string. */
- if ((srch_match()) && (!((srch_strng[0]==' ') && (srch_strng[1]==EDT$K_ESC))))
- {
-   ch_index = 0;  still_online = 1;
-   tmp_pt1 = curse_pt;
-   while (srch_strng[ch_index]!=EDT$K_ESC)
-    {
-     if ((tmp_pt1->ch>64) && (tmp_pt1->ch<91)) tmp_pt1->ch = tmp_pt1->ch + 32;
-     else
-     if ((tmp_pt1->ch>96) && (tmp_pt1->ch<123)) tmp_pt1->ch = tmp_pt1->ch - 32;
-     if (tmp_pt1->ch==10) still_online = 0;
-     tmp_pt1 = tmp_pt1->nxt;
-     ch_index = ch_index + 1;
-    }
-   if (still_online)
-    {
-     printf("%c[K", EDT$K_ESC);  /* Clr to EOLN */
-     spew_line( curse_pt );  /* Spew line from the new char */
-     reposition_cursor();
-    }
-   else
-    display_screen(1);
- }
- else
- if (direction==1)
- { /*dir=1*/
-  if (curse_pt==EOB) ch = 0;
-  else ch = curse_pt->ch;
-  if ((ch>64) && (ch<91)) ch = ch + 32;
-  else
-  if ((ch>96) && (ch<123)) ch = ch - 32;
-  else ch = 0;
-  if (ch!=0)
-  {
-   curse_pt->ch = ch;
-   printf("%c",ch);
-   curse_pt = curse_pt->nxt;
-   compute_curse_col(curse_pt);
-   last_curse_col = rel_curse_col;
-   reposition_cursor();
-   changed++;
-  }
-  else right_arrow();
- } /*dir=1*/
- else
- { /*dir=0*/
-  if (curse_pt==txt_head->nxt) ch = 0;
-  else ch = curse_pt->prv->ch;
-  if ((ch>64) && (ch<91)) ch = ch + 32;
-  else
-  if ((ch>96) && (ch<123)) ch = ch - 32;
-  else ch = 0;
-  if (ch!=0)
-  {
-   curse_pt->prv->ch = ch;
-   curse_pt = curse_pt->prv;
-   compute_curse_col(curse_pt);
-   reposition_cursor();
-   printf("%c",ch);
-   last_curse_col = rel_curse_col;
-   reposition_cursor();
-   changed++;
-  }
-  else left_arrow();
- } /*dir=0*/
- Gold = 0;
-}
+		if ( (*rel_col < hscroll) && (pt != EOB) && (pt->ch != '\n') )
+			{
+			*rel_col += spaces( pt->ch, *rel_col );
+			pt = pt->nxt;
+			}
 
+		return	pt;
+		}
 
+	for (*rel_col = 0; (pt != EOB) && (pt->ch != '\n') && (*rel_col < hscroll); pt = pt->nxt)
+		*rel_col += spaces( pt->ch, *rel_col );
 
+	return	pt;
+}
 
-void jump_by_word()
+/*
+ * Lay the frame from tframe_row out in scr_new, the way it is printed by spew_line()
+ */
+void	scr_compose	(void)
 {
- int ln_flag = 0;
+TEXT	*tmp_pt;
+char	glyph[8], *cp;
+int	row, rel_col, i;
 
- if (direction==1)
- { /*forward*/
-  if (curse_pt==EOB)
-   {
-    printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-    printf("%c%c[%d;1H%c[7mAdvance past bottom of buffer%c[m%c[1;1H",
-	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
-    printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
-    reposition_cursor();
-    message_pending = 1;
-   }
-  else
-  { /*ok*/
-   if (curse_pt->ch=='\n')  /* If at end of line */
-   {
-    curse_pt = curse_pt->nxt;
-    ln_flag = 1; curse_row = curse_row + 1;
-   }
-   else
-   if (curse_pt->ch=='	') 	/* if at TAB */
-     {curse_pt = curse_pt->nxt;}
-   else
-   { /*not_at_end_of_line*/
-    /* while not white_space, advance */
-    while ((curse_pt!=EOB) && (curse_pt->ch!=10) && (curse_pt->ch!=' ')
-			&& (curse_pt->ch!='	'))
-     { curse_pt = curse_pt->nxt; }
-    /* while white space, advance */
-    while ((curse_pt!=EOB) && ((curse_pt->ch==' ')
-			/* || (curse_pt->ch=='	') */ ) )
-     { curse_pt = curse_pt->nxt; }
-   } /*not_at_end_of_line*/
-  } /*ok*/
- } /*forward*/
- else
- { /*backward*/
-  if (curse_pt==txt_head->nxt)
-   {
-    printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-    printf("%c%c[%d;1H%c[7mBackup past top of buffer%c[m%c[1;1H",
-	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
-    printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
-    message_pending = 1;
-    reposition_cursor();
-   }
-  else
-  { /*ok*/
-   if (curse_pt->prv->ch=='\n')  /* If at front of line */
-    {curse_pt = curse_pt->prv; ln_flag = 1; curse_row = curse_row - 1;}
-   else
-   if (curse_pt->prv->ch=='	')      /* if at TAB */
-     {curse_pt = curse_pt->prv;}
-   else
-   { /*not_at_front_of_line*/
-    curse_pt = curse_pt->prv;
-    /* while white space, advance */
-    while ((curse_pt!=txt_head) &&
-	((curse_pt->ch==' ') /* || (curse_pt->ch=='	') */ ) )
-     { curse_pt = curse_pt->prv; }
-    /* while not white_space, advance */
-    while ((curse_pt!=txt_head)  && (curse_pt->ch!=10)
-	 && (curse_pt->ch!=' ') && (curse_pt->ch!='	'))
-    { curse_pt = curse_pt->prv; }
-    curse_pt = curse_pt->nxt;
+	tmp_pt = frame_top();
 
-   } /*not_at_front_of_line*/
-  } /*ok*/
- } /*backward*/
+	memset(scr_new, ' ', scr_rows * scr_cols);
 
-  compute_curse_col(curse_pt);
-  last_curse_col = rel_curse_col;
-  reposition_cursor();
-  if (ln_flag) ADJUST_DISPLAY();
-}
+	for (row = 0; (row < scr_rows) && (tmp_pt != EOB); row++)
+		{
+		for (tmp_pt = scr_hseek(tmp_pt, &rel_col); (tmp_pt != EOB) && (tmp_pt->ch != '\n'); tmp_pt = tmp_pt->nxt)
+			{
+			i = rel_col - hscroll;
+			rel_col += spaces(tmp_pt->ch, rel_col);
 
+			if ( rel_col - hscroll > ncols )
+				break;
 
+			if ( tmp_pt->ch != 9 )
+				for (cp = char_glyph(tmp_pt->ch, glyph); *cp; cp++)
+					SCR_CELL(scr_new, row, i++) = *cp;
+			}
 
+		/* On to the next line, past the part out of the view */
+		if ( (tmp_pt = col_eol(tmp_pt)) != EOB )
+			tmp_pt = tmp_pt->nxt;
+		}
 
-void screen_jump()
-{
- int i, old_curse_row;
- old_curse_row = curse_row;
- rel_curse_col = 0; last_curse_col = 0;
- curse_row = curse_row + 16 * direction;
+	if ( tmp_pt != EOB )
+		return;
 
- if (curse_row<0)
-  {
-   curse_row = 0;
-   printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-   printf("%c%c[%d;1H%c[7mBackup past top of buffer%c[m%c[1;1H",
-	   EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
-   printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
-   message_pending = 1;
-  }
- if (curse_row>last_row)
-  {
-   curse_row = last_row;
-   printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-   printf("%c%c[%d;1H%c[7mAdvance past bottom of buffer%c[m%c[1;1H",
-	   EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
-   printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
-   message_pending = 1;
-  }
+	if ( row >= scr_rows )
+		return;
 
- if (direction>0)
- {
-  for (i=old_curse_row; i<curse_row; i++)
-   move_pt_down_line( &curse_pt );
- }
- else
- {
-  for (i=old_curse_row; i>curse_row; i--)
-   move_pt_up_line( &curse_pt );
-  move_pt_begin_of_line( &curse_pt );
- }
+	sprintf(glyph, "[EOB ");
 
- ADJUST_DISPLAY();
-}
+	for (i = 0, cp = glyph; *cp && (i < ncols); )
+		SCR_CELL(scr_new, row, i++) = *(cp++);
 
+	for (cp = active_buffer_name; *cp && (i < ncols); )
+		SCR_CELL(scr_new, row, i++) = *(cp++);
 
+	if ( i < ncols )
+		SCR_CELL(scr_new, row, i) = ']';
+}
 
-void	jump_eol	(void)
+
+/*
+ * Lines inserted/deleted in the middle of the frame, or the frame moved by a few rows:
+ * the rows from the first changed one on are shifted by the terminal (ESC[nL, ESC[nM)
+ * if that puts more of them in place.
+ */
+void	scr_vshift	(void)
 {
+int	top, k, r, n, best = 0, nbest;
 
+	for (top = 0; (top < scr_rows) && !memcmp(&SCR_CELL(scr_cur, top, 0), &SCR_CELL(scr_new, top, 0), scr_cols); top++);
 
-	if (direction==1)
+	for (nbest = 0, r = top; r < scr_rows; r++)
+		nbest += !memcmp(&SCR_CELL(scr_cur, r, 0), &SCR_CELL(scr_new, r, 0), scr_cols);
+
+	for (k = top + 1 - scr_rows; k < scr_rows - top; k++)
 		{
-		if (curse_pt != EOB)
+		for (n = 0, r = (k > 0) ? top + k : top; k && (r < scr_rows) && (r - k < scr_rows); r++)
+			n += !memcmp(&SCR_CELL(scr_cur, r - k, 0), &SCR_CELL(scr_new, r, 0), scr_cols);
+
+		if ( n > nbest + 1 )
 			{
-			if (curse_pt->ch == '\n' )
-				{
-				curse_row = curse_row + direction;
-				move_pt_down_line( &curse_pt );
-				}
+			best = k;
+			nbest = n;
 			}
-		else
-			curse_row = last_row + 2;
-		}
-	else	{
-		curse_row = curse_row +  direction;
-		move_pt_up_line( &curse_pt );
 		}
 
-	move_pt_end_of_line( &curse_pt );
+	if ( !best )
+		return;
 
-	if (curse_row < 0)
-		{
-		curse_row = 0;
+	scr_goto(top, 0);
+	out_csi(abs(best), (best > 0) ? 'L' : 'M');
+	scr_shift(top, scr_rows, best);
+	scr_col = 0;
+}
 
-		printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-		printf("%c%c[%d;1H%c[7mBackup past top of buffer%c[m%c[1;1H",
-			EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
-		printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
 
-		message_pending = 1;
-		}
+/*
+ * Send the difference of scr_new against scr_cur: runs of changed cells are written over
+ * (short gaps of equal ones included), a tail which is blank now is erased by ESC[K.
+ */
+void	scr_update	(void)
+{
+char	*cur, *new;
+int	row, col, first, last, end, cend;
 
-	if (curse_row > last_row)
+	scr_row = -1;	/* The cursor may be anywhere - the first move is always sent */
+	scr_vshift();
+
+	for (row = 0; row < scr_rows; row++)
 		{
-		curse_row = last_row;
+		cur = &SCR_CELL(scr_cur, row, 0);
+		new = &SCR_CELL(scr_new, row, 0);
 
-		printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-		printf("%c%c[%d;1H%c[7mAdvance past bottom of buffer%c[m%c[1;1H",
-			EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
-		printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+		for (end = scr_cols; (end > 0) && (new[end - 1] == ' '); end--);
+		for (cend = scr_cols; (cend > 0) && (cur[cend - 1] == ' '); cend--);
 
-		message_pending = 1;
-		}
+		for (col = 0; col < end; )
+			{
+			if ( cur[col] == new[col] )
+				{
+				col++;
+				continue;
+				}
 
-	compute_curse_col(curse_pt);
-	last_curse_col = rel_curse_col;
+			for (first = last = col++; (col < end) && (col - last <= SCR_GAP); col++)
+				if ( cur[col] != new[col] )
+					last = col;
 
-	ADJUST_DISPLAY();
-}
+			if ( (row != scr_row) || (first != scr_col) )
+				scr_goto(row, first);
 
+			out_put(new + first, last + 1 - first);
+			scr_col = col = last + 1;
+			}
 
+		if ( cend > end )
+			{
+			if ( (row != scr_row) || (end != scr_col) )
+				scr_goto(row, end);
 
-void	jump_bol	(void)
-{
-	rel_curse_col = last_curse_col = 0;
+			OUT_STR(OUT_CLREOL);
+			}
 
-	if (direction==1)
-		{
-		curse_row = curse_row + direction;
-		move_pt_down_line( &curse_pt );
-		}
-	else	{
-		if (curse_pt->prv!=txt_head)
-			{
-			if (curse_pt->prv->ch==10)
-				{
-				curse_row = curse_row +  direction;
-				move_pt_up_line( &curse_pt );
-				}
-			}
-		else curse_row = -1;
-		}
-
-	move_pt_begin_of_line( &curse_pt );
-
-	if (curse_row < 0)
-		{
-		curse_row = 0;
-
-		printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-		printf("%c%c[%d;1H%c[7mBackup past top of buffer%c[m%c[1;1H",
-			EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
-		printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
-
-		message_pending = 1;
+		memcpy(cur, new, scr_cols);
 		}
+}
 
-	if (curse_row > last_row)
-		{
-		curse_row = last_row;
 
-		printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-		printf("%c%c[%d;1H%c[7mAdvance past bottom of buffer%c[m%c[1;1H",
-		   EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
-		printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
 
-		message_pending = 1;
-		}
+void resize(int verb)
+{
+ struct winsize ws;
 
-	ADJUST_DISPLAY();
+ /* The terminal is asked directly, on the input side first as stty does */
+ if ((ioctl(0, TIOCGWINSZ, &ws) != 0) && (ioctl(1, TIOCGWINSZ, &ws) != 0))
+  out_printf("Error: Getting size.\n");
+ else
+  {
+   if (ws.ws_row==0) out_printf("Error: Getting row size.\n"); else nrows = ws.ws_row;
+   if (ws.ws_col==0) out_printf("Error: Getting col size.\n"); else ncols = ws.ws_col-1;
+   if (verb) out_printf("Window_Size set to %d-rows, %d-cols\n", nrows, ncols );
+  }
 }
 
 
 
+/*
+ * SIGWINCH: the handler only writes a byte to winch_fd, edt_getc() waits on that pipe
+ * along with the terminal and lays the screen out again (screen_winch()).
+ */
+int	winch_fd[2] = { -1, -1 };
 
-int er_message	(void)
+void	winch_handler	(int sig)
 {
-	printf("ERROR: Non-decimal digit after percent-sign\n");
-	printf("	Percent-sign must be followed by three decimal digits.\n");
-	printf("	Percent-sign is special character for expressing non-printable\n");
-	printf("	characters as ASCII number.\n");
-	printf("	(To enter a 'real'-precent-sign, use %c037).\n", 37);
-	return -1;
-}
+int	err = errno;
+ssize_t	n;
 
+	(void) sig;
 
-/* Replace any %'s with ascii equivalents. */
-/* Returns 1 if substitution made, else returns zero, else returns -1 on error. */
-int replace_percents_with_ascii( char *word )
+	/* A full pipe already holds a wakeup, nothing else can be done in a handler */
+	n = write(winch_fd[1], "", 1);
+	(void) n;
+	errno = err;
+}
+
+void	winch_setup	(void)
 {
-int	i, j, k, replacement = 0;
+struct sigaction sa;
 
-	for (i = 0; (word[i] != '\0') && (replacement != -1); i++ )
+	if ( pipe2(winch_fd, O_NONBLOCK | O_CLOEXEC) )
 		{
-		if (word[i] == '%')
-			{
-			if ( !isdigit(word[i+1]) )
-				return	replacement = er_message();
+		winch_fd[0] = winch_fd[1] = -1;
+		return;
+		}
 
-			k = word[i+1] - '0';
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = winch_handler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGWINCH, &sa, NULL);
+}
 
-			if ( !isdigit(word[i+2]) )
-				return	replacement = er_message();
+/* Size changes are taken in, whether any came is returned */
+int	winch_drain	(void)
+{
+char	buf[64];
+int	n = 0;
 
-			k = 10 * k + word[i+2] - '0';
+	while ( (winch_fd[0] >= 0) && (read(winch_fd[0], buf, sizeof(buf)) > 0) )
+		n = 1;
 
-			if ( !isdigit(word[i+3]) )
-				return	replacement = er_message();
+	return	n;
+}
 
-			k = 10 * k + word[i+3] - '0';
 
-			word[i] = k;
 
-			/* Now move the rest of the characters down. */
-			j = i + 1;
-			do	{
-				word[j] = word[j+3];
-				j++;
-			} while (word[j-1] != '\0');
 
-			replacement = 1;
-			}
+/*
+ * Horizontal scrolling: the view follows the cursor column by half screens, it is not
+ * scrolled while the cursor fits without. Returns whether hscroll has changed, the frame
+ * must be composed again then.
+ */
+int	hview_fit	(void)
+{
+int	col = col_of( curse_pt ), old = hscroll, w = 1;
+
+	if ( (curse_pt != EOB) && (curse_pt->ch != '\n') )
+		w = spaces( curse_pt->ch, col );
+
+	if ( (col < hscroll) || (col + w - hscroll > ncols) )
+		{
+		if ( col + w <= ncols )
+			hscroll = 0;
+		else	hscroll = ((col - ncols / 2) / 8) * 8;
 		}
 
-	return replacement;
+	return	hscroll != old;
 }
 
-
-int	getctrl	(void)
+/* Screen column of the cursor, kept on the screen */
+int	hview_col	(void)
 {
-int	spkey = 0, letter, col, ch = EDT$K_ESC, getanother;
+	if ( rel_curse_col - hscroll > ncols - 1 )
+		return	ncols - 1;
 
-	for (letter = 0; letter < 19; letter++)
-		functkeys_table[letter][1] = 1;
+	if ( rel_curse_col < hscroll )
+		return	0;
 
-	col = 2;
-	do	{
-		getanother = 0;
+	return	rel_curse_col - hscroll;
+}
 
-		for (letter = 0; letter < 19; letter++)
-			if (functkeys_table[letter][1]==1)
-				{
-				if (ch == functkeys_table[letter][col])
-					{
-					if (functkeys_table[letter][col+1] == -1)
-						spkey = functkeys_table[letter][0];
-					else	getanother = 1;
-					}
-				else	functkeys_table[letter][1] = 0;
-				}
+void display_screen( int position_cursor )
+/* Input: new row position */
+{
+ if (scr_defer)		/* Drawn after the keys typed ahead */
+  return;
 
-		col++;
+ hview_fit();
 
-		if ( (spkey < 1000) && (getanother) && (col < 8) )
-			ch = getchar();
-	} while ( (spkey < 1000) && (getanother) && (col < 8) );
+ if (!scr_valid)	/* Nothing is known of the screen - start from a clear one */
+  {
+   OUT_STR(OUT_CLEAR);
+   memset(scr_cur, ' ', scr_rows * scr_cols);
+   scr_valid = 1;
+  }
 
-	return spkey;
-}
+ scr_compose();
+ scr_update();
 
+ if (position_cursor)
+  scr_goto( rel_curse_row, hview_col() );
+
+}
 
 
 
-void search()
+/* Gets curser pointing to proper position on screen */
+void reposition_cursor( )
 {
- int match, i, j1, j2, cntl=0, eos=0, new_row;
- char ch, s_strng[MAX_SRCH_STRING];
- struct __text__ *tmp_pt, *tmp_pt1;
+	rel_curse_row = curse_row - tframe_row;
 
- if (Gold)
- { /*Accept_strng*/
-  printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-  printf("%c[%d;1H%c[7mSearch for: ", EDT$K_ESC, nrows - 1, EDT$K_ESC);
-  i = 0;
-  do
-  {
-   ch  = getchar();  fprintf(jou_outfile,"%c",ch);
-   if (ch==13) ch = 10;
-   if (ch==EDT$K_ESC) cntl = 1;
-   srch_strng[i] = ch;   i = i + 1;  if (i==MAX_SRCH_STRING) eos = 1;
-   if ((ch==127) || (ch==8))    /* handle delete key */
-   { /*4*/
-    if (i>1)
-    { /*3*/
-     i = i - 2;
-     if (srch_strng[i]==9)	/* deleting a TAB */
-     { /*2*/
-      j1 = 5;
-     } /*2*/
-     else
-     if (srch_strng[i]==12)
-      j1 = 4;
-     else
-     if (srch_strng[i]==EDT$K_ESC)
-      j1 = 5;
-     else
-     if (srch_strng[i] < EDT$K_ESC)
-      j1 = 2;
-     else
-      j1 = 1;
-     for (j2=0; j2!=j1; j2++) printf("%c",8);
-     printf("%c[m",EDT$K_ESC);
-     for (j2=0; j2!=j1; j2++) printf(" ");
-     for (j2=0; j2!=j1; j2++) printf("%c",8);
-     printf("%c[7m",EDT$K_ESC);
-    } /*3*/
-    else
-    {
-     printf("%c",EDT$K_BELL);
-     i = 0;
-    }
-   } /*4*/
-   else
-   if (!cntl)
-   {
-    if (ch==9) printf("<TAB>"); else    print_char( ch );
-   }
-   else
-   {
-    int spkey;
+	scr_goto(rel_curse_row, hview_col());
+}
 
-    if (ch==EDT$K_ESC) spkey = getctrl();
 
-    if (spkey>=1000)
-     {
-      eos = 1;
-      if (spkey==1005) direction = 1;
-      if (spkey==1006) direction = -1;
-     }
 
-   }
-  } while (!eos);
-  printf("%c[m", EDT$K_ESC);
- } /*Accept_strng*/
+/* Gets curser pointing to given position in file */
+void position_curser( int nrow, int ncol )
+{
+int row, col;
+struct __text__ *tmp_pt;
 
- { /*Do_Search*/
-  if (srch_caps)	/* Capitolize the search string */
-  {
-   i=0;
-   while (srch_strng[i]!=EDT$K_ESC)
-    {s_strng[i] = cap_ch( srch_strng[i] ); i = i + 1;}
-   s_strng[i] = EDT$K_ESC;
-  }
-  match = 0;  tmp_pt = curse_pt;  new_row = curse_row;
-  while ((!match) && (((direction==-1) && (tmp_pt!=txt_head))  ||
-		((direction==1) && (tmp_pt!=EOB))))
-  {
-   i = 0;   tmp_pt1 = tmp_pt;
-   if (srch_caps)
-   {
-    while ((tmp_pt1!=txt_head) && (tmp_pt1!=EOB) &&
-	   (s_strng[i]==cap_ch(tmp_pt1->ch)) && (srch_strng[i]!=EDT$K_ESC))
-     { i = i + 1;  tmp_pt1 = tmp_pt1->nxt; }
-   }
-   else
-   {
-    while ((tmp_pt1!=txt_head) && (tmp_pt1!=EOB) &&
-	   (srch_strng[i]==tmp_pt1->ch) && (srch_strng[i]!=EDT$K_ESC))
-     { i = i + 1;  tmp_pt1 = tmp_pt1->nxt; }
-   }
-   if ((srch_strng[i]==EDT$K_ESC) && (tmp_pt!=curse_pt)) match = 1;
+	row = 0;
+	tmp_pt = txt_head->nxt;
 
-   if (!match)   /* If still no match, then advance pointer */
-   {
-    if (direction==1)
-     {
-      if (tmp_pt->ch==10) new_row = new_row + direction;
-      if (tmp_pt!=EOB) tmp_pt = tmp_pt->nxt;
-     }
-    else
-     {
-      if (tmp_pt!=txt_head) tmp_pt = tmp_pt->prv;
-      if (tmp_pt->ch==10) new_row = new_row + direction;
-     }
-   }
-  }
+	for (row = 0; (row < nrow) && (tmp_pt->nxt != EOB); tmp_pt = tmp_pt->nxt )
+		if (tmp_pt->ch == '\n')
+			row++;
 
-  if (!match)
-  {
-   printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-   printf("%c%c[%d;1H%c[K%c[7mString /", EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC);
-   i=0; while (srch_strng[i]!=EDT$K_ESC) {print_char(srch_strng[i]); i=i+1; }
-   printf("/ was not found%c[m",  EDT$K_ESC);
-   printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
-   reposition_cursor();
-   message_pending = 1;
-  }
-  else
-  {
-   if (Gold)
-   { /* Clear the message box */
-    printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-    printf("%c[%d;1H%c[K", EDT$K_ESC, nrows - 1, EDT$K_ESC );
-    printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
-   }
-   curse_pt = tmp_pt;
-   curse_row = new_row;
-   compute_curse_col(curse_pt);
-   last_curse_col = rel_curse_col;
-   ADJUST_DISPLAY();
-  }
- } /*Do_Search*/
+	for  (col = 0; (col < ncol) && (tmp_pt->nxt != EOB) && (tmp_pt->ch != '\n');
+	      col++, tmp_pt = tmp_pt->nxt );
 
- Gold = 0;
+	curse_pt = tmp_pt;
+	curse_row = row;
 }
 
 
+/* Leaves cursor pointing to end of previous line. */
+void move_pt_up_line( TEXT **tmp_pt )
+{
+	if ( (*tmp_pt) != txt_head->nxt )
+		*tmp_pt = col_bol( *tmp_pt );
 
+	if ( (*tmp_pt) != txt_head->nxt )
+		*tmp_pt = (*tmp_pt)->prv;
+}
 
-
-void	enter_ascii	(void)
+/* Leaves cursor pointing to first char in current line. */
+void move_pt_begin_of_line( TEXT **tmp_pt )
 {
-int	p = 0, cntl = 0, ascii_number = 0, eos = 0;
-char	ch;
+	if ( (*tmp_pt) == txt_head )
+		{
+		out_printf("ERROR1: ON TXT_HEAD\n");
+		exit(1);
+		}
 
-	printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-	printf("%c[%d;1H%c[7mEnter ASCII value in decimal: ", EDT$K_ESC, nrows - 1, EDT$K_ESC);
+	*tmp_pt = col_bol( *tmp_pt );
+}
 
-	do	{
-		ch  = getchar();
-		fprintf(jou_outfile, "%c", ch);
+/* Leaves cursor pointing to beginning of next line. */
+void move_pt_down_line( TEXT **tmp_pt )
+{
+	 while ( ((*tmp_pt)->ch != '\n') && ((*tmp_pt) != EOB) )
+		*tmp_pt = (*tmp_pt)->nxt;
 
-		if ( (cntl = (ch == EDT$K_ESC)) )
-			{
-			if ( (ch > 47) && (ch < 57) )
-				{
-				ascii_number = ascii_number * 10 + ch - '0';
-				printf("%c",ch);
-				}
-			else	printf("%c", EDT$K_BELL);
-			}
-		else	{
-			if (p == 2)
-				eos = ( (ch > '@') && (ch < 'E') );
+	 if ( (*tmp_pt) != EOB)
+		 *tmp_pt = (*tmp_pt)->nxt;
+}
 
-#if ((EDT$K_TERMTYPE == 2) || (EDT$K_TERMTYPE == 3))
-				if ( p == 2 )
-					eos = 1;
-#endif
+/* Leaves cursor pointing to end of current line. */
+void move_pt_end_of_line( TEXT **tmp_pt )
+{
+	*tmp_pt = col_eol( *tmp_pt );
+}
 
-			if ( p == 4)
-				eos = 1;
 
-			if ( (p == 1) && ((ch != '[') && (ch != 'O')) )
-				{
-				printf("%c", EDT$K_BELL);
-				cntl= p = 0;
-				}
-			else    p = p + 1;
-			}
-	} while (!eos);
+/* Moves curser right x-columns */
+void move_right( TEXT **tmp_pt, int x )
+{
+int	i = 0;
 
-	printf("%c[m", EDT$K_ESC);
-	/* Clear the message box */
-	printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-	printf("%c[%d;1H%c[K", EDT$K_ESC, nrows - 1, EDT$K_ESC );
-	printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+	for ( i = 0; (i != x) && ((*tmp_pt)->nxt!=EOB); i++, *tmp_pt = (*tmp_pt)->nxt);
+}
 
-	reposition_cursor();
+/*
+ * Prints the row from tmp_pt on; the terminal cursor is where tmp_pt is shown, or at the
+ * first column if tmp_pt is left of the view.
+ */
+void spew_line( TEXT *tmp_pt )
+{
+int	rel_col, skip, i;
 
-	if ( ascii_number > 255)
-		printf("%c",EDT$K_BELL);
-	else	{
-		if ( ascii_number == '\r' )
-			ascii_number = '\n';
+	if (tmp_pt == EOB)
+		{
+		scr_eob();
+		return;
+		}
 
-		insert_char( ascii_number, &curse_pt );
-		INSERT_CHAR_INLINE(ascii_number);
+	if ( (tmp_pt->prv == txt_head) || (tmp_pt->prv->ch == '\n') )
+		rel_col = 0;
+	else	rel_col = col_of( tmp_pt );
+
+	for (skip = (rel_col < hscroll); (tmp_pt != EOB) && (tmp_pt->ch != '\n') && (rel_col - hscroll < ncols); tmp_pt = tmp_pt->nxt)
+		{
+		i = rel_col;
+		rel_col = spaces( tmp_pt->ch, rel_col ) + rel_col;
+
+		if ( (i >= hscroll) && (rel_col - hscroll <= ncols) )
+			{
+			if ( skip )
+				scr_goto(scr_row, i - hscroll);
+
+			skip = 0;
+			scr_char(tmp_pt->ch);
+			}
 		}
 }
-/**/
 
 
 
-void	handle_key	(char ch)
+void	compute_curse_col( TEXT *cursor_ptr )
 {
-int	ch_index, old_ch, letter, col, getanother, spkey;
-TEXT	*txt_tmp2;
+	rel_curse_col = col_of( cursor_ptr );
+}
 
-	if (message_pending == 1)
-		{ /* Clear the message box */
-		printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
-		printf("%c[%d;1H%c[K", EDT$K_ESC, nrows - 1, EDT$K_ESC );
-		printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
 
-		reposition_cursor();
-		}
+void  adjust_screen_parameters()
+{
+	col_reset();		/* After bulk changes */
+	compute_curse_col(curse_pt);
+	last_curse_col =  rel_curse_col;
 
+	if (curse_row < tframe_row + 6)    /* If cursor is above work area */
+		{ /*above*/
+		if ( 0 > (tframe_row = curse_row - 6) )
+			tframe_row = 0;    /* If new top row is above TOB, set */
+		} /*above*/
+	else if (curse_row > tframe_row + nrows - 10)
+		{ /*below*/                          /* If cursor is below work area */
+		tframe_row = curse_row - nrows + 10;
+				  /* If new bottom row is below EOB, set to EOB */
+		if (tframe_row + nrows - 3 > last_row)
+			tframe_row = last_row - nrows + 3;
 
-	for (spkey = 0, letter = 0; letter < 19; letter++)
-		functkeys_table[letter][1] = 1;
+		if (tframe_row < 0)
+			tframe_row = 0;
+		} /*below*/
 
-	col = 2;
+	rel_curse_row = curse_row - tframe_row;
+	tframe_pt = NULL;	/* Moved by the cursor */
+}
 
-	do	{
-		for (getanother = letter = 0; letter < 19; letter++)
-			{
-			if (functkeys_table[letter][1]==1)
-				{
-				if (ch == functkeys_table[letter][col])
-					{
-					if (functkeys_table[letter][col+1] == -1)
-						spkey = functkeys_table[letter][0];
-					else	getanother = 1;
-					}
-				else	functkeys_table[letter][1] = 0;
-				}
-			}
+/**/
 
-	/* printf("COL=%d spkey=%d  getanother=%d\n", col, spkey, getanother); */
+/* Use this when a line deletion has caused screen to scroll up */
+/* (Call this after deleting the line on the screen, but before */
+/*  actually deleting any characters from the file, or changing */
+/*  any of the row or column, or last_row pointers.)		*/
+void REPLACE_BOTTOM_LINE( int fswitch )
+{
+int	i, bottom_row;
+TEXT	*tmp_pt1;
 
-	col++;
+	/*get pointer to 1st char in bottom line of current screen*/
+	if ( ! (last_row > (bottom_row = tframe_row + nrows - 3)) )
+		return;
 
-	if ( (spkey < 1000) && (getanother) && (col < 8) )
-		ch = getchar();
-	} while ( (spkey < 1000) && (getanother) && (col < 8) );
+	tmp_pt1 = curse_pt;
 
-	ctrl = !(spkey == 0);
+	if (curse_row < bottom_row)
+		for (i=curse_row; i!=bottom_row; i++) move_pt_down_line( &tmp_pt1 );
+	else	for (i=curse_row; i!=bottom_row; i--) move_pt_up_line( &tmp_pt1 );
 
- if (!ctrl)
-  { /*notcntrl*/
-    /*If valid ascii, enque it into file.*/
-    Gold = 0;
-    if (ch==23) display_screen(1);
-    else
-    if ((ch==127) || (ch==8))
-     { /*deletechar*/
-	DELETE_CHAR_BACKWARD();
-	Mark = 0;		/* <<<==== For safety, for now.  Need to guard against deleting the marked character. */
-     } /*deletechar*/
-    else
-     {
-      if (ch==13) { ch = 10; }
-      insert_char( ch, &curse_pt );
-      INSERT_CHAR_INLINE(ch);
-      Mark = 0;			/* <<<==== For safety, for now.  Need to guard against deleting the marked character. */
-     }
-  } /*notcntrl*/
- else
-  { /*cntrl*/
+	if (bottom_row>last_row)
+		bottom_row = last_row;
 
-    switch (spkey)
-    {
-     case 1016:	/*down*/
-		Gold = 0;
-		down_arrow();
-	break;
-     case 1017:	/*right*/
-		Gold = 0;
-		right_arrow();
-	break;
-     case 1018:	/*left*/
-		Gold = 0;
-		left_arrow();
-	break;
-     case 1015:	/*up*/
-		Gold = 0;
-		up_arrow();
-	break;
+	scr_goto(nrows - 3, 0);
 
-     case 1002:  /* Delete by Line key */
-		DELETE_LINE_FORWARD();
-		Mark = 0;
-	break;
-     case 1008:  /* Delete by Word key */
-		DELETE_WORD_FORWARD();
-		Mark = 0;
-	break;
-     case 1000:  /* GOLD */
-		Gold = 1;
-	break;
-     case 1003:	/* Jump by Page / Reformat Paragraph */
-		if (Gold)
-		{
-		 if (Mark)
-		 { /*Re-format*/
+	if (fswitch)
+		move_pt_down_line( &tmp_pt1 );
 
-		   /* First decide direction work in. */
+	spew_line( tmp_pt1 );
+}
 
-		   if (mark_pt1!=curse_pt)  /* Don't do anything, if curse_pt is on mark. */
-		   { /*ok2reformat*/
-		   if ((mark_row<curse_row) || ((curse_row==mark_row) && (mark_col<last_curse_col)))
-		    { /*forward*/
 
-		      /* First get txt_tmp to first white-space. */
-		      txt_tmp = mark_pt1;
-		      while ((txt_tmp!=curse_pt) && (txt_tmp->ch!=10) &&
-				(txt_tmp->ch!=' ') && (txt_tmp->ch!='	'))
-			 txt_tmp = txt_tmp->nxt;
 
+void scroll_window_up( int old_tframe_row )
+{
+int i;
+TEXT	*tmp_pt1;
 
-		      while (txt_tmp!=curse_pt)
-		      { /*loop*/
+  /*get pointer to 1st char in top line of current screen*/
+  tmp_pt1 = curse_pt;
+  if (curse_row<old_tframe_row)
+   for (i=curse_row+1; i!=old_tframe_row; i++) move_pt_down_line( &tmp_pt1 );
+  else
+   for (i=curse_row+1; i!=old_tframe_row; i--) move_pt_up_line( &tmp_pt1 );
+  for (i=old_tframe_row; i>tframe_row; i--)    /* scroll up by        */
+   {						/*  inserting lines at top */
+    scr_goto(0, 0);  scr_revindex();
+    move_pt_begin_of_line( &tmp_pt1 );
+    tframe_pt = tmp_pt1;
+    spew_line( tmp_pt1 );
+    move_pt_up_line( &tmp_pt1 );
+   }
+}
 
-		       /* Next get txt_tmp2 to end of next word, changing <cr>s to spaces. */
-		       txt_tmp2 = txt_tmp;  old_ch = ' ';
-		       while ((txt_tmp2!=curse_pt) && ((txt_tmp2->ch==10) ||
-				(txt_tmp2->ch==' ') || (txt_tmp2->ch=='	')))
-			{
-			 if ((txt_tmp2->ch==10) && (txt_tmp2->nxt->ch!=10) && (old_ch!=10))
-			  if (EOB->prv!=txt_tmp2)
-			  { txt_tmp2->ch=' '; last_row = last_row - 1; curse_row = curse_row - 1; }
-			 old_ch = txt_tmp2->ch;
-			 txt_tmp2 = txt_tmp2->nxt;
-			}
-		       /* Now txt_tmp2 points to first char of next word. */
-		       /* Now, get it to the end of that word. */
-		       while ((txt_tmp2!=curse_pt) && (txt_tmp2->ch!=10) &&
-				(txt_tmp2->ch!=' ') && (txt_tmp2->ch!='	'))
-			{
-			 txt_tmp2 = txt_tmp2->nxt;
-			}
 
-		       /* Now txt_tmp2 points to (after) end of next word, or curse_pt. */
-		       if (txt_tmp2!=curse_pt)
-		       {
-			txt_tmp2 = txt_tmp2->prv;
-			compute_curse_col( txt_tmp2 );
-			if (rel_curse_col>right_margin)
-			 {
-			  txt_tmp->ch = 10;  last_row = last_row + 1; curse_row = curse_row + 1;
-			  txt_tmp = txt_tmp->nxt;
-			  /* Delete intervening white-space. */
-			  while ((txt_tmp->ch==' ') || (txt_tmp->ch=='	'))
-			   {
-			     txt_tmp = txt_tmp->nxt;
-			     delete_char( txt_tmp->prv );
-			   }
-			 }
-			txt_tmp = txt_tmp2->nxt;
-		       } else txt_tmp = txt_tmp2;
-		      } /*loop*/
+void scroll_window_down( int old_tframe_row )
+{
+ int i, bottom_row, new_bottom_row;
+ struct __text__ *tmp_pt1;
 
-		    } /*forward*/
-		   else
-		    { /*backward*/
+ /*get pointer to 1st char in bottom line of current screen*/
+ bottom_row = old_tframe_row + nrows - 3;
+ if (bottom_row>last_row) bottom_row = last_row;
+ tmp_pt1 = curse_pt;
+ if (curse_row < bottom_row)
+  for (i=curse_row; i!=bottom_row; i++) move_pt_down_line( &tmp_pt1 );
+ else
+  for (i=curse_row; i!=bottom_row; i--) move_pt_up_line( &tmp_pt1 );
+ new_bottom_row = tframe_row + nrows - 3;
+ if (new_bottom_row>last_row) new_bottom_row = last_row;
+ for (i=bottom_row; i!=new_bottom_row; i++)     /*scroll up by     */
+  {				 	     /* inserting lines at bottom */
+   scr_goto(nrows - 3, 0);  scr_newline();
+   move_pt_down_line( &tmp_pt1 );
+   spew_line( tmp_pt1 );
+  }
+ if (tframe_pt)		/* The top of the frame goes down by as much */
+  for (i=old_tframe_row; i<tframe_row; i++) move_pt_down_line( &tframe_pt );
+}
+
+
+
+void ADJUST_DISPLAY()
+/* Input:  curse_row, (the prevaling tframe_row), and last_row */
+{
+ int old_tframe_row;
+
+ old_tframe_row = tframe_row;
+
+ if (curse_row < old_tframe_row + 6)	/* If cursor is above work area */
+  { /*above*/
+   tframe_row = curse_row - 6;
+   if (tframe_row<0) tframe_row = 0;	/* If new top row is above TOB, */
+					/*			set to TOB */
+   if (tframe_row != old_tframe_row)
+   { /*ok*/
+    if (old_tframe_row - tframe_row < nrows - 6)
+     { /*1*/	/* Scroll-up until new tframe */
+      scroll_window_up( old_tframe_row );
+     } /*1*/
+    else
+     { /*redraw_screen_at_new_location*/
+      tframe_pt = NULL;
+      display_screen(0);
+     }
+   } /*ok*/
+
+  } /*above*/
+ else
+  if (curse_row > old_tframe_row + nrows - 10)
+   { /*below*/				/* If cursor is below work area */
+    tframe_row = curse_row - nrows + 10;
+				/* If new bottom row is below EOB, set to EOB */
+    if (tframe_row + nrows - 3 > last_row) tframe_row = last_row - nrows + 3;
+    if (tframe_row<0) tframe_row = 0;
+
+    if (tframe_row != old_tframe_row)
+    {
+     if (abs(tframe_row - old_tframe_row) < nrows - 5)
+      { /*2*/	/* Scroll-down until new bottom row */
+       if (tframe_row > old_tframe_row)
+	{
+	 /* if (curse_pt!=EOB) if (curse_pt->nxt!=EOB) */
+	  scroll_window_down( old_tframe_row );
+	}
+       else
+	scroll_window_up( old_tframe_row );
+      } /*2*/
+     else
+      { /*redraw_screen_at_new_location*/
+       tframe_pt = NULL;
+       display_screen(0);
+      }
+    }
+
+   } /*below*/
+
+ reposition_cursor();
+} /*ADJUST_DISPLAY*/
+
+
+/**/
+
+/*Device Dependent Screen Operations*/
+/*for vt100*/
+void INSERT_CHAR_INLINE( char ch )
+{
+ if (ch==10)			/* If inserting a new line: */
+  {
+    curse_row = curse_row + 1;
+    last_row = last_row + 1;
+    if (curse_row-tframe_row<nrows-2)  /* If not at very bottom of screen */
+     { scr_clreol();  scr_newline(); } /* Erase to EOLN and move cursor */
+					/*  to 1st position on next line */
+    if (curse_row-tframe_row<nrows-3)  /* If not at bottom of screen */
+    {
+     scr_insline();			 /* Insert New Line */
+    }
+    else
+     scr_clreol();
+
+    if (curse_row-tframe_row<nrows-2)  /* If not at very bottom of screen */
+     spew_line( curse_pt );	/* Spew line from the new char */
+  }
+ else
+  {
+   scr_clreol();	/* Clr to EOLN */
+   if (curse_pt==EOB)
+   {
+    insert_char( 10, &curse_pt );
+    curse_pt = curse_pt->prv;
+    if (curse_row-tframe_row<nrows-3)  /* If not at bottom of screen */
+     {
+      scr_clreol();  scr_newline();  scr_eob();  scr_up();  scr_left(6 + strlen(active_buffer_name));
+     }
+    else scr_clreol();
+    last_row = last_row + 1;
+    ch = 10;
+   }
+   spew_line( curse_pt->prv );	/* Spew line from the new char */
+  }
+ compute_curse_col(curse_pt);
+ reposition_cursor();
+ last_curse_col = rel_curse_col;
+ if (ch==10) ADJUST_DISPLAY();
+}
+
+/*END Device Dependent Screen Operations*/
+/*for vt100*/
+
+
+/**/
+
+
+void DELETE_CHAR_BACKWARD()
+{
+ struct __text__ *tmp_pt;
+ int do_delete;
+ char tmp_ch;
+
+ if (curse_pt != txt_head->nxt)
+  {
+   if ((curse_pt==EOB) && (curse_pt->prv!=txt_head->nxt))
+    if ((curse_pt->prv->prv->ch!=10) && (curse_pt->prv!=txt_head->nxt))
+    {
+     curse_pt = curse_pt->prv;
+     curse_row = curse_row - 1;
+     compute_curse_col(curse_pt);
+     reposition_cursor();
+     last_curse_col = rel_curse_col;
+     do_delete = 0;
+    }
+    else
+     do_delete = 1;
+   else
+    do_delete = 1;
+
+   if (do_delete)
+   {
+    tmp_pt = curse_pt->prv;
+    tmp_ch = tmp_pt->ch;
+    ch_buf = tmp_ch;
+    if (tmp_ch == 10)	/* If deleting a <CR>: */
+    {
+     scr_delline();
+     REPLACE_BOTTOM_LINE(1);
+     curse_row = curse_row - 1;  rel_curse_row = rel_curse_row - 1;
+     last_row = last_row - 1;
+    }
+    delete_char( tmp_pt );
+    compute_curse_col(curse_pt);
+    reposition_cursor();
+    scr_clreol();		/* clear to EOLN */
+    spew_line( curse_pt );
+    reposition_cursor();
+    last_curse_col = rel_curse_col;
+    if (tmp_ch == 10)	/* If deleting a <CR>: */
+     ADJUST_DISPLAY();
+   }
+  }
+ else
+  {
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+    out_printf("%c%c[%d;1H%c[7mBackup past top of buffer%c[m%c[1;1H",
+	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+    message_pending = 1;
+    reposition_cursor();
+  }
+}
+
+
+
+
+void DELETE_CHAR_FORWARD()
+{
+ struct __text__ *tmp_pt;
+ char tmp_ch;
+
+ if (curse_pt != EOB)
+  {
+    tmp_pt = curse_pt;
+    curse_pt = curse_pt->nxt;
+    tmp_ch = tmp_pt->ch;
+    ch_buf = tmp_ch;
+    if ((tmp_ch==10) && (curse_pt==EOB) && (tmp_pt->prv!=txt_head)
+	&& (tmp_pt->prv->ch!=10))
+    {
+     curse_row = curse_row + 1;
+    }
+    else
+    {
+     if (tmp_ch == 10)	/* If deleting a <CR>: */
+     {
+      scr_newline();  scr_delline();
+      REPLACE_BOTTOM_LINE(0);
+      last_row = last_row - 1;
+     }
+     delete_char( tmp_pt );
+    }
+    compute_curse_col(curse_pt);
+    reposition_cursor();
+    scr_clreol();		/* clear to EOLN */
+    spew_line( curse_pt );
+    reposition_cursor();
+    last_curse_col = rel_curse_col;
+    if (tmp_ch == 10)	/* If deleting a <CR>: */
+     ADJUST_DISPLAY();
+  }
+ else
+  {
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+    out_printf("%c%c[%d;1H%c[7mAdvance past top of buffer%c[m%c[1;1H",
+	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+    message_pending = 1;
+    reposition_cursor();
+  }
+}
+
+
+
+
+void DELETE_WORD_FORWARD()
+{
+ struct __text__ *tmp_pt;
+
+if (!Gold)
+{ /*!Gold*/
+ if (curse_pt != EOB)
+  {
+
+   /* Free anything on word_buf. */
+   while (word_buf!=0) { txt_tmp = word_buf; word_buf = word_buf->nxt; dispose_ch( txt_tmp ); }
+
+   if ((curse_pt->ch==10) || (curse_pt->ch=='	'))
+    {
+     push_buffer( curse_pt->ch, &word_buf );
+     DELETE_CHAR_FORWARD();
+    }
+   else
+    { /*Not_starting_at_CR_or_TAB*/
+     /* Find EOW */
+     tmp_pt = curse_pt;
+     /* while not white_space, advance */
+     while ((tmp_pt!=EOB) && (tmp_pt->ch!=10) && (tmp_pt->ch!=' ')
+			&& (tmp_pt->ch!='	'))   tmp_pt = tmp_pt->nxt;
+     while ((tmp_pt!=EOB) && (tmp_pt->ch==' '))  tmp_pt = tmp_pt->nxt;
+     tmp_pt = tmp_pt->prv;
+
+     /* push and delete from EOW upto and including curse_pt. */
+     while (tmp_pt!=curse_pt)
+      {
+       push_buffer( tmp_pt->ch, &word_buf );
+       tmp_pt = tmp_pt->prv;
+       delete_char( tmp_pt->nxt );
+      }
+     push_buffer( curse_pt->ch, &word_buf );
+     curse_pt = curse_pt->prv;
+     delete_char( curse_pt->nxt );
+     curse_pt = curse_pt->nxt;
+
+     compute_curse_col(curse_pt);
+     reposition_cursor();
+     scr_clreol();         /* clear to EOLN */
+     spew_line( curse_pt );
+     reposition_cursor();
+     last_curse_col = rel_curse_col;
+    } /*Not_starting_at_CR_or_TAB*/
+
+  }
+ else
+  {
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+    out_printf("%c%c[%d;1H%c[7mAdvance past top of buffer%c[m%c[1;1H",
+	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+    message_pending = 1;
+    reposition_cursor();
+  }
+ } /*!Gold*/
+else
+ { /*Gold*/	/* Undelete word */
+
+  tmp_pt = curse_pt->prv;
+
+  if (word_buf!=0)
+  { /*word_buf_not_empty*/
+
+   txt_tmp = word_buf;
+   while (txt_tmp!=0)
+    {
+     insert_char( txt_tmp->ch, &curse_pt );
+     txt_tmp = txt_tmp->nxt;
+    }
+
+  if (curse_pt->prv->ch == 10)
+  {
+    last_row = last_row + 1;
+    if (curse_row-tframe_row<nrows-2)	/* If not at very bottom of screen */
+     { scr_clreol();  scr_newline(); } 	/* Erase to EOLN and move cursor */
+					/*  to 1st position on next line */
+    if (curse_row-tframe_row < nrows-3)	/* If not at bottom of screen */
+    {
+     scr_insline();                  /* Insert New Line */
+    }
+    else
+     scr_clreol();
+
+    if (curse_row-tframe_row<nrows-2)  /* If not at very bottom of screen */
+     spew_line( curse_pt );     /* Spew line from the new char */
+    if (curse_row-tframe_row < nrows-2) scr_up();
+
+  }
+  else
+  if (curse_pt==EOB)
+   {
+    insert_char( 10, &curse_pt );
+    curse_pt = curse_pt->prv;
+    if (curse_row-tframe_row<nrows-3)  /* If not at bottom of screen */
+    {
+     scr_clreol();  scr_newline();  scr_eob();  scr_up();  scr_left(6 + strlen(active_buffer_name));
+    }
+    else scr_clreol();
+    last_row = last_row + 1;
+
+   }
+
+   curse_pt = tmp_pt->nxt;
+   compute_curse_col(curse_pt);
+   reposition_cursor();
+   last_curse_col = rel_curse_col;
+
+   scr_clreol();  /* Clr to EOLN */
+   spew_line( curse_pt );  /* Spew line from the new char */
+   reposition_cursor();
+   ADJUST_DISPLAY();
+
+  } /*word_buf_not_empty*/
+
+  Gold = 0;
+ } /*Gold*/
+}
+
+
+
+void DELETE_LINE_FORWARD()
+{
+ struct __text__ *tmp_pt;
+
+if (!Gold)
+{ /*!Gold*/
+ if (curse_pt != EOB)
+  {
+
+   /* Free anything on line_buf. */
+   while (line_buf!=0) { txt_tmp = line_buf; line_buf = line_buf->nxt; dispose_ch( txt_tmp ); }
+
+   /* Find EOL */
+   tmp_pt = curse_pt;
+   while ((tmp_pt!=EOB) && (tmp_pt->ch!=10)) tmp_pt = tmp_pt->nxt;
+
+   /* push and delete from EOL upto and including curse_pt. */
+   while (tmp_pt!=curse_pt)
+    {
+     push_buffer( tmp_pt->ch, &line_buf );
+     tmp_pt = tmp_pt->prv;
+     delete_char( tmp_pt->nxt );
+    }
+   push_buffer( curse_pt->ch, &line_buf );
+   curse_pt = curse_pt->prv;
+   delete_char( curse_pt->nxt );
+   curse_pt = curse_pt->nxt;
+
+   scr_newline();  scr_delline();
+   REPLACE_BOTTOM_LINE(0);
+   last_row = last_row - 1;
+
+   compute_curse_col(curse_pt);
+   reposition_cursor();
+   scr_clreol();         /* clear to EOLN */
+   spew_line( curse_pt );
+   reposition_cursor();
+   last_curse_col = rel_curse_col;
+  }
+ else
+  {
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+    out_printf("%c%c[%d;1H%c[7mAdvance past top of buffer%c[m%c[1;1H",
+	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+    message_pending = 1;
+    reposition_cursor();
+  }
+ } /*!Gold*/
+else
+ { /*Gold*/     /* Undelete line */
+  tmp_pt = curse_pt->prv;
+
+  if (line_buf!=0)
+  { /*line_buf_not_empty*/
+
+   txt_tmp = line_buf;
+   while (txt_tmp!=0)
+    {
+     insert_char( txt_tmp->ch, &curse_pt );
+     txt_tmp = txt_tmp->nxt;
+    }
+
+   last_row = last_row + 1;
+
+   if (curse_row-tframe_row < nrows-2)	/* If not at very bottom of screen */
+    {
+     scr_clreol();  scr_newline();	/* Erase to EOLN and move cursor */
+					/*  to 1st position on next line */
+     if (curse_row-tframe_row < nrows-3)  /* If not at bottom of screen */
+       scr_insline();        /* Insert New Line */
+     else
+       scr_clreol();
+
+     spew_line( curse_pt );     /* Spew line from the new char */
+    }
+
+   if (curse_pt==EOB)
+    {
+     curse_pt = curse_pt->prv;
+    }
+
+   curse_pt = tmp_pt->nxt;
+   compute_curse_col(curse_pt);
+   reposition_cursor();
+   last_curse_col = rel_curse_col;
+
+   scr_clreol();  /* Clr to EOLN */
+   spew_line( curse_pt );  /* Spew line from the new char */
+   reposition_cursor();
+   ADJUST_DISPLAY();
+
+  } /*line_buf_not_empty*/
+  Gold = 0;
+ } /*Gold*/
+}
+
+
+
+
+
+void left_arrow()
+{
+  if (curse_pt!=txt_head->nxt)
+   {
+    curse_pt = curse_pt->prv;
+    if (curse_pt->ch==10) curse_row = curse_row - 1;
+    compute_curse_col(curse_pt);
+    last_curse_col = rel_curse_col;
+    reposition_cursor();
+    if (curse_pt->ch==10) ADJUST_DISPLAY();
+   }
+  else
+   {
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+    out_printf("%c%c[%d;1H%c[7mBackup past top of buffer%c[m%c[1;1H",
+	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+    message_pending = 1;
+    reposition_cursor();
+   }
+}
+
+
+void up_arrow()
+{
+  curse_row = curse_row - 1;
+  if (curse_row < 0)
+   {
+    curse_row = 0;
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+    out_printf("%c%c[%d;1H%c[7mBackup past top of buffer%c[m%c[1;1H",
+	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+    reposition_cursor();
+    message_pending = 1;
+   }
+  else
+   {
+    /*Get curser to end of previous line, Then to begining of that line, */
+    /* then try to move to last_curse_col */
+    move_pt_up_line( &curse_pt );
+    move_pt_begin_of_line( &curse_pt );
+    curse_pt = col_seek( curse_pt, last_curse_col, &rel_curse_col );
+    reposition_cursor();
+    ADJUST_DISPLAY();
+   }
+}
+
+
+
+void right_arrow()
+{
+
+  if (curse_pt!=EOB)
+   {
+    if (curse_pt->ch==10) curse_row = curse_row + 1;
+    curse_pt = curse_pt->nxt;
+    compute_curse_col(curse_pt);
+    last_curse_col = rel_curse_col;
+    reposition_cursor();
+    if (curse_pt->prv->ch==10) ADJUST_DISPLAY();
+   }
+  else
+   {
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+    out_printf("%c%c[%d;1H%c[7mAdvance past bottom of buffer%c[m%c[1;1H",
+	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+    reposition_cursor();
+    message_pending = 1;
+   }
+}
+
+
+void down_arrow()
+{
+  /*Get curser to begining of next line, Then try to move to last_curse_col */
+  if (curse_pt==EOB)
+   {
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+    out_printf("%c%c[%d;1H%c[7mAdvance past bottom of buffer%c[m%c[1;1H",
+	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+    reposition_cursor();
+    message_pending = 1;
+   }
+  else
+  {
+   curse_row = curse_row + 1;
+   move_pt_end_of_line( &curse_pt );
+   curse_pt = curse_pt->nxt;
+    curse_pt = col_seek( curse_pt, last_curse_col, &rel_curse_col );
+    reposition_cursor();
+    ADJUST_DISPLAY();
+  }
+}
+
+
+
+
+
+char cap_ch( char ch )	/* Like toupper. */
+{
+ if ((ch>96) && (ch<123)) ch = ch - 32;
+ return ch;
+}
+
+
+
+
+
+/* This routine determines if curse_pt is aligned at the start of a match to the search-string in the text buffer. */
+/* Returns '1' if so, else returns '0'. */
+int srch_match()
+{
+ int i;
+ char s_strng[512];
+ struct __text__ *tmp_pt1;
+
+  if (srch_caps)        /* Capitolize the search string */
+  {
+   i=0;
+   while (srch_strng[i] != EDT$K_ESC)
+    {s_strng[i] = cap_ch( srch_strng[i] ); i = i + 1;}
+   s_strng[i] = EDT$K_ESC;
+  }
+
+  tmp_pt1 = curse_pt;
+
+  i = 0;
+  if (srch_caps)
+  {
+   while ((tmp_pt1 != EOB) && (s_strng[i] == cap_ch(tmp_pt1->ch)) && (srch_strng[i] != EDT$K_ESC))
+    { i = i + 1;  tmp_pt1 = tmp_pt1->nxt; }
+  }
+  else
+  {
+   while ((tmp_pt1 != EOB) && (srch_strng[i] == tmp_pt1->ch) && (srch_strng[i] != EDT$K_ESC))
+    { i = i + 1;  tmp_pt1 = tmp_pt1->nxt; }
+  }
+  if ((srch_strng[i] == EDT$K_ESC) && (tmp_pt1 != curse_pt)) return 1; else return 0;
+}
+
+
+
+
+void CAPITOLIZE_CHAR()
+{
+ char ch;
+ int ch_index, still_online;
+ struct __text__ *tmp_pt1;
+
+ if ((Mark) && (mark_pt1!=curse_pt))
+ {
+   /* First decide direction to change-caps in. */
+   if ((mark_row<curse_row) || ((curse_row==mark_row) && (mark_col<last_curse_col)))
+     { /*change_backward*/  /* Change back-up to mark, from left of cursor. */
+       tmp_pt1 = curse_pt->prv;  /* Cursor stays where it is. */
+       still_online = 1;
+       while (tmp_pt1!=mark_pt1->prv)
+	{
+	 if ((tmp_pt1->ch>64) && (tmp_pt1->ch<91)) tmp_pt1->ch = tmp_pt1->ch + 32;
+	 else
+	 if ((tmp_pt1->ch>96) && (tmp_pt1->ch<123)) tmp_pt1->ch = tmp_pt1->ch - 32;
+	 TXT_MODIFY(tmp_pt1);
+	 if (tmp_pt1->ch==10) still_online = 0;
+	 tmp_pt1 = tmp_pt1->prv;
+	 if (tmp_pt1==txt_head) {out_printf("SEVERE_ERROR: BOB\n"); /* tmp_pt1=mark_pt1->prv; */}
+	}
+       display_screen(1);
+     } /*change_backward*/
+    else
+     { /*change_forward*/   /* Change back-up to cursor, from mark. */
+       tmp_pt1 = mark_pt1->prv;
+       while (tmp_pt1!=curse_pt->prv)
+	{
+	 if ((tmp_pt1->ch>64) && (tmp_pt1->ch<91)) tmp_pt1->ch = tmp_pt1->ch + 32;
+	 else
+	 if ((tmp_pt1->ch>96) && (tmp_pt1->ch<123)) tmp_pt1->ch = tmp_pt1->ch - 32;
+	 TXT_MODIFY(tmp_pt1);
+	 if (tmp_pt1->ch==10) still_online = 0;
+	 tmp_pt1 = tmp_pt1->prv;
+	 if (tmp_pt1==txt_head) {out_printf("SEVERE_ERROR: BOB\n"); /* tmp_pt1=mark_pt1; */}
+	}
+       display_screen(1);
+     } /*change_forward*/
+    // Mark = 0;  	/* Safe to keep marked. */
+ }
+ else
+ /* Check if you are positioned at front of match to search_string. */
+ if ((srch_match()) && (!((srch_strng[0]==' ') && (srch_strng[1]==EDT$K_ESC))))
+ {
+   ch_index = 0;  still_online = 1;
+   tmp_pt1 = curse_pt;
+   while (srch_strng[ch_index]!=EDT$K_ESC)
+    {
+     if ((tmp_pt1->ch>64) && (tmp_pt1->ch<91)) tmp_pt1->ch = tmp_pt1->ch + 32;
+     else
+     if ((tmp_pt1->ch>96) && (tmp_pt1->ch<123)) tmp_pt1->ch = tmp_pt1->ch - 32;
+     TXT_MODIFY(tmp_pt1);
+     if (tmp_pt1->ch==10) still_online = 0;
+     tmp_pt1 = tmp_pt1->nxt;
+     ch_index = ch_index + 1;
+    }
+   if (still_online)
+    {
+     scr_clreol();  /* Clr to EOLN */
+     spew_line( curse_pt );  /* Spew line from the new char */
+     reposition_cursor();
+    }
+   else
+    display_screen(1);
+ }
+ else
+ if (direction==1)
+ { /*dir=1*/
+  if (curse_pt==EOB) ch = 0;
+  else ch = curse_pt->ch;
+  if ((ch>64) && (ch<91)) ch = ch + 32;
+  else
+  if ((ch>96) && (ch<123)) ch = ch - 32;
+  else ch = 0;
+  if (ch!=0)
+  {
+   curse_pt->ch = ch;
+   TXT_MODIFY(curse_pt);
+   scr_char(ch);
+   curse_pt = curse_pt->nxt;
+   compute_curse_col(curse_pt);
+   last_curse_col = rel_curse_col;
+   reposition_cursor();
+   changed++;
+  }
+  else right_arrow();
+ } /*dir=1*/
+ else
+ { /*dir=0*/
+  if (curse_pt==txt_head->nxt) ch = 0;
+  else ch = curse_pt->prv->ch;
+  if ((ch>64) && (ch<91)) ch = ch + 32;
+  else
+  if ((ch>96) && (ch<123)) ch = ch - 32;
+  else ch = 0;
+  if (ch!=0)
+  {
+   curse_pt->prv->ch = ch;
+   TXT_MODIFY(curse_pt->prv);
+   curse_pt = curse_pt->prv;
+   compute_curse_col(curse_pt);
+   reposition_cursor();
+   scr_char(ch);
+   last_curse_col = rel_curse_col;
+   reposition_cursor();
+   changed++;
+  }
+  else left_arrow();
+ } /*dir=0*/
+ Gold = 0;
+}
+
+
+
+
+void jump_by_word()
+{
+ int ln_flag = 0;
+
+ if (direction==1)
+ { /*forward*/
+  if (curse_pt==EOB)
+   {
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+    out_printf("%c%c[%d;1H%c[7mAdvance past bottom of buffer%c[m%c[1;1H",
+	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+    reposition_cursor();
+    message_pending = 1;
+   }
+  else
+  { /*ok*/
+   if (curse_pt->ch=='\n')  /* If at end of line */
+   {
+    curse_pt = curse_pt->nxt;
+    ln_flag = 1; curse_row = curse_row + 1;
+   }
+   else
+   if (curse_pt->ch=='	') 	/* if at TAB */
+     {curse_pt = curse_pt->nxt;}
+   else
+   { /*not_at_end_of_line*/
+    /* while not white_space, advance */
+    while ((curse_pt!=EOB) && (curse_pt->ch!=10) && (curse_pt->ch!=' ')
+			&& (curse_pt->ch!='	'))
+     { curse_pt = curse_pt->nxt; }
+    /* while white space, advance */
+    while ((curse_pt!=EOB) && ((curse_pt->ch==' ')
+			/* || (curse_pt->ch=='	') */ ) )
+     { curse_pt = curse_pt->nxt; }
+   } /*not_at_end_of_line*/
+  } /*ok*/
+ } /*forward*/
+ else
+ { /*backward*/
+  if (curse_pt==txt_head->nxt)
+   {
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+    out_printf("%c%c[%d;1H%c[7mBackup past top of buffer%c[m%c[1;1H",
+	    EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+    message_pending = 1;
+    reposition_cursor();
+   }
+  else
+  { /*ok*/
+   if (curse_pt->prv->ch=='\n')  /* If at front of line */
+    {curse_pt = curse_pt->prv; ln_flag = 1; curse_row = curse_row - 1;}
+   else
+   if (curse_pt->prv->ch=='	')      /* if at TAB */
+     {curse_pt = curse_pt->prv;}
+   else
+   { /*not_at_front_of_line*/
+    curse_pt = curse_pt->prv;
+    /* while white space, advance */
+    while ((curse_pt!=txt_head) &&
+	((curse_pt->ch==' ') /* || (curse_pt->ch=='	') */ ) )
+     { curse_pt = curse_pt->prv; }
+    /* while not white_space, advance */
+    while ((curse_pt!=txt_head)  && (curse_pt->ch!=10)
+	 && (curse_pt->ch!=' ') && (curse_pt->ch!='	'))
+    { curse_pt = curse_pt->prv; }
+    curse_pt = curse_pt->nxt;
+
+   } /*not_at_front_of_line*/
+  } /*ok*/
+ } /*backward*/
+
+  compute_curse_col(curse_pt);
+  last_curse_col = rel_curse_col;
+  reposition_cursor();
+  if (ln_flag) ADJUST_DISPLAY();
+}
+
+
+
+
+void screen_jump()
+{
+ int i, old_curse_row;
+ old_curse_row = curse_row;
+ rel_curse_col = 0; last_curse_col = 0;
+ curse_row = curse_row + 16 * direction;
+
+ if (curse_row<0)
+  {
+   curse_row = 0;
+   out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+   out_printf("%c%c[%d;1H%c[7mBackup past top of buffer%c[m%c[1;1H",
+	   EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
+   out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+   message_pending = 1;
+  }
+ if (curse_row>last_row)
+  {
+   curse_row = last_row;
+   out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+   out_printf("%c%c[%d;1H%c[7mAdvance past bottom of buffer%c[m%c[1;1H",
+	   EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
+   out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+   message_pending = 1;
+  }
+
+ if (direction>0)
+ {
+  for (i=old_curse_row; i<curse_row; i++)
+   move_pt_down_line( &curse_pt );
+ }
+ else
+ {
+  for (i=old_curse_row; i>curse_row; i--)
+   move_pt_up_line( &curse_pt );
+  move_pt_begin_of_line( &curse_pt );
+ }
+
+ ADJUST_DISPLAY();
+}
+
+
+
+void	jump_eol	(void)
+{
+
+
+	if (direction==1)
+		{
+		if (curse_pt != EOB)
+			{
+			if (curse_pt->ch == '\n' )
+				{
+				curse_row = curse_row + direction;
+				move_pt_down_line( &curse_pt );
+				}
+			}
+		else
+			curse_row = last_row + 2;
+		}
+	else	{
+		curse_row = curse_row +  direction;
+		move_pt_up_line( &curse_pt );
+		}
+
+	move_pt_end_of_line( &curse_pt );
+
+	if (curse_row < 0)
+		{
+		curse_row = 0;
+
+		out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+		out_printf("%c%c[%d;1H%c[7mBackup past top of buffer%c[m%c[1;1H",
+			EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
+		out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+
+		message_pending = 1;
+		}
+
+	if (curse_row > last_row)
+		{
+		curse_row = last_row;
+
+		out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+		out_printf("%c%c[%d;1H%c[7mAdvance past bottom of buffer%c[m%c[1;1H",
+			EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
+		out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+
+		message_pending = 1;
+		}
+
+	compute_curse_col(curse_pt);
+	last_curse_col = rel_curse_col;
+
+	ADJUST_DISPLAY();
+}
+
+
+
+void	jump_bol	(void)
+{
+	rel_curse_col = last_curse_col = 0;
+
+	if (direction==1)
+		{
+		curse_row = curse_row + direction;
+		move_pt_down_line( &curse_pt );
+		}
+	else	{
+		if (curse_pt->prv!=txt_head)
+			{
+			if (curse_pt->prv->ch==10)
+				{
+				curse_row = curse_row +  direction;
+				move_pt_up_line( &curse_pt );
+				}
+			}
+		else curse_row = -1;
+		}
+
+	move_pt_begin_of_line( &curse_pt );
+
+	if (curse_row < 0)
+		{
+		curse_row = 0;
+
+		out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+		out_printf("%c%c[%d;1H%c[7mBackup past top of buffer%c[m%c[1;1H",
+			EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
+		out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+
+		message_pending = 1;
+		}
+
+	if (curse_row > last_row)
+		{
+		curse_row = last_row;
+
+		out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+		out_printf("%c%c[%d;1H%c[7mAdvance past bottom of buffer%c[m%c[1;1H",
+		   EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, EDT$K_ESC );
+		out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+
+		message_pending = 1;
+		}
+
+	ADJUST_DISPLAY();
+}
+
+
+
+
+int er_message	(void)
+{
+	out_printf("ERROR: Non-decimal digit after percent-sign\n");
+	out_printf("	Percent-sign must be followed by three decimal digits.\n");
+	out_printf("	Percent-sign is special character for expressing non-printable\n");
+	out_printf("	characters as ASCII number.\n");
+	out_printf("	(To enter a 'real'-precent-sign, use %c037).\n", 37);
+	return -1;
+}
+
+
+/* Replace any %'s with ascii equivalents. */
+/* Returns 1 if substitution made, else returns zero, else returns -1 on error. */
+int replace_percents_with_ascii( char *word )
+{
+int	i, j, k, replacement = 0;
+
+	for (i = 0; (word[i] != '\0') && (replacement != -1); i++ )
+		{
+		if (word[i] == '%')
+			{
+			if ( !isdigit(word[i+1]) )
+				return	replacement = er_message();
+
+			k = word[i+1] - '0';
+
+			if ( !isdigit(word[i+2]) )
+				return	replacement = er_message();
+
+			k = 10 * k + word[i+2] - '0';
+
+			if ( !isdigit(word[i+3]) )
+				return	replacement = er_message();
+
+			k = 10 * k + word[i+3] - '0';
+
+			word[i] = k;
+
+			/* Now move the rest of the characters down. */
+			j = i + 1;
+			do	{
+				word[j] = word[j+3];
+				j++;
+			} while (word[j-1] != '\0');
+
+			replacement = 1;
+			}
+		}
+
+	return replacement;
+}
+
+
+int	getctrl	(void)
+{
+int	spkey, ch;
+
+	spkey = key_decode(EDT$K_ESC, &ch);
+
+	/* A paste is not told apart from typing here */
+	return	(spkey == EDT$K_PASTE) || (spkey < 0) ? 0 : spkey;
+}
+
+
+
+
+void search()
+{
+ int match, i, j1, j2, cntl=0, eos=0, new_row;
+ char ch, s_strng[MAX_SRCH_STRING];
+ struct __text__ *tmp_pt, *tmp_pt1;
+
+ if (Gold)
+ { /*Accept_strng*/
+  out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+  out_printf("%c[%d;1H%c[7mSearch for: ", EDT$K_ESC, nrows - 1, EDT$K_ESC);
+  i = 0;
+  do
+  {
+   ch  = edt_getc();
+   if (ch==13) ch = 10;
+   if (ch==EDT$K_ESC) cntl = 1;
+   srch_strng[i] = ch;   i = i + 1;  if (i==MAX_SRCH_STRING) eos = 1;
+   if ((ch==127) || (ch==8))    /* handle delete key */
+   { /*4*/
+    if (i>1)
+    { /*3*/
+     i = i - 2;
+     if (srch_strng[i]==9)	/* deleting a TAB */
+     { /*2*/
+      j1 = 5;
+     } /*2*/
+     else
+     if (srch_strng[i]==12)
+      j1 = 4;
+     else
+     if (srch_strng[i]==EDT$K_ESC)
+      j1 = 5;
+     else
+     if (srch_strng[i] < EDT$K_ESC)
+      j1 = 2;
+     else
+      j1 = 1;
+     for (j2=0; j2!=j1; j2++) out_printf("%c",8);
+     out_printf("%c[m",EDT$K_ESC);
+     for (j2=0; j2!=j1; j2++) out_printf(" ");
+     for (j2=0; j2!=j1; j2++) out_printf("%c",8);
+     out_printf("%c[7m",EDT$K_ESC);
+    } /*3*/
+    else
+    {
+     out_printf("%c",EDT$K_BELL);
+     i = 0;
+    }
+   } /*4*/
+   else
+   if (!cntl)
+   {
+    if (ch==9) out_printf("<TAB>"); else    print_char( ch );
+   }
+   else
+   {
+    int spkey;
+
+    if (ch==EDT$K_ESC) spkey = getctrl();
+
+    if (spkey>=1000)
+     {
+      eos = 1;
+      if (spkey==1005) direction = 1;
+      if (spkey==1006) direction = -1;
+     }
+
+   }
+  } while (!eos);
+  out_printf("%c[m", EDT$K_ESC);
+ } /*Accept_strng*/
+
+ { /*Do_Search*/
+  if (srch_caps)	/* Capitolize the search string */
+  {
+   i=0;
+   while (srch_strng[i]!=EDT$K_ESC)
+    {s_strng[i] = cap_ch( srch_strng[i] ); i = i + 1;}
+   s_strng[i] = EDT$K_ESC;
+  }
+  match = 0;  tmp_pt = curse_pt;  new_row = curse_row;
+  while ((!match) && (((direction==-1) && (tmp_pt!=txt_head))  ||
+		((direction==1) && (tmp_pt!=EOB))))
+  {
+   i = 0;   tmp_pt1 = tmp_pt;
+   if (srch_caps)
+   {
+    while ((tmp_pt1!=txt_head) && (tmp_pt1!=EOB) &&
+	   (s_strng[i]==cap_ch(tmp_pt1->ch)) && (srch_strng[i]!=EDT$K_ESC))
+     { i = i + 1;  tmp_pt1 = tmp_pt1->nxt; }
+   }
+   else
+   {
+    while ((tmp_pt1!=txt_head) && (tmp_pt1!=EOB) &&
+	   (srch_strng[i]==tmp_pt1->ch) && (srch_strng[i]!=EDT$K_ESC))
+     { i = i + 1;  tmp_pt1 = tmp_pt1->nxt; }
+   }
+   if ((srch_strng[i]==EDT$K_ESC) && (tmp_pt!=curse_pt)) match = 1;
+
+   if (!match)   /* If still no match, then advance pointer */
+   {
+    if (direction==1)
+     {
+      if (tmp_pt->ch==10) new_row = new_row + direction;
+      if (tmp_pt!=EOB) tmp_pt = tmp_pt->nxt;
+     }
+    else
+     {
+      if (tmp_pt!=txt_head) tmp_pt = tmp_pt->prv;
+      if (tmp_pt->ch==10) new_row = new_row + direction;
+     }
+   }
+  }
+
+  if (!match)
+  {
+   out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+   out_printf("%c%c[%d;1H%c[K%c[7mString /", EDT$K_BELL, EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC);
+   i=0; while (srch_strng[i]!=EDT$K_ESC) {print_char(srch_strng[i]); i=i+1; }
+   out_printf("/ was not found%c[m",  EDT$K_ESC);
+   out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+   reposition_cursor();
+   message_pending = 1;
+  }
+  else
+  {
+   if (Gold)
+   { /* Clear the message box */
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+    out_printf("%c[%d;1H%c[K", EDT$K_ESC, nrows - 1, EDT$K_ESC );
+    out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+   }
+   curse_pt = tmp_pt;
+   curse_row = new_row;
+   compute_curse_col(curse_pt);
+   last_curse_col = rel_curse_col;
+   ADJUST_DISPLAY();
+  }
+ } /*Do_Search*/
+
+ Gold = 0;
+}
+
+
+
+
+
+void	enter_ascii	(void)
+{
+int	p = 0, cntl = 0, ascii_number = 0, eos = 0;
+char	ch;
+
+	out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+	out_printf("%c[%d;1H%c[7mEnter ASCII value in decimal: ", EDT$K_ESC, nrows - 1, EDT$K_ESC);
+
+	do	{
+		ch  = edt_getc();
+
+		if ( (cntl = (ch == EDT$K_ESC)) )
+			{
+			if ( (ch > 47) && (ch < 57) )
+				{
+				ascii_number = ascii_number * 10 + ch - '0';
+				out_printf("%c",ch);
+				}
+			else	out_printf("%c", EDT$K_BELL);
+			}
+		else	{
+			if (p == 2)
+				eos = ( (ch > '@') && (ch < 'E') );
+
+#if ((EDT$K_TERMTYPE == 2) || (EDT$K_TERMTYPE == 3))
+				if ( p == 2 )
+					eos = 1;
+#endif
+
+			if ( p == 4)
+				eos = 1;
+
+			if ( (p == 1) && ((ch != '[') && (ch != 'O')) )
+				{
+				out_printf("%c", EDT$K_BELL);
+				cntl= p = 0;
+				}
+			else    p = p + 1;
+			}
+	} while (!eos);
+
+	out_printf("%c[m", EDT$K_ESC);
+	/* Clear the message box */
+	out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+	out_printf("%c[%d;1H%c[K", EDT$K_ESC, nrows - 1, EDT$K_ESC );
+	out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+
+	reposition_cursor();
+
+	if ( ascii_number > 255)
+		out_printf("%c",EDT$K_BELL);
+	else	{
+		if ( ascii_number == '\r' )
+			ascii_number = '\n';
+
+		insert_char( ascii_number, &curse_pt );
+		INSERT_CHAR_INLINE(ascii_number);
+		}
+}
+/**/
+
+
+
+/*
+ * Text pasted in bracketed paste mode, up to the ESC[201~ the terminal ends it with: every
+ * byte is put in before the cursor as it is, a CR or CR LF ends a line, and the screen is
+ * laid out and drawn once at the end as for a long paste buffer.
+ */
+void	paste_text	(void)
+{
+int	ch, c, i, n = 0, cr = 0;
+
+	for (;;)
+		{
+		if ( (ch = edt_getc()) == EOF )
+			break;
+
+		if ( ch == paste_end[n] )
+			{
+			if ( !paste_end[++n] )
+				break;
+			continue;
+			}
+
+		/* Not the end after all, what matched of it is text */
+		for (i = 0; i <= n; i++)
+			{
+			c = (i < n) ? paste_end[i] : ch;
+
+			if ( (i == n) && (c == paste_end[0]) )
+				break;
+
+			if ( (c == '\n') && cr )
+				{
+				cr = 0;
+				continue;
+				}
+
+			if ( (cr = (c == '\r')) )
+				c = '\n';
+
+			insert_char( c, &curse_pt );
+			if ( c == '\n' )
+				{ curse_row = curse_row + 1;  last_row = last_row + 1; }
+			}
+
+		n = (ch == paste_end[0]);
+		}
+
+	adjust_screen_parameters();
+	display_screen(1);
+}
+/**/
+
+
+
+void	handle_key	(char ch)
+{
+int	ch_index, old_ch, spkey, last;
+TEXT	*txt_tmp2;
+
+	if (message_pending == 1)
+		{ /* Clear the message box */
+		out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+		out_printf("%c[%d;1H%c[K", EDT$K_ESC, nrows - 1, EDT$K_ESC );
+		out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+
+		reposition_cursor();
+		}
+
+
+	/* A sequence cut short (a lone ESC) is let go */
+	if ( 0 > (spkey = key_decode(ch, &last)) )
+		return;
+
+	ch = last;
+
+	ctrl = !(spkey == 0);
+
+	/* More keys are waiting: the screen is drawn after the last of them */
+	if ( typeahead() )
+		scr_defer = 1;
+
+ if (!ctrl)
+  { /*notcntrl*/
+    /*If valid ascii, enque it into file.*/
+    if ((ch==23) && (Gold)) scr_valid = 0;	/* Gold ^W repaints all of the screen */
+    Gold = 0;
+    if (ch==23) display_screen(1);
+    else
+    if ((ch==127) || (ch==8))
+     { /*deletechar*/
+	DELETE_CHAR_BACKWARD();
+	Mark = 0;		/* <<<==== For safety, for now.  Need to guard against deleting the marked character. */
+     } /*deletechar*/
+    else
+     {
+      if (ch==13) { ch = 10; }
+      insert_char( ch, &curse_pt );
+      INSERT_CHAR_INLINE(ch);
+      Mark = 0;			/* <<<==== For safety, for now.  Need to guard against deleting the marked character. */
+     }
+  } /*notcntrl*/
+ else
+  { /*cntrl*/
+
+    switch (spkey)
+    {
+     case EDT$K_PASTE:
+		Gold = 0;
+		paste_text();
+		Mark = 0;
+	break;
+     case 1016:	/*down*/
+		Gold = 0;
+		down_arrow();
+	break;
+     case 1017:	/*right*/
+		Gold = 0;
+		right_arrow();
+	break;
+     case 1018:	/*left*/
+		Gold = 0;
+		left_arrow();
+	break;
+     case 1015:	/*up*/
+		Gold = 0;
+		up_arrow();
+	break;
+
+     case 1002:  /* Delete by Line key */
+		DELETE_LINE_FORWARD();
+		Mark = 0;
+	break;
+     case 1008:  /* Delete by Word key */
+		DELETE_WORD_FORWARD();
+		Mark = 0;
+	break;
+     case 1000:  /* GOLD */
+		Gold = 1;
+	break;
+     case 1003:	/* Jump by Page / Reformat Paragraph */
+		if (Gold)
+		{
+		 if (Mark)
+		 { /*Re-format*/
+
+		   /* First decide direction work in. */
+
+		   if (mark_pt1!=curse_pt)  /* Don't do anything, if curse_pt is on mark. */
+		   { /*ok2reformat*/
+		   if ((mark_row<curse_row) || ((curse_row==mark_row) && (mark_col<last_curse_col)))
+		    { /*forward*/
+
+		      /* First get txt_tmp to first white-space. */
+		      txt_tmp = mark_pt1;
+		      while ((txt_tmp!=curse_pt) && (txt_tmp->ch!=10) &&
+				(txt_tmp->ch!=' ') && (txt_tmp->ch!='	'))
+			 txt_tmp = txt_tmp->nxt;
+
+
+		      while (txt_tmp!=curse_pt)
+		      { /*loop*/
+
+		       /* Next get txt_tmp2 to end of next word, changing <cr>s to spaces. */
+		       txt_tmp2 = txt_tmp;  old_ch = ' ';
+		       while ((txt_tmp2!=curse_pt) && ((txt_tmp2->ch==10) ||
+				(txt_tmp2->ch==' ') || (txt_tmp2->ch=='	')))
+			{
+			 if ((txt_tmp2->ch==10) && (txt_tmp2->nxt->ch!=10) && (old_ch!=10))
+			  if (EOB->prv!=txt_tmp2)
+			  { col_edit(txt_tmp2);  txt_tmp2->ch=' ';  TXT_MODIFY(txt_tmp2);  last_row = last_row - 1; curse_row = curse_row - 1; }
+			 old_ch = txt_tmp2->ch;
+			 txt_tmp2 = txt_tmp2->nxt;
+			}
+		       /* Now txt_tmp2 points to first char of next word. */
+		       /* Now, get it to the end of that word. */
+		       while ((txt_tmp2!=curse_pt) && (txt_tmp2->ch!=10) &&
+				(txt_tmp2->ch!=' ') && (txt_tmp2->ch!='	'))
+			{
+			 txt_tmp2 = txt_tmp2->nxt;
+			}
+
+		       /* Now txt_tmp2 points to (after) end of next word, or curse_pt. */
+		       if (txt_tmp2!=curse_pt)
+		       {
+			txt_tmp2 = txt_tmp2->prv;
+			compute_curse_col( txt_tmp2 );
+			if (rel_curse_col>right_margin)
+			 {
+			  col_edit(txt_tmp);  txt_tmp->ch = 10;  TXT_MODIFY(txt_tmp);  last_row = last_row + 1; curse_row = curse_row + 1;
+			  txt_tmp = txt_tmp->nxt;
+			  /* Delete intervening white-space. */
+			  while ((txt_tmp->ch==' ') || (txt_tmp->ch=='	'))
+			   {
+			     txt_tmp = txt_tmp->nxt;
+			     delete_char( txt_tmp->prv );
+			   }
+			 }
+			txt_tmp = txt_tmp2->nxt;
+		       } else txt_tmp = txt_tmp2;
+		      } /*loop*/
+
+		    } /*forward*/
+		   else
+		    { /*backward*/
 
 		      /* First get txt_tmp to first white-space. */
 		      txt_tmp = curse_pt;
@@ -2997,409 +4475,1660 @@ TEXT	*txt_tmp2;
 				(txt_tmp->ch!=' ') && (txt_tmp->ch!='	'))
 			 txt_tmp = txt_tmp->nxt;
 
-		      while (txt_tmp!=mark_pt1)
-		      { /*loop*/
+		      while (txt_tmp!=mark_pt1)
+		      { /*loop*/
+
+		       /* Next get txt_tmp2 to end of next word, changing <cr>s to spaces. */
+		       txt_tmp2 = txt_tmp;  old_ch = ' ';
+		       while ((txt_tmp2!=mark_pt1) && ((txt_tmp2->ch==10) ||
+				(txt_tmp2->ch==' ') || (txt_tmp2->ch=='	')))
+			{
+			 if ((txt_tmp2->ch==10) && (txt_tmp2->nxt->ch!=10) && (old_ch!=10))
+			  if (EOB->prv!=txt_tmp2)
+			  { col_edit(txt_tmp2);  txt_tmp2->ch=' ';  TXT_MODIFY(txt_tmp2);  last_row = last_row - 1; }
+			 old_ch = txt_tmp2->ch;
+			 txt_tmp2 = txt_tmp2->nxt;
+			}
+		       /* Now txt_tmp2 points to first char of next word. */
+		       /* Now, get it to the end of that word. */
+		       while ((txt_tmp2!=mark_pt1) && (txt_tmp2->ch!=10) &&
+				(txt_tmp2->ch!=' ') && (txt_tmp2->ch!='	'))
+			{ txt_tmp2 = txt_tmp2->nxt; }
+
+		       /* Now txt_tmp2 points to (after) end of next word, or curse_pt. */
+		       if (txt_tmp2!=mark_pt1)
+		       {
+			txt_tmp2 = txt_tmp2->prv;
+			compute_curse_col( txt_tmp2 );
+			if (rel_curse_col>right_margin)
+			 {
+			  col_edit(txt_tmp);  txt_tmp->ch = 10;  TXT_MODIFY(txt_tmp);  last_row = last_row + 1;
+			  txt_tmp = txt_tmp->nxt;
+			  /* Delete intervening white-space. */
+			  while ((txt_tmp->ch==' ') || (txt_tmp->ch=='	'))
+			   {
+			     txt_tmp = txt_tmp->nxt;
+			     delete_char( txt_tmp->prv );
+			   }
+			 }
+			txt_tmp = txt_tmp2->nxt;
+		       } else txt_tmp = txt_tmp2;
+		      } /*loop*/
+
+		    } /*backward*/
+		   } /*ok2reformat*/
+
+		  adjust_screen_parameters();
+		  display_screen(1);
+		  Mark = 0;
+		  Gold = 0;
+		 } /*Re-format*/
+		}
+		else
+		 screen_jump();
+	break;
+     case 1001:	/* Find */
+		search();
+	break;
+     case 1014:	/* Delete by Char */
+		if (! Gold)
+		 {
+		  DELETE_CHAR_FORWARD();
+		 }
+		else
+		 {  /* Un-delete char */
+		  if (ch_buf!='\0')
+		  {
+		   insert_char( ch_buf, &curse_pt );
+		   INSERT_CHAR_INLINE(ch_buf);
+		  }
+		  Gold = 0;
+		 }
+	       Mark = 0;
+
+	break;
+     case 1005:	/* Forward Switch */
+		if (Gold)
+		{  /* Jump to Bottom of Buffer */
+		 curse_pt = EOB;
+		 curse_row = last_row;  last_curse_col = 0;
+		 rel_curse_col = 0;
+		 ADJUST_DISPLAY();
+		 Gold = 0;  direction = -1;
+		}
+		else
+		 direction = 1;
+	break;
+      case 1006:	/* Backward Switch */
+		if (Gold)
+		{  /* Jump to Top of Buffer */
+		 curse_pt = txt_head->nxt;
+		 curse_row = 0;  last_curse_col = 0;
+		 rel_curse_col = 0;
+		 ADJUST_DISPLAY();
+		 Gold = 0;  direction = 1;
+		}
+		else
+		direction = -1;
+	break;
+
+     case 1004:    /* Replace_and_Search_for_next */
+	  /* First, check that you are positioned at front of match to search_string. */
+	  if (srch_match())
+	   {
+	    /* Then, cut matched string away, and paste buffer in. */
+	      /* Cursor moves to after end of matched string. File shortens. */
+	      ch_index = 0;
+	      while (srch_strng[ch_index] != EDT$K_ESC)
+	       {
+		curse_pt = curse_pt->nxt;
+		if (curse_pt==EOB) {out_printf("SEVERE_ERROR: BOB\n"); /* txt_tmp=mark_pt1; */}
+		if (curse_pt->prv->ch==10) { last_row = last_row - 1; }
+		delete_char( curse_pt->prv );
+		ch_index = ch_index + 1;
+	       }
+	      adjust_screen_parameters();
+	      display_screen(1);
+
+	    /* Now Paste the buffer in. */
+	     txt_tmp = paste_buffer;
+	     if (paste_buffer_length<512)
+	      { /*foreground*/
+		while (txt_tmp!=0)
+		{
+		 insert_char( txt_tmp->ch, &curse_pt );
+		 INSERT_CHAR_INLINE(txt_tmp->ch);
+		 txt_tmp = txt_tmp->nxt;
+		}
+	      } /*foreground*/
+	     else
+	      { /*batch*/
+		while (txt_tmp!=0)
+		{
+		 insert_char( txt_tmp->ch, &curse_pt );
+		 if (txt_tmp->ch==10)                    /* If inserting a new line: */
+		  { curse_row = curse_row + 1;  last_row = last_row + 1; }
+		 txt_tmp = txt_tmp->nxt;
+		}
+		adjust_screen_parameters();
+		display_screen(1);
+	      } /*batch*/
+
+	    if (Gold)
+	    /* Then, search for next occurrence. */
+	     { Gold = 0;  search(); }
+	   } else out_printf("%c", EDT$K_BELL);
+	break;
+
+      case 1007:  /* Cut / Paste */
+	if (Gold) /*paste buffer*/
+	 {
+	   txt_tmp = paste_buffer;
+	   if (paste_buffer_length<512)
+	    { /*foreground*/
+	      while (txt_tmp!=0)
+	      {
+	       insert_char( txt_tmp->ch, &curse_pt );
+	       INSERT_CHAR_INLINE(txt_tmp->ch);
+	       txt_tmp = txt_tmp->nxt;
+	      }
+	    } /*foreground*/
+	   else
+	    { /*batch*/
+	      while (txt_tmp!=0)
+	      {
+	       insert_char( txt_tmp->ch, &curse_pt );
+	       if (txt_tmp->ch==10)                    /* If inserting a new line: */
+		{ curse_row = curse_row + 1;  last_row = last_row + 1; }
+	       txt_tmp = txt_tmp->nxt;
+	      }
+	      adjust_screen_parameters();
+	      display_screen(1);
+	    } /*batch*/
+	  Gold = 0;
+	 }
+	else /*cut to marker*/
+	 if (Mark)
+	 {
+	   /* If paste_buffer is not empty, free it. */
+	   while (paste_buffer!=0) { txt_tmp = paste_buffer; paste_buffer = paste_buffer->nxt; dispose_ch( txt_tmp ); }
+	   paste_buffer_length = 0;
+
+	   /* First decide direction to cut in. */
+	   /* Then push characters on in reverse order. */
+
+	   if (mark_pt1!=curse_pt)  /* If curse_pt is on mark, then don't cut, and leave buffer empty. */
+	   { /*cut*/		    /* Otherwise cut. */
+	   if ((mark_row<curse_row) || ((curse_row==mark_row) && (mark_col<last_curse_col)))
+	    { /*cut_backward*/  /* Cut back-up to mark, from left of cursor. */
+	      txt_tmp = curse_pt->prv;	/* Cursor stays where it is. */
+	      mark_pt1 = mark_pt1->prv;
+	      while (txt_tmp!=mark_pt1) /* File shortens. */
+	       {
+		push_buffer( txt_tmp->ch, &paste_buffer );
+		txt_tmp = txt_tmp->prv;   paste_buffer_length = paste_buffer_length + 1;
+		if (txt_tmp==txt_head) {out_printf("SEVERE_ERROR: BOB\n"); /* txt_tmp=mark_pt1->prv; */}
+		if (txt_tmp->nxt->ch==10) { last_row = last_row - 1; curse_row = curse_row - 1; }
+		delete_char( txt_tmp->nxt );
+	       }
+	      adjust_screen_parameters();
+	      display_screen(1);
+
+	    } /*cut_backward*/
+	   else
+	    { /*cut_forward*/	/* Cut back-up to cursor, from mark. */
+
+	      txt_tmp = mark_pt1->prv;	/* Cursor moves to mark_pt. File shortens. */
+	      curse_pt = curse_pt->prv;
+	      while (txt_tmp!=curse_pt)
+	       {
+		push_buffer( txt_tmp->ch, &paste_buffer );
+		txt_tmp = txt_tmp->prv;   paste_buffer_length = paste_buffer_length + 1;
+		if (txt_tmp==txt_head) {out_printf("SEVERE_ERROR: BOB\n"); /* txt_tmp=mark_pt1; */}
+		if (txt_tmp->nxt->ch==10) { last_row = last_row - 1; mark_row = mark_row - 1; }
+		delete_char( txt_tmp->nxt );
+	       }
+	      curse_pt = mark_pt1;  curse_row = mark_row;
+	      adjust_screen_parameters();
+	      display_screen(1);
+
+	    } /*cut_forward*/
+	   } /*cut*/
+
+	 }
+	else
+	 out_printf("%c%c",EDT$K_BELL,EDT$K_BELL);
+
+	 Mark = 0;
+	break;
+     case 1009:	/* Jump by Word */
+		if (Gold) CAPITOLIZE_CHAR();
+		else
+		jump_by_word();
+	break;
+     case 1010: /* Move to End-Of-Line */
+		jump_eol();
+
+	break;
+     case 1012:	/* Enter Non-Ascii */
+		enter_ascii();   Mark = 0;
+
+	break;
+     case 1011:	/* Move to Begining-Of-Line */
+		jump_bol();
+
+	break;
+     case 1013:	/* Dot (Set Mark or Cancel) */
+		if (Gold) Gold = 0;	/* Cancel Gold. */
+		else
+		 { /* Set mark. */
+		  Mark = 1;
+		  mark_pt1 = curse_pt;
+		  mark_row = curse_row;
+		  mark_col = last_curse_col;
+		 }
+	break;
+     }
+
+  } /*cntrl*/
+
+ inpt1 = 0;
+}
+
+
+
+/*
+ * Put bytes into the journal ring. The producer side is the editor thread only,
+ * so no locking is needed: data is copied into the ring, then the head is published.
+ */
+void	jou_put	(const char *buf, int len)
+{
+unsigned long	head;
+int	i;
+
+	if ( jou_fd < 0 )
+		return;
+
+	head = atomic_load_explicit(&jou_head, memory_order_relaxed);
+
+	for ( i = 0; i < len; i++, head++ )
+		{
+		/* Ring is full - let the writer catch up, keystrokes must not be lost */
+		while ( (head - atomic_load_explicit(&jou_tail, memory_order_acquire)) >= JOU_RING_SZ )
+			{
+			atomic_store_explicit(&jou_head, head, memory_order_release);
+			sem_post(&jou_sem);
+			usleep(1000);
+			}
+
+		jou_ring[head & (JOU_RING_SZ - 1)] = buf[i];
+		}
+
+	atomic_store_explicit(&jou_head, head, memory_order_release);
+	sem_post(&jou_sem);
+
+	jou_size += len;
+	jou_count += len;
+}
+
+void	jou_putc	(char ch)
+{
+	jou_put(&ch, 1);
+}
+
+
+/*
+ * Journal writer thread: on every wakeup drain all queued bytes with write(), then
+ * fsync() once for the whole batch. The tail is advanced only after the data has
+ * reached the disk.
+ */
+void	*jou_writer	(void *arg)
+{
+unsigned long	head, tail;
+unsigned	off, len;
+int	stop, status;
+
+	(void) arg;
+
+	for ( ;; )
+		{
+		sem_wait(&jou_sem);
+
+		stop = atomic_load(&jou_stop);
+		tail = atomic_load_explicit(&jou_tail, memory_order_relaxed);
+		head = atomic_load_explicit(&jou_head, memory_order_acquire);
+
+		if ( head != tail )
+			{
+			while ( tail != head )
+				{
+				off = tail & (JOU_RING_SZ - 1);
+				len = head - tail;
+
+				if ( len > JOU_RING_SZ - off )
+					len = JOU_RING_SZ - off;
+
+				if ( 0 > (status = write(jou_fd, jou_ring + off, len)) )
+					{
+					if ( errno == EINTR )
+						continue;
+
+					break;		/* Disk trouble - drop this batch, keep editing */
+					}
+
+				tail += status;
+				}
+
+			fdatasync(jou_fd);
+			atomic_store_explicit(&jou_tail, head, memory_order_release);
+			}
+
+		if ( stop && (atomic_load(&jou_head) == atomic_load(&jou_tail)) )
+			break;
+		}
+
+	return	NULL;
+}
+
+
+/*
+ * Wait until everything put into the journal so far is on the disk.
+ */
+void	jou_sync	(void)
+{
+	if ( jou_fd < 0 )
+		return;
+
+	sem_post(&jou_sem);
+
+	while ( atomic_load(&jou_tail) != atomic_load(&jou_head) )
+		usleep(1000);
+}
+
+
+/*
+ * Make a file name for journal/backup/etc by add/replace an extension of the file name
+ */
+void	aux_file_name	(char *fname_in, char *ext, char *fname)
+{
+char	*cp;
+
+	strcpy(fname, fname_in);
+
+	if ( (cp = strrchr(fname, '.')) )
+		strcpy(cp, ext);
+	else	strcat(fname, ext);
+}
+
+
+void	jou_header	(void)
+{
+char	hdr[64];
+
+	jou_put(hdr, sprintf(hdr, "EDT-JOU %d\n", jou_seq));
+	jou_count = 0;
+}
+
+
+void	open_journal_file( char *fname_in )
+{
+	/* No journal in encode mode - it would keep the text in clear */
+	if ( encode_mode )
+		return;
+
+	aux_file_name(fname_in, ".jou", jou_fname);
+	aux_file_name(fname_in, ".ckp", ckp_fname);
+
+	/*
+	 * A recovered session goes on appending to the journal it has been replayed from,
+	 * a new one starts from scratch and drops a checkpoint of a previous session.
+	 */
+	if ( !rcv_buf )
+		{
+		unlink(ckp_fname);
+		jou_seq = 0;
+		jou_size = 0;
+		}
+
+	if ( 0 > (jou_fd = open(jou_fname, O_WRONLY | O_CREAT | O_APPEND | (rcv_buf ? 0 : O_TRUNC), 0666)) )
+		{
+		out_printf("%cWARNING:  Could not open Journal file.  There will be no journaling.\n", EDT$K_BELL);
+		return;
+		}
+
+	atomic_store(&jou_head, 0);
+	atomic_store(&jou_tail, 0);
+	atomic_store(&jou_stop, 0);
+	sem_init(&jou_sem, 0, 0);
+
+	if ( pthread_create(&jou_tid, NULL, jou_writer, NULL) )
+		{
+		out_printf("%cWARNING:  Could not start Journal writer.  There will be no journaling.\n", EDT$K_BELL);
+		close(jou_fd);
+		jou_fd = -1;
+		unlink(jou_fname);
+		return;
+		}
+
+	if ( !rcv_buf )
+		jou_header();
+}
+
+void remove_journal_file( char *fname_in )
+{
+	(void) fname_in;
+
+	if ( jou_fd < 0 )
+		return;
+
+	/*
+	 * Let the writer drain the ring to the disk, then shut it down
+	 */
+	atomic_store(&jou_stop, 1);
+	sem_post(&jou_sem);
+	pthread_join(jou_tid, NULL);
+	sem_destroy(&jou_sem);
+
+	close(jou_fd);
+	jou_fd = -1;
+
+	unlink(jou_fname);
+	unlink(ckp_fname);
+}
+
+
+/*
+ * Get a next input byte: from the journal while '-recover' replays it, from the terminal
+ * otherwise. Every byte got from the terminal goes to the journal.
+ */
+void	recover_finish(void);
+void	bg_save_poll(void);
+void	screen_winch(void);
+
+/*
+ * Terminal input: what fd 0 has is read() in blocks into the ring buffer in_ring, and taken
+ * from it a byte at a time by in_getc(). All reading of the terminal goes through here, as
+ * stdio would not see what has been read ahead.
+ */
+#define	IN_SIZE		4096		/* A power of 2 */
+#define	IN_QUEUED()	(in_head - in_tail)
+
+unsigned char	in_ring[IN_SIZE];
+unsigned	in_head = 0, in_tail = 0;	/* Running counts of bytes put in and taken out */
+
+/* Read what there is into the free space of the ring, waiting for a byte at least */
+int	in_fill	(void)
+{
+unsigned pos = in_head & (IN_SIZE - 1), len = IN_SIZE - pos;
+int	n;
+
+	if ( len > IN_SIZE - IN_QUEUED() )
+		len = IN_SIZE - IN_QUEUED();
+
+	/* A prompt is shown before waiting for its answer, as getchar() did */
+	out_flush();
+
+	while ( (0 > (n = read(0, in_ring + pos, len))) && (errno == EINTR) );
+
+	if ( n > 0 )
+		in_head += n;
+
+	return	n;
+}
+
+/* The next byte, left to be got again */
+int	in_peek	(void)
+{
+	if ( !IN_QUEUED() && (in_fill() <= 0) )
+		return	EOF;
+
+	return	in_ring[in_tail & (IN_SIZE - 1)];
+}
+
+int	in_getc	(void)
+{
+int	ch;
+
+	if ( EOF != (ch = in_peek()) )
+		in_tail++;
+
+	return	ch;
+}
+
+/* A word as scanf("%s") takes it: blanks before it are skipped, the one after it is left */
+void	in_word	(char *buf, int max)
+{
+int	i = 0, ch;
+
+	while ( ((ch = in_peek()) != EOF) && isspace(ch) )
+		in_tail++;
+
+	while ( ((ch = in_peek()) != EOF) && !isspace(ch) )
+		{
+		if ( i < max - 1 )
+			buf[i++] = ch;
+		in_tail++;
+		}
+
+	buf[i] = '\0';
+}
+
+/* Input is there to be got without waiting */
+int	typeahead	(void)
+{
+struct pollfd pfd = { 0, POLLIN, 0 };
+
+	if ( rcv_buf )
+		return	rcv_pos < rcv_len;
+
+	if ( IN_QUEUED() )
+		return	1;
+
+	return	poll(&pfd, 1, 0) > 0;
+}
+
+int	edt_getc	(void)
+{
+int	ch, n;
+
+	if ( rcv_buf )
+		{
+		if ( rcv_pos < rcv_len )
+			return	rcv_buf[rcv_pos++];
+
+		recover_finish();
+		}
+
+	/*
+	 * While waiting for a key: the window may be resized, a background save is shown
+	 * as it goes
+	 */
+	while ( screen_mode && !IN_QUEUED() )
+		{
+		struct pollfd pfd[2] = { { 0, POLLIN, 0 }, { winch_fd[0], POLLIN, 0 } };
+
+		/* The frame is done, send it */
+		out_flush();
+
+		if ( 0 > (n = poll(pfd, 2, bg_pid ? 250 : -1)) )
+			{
+			if ( errno != EINTR )
+				break;
+			}
+		else if ( pfd[0].revents )
+			break;
+		else if ( pfd[1].revents )
+			{
+			if ( winch_drain() )
+				screen_winch();
+			}
+		else if ( !n )
+			bg_save_poll();
+		}
+
+	if ( EOF != (ch = in_getc()) )
+		jou_putc(ch);
+
+	return	ch;
+}
+
+
+/*
+ * Read an answer line (y/n and so on) through the journaled input.
+ */
+void	read_answer	(char *ans, int maxlen)
+{
+int	i = 0, ch;
+
+	while ( ((ch = edt_getc()) != '\n') && (ch != '\r') && (ch != EOF) )
+		if ( i < maxlen - 1 )
+			ans[i++] = ch;
+
+	ans[i] = '\0';
+	xml_remove_leading_trailing_spaces( ans );
+}
+
+
+
+/*
+ * Checkpoint file layout:
+ *	EDT-CKP <seq> <offset> <prev_offset>
+ *	<editing state line>
+ *	srch <n>\n<n bytes>  paste <n>\n<n bytes>  word ...  line ...  text ...
+ *
+ * <offset> is where the replay starts in a journal of generation <seq>, <prev_offset> - in
+ * a journal of generation <seq - 1>, i.e. when a crash hit before the journal truncation.
+ */
+void	ckp_put_chain	(FILE *fp, char *name, TEXT *pt, TEXT *stop)
+{
+TEXT	*tmp_pt;
+long	n;
+
+	for (n = 0, tmp_pt = pt; tmp_pt != stop; tmp_pt = tmp_pt->nxt)
+		n++;
+
+	fprintf(fp, "%s %ld\n", name, n);
+
+	for (tmp_pt = pt; tmp_pt != stop; tmp_pt = tmp_pt->nxt)
+		putc(tmp_pt->ch, fp);
+}
+
+int	ckp_get_chain	(FILE *fp, char *name, TEXT **list)
+{
+TEXT	*tail = NULL, *tmp_pt;
+char	word[32];
+long	n;
+
+	*list = NULL;
+
+	if ( (2 != fscanf(fp, "%31s %ld", word, &n)) || strcmp(word, name) || (getc(fp) != '\n') )
+		return	0;
+
+	for ( ; n; n--)
+		{
+		tmp_pt = new_ch();
+		tmp_pt->ch = getc(fp);
+		tmp_pt->nxt = NULL;
+
+		if ( tail )
+			tail->nxt = tmp_pt;
+		else	*list = tmp_pt;
+
+		tail = tmp_pt;
+		}
+
+	return	!feof(fp);
+}
+
+
+/*
+ * Write a checkpoint: snapshot of the main buffer and of the editing state, then truncate
+ * the journal. Called only between commands/keys, when no input sequence is half-read.
+ */
+void	checkpoint_journal	(void)
+{
+FILE	*fp;
+TEXT	*tmp_pt;
+long	n, pos = 0, markpos = 0;
+int	i, hdrlen;
+char	tmpname[PATH_MAX + 8], hdr[64];
+
+	/* Other buffers would not survive a journal truncation, so no checkpoints then */
+	if ( (jou_fd < 0) || rcv_buf || buffer_list->nxt )
+		return;
+
+	sprintf(tmpname, "%s.tmp", ckp_fname);
+
+	if ( !(fp = fopen(tmpname, "w")) )
+		{
+		jou_count = 0;	/* Don't retry on every key */
+		return;
+		}
+
+	for (n = 0, tmp_pt = txt_head->nxt; ; tmp_pt = tmp_pt->nxt, n++)
+		{
+		if ( tmp_pt == curse_pt )
+			pos = n;
+
+		if ( Mark && (tmp_pt == mark_pt1) )
+			markpos = n;
+
+		if ( tmp_pt == EOB )
+			break;
+		}
+
+	jou_sync();
+	hdrlen = sprintf(hdr, "EDT-JOU %d\n", jou_seq + 1);
+
+	fprintf(fp, "EDT-CKP %d %d %ld\n", jou_seq + 1, hdrlen, jou_size);
+	fprintf(fp, "screen=%d pos=%ld row=%d last=%d tframe=%d lcol=%d rcol=%d dir=%d gold=%d mark=%d markpos=%ld markrow=%d markcol=%d caps=%d chbuf=%d margin=%d changed=%d\n",
+		screen_mode, pos, curse_row, last_row, tframe_row, last_curse_col, rel_curse_col, direction,
+		Gold, Mark, markpos, mark_row, mark_col, srch_caps, ch_buf, right_margin, changed);
+
+	for (i = 0; (i < MAX_SRCH_STRING - 1) && (srch_strng[i] != EDT$K_ESC); i++);
+	fprintf(fp, "srch %d\n", i + 1);
+	fwrite(srch_strng, 1, i + 1, fp);
+
+	ckp_put_chain(fp, "paste", paste_buffer, NULL);
+	ckp_put_chain(fp, "word", word_buf, NULL);
+	ckp_put_chain(fp, "line", line_buf, NULL);
+	ckp_put_chain(fp, "text", txt_head->nxt, EOB);
+
+	if ( fflush(fp) || fsync(fileno(fp)) || fclose(fp) || rename(tmpname, ckp_fname) )
+		{
+		unlink(tmpname);
+		jou_count = 0;
+		return;
+		}
+
+	/* Writer is idle after jou_sync(), the journal is opened with O_APPEND */
+	ftruncate(jou_fd, 0);
+	jou_seq++;
+	jou_size = 0;
+	jou_header();
+}
 
-		       /* Next get txt_tmp2 to end of next word, changing <cr>s to spaces. */
-		       txt_tmp2 = txt_tmp;  old_ch = ' ';
-		       while ((txt_tmp2!=mark_pt1) && ((txt_tmp2->ch==10) ||
-				(txt_tmp2->ch==' ') || (txt_tmp2->ch=='	')))
+
+/*
+ * Restore the main buffer and the editing state from a checkpoint, file is positioned
+ * after the header line.
+ */
+int	load_checkpoint	(FILE *fp)
+{
+TEXT	*text, *tmp_pt, *nxt_pt;
+long	pos, markpos;
+int	scr, i, chb, caps;
+
+	if ( 17 != fscanf(fp, " screen=%d pos=%ld row=%d last=%d tframe=%d lcol=%d rcol=%d dir=%d gold=%d mark=%d markpos=%ld markrow=%d markcol=%d caps=%d chbuf=%d margin=%d changed=%d",
+			&scr, &pos, &curse_row, &last_row, &tframe_row, &last_curse_col, &rel_curse_col, &direction,
+			&Gold, &Mark, &markpos, &mark_row, &mark_col, &caps, &chb, &right_margin, &changed) )
+		return	-1;
+
+	srch_caps = caps;
+	ch_buf = chb;
+
+	if ( (1 != fscanf(fp, " srch %d", &i)) || (getc(fp) != '\n') || (i < 1) || (i > MAX_SRCH_STRING) )
+		return	-1;
+
+	fread(srch_strng, 1, i, fp);
+
+	if ( !ckp_get_chain(fp, "paste", &paste_buffer) || !ckp_get_chain(fp, "word", &word_buf)
+		|| !ckp_get_chain(fp, "line", &line_buf) || !ckp_get_chain(fp, "text", &text) )
+		return	-1;
+
+	for (paste_buffer_length = 0, tmp_pt = paste_buffer; tmp_pt; tmp_pt = tmp_pt->nxt)
+		paste_buffer_length++;
+
+	/* Link the text chain into the (empty) main buffer */
+	for (tmp_pt = text; tmp_pt; tmp_pt = nxt_pt)
+		{
+		nxt_pt = tmp_pt->nxt;
+		tmp_pt->prv = EOB->prv;
+		tmp_pt->nxt = EOB;
+		EOB->prv->nxt = tmp_pt;
+		EOB->prv = tmp_pt;
+		}
+
+	for (curse_pt = txt_head->nxt; pos && (curse_pt != EOB); pos--)
+		curse_pt = curse_pt->nxt;
+
+	for (mark_pt1 = txt_head->nxt; markpos && (mark_pt1 != EOB); markpos--)
+		mark_pt1 = mark_pt1->nxt;
+
+	return	scr;
+}
+
+
+/*
+ * Prepare '-recover': read the journal in, pick a checkpoint to start from.
+ * Returns 1 if the buffer has been restored from the checkpoint (*scr is set to the screen
+ * mode flag), 0 - if the replay starts from the original file, -1 - nothing to recover.
+ */
+int	recover_open	(char *fname, int *scr)
+{
+FILE	*fp;
+struct stat st;
+long	hdrlen = 0, off, prev_off;
+int	fd, seq = 0, ckp_seq, status = 0;
+
+	aux_file_name(fname, ".jou", jou_fname);
+	aux_file_name(fname, ".ckp", ckp_fname);
+
+	if ( (0 > (fd = open(jou_fname, O_RDONLY))) || fstat(fd, &st) )
+		{
+		out_printf("%cNo journal '%s' to recover from.\n", EDT$K_BELL, jou_fname);
+		return	-1;
+		}
+
+	rcv_len = st.st_size;
+	rcv_buf = malloc(rcv_len + 1);
+
+	if ( rcv_len != read(fd, rcv_buf, rcv_len) )
+		{
+		out_printf("%cERROR reading journal '%s'.\n", EDT$K_BELL, jou_fname);
+		close(fd);
+		free(rcv_buf);
+		rcv_buf = NULL;
+		return	-1;
+		}
+
+	close(fd);
+	rcv_buf[rcv_len] = '\0';
+
+	/* A journal of an older EDT has no header */
+	if ( !strncmp((char *) rcv_buf, "EDT-JOU ", 8) && strchr((char *) rcv_buf, '\n') )
+		{
+		seq = atoi((char *) rcv_buf + 8);
+		hdrlen = strchr((char *) rcv_buf, '\n') - (char *) rcv_buf + 1;
+		}
+
+	rcv_pos = hdrlen;
+	jou_seq = seq;
+	jou_size = rcv_len;
+
+	if ( (fp = fopen(ckp_fname, "r")) )
+		{
+		if ( 3 != fscanf(fp, "EDT-CKP %d %ld %ld", &ckp_seq, &off, &prev_off) )
+			out_printf("%cWARNING: Checkpoint '%s' is corrupted, ignored.\n", EDT$K_BELL, ckp_fname);
+		else if ( (ckp_seq != seq) && (ckp_seq != seq + 1) )
+			out_printf("%cWARNING: Checkpoint '%s' does not match the journal, ignored.\n", EDT$K_BELL, ckp_fname);
+		else if ( 0 > (*scr = load_checkpoint(fp)) )
 			{
-			 if ((txt_tmp2->ch==10) && (txt_tmp2->nxt->ch!=10) && (old_ch!=10))
-			  if (EOB->prv!=txt_tmp2)
-			  { txt_tmp2->ch=' '; last_row = last_row - 1; }
-			 old_ch = txt_tmp2->ch;
-			 txt_tmp2 = txt_tmp2->nxt;
+			out_printf("%cERROR: Checkpoint '%s' is corrupted.\n", EDT$K_BELL, ckp_fname);
+			exit(1);
+			}
+		else	{
+			rcv_pos = (ckp_seq == seq) ? off : prev_off;
+			status = 1;
 			}
-		       /* Now txt_tmp2 points to first char of next word. */
-		       /* Now, get it to the end of that word. */
-		       while ((txt_tmp2!=mark_pt1) && (txt_tmp2->ch!=10) &&
-				(txt_tmp2->ch!=' ') && (txt_tmp2->ch!='	'))
-			{ txt_tmp2 = txt_tmp2->nxt; }
 
-		       /* Now txt_tmp2 points to (after) end of next word, or curse_pt. */
-		       if (txt_tmp2!=mark_pt1)
-		       {
-			txt_tmp2 = txt_tmp2->prv;
-			compute_curse_col( txt_tmp2 );
-			if (rel_curse_col>right_margin)
-			 {
-			  txt_tmp->ch = 10;  last_row = last_row + 1;
-			  txt_tmp = txt_tmp->nxt;
-			  /* Delete intervening white-space. */
-			  while ((txt_tmp->ch==' ') || (txt_tmp->ch=='	'))
-			   {
-			     txt_tmp = txt_tmp->nxt;
-			     delete_char( txt_tmp->prv );
-			   }
-			 }
-			txt_tmp = txt_tmp2->nxt;
-		       } else txt_tmp = txt_tmp2;
-		      } /*loop*/
+		fclose(fp);
+		}
+
+	if ( rcv_pos > rcv_len )
+		rcv_pos = rcv_len;
+
+	out_printf("Recovering: replaying %ld journal bytes from '%s'%s.\n", rcv_len - rcv_pos, jou_fname,
+		status ? " on top of the checkpoint" : "");
+
+	/* Replay is headless */
+	out_flush();
+	rcv_stdout = dup(1);
+
+	if ( 0 <= (fd = open("/dev/null", O_WRONLY)) )
+		{
+		dup2(fd, 1);
+		close(fd);
+		}
+
+	return	status;
+}
+
+
+/*
+ * The journal is exhausted: back to the terminal, and to the screen if the replay
+ * stopped in the screen mode.
+ */
+void	screen_mode_setup(void);
+
+void	recover_finish	(void)
+{
+	out_printf("%c[m", EDT$K_ESC);
+	out_flush();
+
+	dup2(rcv_stdout, 1);
+	close(rcv_stdout);
+
+	free(rcv_buf);
+	rcv_buf = NULL;
+
+	if ( screen_mode )
+		screen_mode_setup();
+	else	out_printf("\n(Journal replayed, recovered session continues.)\n*");
+}
+
+
+
+/*
+ * COPY <infile> <outfile> - by the kernel: share the blocks if the filesystem can
+ * (reflink), copy inside the kernel otherwise, read()/write() as a last resort.
+ */
+int	copy_fd	(int ifd, int ofd, off_t size)
+{
+char	buf[64 * 1024];
+off_t	off = 0;
+ssize_t	n, w, k;
+
+#ifdef	FICLONE
+	if ( !ioctl(ofd, FICLONE, ifd) )
+		return	0;
+#endif
+
+	while ( off < size )
+		{
+		if ( 0 >= (n = copy_file_range(ifd, NULL, ofd, NULL, size - off, 0)) )
+			break;
+
+		off += n;
+		}
+
+	while ( off < size )
+		{
+		if ( 0 >= (n = sendfile(ofd, ifd, NULL, size - off)) )
+			break;
+
+		off += n;
+		}
+
+	/* Nothing of above worked, pick up from where it stopped */
+	while ( 0 < (n = read(ifd, buf, sizeof(buf))) )
+		{
+		for (w = 0; w < n; w += k)
+			if ( 0 >= (k = write(ofd, buf + w, n - w)) )
+				return	-1;
+		}
+
+	return	n;
+}
+
+
+void	copy_backup	(char *fname_in)
+{
+struct stat st;
+char	fname[PATH_MAX];
+int	ifd, ofd;
+
+	if ( (0 > (ifd = open(fname_in, O_RDONLY))) || fstat(ifd, &st) )
+		{
+		out_printf("ERROR: file %s does not exist.\n", fname_in);
+
+		if ( 0 <= ifd )
+			close(ifd);
+
+		return;
+		}
+
+	aux_file_name(fname_in, ".bak", fname);
+
+	if ( 0 > (ofd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, st.st_mode & 07777)) )
+		out_printf("%cWARNING: Cannot write '%s' file.\n", EDT$K_BELL, fname );
+	else	{
+		if ( copy_fd(ifd, ofd, st.st_size) | close(ofd) )
+			out_printf("%cWARNING: Error writing '%s' file.\n", EDT$K_BELL, fname );
+		}
+
+	close(ifd);
+}
+
+
+/*
+ * Make .bak before the file is saved. Save renames a new file over the old one, so
+ * the old inode itself can be kept as the backup - no copy is needed.
+ */
+void	link_backup	(char *fname_in)
+{
+char	fname[PATH_MAX];
+
+	aux_file_name(fname_in, ".bak", fname);
+	unlink(fname);
+
+	if ( linkat(AT_FDCWD, fname_in, AT_FDCWD, fname, AT_SYMLINK_FOLLOW) )
+		copy_backup(fname_in);
+}
+
+
+
+/*
+ * Gather writer: text of a buffer chain is copied into big blocks, which go to the file
+ * by a single writev() when all of them are full. Encoding and newline counting are done
+ * over a whole block.
+ */
+#define	WR_BLKSZ	(64 * 1024)
+#define	WR_NBLK		16
+
+unsigned char	wr_blk[WR_NBLK][WR_BLKSZ];
+
+
+/*
+ * Count '\n'-s, 8 bytes per step: a byte of (w ^ 0x0a0a...) is zero where w has '\n'
+ */
+long	count_newlines	(const unsigned char *buf, long len)
+{
+const unsigned long long ones = 0x0101010101010101ULL, high = 0x8080808080808080ULL, low = ~high;
+unsigned long long w, x;
+long	n = 0, i;
+
+	for (i = 0; i + 8 <= len; i += 8)
+		{
+		memcpy(&w, buf + i, 8);
+		x = w ^ (ones * '\n');
+		n += __builtin_popcountll(~(((x & low) + low) | x) & high);
+		}
+
+	for ( ; i < len; i++)
+		n += (buf[i] == '\n');
+
+	return	n;
+}
+
+
+int	wr_flush	(int fd, struct iovec *iov, int niov)
+{
+ssize_t	n;
+
+	while ( niov )
+		{
+		if ( 0 > (n = writev(fd, iov, niov)) )
+			{
+			if ( errno == EINTR )
+				continue;
+
+			return	errno;
+			}
+
+		/* Partial write - skip what is gone */
+		while ( niov && (n >= (ssize_t) iov->iov_len) )
+			{
+			n -= iov->iov_len;
+			iov++;
+			niov--;
+			}
+
+		if ( niov )
+			{
+			iov->iov_base = (char *) iov->iov_base + n;
+			iov->iov_len -= n;
+			}
+		}
+
+	return	0;
+}
+
+
+/*
+ * Write text from pt up to (not including) stop, stop is EOB or NULL for the singly linked
+ * buffers. The blocks go through the gz stream if it is given. Returns 0 or errno; number
+ * of lines/characters and a last byte written are returned by the pointers.
+ */
+int	wr_chain	(int fd, GZ_STREAM *gz, TEXT *pt, TEXT *stop, long *nln, long *nch, int *lastch)
+{
+struct iovec iov[WR_NBLK];
+unsigned char *cp, *end;
+int	nblk = 0, pwi = 0, err = 0;
+
+	*nln = *nch = 0;
+
+	while ( !err && (pt != stop) )
+		{
+		cp = wr_blk[nblk];
+		end = cp + WR_BLKSZ;
+
+		for ( ; (cp < end) && (pt != stop); pt = pt->nxt)
+			*(cp++) = pt->ch;
+
+		iov[nblk].iov_base = wr_blk[nblk];
+		iov[nblk].iov_len = cp - wr_blk[nblk];
+
+		*nln += count_newlines(wr_blk[nblk], iov[nblk].iov_len);
+		*nch += iov[nblk].iov_len;
+
+		if ( bg_child )
+			{
+			bg_save->done = *nch;
+			bg_save->nln = *nln;
+			}
+
+		*lastch = cp[-1];
+
+		if ( encode_mode )
+			encode_block(wr_blk[nblk], iov[nblk].iov_len, &pwi);
+
+		if ( gz )
+			err = gz_deflate_write(gz, wr_blk[nblk], iov[nblk].iov_len);
+		else if ( (++nblk == WR_NBLK) || (pt == stop) )
+			{
+			err = wr_flush(fd, iov, nblk);
+			nblk = 0;
+			}
+		}
+
+	return	err;
+}
+
+
+/*
+ * Safe save: a new content goes to a temp file in the directory of the target, which is
+ * renamed over the target only when it is completely on the disk. Symbolic link is
+ * followed to the real file, a permission mode of the file is kept.
+ * Returns a file descriptor to write or -1.
+ */
+int	save_open	(char *fname, char *target, char *tmpname)
+{
+struct stat st;
+char	dir[PATH_MAX];
+mode_t	mode;
+int	fd;
+
+	if ( realpath(fname, target) && !stat(target, &st) )
+		mode = st.st_mode & 07777;
+	else	{
+		strcpy(target, fname);
+		mode = umask(0);
+		umask(mode);
+		mode = 0666 & ~mode;
+		}
+
+	strcpy(dir, target);
+	sprintf(tmpname, "%s/.edt_save_XXXXXX", dirname(dir));
+
+	if ( 0 <= (fd = mkstemp(tmpname)) )
+		{
+		fchmod(fd, mode);
+		return	fd;
+		}
+
+	/* Directory is not writable - the old way, over the file itself */
+	tmpname[0] = '\0';
+
+	return	open(target, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+}
+
+
+/*
+ * Finish the save started by save_open(): on error the temp file is dropped and the
+ * target is untouched. Returns 0 or errno.
+ */
+int	save_close	(int fd, char *target, char *tmpname, int err)
+{
+char	dir[PATH_MAX];
+int	dfd;
+
+	if ( !err && fsync(fd) )
+		err = errno;
+
+	if ( close(fd) && !err )
+		err = errno;
+
+	if ( !tmpname[0] )
+		return	err;
+
+	if ( err )
+		{
+		unlink(tmpname);
+		return	err;
+		}
+
+	if ( rename(tmpname, target) )
+		{
+		err = errno;
+		unlink(tmpname);
+		return	err;
+		}
+
+	/* Make the rename itself durable */
+	strcpy(dir, target);
+
+	if ( 0 <= (dfd = open(dirname(dir), O_RDONLY | O_DIRECTORY)) )
+		{
+		fsync(dfd);
+		close(dfd);
+		}
+
+	return	0;
+}
+
+
+/*
+ * The main buffer is the same as the file on the disk now: remember the file identity
+ * and forget all node changes.
+ */
+void	disk_image	(char *fname, int fd)
+{
+TEXT	*tmp_pt;
+
+	if ( fstat(fd, &disk_st) || (strcmp(active_buffer_name, "main")) )
+		{
+		disk_valid = 0;
+		return;
+		}
+
+	if ( !realpath(fname, disk_fname) )
+		strcpy(disk_fname, fname);
+
+	for (tmp_pt = txt_head->nxt; ; tmp_pt = tmp_pt->nxt)
+		{
+		tmp_pt->flags = 0;
+		tmp_pt->del = 0;
+
+		if ( tmp_pt == EOB )
+			break;
+		}
+
+	disk_valid = 1;
+}
+
+
+/*
+ * The incremental save writes at most this much, a full save is cheaper otherwise
+ */
+#define	PTC_MAX		(64 * 1024 * 1024)
+
+typedef	struct __ptc_ext__ {
+	long	off, len, boff;		/* File offset, length, offset in the patch data */
+} PTC_EXT;
+
+
+/*
+ * Apply patch extents to the file and cut it to size
+ */
+int	patch_apply	(int fd, PTC_EXT *ext, int next, unsigned char *data, long size)
+{
+int	i;
 
-		    } /*backward*/
-		   } /*ok2reformat*/
+	for (i = 0; i < next; i++)
+		if ( ext[i].len != pwrite(fd, data + ext[i].boff, ext[i].len, ext[i].off) )
+			return	errno ? errno : EIO;
 
-		  adjust_screen_parameters();
-		  display_screen(1);
-		  Mark = 0;
-		  Gold = 0;
-		 } /*Re-format*/
+	if ( ftruncate(fd, size) || fdatasync(fd) )
+		return	errno;
+
+	return	0;
+}
+
+
+/*
+ * Finish a save interrupted while patching the file in place: the .ptc redo log is
+ * complete (has an END), so it is just applied again.
+ */
+void	patch_replay	(char *fname)
+{
+char	path[PATH_MAX], ptc_fname[PATH_MAX];
+unsigned char *buf, *cp, *end;
+PTC_EXT	*ext;
+struct stat st;
+long	size;
+int	fd, i, next, n;
+
+	if ( !realpath(fname, path) )
+		return;
+
+	aux_file_name(path, ".ptc", ptc_fname);
+
+	if ( 0 > (fd = open(ptc_fname, O_RDONLY)) )
+		return;
+
+	fstat(fd, &st);
+	buf = malloc(st.st_size + 1);
+	n = read(fd, buf, st.st_size);
+	close(fd);
+
+	cp = buf;
+	end = buf + ((n > 0) ? n : 0);
+	*end = '\0';
+
+	if ( (n < 4) || strcmp((char *) end - 4, "END\n") || (2 != sscanf((char *) cp, "EDT-PTC %ld %d", &size, &next)) )
+		{
+		/* Incomplete: the file has not been touched yet */
+		free(buf);
+		unlink(ptc_fname);
+		return;
 		}
-		else
-		 screen_jump();
-	break;
-     case 1001:	/* Find */
-		search();
-	break;
-     case 1014:	/* Delete by Char */
-		if (! Gold)
-		 {
-		  DELETE_CHAR_FORWARD();
-		 }
-		else
-		 {  /* Un-delete char */
-		  if (ch_buf!='\0')
-		  {
-		   insert_char( ch_buf, &curse_pt );
-		   INSERT_CHAR_INLINE(ch_buf);
-		  }
-		  Gold = 0;
-		 }
-	       Mark = 0;
 
-	break;
-     case 1005:	/* Forward Switch */
-		if (Gold)
-		{  /* Jump to Bottom of Buffer */
-		 curse_pt = EOB;
-		 curse_row = last_row;  last_curse_col = 0;
-		 rel_curse_col = 0;
-		 ADJUST_DISPLAY();
-		 Gold = 0;  direction = -1;
+	ext = malloc((next + 1) * sizeof(PTC_EXT));
+	cp = (unsigned char *) strchr((char *) cp, '\n') + 1;
+
+	for (i = 0; i < next; i++)
+		{
+		if ( 2 != sscanf((char *) cp, "%ld %ld", &ext[i].off, &ext[i].len) )
+			break;
+
+		cp = (unsigned char *) strchr((char *) cp, '\n') + 1;
+		ext[i].boff = cp - buf;
+		cp += ext[i].len;
 		}
-		else
-		 direction = 1;
-	break;
-      case 1006:	/* Backward Switch */
-		if (Gold)
-		{  /* Jump to Top of Buffer */
-		 curse_pt = txt_head->nxt;
-		 curse_row = 0;  last_curse_col = 0;
-		 rel_curse_col = 0;
-		 ADJUST_DISPLAY();
-		 Gold = 0;  direction = 1;
+
+	if ( (i != next) || (cp > end) || (0 > (fd = open(path, O_WRONLY))) || patch_apply(fd, ext, next, buf, size) )
+		out_printf("%cERROR: Could not complete an interrupted save from '%s', file '%s' may be damaged.\n",
+			EDT$K_BELL, ptc_fname, fname);
+	else	{
+		out_printf("Completed an interrupted save of '%s'.\n", fname);
+		unlink(ptc_fname);
 		}
-		else
-		direction = -1;
-	break;
 
-     case 1004:    /* Replace_and_Search_for_next */
-	  /* First, check that you are positioned at front of match to search_string. */
-	  if (srch_match())
-	   {
-	    /* Then, cut matched string away, and paste buffer in. */
-	      /* Cursor moves to after end of matched string. File shortens. */
-	      ch_index = 0;
-	      while (srch_strng[ch_index] != EDT$K_ESC)
-	       {
-		curse_pt = curse_pt->nxt;
-		if (curse_pt==EOB) {printf("SEVERE_ERROR: BOB\n"); /* txt_tmp=mark_pt1; */}
-		if (curse_pt->prv->ch==10) { last_row = last_row - 1; }
-		delete_char( curse_pt->prv );
-		ch_index = ch_index + 1;
-	       }
-	      adjust_screen_parameters();
-	      display_screen(1);
+	if ( 0 <= fd )
+		close(fd);
 
-	    /* Now Paste the buffer in. */
-	     txt_tmp = paste_buffer;
-	     if (paste_buffer_length<512)
-	      { /*foreground*/
-		while (txt_tmp!=0)
+	free(ext);
+	free(buf);
+}
+
+
+/*
+ * Incremental save of the main buffer into the file it has been loaded from: only bytes
+ * which differ from the file are written, in place. The patch goes to a .ptc redo log
+ * first, so an interrupted save is completed on the next start.
+ * Returns -1 if the incremental save can't be used (a full save must be done), 0 or errno.
+ */
+int	save_incremental	(char *fname, long *nln, long *nch, long *npatch)
+{
+struct stat st;
+TEXT	*tmp_pt;
+PTC_EXT	*ext = NULL;
+unsigned char *data = NULL;
+char	path[PATH_MAX], ptc_fname[PATH_MAX], hdr[64];
+long	pos, doff, blen = 0, bmax, cap;
+int	next = 0, extmax = 0, fd, i, pwi, err = 0;
+
+	if ( !disk_valid || strcmp(active_buffer_name, "main") || !realpath(fname, path) || strcmp(path, disk_fname)
+		|| stat(path, &st) || (st.st_dev != disk_st.st_dev) || (st.st_ino != disk_st.st_ino)
+		|| (st.st_size != disk_st.st_size) || (st.st_mtim.tv_sec != disk_st.st_mtim.tv_sec)
+		|| (st.st_mtim.tv_nsec != disk_st.st_mtim.tv_nsec) )
+		return	-1;
+
+	cap = st.st_size / 4 + 64 * 1024;
+
+	if ( cap > PTC_MAX )
+		cap = PTC_MAX;
+
+	bmax = (cap < 64 * 1024) ? cap : 64 * 1024;
+	data = malloc(bmax);
+
+	/*
+	 * <pos> is an offset in the buffer, <doff> - an offset in the file of the next byte
+	 * which is on the disk. A byte is written if it is new/changed or it has moved.
+	 */
+	*nln = 0;
+
+	for (pos = doff = 0, tmp_pt = txt_head->nxt; ; tmp_pt = tmp_pt->nxt)
 		{
-		 insert_char( txt_tmp->ch, &curse_pt );
-		 INSERT_CHAR_INLINE(txt_tmp->ch);
-		 txt_tmp = txt_tmp->nxt;
+		doff += tmp_pt->del;
+
+		if ( tmp_pt == EOB )
+			break;
+
+		*nln += (tmp_pt->ch == '\n');
+
+		if ( (tmp_pt->flags & (TXT$M_NEW | TXT$M_MOD)) || (pos != doff) )
+			{
+			if ( blen == cap )
+				break;
+
+			if ( blen == bmax )
+				data = realloc(data, bmax = (2 * bmax < cap) ? 2 * bmax : cap);
+
+			if ( !next || (ext[next - 1].off + ext[next - 1].len != pos) )
+				{
+				if ( next == extmax )
+					ext = realloc(ext, (extmax = 2 * extmax + 16) * sizeof(PTC_EXT));
+
+				ext[next].off = pos;
+				ext[next].len = 0;
+				ext[next++].boff = blen;
+				}
+
+			data[blen++] = tmp_pt->ch;
+			ext[next - 1].len++;
+			}
+
+		doff += !(tmp_pt->flags & TXT$M_NEW);
+		pos++;
+
+		tmp_pt->flags = 0;
+		tmp_pt->del = 0;
 		}
-	      } /*foreground*/
-	     else
-	      { /*batch*/
-		while (txt_tmp!=0)
+
+	/* Too much to patch, or the node changes don't add up to the file */
+	if ( (tmp_pt != EOB) || (doff != st.st_size) )
 		{
-		 insert_char( txt_tmp->ch, &curse_pt );
-		 if (txt_tmp->ch==10)                    /* If inserting a new line: */
-		  { curse_row = curse_row + 1;  last_row = last_row + 1; }
-		 txt_tmp = txt_tmp->nxt;
+		disk_valid = 0;	/* Flags are half reset - the full save takes over */
+		free(ext);
+		free(data);
+		return	-1;
 		}
-		adjust_screen_parameters();
-		display_screen(1);
-	      } /*batch*/
-
-	    if (Gold)
-	    /* Then, search for next occurrence. */
-	     { Gold = 0;  search(); }
-	   } else printf("%c", EDT$K_BELL);
-	break;
-
-      case 1007:  /* Cut / Paste */
-	if (Gold) /*paste buffer*/
-	 {
-	   txt_tmp = paste_buffer;
-	   if (paste_buffer_length<512)
-	    { /*foreground*/
-	      while (txt_tmp!=0)
-	      {
-	       insert_char( txt_tmp->ch, &curse_pt );
-	       INSERT_CHAR_INLINE(txt_tmp->ch);
-	       txt_tmp = txt_tmp->nxt;
-	      }
-	    } /*foreground*/
-	   else
-	    { /*batch*/
-	      while (txt_tmp!=0)
-	      {
-	       insert_char( txt_tmp->ch, &curse_pt );
-	       if (txt_tmp->ch==10)                    /* If inserting a new line: */
-		{ curse_row = curse_row + 1;  last_row = last_row + 1; }
-	       txt_tmp = txt_tmp->nxt;
-	      }
-	      adjust_screen_parameters();
-	      display_screen(1);
-	    } /*batch*/
-	  Gold = 0;
-	 }
-	else /*cut to marker*/
-	 if (Mark)
-	 {
-	   /* If paste_buffer is not empty, free it. */
-	   while (paste_buffer!=0) { txt_tmp = paste_buffer; paste_buffer = paste_buffer->nxt; dispose_ch( txt_tmp ); }
-	   paste_buffer_length = 0;
 
-	   /* First decide direction to cut in. */
-	   /* Then push characters on in reverse order. */
+	EOB->del = 0;
+	*nch = pos;
+	*npatch = blen;
 
-	   if (mark_pt1!=curse_pt)  /* If curse_pt is on mark, then don't cut, and leave buffer empty. */
-	   { /*cut*/		    /* Otherwise cut. */
-	   if ((mark_row<curse_row) || ((curse_row==mark_row) && (mark_col<last_curse_col)))
-	    { /*cut_backward*/  /* Cut back-up to mark, from left of cursor. */
-	      txt_tmp = curse_pt->prv;	/* Cursor stays where it is. */
-	      mark_pt1 = mark_pt1->prv;
-	      while (txt_tmp!=mark_pt1) /* File shortens. */
-	       {
-		push_buffer( txt_tmp->ch, &paste_buffer );
-		txt_tmp = txt_tmp->prv;   paste_buffer_length = paste_buffer_length + 1;
-		if (txt_tmp==txt_head) {printf("SEVERE_ERROR: BOB\n"); /* txt_tmp=mark_pt1->prv; */}
-		if (txt_tmp->nxt->ch==10) { last_row = last_row - 1; curse_row = curse_row - 1; }
-		delete_char( txt_tmp->nxt );
-	       }
-	      adjust_screen_parameters();
-	      display_screen(1);
+	if ( encode_mode )
+		for (enc_expand(), i = 0; i < next; i++)
+			{
+			pwi = ext[i].off % enc_pwl;
+			encode_block(data + ext[i].boff, ext[i].len, &pwi);
+			}
 
-	    } /*cut_backward*/
-	   else
-	    { /*cut_forward*/	/* Cut back-up to cursor, from mark. */
+	/*
+	 * Redo log: "EDT-PTC <size> <extents>", "<offset> <length>" + data for each of them, "END"
+	 */
+	aux_file_name(path, ".ptc", ptc_fname);
 
-	      txt_tmp = mark_pt1->prv;	/* Cursor moves to mark_pt. File shortens. */
-	      curse_pt = curse_pt->prv;
-	      while (txt_tmp!=curse_pt)
-	       {
-		push_buffer( txt_tmp->ch, &paste_buffer );
-		txt_tmp = txt_tmp->prv;   paste_buffer_length = paste_buffer_length + 1;
-		if (txt_tmp==txt_head) {printf("SEVERE_ERROR: BOB\n"); /* txt_tmp=mark_pt1; */}
-		if (txt_tmp->nxt->ch==10) { last_row = last_row - 1; mark_row = mark_row - 1; }
-		delete_char( txt_tmp->nxt );
-	       }
-	      curse_pt = mark_pt1;  curse_row = mark_row;
-	      adjust_screen_parameters();
-	      display_screen(1);
+	if ( 0 > (fd = open(ptc_fname, O_WRONLY | O_CREAT | O_TRUNC, 0600)) )
+		err = errno;
+	else	{
+		write(fd, hdr, sprintf(hdr, "EDT-PTC %ld %d\n", pos, next));
 
-	    } /*cut_forward*/
-	   } /*cut*/
+		for (i = 0; i < next; i++)
+			{
+			write(fd, hdr, sprintf(hdr, "%ld %ld\n", ext[i].off, ext[i].len));
 
-	 }
-	else
-	 printf("%c%c",EDT$K_BELL,EDT$K_BELL);
+			if ( ext[i].len != write(fd, data + ext[i].boff, ext[i].len) )
+				err = errno ? errno : EIO;
+			}
 
-	 Mark = 0;
-	break;
-     case 1009:	/* Jump by Word */
-		if (Gold) CAPITOLIZE_CHAR();
-		else
-		jump_by_word();
-	break;
-     case 1010: /* Move to End-Of-Line */
-		jump_eol();
+		if ( (4 != write(fd, "END\n", 4)) || fsync(fd) )
+			err = errno ? errno : EIO;
 
-	break;
-     case 1012:	/* Enter Non-Ascii */
-		enter_ascii();   Mark = 0;
+		close(fd);
+		}
 
-	break;
-     case 1011:	/* Move to Begining-Of-Line */
-		jump_bol();
+	if ( !err )
+		{
+		if ( 0 > (fd = open(path, O_WRONLY)) )
+			err = errno;
+		else	{
+			if ( !(err = patch_apply(fd, ext, next, data, pos)) )
+				{
+				fstat(fd, &disk_st);
+				unlink(ptc_fname);
+				}
 
-	break;
-     case 1013:	/* Dot (Set Mark or Cancel) */
-		if (Gold) Gold = 0;	/* Cancel Gold. */
-		else
-		 { /* Set mark. */
-		  Mark = 1;
-		  mark_pt1 = curse_pt;
-		  mark_row = curse_row;
-		  mark_col = last_curse_col;
-		 }
-	break;
-     }
+			close(fd);
+			}
+		}
+	else	unlink(ptc_fname);
 
-  } /*cntrl*/
+	if ( err )
+		disk_valid = 0;
 
- inpt1 = 0;
-}
+	free(ext);
+	free(data);
 
+	return	err;
+}
 
 
-void	open_journal_file( char *fname_in )
+/*
+ * Is the incremental save going to be tried: the file would be changed in place, so
+ * the .bak can't be a hard link of it.
+ */
+int	save_in_place	(char *fname)
 {
-char	*cp, fname[PATH_MAX];
+char	path[PATH_MAX];
 
-	/*
-	 * Make a journal file name by add/replace .jou extension to the file name
-	 */
-	strcpy(fname, fname_in);
+	return	disk_valid && !strcmp(active_buffer_name, "main") && realpath(fname, path) && !strcmp(path, disk_fname);
+}
 
-	if ( (cp = strrchr(fname, '.')) )
-		strcpy(cp, ".jou");
-	else	strcat(fname, ".jou");
 
-	/*
-	 * Open journal file with fallback to "/dev/null" in case of error
-	 */
-	if ( !(jou_outfile = fopen(encode_mode ? "/dev/null" : fname, "w")) )
+/*
+ * Try the incremental save: -1 - not possible, 0 - done, 1 - error
+ */
+int	write_file_incremental	(char *fname)
+{
+long	nln, nch, npatch;
+int	err;
+
+	if ( 0 > (err = save_incremental(fname, &nln, &nch, &npatch)) )
+		return	-1;
+
+	if ( err )
 		{
-		printf("%cWARNING:  Could not open Journal file.  There will be no journaling.\n", EDT$K_BELL);
-		jou_outfile = fopen("/dev/null", "w");
+		out_printf("%cERROR writing file %s.\n",EDT$K_BELL, fname);
+		return	1;
 		}
 
-	setbuffer( jou_outfile, jou_buf, 4 );
+	out_printf("File '%s' has been updated (%ld-lines, %ld-characters, %ld-rewritten)\n", fname, nln, nch, npatch);
+	return	0;
 }
 
-void remove_journal_file( char *fname_in )
+
+/*
+ * Format of the file to be saved: by the name or the main file has been loaded so
+ */
+int	save_format	(char *fname)
 {
-char	*cp, fname[PATH_MAX];
+char	path[PATH_MAX];
+int	len = strlen(fname);
 
-	if ( encode_mode )
-		return;
+	if ( (len > 3) && !strcmp(fname + len - 3, ".gz") )
+		return	CZ_GZIP;
 
-	/*
-	 * Make a journal file name by add/replace .jou extension to the file name
-	 */
-	strcpy(fname, fname_in);
+	if ( (len > 4) && !strcmp(fname + len - 4, ".scz") )
+		return	CZ_SCZ;
 
-	if ( (cp = strrchr(fname, '.')) )
-		strcpy(cp, ".jou");
-	else	strcat(fname, ".jou");
+	if ( cz_fname[0] && realpath(fname, path) && !strcmp(path, cz_fname) )
+		return	cz_format;
 
-	unlink(fname);
+	return	CZ_PLAIN;
 }
 
 
+/*
+ * Is the file to be written the one kept from writing: it is told by the device and inode
+ */
+int	write_kept	(char *fname)
+{
+struct stat st;
+
+	if ( !keep_valid || stat(fname, &st) || (st.st_dev != keep_st.st_dev) || (st.st_ino != keep_st.st_ino) )
+		return	0;
+
+	out_printf("%c  FILE WAS %s.\n  NO WRITE PERFORMED.\n", EDT$K_BELL,
+		view_mode ? "OPENED FOR 'VIEW'" : "NOT READ IN FULL");
 
-void	copy_backup	(char *fname_in)
+	return	1;
+}
+
+
+/*
+ * SCZ compresses a whole buffer at once: the chain is gathered into an array which
+ * is encoded and compressed to the file, nl - add a missing new line at the end
+ */
+int	wr_chain_scz	(int fd, int nl, TEXT *pt, TEXT *stop, long *nln, long *nch, int *lastch)
 {
-FILE	*infile, *outfile;
-char	ch, *cp, fname[PATH_MAX];
+unsigned char *buf = NULL, *cp;
+long	len = 0, cap = 0, outlen;
+int	pwi = 0, err = 0;
 
-	strcpy(fname, fname_in);
+	for ( ; ; pt = pt->nxt)
+		{
+		if ( (len + 1 >= cap) && (cp = realloc(buf, cap = 2 * cap + WR_BLKSZ)) )
+			buf = cp;
+		else if ( len + 1 >= cap )
+			{
+			free(buf);
+			return	ENOMEM;
+			}
+
+		if ( pt == stop )
+			break;
+
+		buf[len++] = pt->ch;
+		}
+
+	*nln = count_newlines(buf, len);
+	*nch = len;
+	*lastch = len ? buf[len - 1] : 0;
 
-	if ( !(infile = fopen(fname,"r")) )
+	if ( bg_child )
 		{
-		printf("ERROR: file %s does not exist.\n", fname);
-		return;
+		bg_save->done = *nch;
+		bg_save->nln = *nln;
 		}
 
-	if ( (cp = strrchr(fname, '.')) )
-		strcpy(cp, ".bak");
-	else	strcat(fname, ".bak");
+	if ( nl && (*lastch != '\n') )
+		buf[len++] = '\n';
 
-	/*
-	 * COPY <infile> <outfile> - hardcore bad motherfucker style!
-	 */
-	if ( !(outfile = fopen(fname, "w")) )
-		printf("%cWARNING: Cannot write '%s' file.\n", EDT$K_BELL, fname );
-	else	{
-		while ( !feof(infile) )
+	if ( encode_mode )
+		encode_block(buf, len, &pwi);
+
+	if ( !Scz_Compress_Buffer2Fd(buf, len, fd, &outlen) )
+		err = errno ? errno : EIO;
+
+	free(buf);
+
+	return	err;
+}
+
+
+/*
+ * Write in the format asked, nl - add a missing new line at the end
+ */
+int	wr_chain_fmt	(int fd, int fmt, int nl, TEXT *pt, TEXT *stop, long *nln, long *nch, int *lastch)
+{
+GZ_STREAM *z = NULL;
+unsigned char eol = '\n';
+int	err, pwi;
+
+	if ( fmt == CZ_SCZ )
+		return	wr_chain_scz(fd, nl, pt, stop, nln, nch, lastch);
+
+	if ( (fmt == CZ_GZIP) && !(z = gz_deflate_open(fd, GZ_LEVEL)) )
+		return	ENOMEM;
+
+	err = wr_chain(fd, z, pt, stop, nln, nch, lastch);
+
+	if ( !err && nl && (*lastch != '\n') )
+		{
+		if ( encode_mode )
 			{
-			ch = getc(infile);
-			putc(ch, outfile);
+			enc_expand();
+			pwi = *nch % enc_pwl;
+			encode_block(&eol, 1, &pwi);
 			}
 
-		fclose(outfile);
+		if ( z )
+			err = gz_deflate_write(z, &eol, 1);
+		else if ( 1 != write(fd, &eol, 1) )
+			err = errno;
 		}
 
-	fclose(infile);
-}
+	if ( z && (fmt = gz_deflate_close(z)) && !err )
+		err = fmt;
 
+	return	err;
+}
 
 
 int write_file( char *fname )	/* Returns 0 on success, 1 on error. */
 {
- FILE *outfile;
- struct __text__ *tmp_pt;
- int nln=0, nch=0, err=0;
- int pwi, ch, pwl;
- int gzipd_file=0;
- char *suffix;
+ int fd, err=0, lastch, fmt;
+ long nln, nch;
+ char target[PATH_MAX], tmpname[PATH_MAX + 32];
+ struct stat st;
 
- suffix = strstr(fname,".gz");
- if ((suffix != 0) && (strlen(suffix) == 3))
-  {
-   gzipd_file = 1;
-   suffix[0] = '\0';	/* Trucate the gzip suffix. */
-  }
+ if (write_kept(fname))
+  return 1;
+
+ fmt = save_format(fname);
 
- outfile = fopen(fname,"w");
- if (outfile==0)
+ if ((fmt == CZ_PLAIN) && (0 <= (err = write_file_incremental(fname))))
+  return err;
+ err = 0;
+
+ fd = save_open(fname, target, tmpname);
+ if (fd < 0)
   {
-   printf("%cCANNOT OPEN FILE /%s/ FOR WRITING.\n",EDT$K_BELL,fname);
+   out_printf("%cCANNOT OPEN FILE /%s/ FOR WRITING.\n",EDT$K_BELL,fname);
    err = 1;
-   printf("FILE WAS NOT WRITTEN.\n");
+   out_printf("FILE WAS NOT WRITTEN.\n");
   }
  else
  {
-  tmp_pt = txt_head->nxt;
-  if (encode_mode)
-   {
-    pwi = 0;  pwl = strlen(psswd);
-    while (tmp_pt!=EOB)
-     { ch = tmp_pt->ch;
-       ch = ch + psswd[pwi]; if (ch>255) ch = ch - 255;
-       pwi = pwi + 1;  if (pwi==pwl) pwi = 0;
-       if (fprintf(outfile,"%c", ch) == EOF) err = 1;;
-       if (tmp_pt->ch==10) nln = nln + 1;
-       nch = nch + 1;
-       tmp_pt = tmp_pt->nxt;
-     }
-   }
-  else
+  if (save_close(fd, target, tmpname, wr_chain_fmt(fd, fmt, 0, txt_head->nxt, EOB, &nln, &nch, &lastch))) err = 1;
+  /* Saved the file the main buffer came from: that is the new disk image */
+  if ((!err) && (fmt == CZ_PLAIN) && (!strcmp(target, disk_fname) || !disk_fname[0]) && (0 <= (fd = open(target, O_RDONLY))))
+   { disk_image(target, fd); close(fd); }
+  if (err) out_printf("%cERROR writing file %s.\n",EDT$K_BELL, fname);
+  else if (fmt == CZ_GZIP)
+   out_printf("File '%s' has been written gzip'd (%ld-lines, %ld-characters)\n", fname, nln, nch);
+  else if (fmt == CZ_SCZ)
    {
-    while (tmp_pt!=EOB)
-     { if (fprintf(outfile,"%c", tmp_pt->ch) == EOF) err = 1;;
-       if (tmp_pt->ch==10) nln = nln + 1;
-       nch = nch + 1;
-       tmp_pt = tmp_pt->nxt;
-     }
+    out_printf("File '%s' has been written SCZ compressed (%ld-lines, %ld-characters)\n", fname, nln, nch);
+    if ((!stat(target, &st)) && st.st_size)
+     out_printf("Compression ratio = %g : 1\n", (float)nch / (float)st.st_size);
    }
-  if (fclose(outfile) == EOF) err = 1;
-  if (err) printf("%cERROR writing file %s.\n",EDT$K_BELL, fname);
   else
-   printf("File '%s' has been written (%d-lines, %d-characters)\n", fname, nln, nch);
-  if (gzipd_file)
-   { char cmd[4096]="gzip -f ";
-    printf(" Gzip'ing %s\n", fname );
-    strcat( cmd, fname );
-    system(cmd);
-   }
+   out_printf("File '%s' has been written (%ld-lines, %ld-characters)\n", fname, nln, nch);
  }
  return err;
 }
@@ -3408,81 +6137,205 @@ int write_file( char *fname )	/* Returns 0 on success, 1 on error. */
 
 int	write_buffer	(struct __text__ *bufpt, char *fname)
 {
-FILE	*outfile;
-TEXT	*tmp_pt;
-int	nln = 0, nch = 0, err = 0, pwi, ch, pwl;
-char	lastch = 0;
+int	fd, err, lastch = 0;
+long	nln, nch;
+char	target[PATH_MAX], tmpname[PATH_MAX + 32];
 
-	if ( !(outfile = fopen(fname,"w")) )
+	if ( 0 > (fd = save_open(fname, target, tmpname)) )
 		{
-		printf("%cCANNOT OPEN FILE /%s/ FOR WRITING.\n", EDT$K_BELL, fname);
-		printf("FILE WAS NOT WRITTEN.\n");
+		out_printf("%cCANNOT OPEN FILE /%s/ FOR WRITING.\n", EDT$K_BELL, fname);
+		out_printf("FILE WAS NOT WRITTEN.\n");
 
 		return	errno;
 		}
 
-	tmp_pt = bufpt;
+	err = wr_chain_fmt(fd, save_format(fname), 1, bufpt, NULL, &nln, &nch, &lastch);
 
-	if (encode_mode)
+	if ( (err = save_close(fd, target, tmpname, err)) )
 		{
-		pwi = 0;
-		pwl = strlen(psswd);
+		out_printf("%cERROR writing file %s.\n", EDT$K_BELL, fname);
+		return	err;
+		}
 
-		while ( tmp_pt )
-			{
-			ch = tmp_pt->ch;
-			ch = ch + psswd[pwi];
 
-			if (ch > 255)
-				ch = ch - 255;
+	out_printf("File '%s' has been written (%ld-lines, %ld-characters)\n", fname, nln, nch);
+	return	err;	/* SUCCESS ! */
+
+}
 
-			lastch = ch;
-			pwi = pwi + 1;
 
-			if (pwi == pwl)
-				pwi = 0;
 
-			if ( fprintf(outfile, "%c", ch) == EOF )
-				err = errno;
 
-			nln += (tmp_pt->ch == '\n');
-			nch++;
 
-			tmp_pt = tmp_pt->nxt;
-			}
-		}
-	else	{
-		while (tmp_pt != 0)
-			{
-			if ( fprintf(outfile,"%c", tmp_pt->ch) == EOF )
-				err = errno;
 
-			lastch = tmp_pt->ch;
+/*
+ * Show a message on the message line of the screen
+ */
+void	screen_message	(char *msg)
+{
+	out_printf("%c[1;%dr", EDT$K_ESC, nrows); /*Temporarily expand scrolling region*/
+	out_printf("%c[%d;1H%c[K%c[7m%s%c[m", EDT$K_ESC, nrows - 1, EDT$K_ESC, EDT$K_ESC, msg, EDT$K_ESC);
+	out_printf("%c[1;%dr", EDT$K_ESC, nrows-2); /*Re-establish scrolling region*/
+	message_pending = 1;
+	reposition_cursor();
+	out_flush();
+}
 
-			nln += (tmp_pt->ch == '\n');
-			nch++;
 
-			tmp_pt = tmp_pt->nxt;
-			}
+/*
+ * Background save has exited: report, take over the disk image it has made
+ */
+void	bg_save_done	(int status)
+{
+char	msg[PATH_MAX + 128];
+
+	bg_pid = 0;
+
+	if ( !WIFEXITED(status) || WEXITSTATUS(status) || bg_save->err )
+		sprintf(msg, "%cERROR writing file %s.", EDT$K_BELL, bg_save->fname);
+	else	sprintf(msg, "File '%s' has been written (%ld-lines, %ld-characters)", bg_save->fname,
+			bg_save->nln, bg_save->nch);
+
+	if ( bg_save->disk_valid )
+		{
+		disk_st = bg_save->disk_st;
+		strcpy(disk_fname, bg_save->disk_fname);
+		disk_valid = 1;
 		}
 
-	if ( lastch != '\n' )
-		fprintf(outfile, "\n");
+	if ( screen_mode )
+		screen_message(msg);
+	else	out_printf("%s\n", msg);
+}
+
 
-	if ( fclose(outfile) == EOF )
+/*
+ * Check a running background save: report progress or completion
+ */
+void	bg_save_poll	(void)
+{
+char	msg[PATH_MAX + 64];
+int	status;
+
+	if ( !bg_pid )
+		return;
+
+	if ( bg_pid == waitpid(bg_pid, &status, WNOHANG) )
+		bg_save_done(status);
+	else if ( screen_mode && bg_save->total )
 		{
-		printf("%cERROR writing file %s.\n", EDT$K_BELL, fname);
-		return	-EIO;
+		sprintf(msg, "Saving '%s' ... %ld%%", bg_save->fname, 100 * bg_save->done / bg_save->total);
+		screen_message(msg);
 		}
+}
 
 
-	printf("File '%s' has been written (%d-lines, %d-characters)\n", fname, nln, nch);
-	return	err;	/* SUCCESS ! */
+/*
+ * Wait for the background save to complete
+ */
+void	bg_save_wait	(void)
+{
+int	status;
+
+	if ( !bg_pid )
+		return;
+
+	out_printf("Waiting for the background save of '%s' ...\n", bg_save->fname);
+	out_flush();
 
+	while ( (bg_pid != waitpid(bg_pid, &status, 0)) && (errno == EINTR) );
+
+	bg_save_done(status);
 }
 
 
+/*
+ * Save the current buffer in background: the child process has a snapshot of the buffer
+ * for free by fork(), editing goes on in the parent. Small/incremental saves and ones
+ * which can't fork are done in place. Returns 0 if the save has been started or done.
+ */
+int	bg_write_file	(char *fname)
+{
+char	path[PATH_MAX];
+TEXT	*tmp_pt;
+int	image, fd, err;
+long	n;
+
+	bg_save_wait();
+
+	if ( write_kept(fname) )
+		return	1;
+
+	if ( rcv_buf )
+		return	write_file(fname);
+
+	/* A small patch is quick enough; if it is not, the child does a full save */
+	if ( save_in_place(fname) && (0 <= (err = write_file_incremental(fname))) )
+		return	err;
+
+	if ( !bg_save && (MAP_FAILED == (bg_save = mmap(NULL, sizeof(BG_SAVE), PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_ANONYMOUS, -1, 0))) )
+		{
+		bg_save = NULL;
+		return	write_file(fname);
+		}
+
+	/* The file will be a new disk image, see write_file(); node changes are relative to it since now */
+	image = !strcmp(active_buffer_name, "main") && (save_format(fname) == CZ_PLAIN)
+		&& (!disk_fname[0] || (realpath(fname, path) && !strcmp(path, disk_fname)));
+
+	memset(bg_save, 0, sizeof(BG_SAVE));
+	strncpy(bg_save->fname, fname, PATH_MAX - 1);
+	out_flush();
+
+	if ( 0 > (bg_pid = fork()) )
+		{
+		bg_pid = 0;
+		return	write_file(fname);
+		}
+
+	if ( !bg_pid )
+		{
+		/* Child: quietly write the snapshot, report through the shared state */
+		bg_child = 1;
+
+		if ( 0 <= (fd = open("/dev/null", O_WRONLY)) )
+			{
+			dup2(fd, 1);
+			close(fd);
+			}
+
+		for (n = 0, tmp_pt = txt_head->nxt; tmp_pt != EOB; tmp_pt = tmp_pt->nxt)
+			n++;
+
+		bg_save->total = n;
+		bg_save->err = write_file(fname);
+		bg_save->nch = bg_save->done;
+		bg_save->disk_valid = image && disk_valid;
+		bg_save->disk_st = disk_st;
+		strcpy(bg_save->disk_fname, disk_fname);
+
+		_exit(bg_save->err);
+		}
+
+	if ( image )
+		{
+		for (tmp_pt = txt_head->nxt; ; tmp_pt = tmp_pt->nxt)
+			{
+			tmp_pt->flags = 0;
+			tmp_pt->del = 0;
+
+			if ( tmp_pt == EOB )
+				break;
+			}
+
+		disk_valid = 0;		/* Until the save is completed */
+		}
+
+	out_printf("Saving '%s' in background.\n", fname);
 
+	return	0;
+}
 
 
 
@@ -3546,7 +6399,7 @@ void global_substitute( char *sub_srch_strng, char *sub_rplcmnt_strng )
       match_online = 0;
       tmp_pt1 = tmp_pt;
       move_pt_begin_of_line( &tmp_pt1 );
-      spew_line( tmp_pt1 ); printf("\n");
+      spew_line( tmp_pt1 ); out_printf("\n");
     } /*Display_modified_line*/
   } /*scan_file*/
 
@@ -3554,15 +6407,15 @@ void global_substitute( char *sub_srch_strng, char *sub_rplcmnt_strng )
 
  if (match_found!=0)
   {
-   if ((EOB->prv!=txt_head) && (EOB->prv->ch!=10)) {printf("MISSING <CR> INSERTED at [EOF]\n"); insert_char( 10, &EOB ); last_row=last_row + 1;}
-   printf("\n%d substitutions made.\n", match_found );
+   if ((EOB->prv!=txt_head) && (EOB->prv->ch!=10)) {out_printf("MISSING <CR> INSERTED at [EOF]\n"); insert_char( 10, &EOB ); last_row=last_row + 1;}
+   out_printf("\n%d substitutions made.\n", match_found );
    curse_pt = txt_head->nxt;
    curse_row = 0;  last_curse_col = 0;
    rel_curse_col = 0;
    adjust_screen_parameters();
    Gold = 0;  direction = 1;
   }
- else printf("No substitutions made.\n");
+ else out_printf("No substitutions made.\n");
 }
 
 
@@ -3573,7 +6426,7 @@ void substitute_command( char *com_line )
  char sub_srch_strng[256], sub_rplcmnt_strng[256];
    /* Expect s/srch_strng/rplcmnt_strng/w  or line range in brackets. */
    j = 0; i = 2;  /* Use com_line[1] as the search delimiter. */
-   if (com_line[1]=='\0') printf("Badly formed Substitute command.\n");
+   if (com_line[1]=='\0') out_printf("Badly formed Substitute command.\n");
    else
    {
     while ((com_line[i]!=com_line[1]) && (com_line[i]!='\0'))
@@ -3587,8 +6440,8 @@ void substitute_command( char *com_line )
       sub_rplcmnt_strng[j] = '\0';
       if (com_line[i]==com_line[1])
        global_substitute( sub_srch_strng, sub_rplcmnt_strng );
-      else printf("Badly formed Substitute command.\n");
-     } else printf("Badly formed Substitute command.\n");
+      else out_printf("Badly formed Substitute command.\n");
+     } else out_printf("Badly formed Substitute command.\n");
    }
 }
 
@@ -3621,10 +6474,100 @@ void insert_string( char *line )
 
 
 
+/*
+ * Enter/leave the full screen mode, the terminal is not touched while '-recover' replays
+ * the journal.
+ */
+void	screen_mode_setup	(void)
+{
+	screen_mode = 1;
+
+	resize(0);
+	out_setup();
+
+	out_printf("%c[m%c)B", EDT$K_ESC, EDT$K_ESC);
+	out_printf("%c[1;%dr", EDT$K_ESC, nrows-2 );	/*set scrolling region*/
+	scr_setup();
+
+	if ( !rcv_buf )
+		term_raw();
+
+	adjust_screen_parameters();
+	display_screen(1);
+}
+
+void	screen_mode_leave	(void)
+{
+	/* Nice Exit (Return terminal screen to nice way) */
+	out_printf("%c[m%c[1;%dr", EDT$K_ESC, EDT$K_ESC, nrows); /* Re-expand scrolling region*/
+	out_printf("%c[%d;1H%c[K", EDT$K_ESC, nrows - 1, EDT$K_ESC );
+	out_printf("%c[%d;1H%cE", EDT$K_ESC, nrows, EDT$K_ESC);
+	out_printf("%c[%d;1H", EDT$K_ESC, nrows-1 );
+
+	out_leave();
+
+	if ( !rcv_buf )
+		term_restore();
+
+	/* A ^Z typed ahead leaves the frame undrawn: line mode prints, the next entry draws all */
+	scr_defer = 0;
+	scr_valid = 0;
+
+	screen_mode = 0;
+}
+
+/* The window has been resized: the frame is laid out for the new size and drawn anew */
+void	screen_winch	(void)
+{
+	resize(0);
+
+	out_printf("%c[1;%dr", EDT$K_ESC, nrows-2 );	/*set scrolling region*/
+	scr_setup();
+
+	adjust_screen_parameters();
+	display_screen(1);
+}
+
+/* This is the main screen-mode editing loop. */
+void	screen_mode_loop	(void)
+{
+int	ch;
+
+	inpt1 = ctrl = 0;
+
+	/* While ^Z is not pressed. */
+	for ( ; ; )
+		{
+		if ( jou_count >= JOU_CKP_BYTES )
+			checkpoint_journal();
+
+		if ( 26 == (ch = edt_getc()) )
+			break;
+
+		handle_key(ch);
+
+		if ( scr_defer )
+			{
+			if ( typeahead() )
+				continue;
+
+			/* The keys typed ahead are all in: one frame for them */
+			scr_defer = 0;
+			display_screen(1);
+			}
+		else if ( hview_fit() )		/* The cursor has left the view */
+			display_screen(1);
+		}
+
+	screen_mode_leave();
+}
+
+
+
 int main( int argc, char *argv[] )
 {
-char	ch, *suffix, fname[2560], name1[2560], com_line[4196];
-int	i, j, k, jj, file_exists, openatlinenum = 1, gzipd_file = 0, leave = 0;
+char	fname[2560], name1[2560], com_line[4196];
+int	i, j, k, jj, file_exists, openatlinenum = 1, leave = 0, rcv_status = 0, rcv_screen = 0;
 struct __text__ *tmp_pt;
 struct stat file_info;
 
@@ -3646,6 +6589,8 @@ struct stat file_info;
 
 	/* Find window size, and set parameters appropriately. */
 	resize(1);
+	winch_setup();
+	term_setup();
 
 	strcpy(active_buffer_name, "main");
 	buffer_list = (struct __buf_lis__ *) malloc(sizeof(struct __buf_lis__));
@@ -3665,6 +6610,7 @@ struct stat file_info;
 	word_buf = 0, line_buf = 0, paste_buffer = mark_pt1 = 0;  Mark = 0;
 
 	get_keypad_setup();
+	key_compile();
 
 	txt_free = (struct __text__ *)calloc( 1, sizeof(struct __text__) );
 	free_nil = txt_free;
@@ -3688,16 +6634,23 @@ struct stat file_info;
 			if ( !strncmp(argv[j], "-read", 5) )
 				{
 				read_only = 1;
-				printf("FILE OPENED AS 'READ-ONLY'.\n");
+				out_printf("FILE OPENED AS 'READ-ONLY'.\n");
 				}
 			else if ( !strncmp(argv[j], "-encode", 7) )
 				{
 				encode_mode = 1;
-				printf("ENCODING-MODE:\nPassword: ");
+				out_printf("ENCODING-MODE:\nPassword: ");
 				psswd = (char *) malloc(256);
-				scanf("%s", psswd);
+				in_word(psswd, 256);
 				}
-			else	printf("%cNO SUCH OPTION AS /%s/\n", EDT$K_BELL, argv[j]);
+			else if ( !strncmp(argv[j], "-recover", 8) )
+				recover_mode = 1;
+			else if ( !strncmp(argv[j], "-view", 5) )
+				{
+				view_mode = read_only = 1;
+				out_printf("FILE OPENED FOR 'VIEW', READ-ONLY.\n");
+				}
+			else	out_printf("%cNO SUCH OPTION AS /%s/\n", EDT$K_BELL, argv[j]);
 			} /*accept_option*/
 		else	{
 			strcpy(fname,argv[j]);
@@ -3705,7 +6658,7 @@ struct stat file_info;
 
 			if ( k > 1 )
 				{
-				printf("Too many files on command-line. Exiting.\n");
+				out_printf("Too many files on command-line. Exiting.\n");
 				exit(1);
 				}
 			}
@@ -3736,21 +6689,25 @@ struct stat file_info;
 	if ( fname[0] == '\0')
 		strcpy(fname, "noname");
 
-	suffix = strstr(fname,".gz");
-
-	if ( (suffix) && (strlen(suffix) == 3))
+	/*
+	 * Recovery: the buffer comes from a checkpoint, or from the file as it is on the disk,
+	 * then the journal is replayed on top of it.
+	 */
+	if ( recover_mode )
 		{
-		char cmd[4096] = "gunzip ";
-		gzipd_file = 1;
-
-		printf(" Temporarily gunzip'ing %s\n", fname );
-
-		strcat( cmd, fname );
-		system( cmd );
+		if ( encode_mode )
+			{
+			out_printf("%cNo journal is kept in encoding mode, nothing to recover.\n", EDT$K_BELL);
+			exit(1);
+			}
 
-		suffix[0] = '\0';	/* Trucate the gzip suffix. */
+		if ( 0 > (rcv_status = recover_open(fname, &rcv_screen)) )
+			exit(1);
 		}
 
+	/* A save patching the file in place has been interrupted - complete it */
+	patch_replay(fname);
+
 	stat( fname, &file_info );
 
 	if ( S_ISDIR( file_info.st_mode ) )
@@ -3759,11 +6716,21 @@ struct stat file_info;
 		exit(1);
 		}
 
-	if ( !(infile = fopen(fname, "r")) )
+	if ( rcv_status == 1 )
+		{
+		if ( (file_exists = !stat(fname, &file_info)) && (infile = fopen(fname, "r")) )
+			{
+			if ( (cz_format = file_format(fileno(infile))) )
+				realpath(fname, cz_fname);
+
+			fclose(infile);
+			}
+		}
+	else if ( !(infile = fopen(fname, "r")) )
 		{
 		file_exists = 0;
 
-		printf("Input file '%s' does not exist\n[EOB %s]\n", fname, active_buffer_name);
+		out_printf("Input file '%s' does not exist\n[EOB %s]\n", fname, active_buffer_name);
 
 		tframe_row = last_row = curse_row = last_curse_col = rel_curse_row = rel_curse_col = 0;
 		curse_pt = EOB;
@@ -3774,7 +6741,23 @@ struct stat file_info;
 		curse_pt = EOB; /* keep inserting at eob */
 
 
-		load_file();
+		/* A compressed file is expanded to the buffer, it can't be patched in place */
+		if ( view_mode && (0 < (i = view_file(fname, &openatlinenum))) )
+			openatlinenum -= i - 1;
+		else if ( view_mode && (i < 0) )
+			exit(1);
+		else if ( 0 > (i = load_file()) )
+			keep_valid = 1;		/* Only a part of it is in the buffer */
+		else if ( (cz_format = i) )
+			realpath(fname, cz_fname);
+		else	disk_image(fname, fileno(infile));
+
+		if ( view_mode )
+			keep_valid = 1;
+
+		if ( keep_valid )
+			fstat(fileno(infile), &keep_st);
+
 		fclose(infile);
 
 		tframe_row = curse_row = last_curse_col = rel_curse_row = rel_curse_col = 0;
@@ -3782,21 +6765,15 @@ struct stat file_info;
 		changed = 0;
 		}
 
-	if ( gzipd_file )
-		{
-		char cmd[4096] = "gzip ";
-		strcat( cmd, fname );
-		system( cmd );
-		strcat( fname, ".gz" );
-		}
-
-	open_journal_file(fname);
+	/* Nothing to recover in a view */
+	if ( !view_mode )
+		open_journal_file(fname);
 
-	if ( openatlinenum > 1 )
+	if ( (openatlinenum > 1) && (rcv_status != 1) )
 		{
 		tmp_pt = curse_pt;
 		move_pt_begin_of_line( &tmp_pt );
-		printf("Opening at line %d.\n", openatlinenum);
+		out_printf("Opening at line %d.\n", openatlinenum);
 		i = 1;
 		curse_pt = txt_head->nxt;
 
@@ -3809,35 +6786,46 @@ struct stat file_info;
 			}
 
 		if (i != openatlinenum )
-			printf("ONLY %d LINES in FILE.\n", i);
+			out_printf("ONLY %d LINES in FILE.\n", i);
 
 		curse_row = i - 1;
 		//adjust_screen_parameters();
 		}
 
+	/* Checkpoint has been taken in the screen mode - go on replaying there */
+	if ( rcv_screen )
+		{
+		screen_mode_setup();
+		screen_mode_loop();
+		}
+
 
 	do	{ /*line_mode_loop*/
-		printf("%d: ", curse_row + 1);
+		bg_save_poll();
+
+		if ( jou_count >= JOU_CKP_BYTES )
+			checkpoint_journal();
+
+		out_printf("%d: ", curse_row + 1);
 		tmp_pt = curse_pt;
 		move_pt_begin_of_line( &tmp_pt );
 		spew_line( tmp_pt );
-		printf("\n");
+		out_printf("\n");
 
 		if ( strcmp(active_buffer_name, "main") )
-			printf("%s", active_buffer_name);
+			out_printf("%s", active_buffer_name);
 
-		printf("*");
+		out_printf("*");
 
 		/* scanf("%s",com_line);  ch = getchar(); */
 		i = 0;
 		do	{
-			com_line[i++] = getchar();
-		} while ( (com_line[i-1] != '\n') && (com_line[i-1] != '\r') );
+			com_line[i++] = edt_getc();
+		} while ( (com_line[i-1] != '\n') && (com_line[i-1] != '\r') && (i < (int) sizeof(com_line) - 1) );
 
 		com_line[i-1] = '\0';
 		xml_remove_leading_trailing_spaces( com_line );
-		printf("%s\n", com_line);
-		fprintf(jou_outfile,"%s\n", com_line );
+		out_printf("%s\n", com_line);
 
 		if (com_line[0]=='\0')
 			{
@@ -3849,41 +6837,14 @@ struct stat file_info;
 			}
 		else	if ( !strcmp(com_line, "c") )
 			{ /*Screen_mode*/
-			resize(0);
-
-			printf("%c[m%c)B", EDT$K_ESC, EDT$K_ESC);
-			printf("%c[1;%dr", EDT$K_ESC, nrows-2 );	/*set scrolling region*/
-
-			system("stty raw");
-			system("stty -echo");
-
-			adjust_screen_parameters();
-			display_screen(1);
-
-			inpt1 = ctrl = 0;
-			ch = getchar();
-			fprintf(jou_outfile, "%c", ch);
-
-			/* While ^Z is not pressed. */
-			/* This is the main screen-mode editing loop. */
-			while (ch != 26)
-				{
-				handle_key(ch);
-				ch = getchar();
-				fprintf(jou_outfile,"%c", ch);
-				}
-
-			/* Nice Exit (Return terminal screen to nice way) */
-			printf("%c[m%c[1;%dr", EDT$K_ESC, EDT$K_ESC, nrows); /* Re-expand scrolling region*/
-			printf("%c[%d;1H%c[K", EDT$K_ESC, nrows - 1, EDT$K_ESC );
-			printf("%c[%d;1H%cE", EDT$K_ESC, nrows, EDT$K_ESC);
-			printf("%c[%d;1H", EDT$K_ESC, nrows-1 );
-
-			system("stty -raw");
-			system("stty echo");
+			screen_mode_setup();
+			screen_mode_loop();
 			} /*Screen_mode*/
 		else if (!strcmp(com_line,"configure_keypad") )
-			configure_keyboard();
+			{
+			if ( !rcv_buf )		/* Not while replaying the journal */
+				configure_keyboard();
+			}
 		else if (com_line[0] == 'q' )
 			{
 			leave = 1;
@@ -3892,14 +6853,14 @@ struct stat file_info;
 				{
 				if ( com_line[1] != '!' )
 					{
-					printf("Really Quit (y/n) ? ");
-					scanf("%s", com_line );
+					out_printf("Really Quit (y/n) ? ");
+					read_answer(com_line, sizeof(com_line));
 
 					if (com_line[0] != 'y')
 						leave = 0;
 					}
 				}
-			else	printf("No Changes.\n");
+			else	out_printf("No Changes.\n");
 			}
 		else	if ( !strncmp(com_line, "ex", 2) )
 			{
@@ -3907,36 +6868,42 @@ struct stat file_info;
 				{
 				if ( !changed )
 					{
-					printf("  FILE WAS READ_ONLY, AND THERE WHERE NO CHANGES.\n");
-					printf("  THEREFORE, FILE WAS NOT RE-WRITTEN.\n");
+					out_printf("  FILE WAS READ_ONLY, AND THERE WHERE NO CHANGES.\n");
+					out_printf("  THEREFORE, FILE WAS NOT RE-WRITTEN.\n");
 					leave = 1;
 					}
-				else	printf("%c  FILE WAS OPENED AS 'READ_ONLY'.\n  NO WRITE PERFORMED.\n",EDT$K_BELL);
+				else	out_printf("%c  FILE WAS OPENED AS 'READ_ONLY'.\n  NO WRITE PERFORMED.\n",EDT$K_BELL);
 				}
 			else	{
 				if ( !changed )
-					printf("There were NO changes.\n");
+					out_printf("There were NO changes.\n");
 
 				if ( strcmp(active_buffer_name, "main") )
 					{
-					printf("\nWARNING:\n You are not exiting from the 'main' buffer.\n");
-					printf(" Only the current buffer '%s' will be saved.\n", active_buffer_name );
-					printf(" The contents of the 'main' buffer will be lost.\n");
-					printf(" Do you really want to exit from this buffer (y/n) ? ");
-					scanf("%s",com_line);
+					out_printf("\nWARNING:\n You are not exiting from the 'main' buffer.\n");
+					out_printf(" Only the current buffer '%s' will be saved.\n", active_buffer_name );
+					out_printf(" The contents of the 'main' buffer will be lost.\n");
+					out_printf(" Do you really want to exit from this buffer (y/n) ? ");
+					read_answer(com_line, sizeof(com_line));
 					}
 				else	com_line[0] = 'y';
 
 				if (com_line[0] == 'y')
 					{
+					bg_save_wait();
+
 					if ( file_exists == 1 )
 					 /* Before over-writing file, copy existing file to back-up */
-					copy_backup(fname);
+					 {
+					 if ( save_in_place(fname) )
+						copy_backup(fname);
+					 else	link_backup(fname);
+					 }
 
 					if ( !write_file(fname) )
 						leave = 1;
 					}
-				else	printf("\nExit was averted.  File was NOT WRITTEN.\n\n");
+				else	out_printf("\nExit was averted.  File was NOT WRITTEN.\n\n");
 				}
 			}
 		else if ( !strncmp(com_line, "wpb", 3) )
@@ -3944,14 +6911,14 @@ struct stat file_info;
 			next_word(com_line,name1,delimiters); next_word(com_line,name1,delimiters);
 
 			if ( name1[0] == '\0')
-				printf("Missing file name:  wpb <file_name>%c\n", EDT$K_BELL);
+				out_printf("Missing file name:  wpb <file_name>%c\n", EDT$K_BELL);
 			else	{
 				if ( paste_buffer )
 					{
-					printf("Writing Paste Buffer to File %s\n", name1);
+					out_printf("Writing Paste Buffer to File %s\n", name1);
 					i = write_buffer(paste_buffer, name1);
 					}
-				else	printf("Paste Buffer Empty.  No file written.%c\n", EDT$K_BELL );
+				else	out_printf("Paste Buffer Empty.  No file written.%c\n", EDT$K_BELL );
 				}
 			}
 		else if ( !strncmp(com_line, "wb", 2) )
@@ -3963,9 +6930,9 @@ struct stat file_info;
 			next_word(com_line, name1, delimiters);
 
 			if ( (bufname[0] == '\0') || (name1[0] == '\0') )
-				printf("Missing argument:  wb <buffer_name> <file_name>%c\n", EDT$K_BELL);
+				out_printf("Missing argument:  wb <buffer_name> <file_name>%c\n", EDT$K_BELL);
 			else	{
-				printf("Writing Buffer: %s to file %s\n", bufname, name1);
+				out_printf("Writing Buffer: %s to file %s\n", bufname, name1);
 
 				/* Search for existing buffer. */
 				tmp_buff_pt = buffer_list;
@@ -3975,20 +6942,20 @@ struct stat file_info;
 
 				if ( tmp_buff_pt )
 					i = write_buffer(tmp_buff_pt->txt_head,name1);
-				else	printf("No Buffer called '%s'.  No file written.%c\n", bufname, EDT$K_BELL );
+				else	out_printf("No Buffer called '%s'.  No file written.%c\n", bufname, EDT$K_BELL );
 				}
 			}
 		else	if (com_line[0] == 'w')
 			{
-			printf("Writing File: ");
+			out_printf("Writing File: ");
 			next_word(com_line,name1,delimiters); next_word(com_line,name1,delimiters);
 
 			if ( name1[0] == '\0')
 				{
 				if (strcmp(active_buffer_name, "main") != 0)
 					{
-					printf("\nWARNING:\n You are not saving from the 'main' buffer.\n");
-					printf(" Only the current buffer '%s' is being written to file '%s'.\n\n", active_buffer_name, fname );
+					out_printf("\nWARNING:\n You are not saving from the 'main' buffer.\n");
+					out_printf(" Only the current buffer '%s' is being written to file '%s'.\n\n", active_buffer_name, fname );
 					}
 
 				i=0;
@@ -4000,8 +6967,18 @@ struct stat file_info;
 				}
 
 			/* scanf("%s", name1); */
-			printf("'%s'\n", name1);
-			i = write_file(name1);
+			out_printf("'%s'\n", name1);
+
+			if ( com_line[1] == 'q' )
+				{
+				bg_save_wait();
+				i = write_file(name1);
+				}
+			else	i = bg_write_file(name1);
+
+			/* File on the disk has everything, no need to keep a long journal of it */
+			if ( !i && !bg_pid && !strcmp(name1, fname) )
+				checkpoint_journal();
 
 			if (com_line[1] == 'q')
 				{ /*write-quit*/
@@ -4009,61 +6986,46 @@ struct stat file_info;
 
 				if ((changed != 0) && (com_line[2] != '!'))
 					{
-					printf("Really Quit (y/n) ? "); scanf("%s", com_line );
+					out_printf("Really Quit (y/n) ? "); read_answer(com_line, sizeof(com_line));
 					if (com_line[0] != 'y') leave = 0;
 					}
-				else	printf("No Changes.\n");
+				else	out_printf("No Changes.\n");
 				} /*write-quit*/
 			}
 		else if ( (!strncmp(com_line, "rea", 3)) || (!strncmp(com_line, "incl", 4)) )
 			{
-			char	*suffix;
-			int	tmpgzunzip = 0;
 			next_word(com_line, name1, delimiters);
 			next_word(com_line, name1, delimiters);
 			/* scanf("%s", name1); */
 
-			suffix = strstr(name1,".gz");
-
-			if ( (suffix ) && (strlen(suffix) == 3))
-				{
-				char cmd[4096]="gunzip ";
-				printf(" Temporarily gunzip'ing %s\n", fname );
-				strcat( cmd, name1 );
-				system( cmd );
-				suffix[0] = '\0';	/* Trucate the gzip suffix. */
-				tmpgzunzip = 1;
-				}
-
 			infile = fopen(name1, "r");
 
 			if ( !infile)
-				printf("File '%s' NOT FOUND.\n", name1);
+				out_printf("File '%s' NOT FOUND.\n", name1);
 			else	{
-				printf("File '%s': ", name1);
+				out_printf("File '%s': ", name1);
 				i = last_row;  			    /* save number of rows */
 				load_file();
 				fclose(infile);
 				curse_row = curse_row + last_row - i;  /* compute new curse_row */
 				adjust_screen_parameters();
-				if (tmpgzunzip)
-					{
-					char cmd[4096] = "gzip ";		/* Restore gzip'd file. */
-
-					strcat( cmd, name1 );
-					system( cmd );
-					}
 				}
 			}
 		else	if ( !strcmp(com_line, "rk") )		/* Restore Keyboard Map */
 			{
-			printf("\n Restoring numeric keypad to original (pre-editor) configuration.\n\n");
-			restore_keypad_setup();
+			out_printf("\n Restoring numeric keypad to original (pre-editor) configuration.\n\n");
+
+			if ( !rcv_buf )
+				restore_keypad_setup();
 			}
 		else	if ( !strcmp(com_line, "sk") )		/* Restore Keyboard Map */
 			{
-			printf("\n Restoring numeric keypad to Edt configuration.\n\n");
-			get_keypad_setup();
+			out_printf("\n Restoring numeric keypad to Edt configuration.\n\n");
+
+			if ( !rcv_buf )
+				get_keypad_setup();
+
+			key_compile();
 			}
 		else	if (edt_isnum(com_line[0]))	/* line number */
 			{
@@ -4071,7 +7033,7 @@ struct stat file_info;
 				j = 10 * j + com_line[i] - 48;
 
 			if ( com_line[i] != '\0' )
-				printf("NON-NUMERIC CHAR '%c' in line number.\n", com_line[i]);
+				out_printf("NON-NUMERIC CHAR '%c' in line number.\n", com_line[i]);
 			else	{
 				curse_pt = txt_head->nxt;
 				i = 1;
@@ -4085,7 +7047,7 @@ struct stat file_info;
 					}
 
 				if (i != j)
-					printf("ONLY %d LINES in FILE.\n", i);
+					out_printf("ONLY %d LINES in FILE.\n", i);
 
 				curse_row = i - 1;
 				adjust_screen_parameters();
@@ -4094,27 +7056,32 @@ struct stat file_info;
 		else	if ( com_line[0] == '!' )		/* System escape.  Perform external OS command. */
 			{
 			com_line[0] = ' ';  /* Remove the leading bang ('!'). */
-			system(com_line);
+
+			if ( !rcv_buf )		/* Don't repeat side effects while replaying the journal */
+				system(com_line);
 			}
 		else	if ( !strncmp(com_line, "ls", 2) ) /* List directory. */
 			{
-			system(com_line);
+			if ( !rcv_buf )
+				system(com_line);
 			}
 		else	if ( !strncmp(com_line, "dir", 3) ) /* List directory, full style. */
 			{
 			strcpy(name1, com_line);
 			strcpy(com_line, "ls -l ");
 			strcat(com_line, &(name1[3]) );
-			system(com_line);
+
+			if ( !rcv_buf )
+				system(com_line);
 			}
 		else	if ( (!strncmp(com_line, "case", 4)) || (!strncmp(com_line, "cap", 3)) )
 			{
 			srch_caps = !srch_caps;
 
-			printf("Search will be CAPS %sSENSITIVE\n", srch_caps ? "IN" : "");
+			out_printf("Search will be CAPS %sSENSITIVE\n", srch_caps ? "IN" : "");
 			}
 		else	if ( !strcmp(com_line, "file") )
-			printf("Editing file '%s'.\n", fname );	/* Show the name of file being edited. */
+			out_printf("Editing file '%s'.\n", fname );	/* Show the name of file being edited. */
 		else	if ( !strcmp(com_line, "help_config") )
 			help_keypad_setup();
 		else	if ( !strncmp(com_line, "help", 4) )
@@ -4131,32 +7098,32 @@ struct stat file_info;
 				next_word(com_line, name1, delimiters);
 
 				if (sscanf(name1, "%d", &i) != 1 )
-					printf("Expected Integer Number of Rows.\n");
+					out_printf("Expected Integer Number of Rows.\n");
 				else	nrows = i;
 
-				printf("Nrows = %d\n", nrows);
+				out_printf("Nrows = %d\n", nrows);
 				}
 			else	if ( !strncmp(name1, "co", 2) )
 				{
 				next_word(com_line, name1, delimiters);
 
 				if (sscanf(name1, "%d", &i) !=1 )
-					printf("Expected Integer Number of Columns (Right Margin).\n");
+					out_printf("Expected Integer Number of Columns (Right Margin).\n");
 				else	ncols = i;
 
-				printf("Ncols = %d\n", ncols);
+				out_printf("Ncols = %d\n", ncols);
 				}
 			else	if ( (!strncmp(name1, "ma", 2)) || (!strncmp(name1, "wr", 2)) )
 				{
 				next_word(com_line, name1, delimiters);
 
 				if (sscanf(name1, "%d", &i) !=1 )
-					printf("Expected Integer Margin Number (Right Margin).\n");
+					out_printf("Expected Integer Margin Number (Right Margin).\n");
 				else	right_margin = i;
 
-				printf("Right Margin Formatting Wrap Setting = %d\n", right_margin);
+				out_printf("Right Margin Formatting Wrap Setting = %d\n", right_margin);
 				}
-			else	printf("Unknown set /%s/\n", name1);
+			else	out_printf("Unknown set /%s/\n", name1);
 			}
 		else	if ( (com_line[0] == 's') && (strncmp(com_line, "start", 5)))   /*Substitute command*/
 			{
@@ -4176,6 +7143,7 @@ struct stat file_info;
 		tmp_buff_pt->EOB = EOB;
 		tmp_buff_pt->curse_row = curse_row;
 		tmp_buff_pt->last_row = last_row;
+		tmp_buff_pt->hscroll = hscroll;
 
 		/* Now get the new active buffer name. */
 		for (i = 0; com_line[i+1] != '\0'; i++ )
@@ -4201,7 +7169,7 @@ struct stat file_info;
 
 		if ( strcmp(tmp_buff_pt->buff_name,active_buffer_name) )  /*Then new buffer.*/
 			{
-			printf("Establishing new buffer '%s'.\n", active_buffer_name );
+			out_printf("Establishing new buffer '%s'.\n", active_buffer_name );
 
 			tmp_buff_pt = (struct __buf_lis__ *)malloc(sizeof(struct __buf_lis__));
 			strcpy(tmp_buff_pt->buff_name,active_buffer_name);
@@ -4211,6 +7179,7 @@ struct stat file_info;
 
 			tmp_buff_pt->curse_row = 0;
 			tmp_buff_pt->last_row = 0;
+			tmp_buff_pt->hscroll = 0;
 
 			tmp_buff_pt->EOB = new_ch();
 			tmp_buff_pt->EOB->nxt = 0;
@@ -4229,16 +7198,17 @@ struct stat file_info;
 		EOB = tmp_buff_pt->EOB;
 		curse_row = tmp_buff_pt->curse_row;
 		last_row = tmp_buff_pt->last_row;
+		hscroll = tmp_buff_pt->hscroll;
 		mark_pt1 = 0;  Mark = 0;
 		}
 	else	if ( !strncmp(com_line, "list", 4) )
 		{
-		printf("\n Buffer Name List:\n");
+		out_printf("\n Buffer Name List:\n");
 
 		for (tmp_buff_pt = buffer_list; tmp_buff_pt; tmp_buff_pt = tmp_buff_pt->nxt)
-			printf("			%s\n", tmp_buff_pt->buff_name);
+			out_printf("			%s\n", tmp_buff_pt->buff_name);
 
-		printf("\n");
+		out_printf("\n");
 		}
 	else	if ( !strncmp(com_line, "resi", 4) )
 		resize(1);
@@ -4248,12 +7218,13 @@ struct stat file_info;
 			{
 			free(psswd);
 			encode_mode = 0;
-			printf("Unencoded-mode:\n");
+			disk_valid = 0;		/* File on the disk is encoded differently now */
+			out_printf("Unencoded-mode:\n");
 			}
 		else	{
-			encode_mode = 1;  printf("ENCODING-MODE:\nEnter Encode Password: ");
+			encode_mode = 1;  disk_valid = 0;  out_printf("ENCODING-MODE:\nEnter Encode Password: ");
 			psswd = (char *)malloc(256);
-			scanf("%s", psswd);
+			in_word(psswd, 256);
 			}
 		}
 	else	if ( (!strncmp(com_line, "begin", 3)) || (!strncmp(com_line, "start", 5)) )
@@ -4264,13 +7235,13 @@ struct stat file_info;
 
 		if (strncmp(name1,"c++prog", 2) == 0)
 			{
-			printf(" Inserting beginning lines of new C++ program.\n");
+			out_printf(" Inserting beginning lines of new C++ program.\n");
 			insert_string( "#include <iostream.h>\nusing namespace std;\n\n\n" );
 			insert_string( "int main( int argc, char *argv[] )\n{\n\n\n return 0;\n}\n" );
 			}
 		else	if (!strncmp(name1, "cprog", 1) )
 			{
-			printf(" Inserting beginning lines of new C program.\n");
+			out_printf(" Inserting beginning lines of new C program.\n");
 			insert_string( "#include\t<stdio.h>\n" );
 			insert_string( "#include\t<string.h>\n" );
 			insert_string( "#include\t<stdlib.h>\n\n\n" );
@@ -4278,7 +7249,7 @@ struct stat file_info;
 			}
 		else	if ( !strncmp(name1, "javaprog", 3) )
 			{
-			printf(" Inserting beginning lines of new Java program.\n");
+			out_printf(" Inserting beginning lines of new Java program.\n");
 			strcpy(name1,fname);	/* Pick class name as file-name, minus suffix. */
 			for (j = 0; (name1[j] != '\0') && (name1[j] != '.'); j++);
 
@@ -4292,22 +7263,22 @@ struct stat file_info;
 			}
 		else	if ( !strncmp(name1, "html", 3) )
 			{
-			printf(" Inserting beginning lines of new HTML page.\n");
+			out_printf(" Inserting beginning lines of new HTML page.\n");
 			insert_string( "<html>\n <head>\n  <title></title>\n </head>\n" );
 			insert_string( " <body bgcolor = \"#f0f0e4\">\n\n\n\n\n\n\n </body>\n</html>\n" );
 			}
-		else	printf("Unknown language '%s'\n", name1);
+		else	out_printf("Unknown language '%s'\n", name1);
 
 		curse_row = curse_row + last_row - jj;  /* compute new curse_row */
 		adjust_screen_parameters();
 		} /*insert-a-program-shell*/
 	else	if ( com_line[0] != '\0' )
-		printf("Unknown command /%s/\n", com_line);
+		out_printf("Unknown command /%s/\n", com_line);
 
 		} while (!leave);	/* Continue interpretting commands while not 'leave'. */
 
 
-
+	bg_save_wait();
 	remove_journal_file(fname);
 
 
@@ -0,0 +1,548 @@
+#define	__MODULE__	"EDT_BENCH"
+
+/*
+**++
+**
+**  FACILITY:  EDT
+**
+**  ABSTRACT: Simple text editor emulates VAX VMS EDT
+**
+**  DESCRIPTION: This module is a part of the EDT project, a standalone benchmark of the
+**	at-rest formats of the editor: SCZ (scz_routines.c), gzip (edt_gzip.c) and plain
+**	files, going through the same calls as the save/load of the editor do.
+**
+**	A synthetic corpus (logs, C source, CSV and binary-ish records) is generated, each
+**	sample is saved and loaded back in every format by a forked child; the child's
+**	peak RSS is taken by wait4().  Results are printed as CSV or JSON, e.g.:
+**
+**		edt_bench [-json] [-size <MB>] [-reps <n>] [-level <1-9>] [-dir <path>] [file ...]
+**
+**	Files given on the command line are benchmarked in addition to the corpus.
+**
+**  AUTHORS: agent <agent@local>
+**
+**  CREATION DATE:  19-OCT-2026
+**
+**  MODIFICATION HISTORY:
+**
+**	19-OCT-2026	agent	Created.
+**
+**
+*/
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<sys/types.h>
+#include	<sys/stat.h>
+#include	<sys/time.h>
+#include	<sys/resource.h>
+#include	<sys/wait.h>
+#include	<unistd.h>
+#include	<fcntl.h>
+#include	<errno.h>
+#include	<limits.h>
+#include	<time.h>
+
+#include	"scz_routines.c"
+
+/*
+ * GZIP-Externals, see edt_gzip.c
+ */
+typedef	struct __gz_stream__ GZ_STREAM;
+
+extern	int	gz_inflate_fd(int fd, int (*put)(void *ctx, unsigned char *buf, long len), void *ctx);
+extern	GZ_STREAM *gz_deflate_open(int fd, int level);
+extern	int	gz_deflate_write(GZ_STREAM *z, const unsigned char *buf, long len);
+extern	int	gz_deflate_close(GZ_STREAM *z);
+
+#define	BENCH_BLKSZ	(64 * 1024)	/* The editor writes/reads by so much, see wr_chain()/load_file() */
+
+enum	{ FMT_PLAIN, FMT_GZIP, FMT_SCZ, FMT_COUNT };
+
+static	char	*fmt_name[FMT_COUNT] = { "plain", "gzip", "scz" };
+
+/*
+ * Results of a case, from the child
+ */
+typedef	struct __bench_res__ {
+	long	size, packed;
+	double	tcomp, tdecomp;		/* Seconds, the best of the reps */
+	int	ok;
+} BENCH_RES;
+
+static	int	json = 0, reps = 3, level = 6;
+static	long	sample_size = 16 * 1048576;
+static	char	*tmpdir = NULL;
+
+
+
+static	double	now	(void)
+{
+struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return	ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+
+/*
+ *	Synthetic corpus
+ *
+ * Every generator fills the buffer with the same text for the same size, the random
+ * numbers come from a fixed seed.
+ */
+static	unsigned long long rnd_state;
+
+static	unsigned	rnd	(unsigned n)
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+
+	return	(unsigned) ((rnd_state >> 11) % n);
+}
+
+static	char	*pick	(char **list, int n)
+{
+	return	list[rnd(n)];
+}
+
+#define	NELEM(a)	((int) (sizeof(a) / sizeof(a[0])))
+
+static	char	*words[] = { "request", "session", "buffer", "timeout", "connection", "user",
+		"file", "cache", "queue", "worker", "record", "index", "journal", "block",
+		"update", "retry", "opened", "closed", "failed", "accepted", "ready" };
+
+static	char	*hosts[] = { "web01", "web02", "db01", "cache01", "batch03" };
+
+static	char	*daemons[] = { "sshd", "nginx", "postgres", "cron", "kernel", "systemd" };
+
+static	char	*levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+
+static	char	*types[] = { "int", "long", "char *", "unsigned", "TEXT *", "void" };
+
+static	char	*months[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep",
+		"Oct", "Nov", "Dec" };
+
+static	long	gen_logs	(unsigned char *buf, long size)
+{
+long	len = 0, t = 0;
+int	i, n;
+
+	while ( len < size - 512 )
+		{
+		t += rnd(1500);
+
+		len += sprintf((char *) buf + len, "%s %2u %02ld:%02ld:%02ld %s %s[%u]: %s ",
+			months[(t / 2678400) % 12], 1 + (unsigned) (t / 86400) % 28,
+			(t / 3600) % 24, (t / 60) % 60, t % 60,
+			pick(hosts, NELEM(hosts)), pick(daemons, NELEM(daemons)), 1000 + rnd(200),
+			pick(levels, NELEM(levels)));
+
+		for (i = 0, n = 3 + rnd(6); i < n; i++)
+			len += sprintf((char *) buf + len, "%s ", pick(words, NELEM(words)));
+
+		len += sprintf((char *) buf + len, "id=%u elapsed=%ums\n", rnd(100000), rnd(5000));
+		}
+
+	return	len;
+}
+
+static	long	gen_c	(unsigned char *buf, long size)
+{
+long	len = 0;
+int	i, n, fn = 0;
+
+	while ( len < size - 1024 )
+		{
+		len += sprintf((char *) buf + len, "\n\n/*\n * %s the %s of a %s\n */\n%s\t%s_%s_%d\t(%s *%s, int %s)\n{\n",
+			pick(words, NELEM(words)), pick(words, NELEM(words)), pick(words, NELEM(words)),
+			pick(types, NELEM(types)), pick(words, NELEM(words)), pick(words, NELEM(words)), fn++,
+			pick(types, NELEM(types)), pick(words, NELEM(words)), pick(words, NELEM(words)));
+
+		len += sprintf((char *) buf + len, "int\ti, n = %u;\n\n", rnd(64));
+
+		for (i = 0, n = 2 + rnd(8); i < n; i++)
+			switch ( rnd(4) )
+				{
+				case 0:
+					len += sprintf((char *) buf + len, "\tfor (i = 0; i < n; i++)\n\t\t%s[i] = %s(%s, i);\n\n",
+						pick(words, NELEM(words)), pick(words, NELEM(words)), pick(words, NELEM(words)));
+					break;
+				case 1:
+					len += sprintf((char *) buf + len, "\tif ( %s->%s == %u )\n\t\treturn\t%s;\n\n",
+						pick(words, NELEM(words)), pick(words, NELEM(words)), rnd(256), pick(words, NELEM(words)));
+					break;
+				case 2:
+					len += sprintf((char *) buf + len, "\tprintf(\"%%cERROR %s %s (%%s).\\n\", EDT$K_BELL, strerror(errno));\n",
+						pick(words, NELEM(words)), pick(words, NELEM(words)));
+					break;
+				default:
+					len += sprintf((char *) buf + len, "\t%s = %s + %u;\t/* %s */\n",
+						pick(words, NELEM(words)), pick(words, NELEM(words)), rnd(1000), pick(words, NELEM(words)));
+				}
+
+		len += sprintf((char *) buf + len, "\n\treturn\t0;\n}\n");
+		}
+
+	return	len;
+}
+
+static	long	gen_csv	(unsigned char *buf, long size)
+{
+long	len = 0, id = 0, t = 1700000000;
+
+	len += sprintf((char *) buf, "id,timestamp,host,user,latency,amount,status\n");
+
+	while ( len < size - 256 )
+		{
+		t += rnd(30);
+
+		len += sprintf((char *) buf + len, "%ld,%ld,%s,%s%u,%u.%03u,%u.%02u,%s\n",
+			++id, t, pick(hosts, NELEM(hosts)), pick(words, NELEM(words)), rnd(500),
+			rnd(20), rnd(1000), rnd(10000), rnd(100), pick(levels, NELEM(levels)));
+		}
+
+	return	len;
+}
+
+/* Records with counters, small integers, floats and some noise */
+static	long	gen_binary	(unsigned char *buf, long size)
+{
+long	len = 0;
+unsigned seq = 0;
+float	f = 0;
+int	i;
+
+	while ( len < size - 64 )
+		{
+		seq += 1 + rnd(3);
+		f += (rnd(2000) - 1000) / 100.0f;
+
+		memcpy(buf + len, &seq, sizeof(seq));
+		len += sizeof(seq);
+		memcpy(buf + len, &f, sizeof(f));
+		len += sizeof(f);
+
+		buf[len++] = rnd(4);
+		buf[len++] = 0;
+		buf[len++] = rnd(256);
+		buf[len++] = 0xff;
+
+		for (i = 0; i < 8; i++)
+			buf[len++] = (rnd(4) == 0) ? rnd(256) : 0;
+		}
+
+	return	len;
+}
+
+typedef	struct __corpus__ {
+	char	*name;
+	long	(*gen) (unsigned char *buf, long size);
+} CORPUS;
+
+static	CORPUS	corpus[] = {
+	{ "logs", gen_logs },
+	{ "c", gen_c },
+	{ "csv", gen_csv },
+	{ "binary", gen_binary }
+	};
+
+static	unsigned char *make_sample	(CORPUS *c, long *len)
+{
+unsigned char *buf;
+
+	if ( !(buf = malloc(sample_size)) )
+		return	NULL;
+
+	rnd_state = 0x9e3779b97f4a7c15ULL;
+	*len = c->gen(buf, sample_size);
+
+	return	buf;
+}
+
+static	unsigned char *read_sample	(char *fname, long *len)
+{
+unsigned char *buf;
+struct stat st;
+long	n = 0, k;
+int	fd;
+
+	if ( 0 > (fd = open(fname, O_RDONLY)) )
+		return	NULL;
+
+	if ( fstat(fd, &st) || !(buf = malloc(st.st_size + 1)) )
+		{
+		close(fd);
+		return	NULL;
+		}
+
+	while ( (n < st.st_size) && (0 < (k = read(fd, buf + n, st.st_size - n))) )
+		n += k;
+
+	close(fd);
+	*len = n;
+
+	return	buf;
+}
+
+
+
+/*
+ *	Save and load in a format
+ */
+static	int	save_plain	(int fd, unsigned char *buf, long len)
+{
+long	n;
+
+	for ( ; len; buf += n, len -= n)
+		if ( !scz_write(fd, buf, n = (len < BENCH_BLKSZ) ? len : BENCH_BLKSZ) )
+			return	0;
+
+	return	1;
+}
+
+static	int	save_gzip	(int fd, unsigned char *buf, long len)
+{
+GZ_STREAM *z;
+int	err = 0;
+long	n;
+
+	if ( !(z = gz_deflate_open(fd, level)) )
+		return	0;
+
+	for ( ; !err && len; buf += n, len -= n)
+		err = gz_deflate_write(z, buf, n = (len < BENCH_BLKSZ) ? len : BENCH_BLKSZ);
+
+	return	!gz_deflate_close(z) && !err;
+}
+
+/*
+ * Loading sink: the data is checked against the original as it goes
+ */
+typedef	struct __bench_load__ {
+	unsigned char	*ref;
+	long		len, pos;
+	int		bad;
+} BENCH_LOAD;
+
+static	int	load_put	(void *ctx, unsigned char *buf, long len)
+{
+BENCH_LOAD *ld = ctx;
+
+	if ( (ld->pos + len > ld->len) || memcmp(ld->ref + ld->pos, buf, len) )
+		ld->bad = 1;
+
+	ld->pos += len;
+
+	return	0;
+}
+
+static	int	load_fmt	(int fmt, int fd, BENCH_LOAD *ld)
+{
+unsigned char buf[BENCH_BLKSZ], *data;
+long	n;
+
+	switch ( fmt )
+		{
+		case FMT_GZIP:
+			if ( gz_inflate_fd(fd, load_put, ld) )
+				return	0;
+			break;
+
+		case FMT_SCZ:
+			if ( !Scz_Decompress_Fd2Buffer(fd, &data, &n) )
+				return	0;
+
+			load_put(ld, data, n);
+			free(data);
+			break;
+
+		default:
+			while ( 0 < (n = read(fd, buf, sizeof(buf))) )
+				load_put(ld, buf, n);
+
+			if ( n < 0 )
+				return	0;
+		}
+
+	return	!ld->bad && (ld->pos == ld->len);
+}
+
+/*
+ * A case: save the sample in the format and load it back, the best times of the reps
+ */
+static	void	run_case	(int fmt, unsigned char *buf, long len, char *path, BENCH_RES *res)
+{
+BENCH_LOAD ld;
+struct stat st;
+double	t;
+int	i, fd, ok = 1;
+long	outlen;
+
+	res->size = len;
+	res->tcomp = res->tdecomp = 1e30;
+
+	for (i = 0; ok && (i < reps); i++)
+		{
+		if ( 0 > (fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600)) )
+			break;
+
+		t = now();
+
+		if ( fmt == FMT_GZIP )
+			ok = save_gzip(fd, buf, len);
+		else if ( fmt == FMT_SCZ )
+			ok = Scz_Compress_Buffer2Fd(buf, len, fd, &outlen);
+		else	ok = save_plain(fd, buf, len);
+
+		ok = !close(fd) && ok;
+
+		if ( (t = now() - t) < res->tcomp )
+			res->tcomp = t;
+
+		if ( !ok || (0 > (fd = open(path, O_RDONLY))) )
+			break;
+
+		fstat(fd, &st);
+		res->packed = st.st_size;
+
+		memset(&ld, 0, sizeof(ld));
+		ld.ref = buf;
+		ld.len = len;
+
+		t = now();
+		ok = load_fmt(fmt, fd, &ld);
+
+		if ( (t = now() - t) < res->tdecomp )
+			res->tdecomp = t;
+
+		close(fd);
+		}
+
+	unlink(path);
+	res->ok = ok && (i == reps);
+}
+
+
+
+static	void	report	(char *name, int fmt, BENCH_RES *res, long rss, int first)
+{
+double	mb = res->size / 1048576.0;
+double	ratio = res->packed ? (double) res->size / res->packed : 0;
+double	comp = (res->tcomp > 0) ? mb / res->tcomp : 0, decomp = (res->tdecomp > 0) ? mb / res->tdecomp : 0;
+
+	if ( !json )
+		{
+		if ( first )
+			printf("corpus,format,size,packed,ratio,compress_mbs,decompress_mbs,peak_rss_kb,ok\n");
+
+		printf("%s,%s,%ld,%ld,%.3f,%.1f,%.1f,%ld,%d\n", name, fmt_name[fmt], res->size,
+			res->packed, ratio, comp, decomp, rss, res->ok);
+		}
+	else	printf("%s\n  {\"corpus\": \"%s\", \"format\": \"%s\", \"size\": %ld, \"packed\": %ld, "
+			"\"ratio\": %.3f, \"compress_mbs\": %.1f, \"decompress_mbs\": %.1f, "
+			"\"peak_rss_kb\": %ld, \"ok\": %s}", first ? "[" : ",", name, fmt_name[fmt],
+			res->size, res->packed, ratio, comp, decomp, rss, res->ok ? "true" : "false");
+
+	fflush(stdout);
+}
+
+/*
+ * The sample is made and the case is run by a child, so the peak RSS is of this
+ * case alone: the sample, the codec's working memory and the loaded copy.
+ */
+static	int	bench	(char *name, CORPUS *c, char *fname, int fmt, int first)
+{
+BENCH_RES res = {0};
+struct rusage ru;
+unsigned char *buf;
+char	path[PATH_MAX];
+int	pfd[2], status;
+pid_t	pid;
+long	len;
+
+	snprintf(path, sizeof(path), "%s/edt_bench.%d.%s", tmpdir, (int) getpid(), fmt_name[fmt]);
+
+	if ( pipe(pfd) )
+		return	errno;
+
+	fflush(stdout);
+
+	if ( 0 > (pid = fork()) )
+		return	errno;
+
+	if ( !pid )
+		{
+		close(pfd[0]);
+
+		if ( (buf = c ? make_sample(c, &len) : read_sample(fname, &len)) )
+			run_case(fmt, buf, len, path, &res);
+
+		_exit(sizeof(res) != write(pfd[1], &res, sizeof(res)));
+		}
+
+	close(pfd[1]);
+
+	if ( sizeof(res) != read(pfd[0], &res, sizeof(res)) )
+		memset(&res, 0, sizeof(res));
+
+	close(pfd[0]);
+
+	while ( (0 > wait4(pid, &status, 0, &ru)) && (errno == EINTR) )
+		;
+
+	report(name, fmt, &res, ru.ru_maxrss, first);
+
+	return	0;
+}
+
+
+
+int	main	(int argc, char **argv)
+{
+int	i, k, fmt, first = 1;
+
+	for (i = 1; (i < argc) && (argv[i][0] == '-'); i++)
+		{
+		if ( !strcmp(argv[i], "-json") )
+			json = 1;
+		else if ( !strcmp(argv[i], "-size") && (i + 1 < argc) )
+			sample_size = atol(argv[++i]) * 1048576;
+		else if ( !strcmp(argv[i], "-reps") && (i + 1 < argc) )
+			reps = atoi(argv[++i]);
+		else if ( !strcmp(argv[i], "-level") && (i + 1 < argc) )
+			level = atoi(argv[++i]);
+		else if ( !strcmp(argv[i], "-dir") && (i + 1 < argc) )
+			tmpdir = argv[++i];
+		else	{
+			fprintf(stderr, "Usage: %s [-json] [-size <MB>] [-reps <n>] [-level <1-9>] [-dir <path>] [file ...]\n", argv[0]);
+			return	1;
+			}
+		}
+
+	if ( (sample_size < 4096) || (reps < 1) || (level < 1) || (level > 9) )
+		{
+		fprintf(stderr, "%s: bad -size, -reps or -level\n", argv[0]);
+		return	1;
+		}
+
+	if ( !tmpdir && !(tmpdir = getenv("TMPDIR")) )
+		tmpdir = "/tmp";
+
+	for (k = 0; k < NELEM(corpus); k++)
+		for (fmt = 0; fmt < FMT_COUNT; fmt++, first = 0)
+			bench(corpus[k].name, &corpus[k], NULL, fmt, first);
+
+	for ( ; i < argc; i++)
+		for (fmt = 0; fmt < FMT_COUNT; fmt++, first = 0)
+			bench(argv[i], NULL, argv[i], fmt, first);
+
+	if ( json )
+		printf("\n]\n");
+
+	return	0;
+}
@@ -0,0 +1,196 @@
+#define	__MODULE__	"EDT_CHECK"
+
+/*
+**++
+**
+**  FACILITY:  EDT
+**
+**  ABSTRACT: Simple text editor emulates VAX VMS EDT
+**
+**  DESCRIPTION: This module is a part of the EDT project, a standalone check which runs
+**	the editor on a pseudo terminal and looks at what it prints, e.g.:
+**
+**		edt_check [./edt]
+**
+**	Checked now: a ^Z typed ahead together with other keys leaves screen mode so that
+**	line mode still prints the text, and the next screen mode entry draws it again.
+**
+**  AUTHORS: agent <agent@local>
+**
+**  CREATION DATE:  19-OCT-2026
+**
+**  MODIFICATION HISTORY:
+**
+**	19-OCT-2026	agent	Created.
+**
+**
+*/
+
+#define	_XOPEN_SOURCE	700
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<sys/types.h>
+#include	<sys/ioctl.h>
+#include	<sys/wait.h>
+#include	<unistd.h>
+#include	<fcntl.h>
+#include	<errno.h>
+#include	<limits.h>
+#include	<poll.h>
+#include	<signal.h>
+#include	<termios.h>
+
+#define	CHECK_OUTMAX	(256 * 1024)
+
+static	int	pty_fd = -1;
+static	pid_t	edt_pid = -1;
+static	char	out[CHECK_OUTMAX];
+static	int	out_len = 0;
+
+
+
+/*
+ * Start the editor on a new pseudo terminal of 24 x 80
+ */
+static	int	edt_start	(char *edt, char *fname)
+{
+struct winsize ws = { 24, 80, 0, 0 };
+char	*slave;
+int	fd;
+
+	if ( (0 > (pty_fd = posix_openpt(O_RDWR | O_NOCTTY))) || grantpt(pty_fd) || unlockpt(pty_fd)
+		|| !(slave = ptsname(pty_fd)) )
+		{
+		perror("pty");
+		return	0;
+		}
+
+	if ( 0 > (edt_pid = fork()) )
+		{
+		perror("fork");
+		return	0;
+		}
+
+	if ( !edt_pid )
+		{
+		setsid();
+
+		if ( 0 > (fd = open(slave, O_RDWR)) )
+			_exit(127);
+
+		ioctl(fd, TIOCSCTTY, 0);
+		ioctl(fd, TIOCSWINSZ, &ws);
+		dup2(fd, 0);
+		dup2(fd, 1);
+		dup2(fd, 2);
+
+		if ( fd > 2 )
+			close(fd);
+
+		execl(edt, edt, fname, (char *) NULL);
+		_exit(127);
+		}
+
+	return	1;
+}
+
+/* Take what the editor prints until it has been quiet for ms */
+static	void	edt_drain	(int ms)
+{
+struct pollfd pfd = { 0, POLLIN, 0 };
+int	n;
+
+	pfd.fd = pty_fd;
+
+	while ( 0 < poll(&pfd, 1, ms) )
+		{
+		if ( 0 >= (n = read(pty_fd, out + out_len, CHECK_OUTMAX - 1 - out_len)) )
+			break;
+
+		out_len += n;
+		}
+
+	out[out_len] = '\0';
+}
+
+/* Send keys in one write(), as a burst typed ahead */
+static	void	edt_keys	(char *keys)
+{
+	if ( (int) strlen(keys) != write(pty_fd, keys, strlen(keys)) )
+		perror("write");
+
+	edt_drain(500);
+}
+
+static	void	edt_stop	(void)
+{
+	if ( edt_pid > 0 )
+		{
+		kill(edt_pid, SIGKILL);
+		waitpid(edt_pid, NULL, 0);
+		}
+
+	if ( pty_fd >= 0 )
+		close(pty_fd);
+}
+
+static	int	check	(char *what, int ok)
+{
+	printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+
+	return	ok;
+}
+
+
+
+int	main	(int argc, char **argv)
+{
+char	dir[] = "/tmp/edt_checkXXXXXX", fname[PATH_MAX];
+char	*edt = (argc > 1) ? argv[1] : "./edt", path[PATH_MAX];
+FILE	*f;
+int	ok = 1, mark;
+
+	if ( !realpath(edt, path) || !mkdtemp(dir) )
+		{
+		perror(edt);
+		return	2;
+		}
+
+	snprintf(fname, sizeof(fname), "%s/check.txt", dir);
+
+	if ( !(f = fopen(fname, "w")) )
+		{
+		perror(fname);
+		return	2;
+		}
+
+	fprintf(f, "hello\nworld\n");
+	fclose(f);
+
+	if ( chdir(dir) || !edt_start(path, "check.txt") )
+		return	2;
+
+	edt_drain(1000);
+
+	/* A key and ^Z in one burst: the frame for the key is never drawn */
+	edt_keys("c\r");
+	mark = out_len;
+	edt_keys("X\032");
+	ok &= check("line mode prints the line after a ^Z typed ahead", !!strstr(out + mark, "1: Xhello"));
+
+	mark = out_len;
+	edt_keys("c\r");
+	ok &= check("the next screen mode entry draws the text", !!strstr(out + mark, "Xhello"));
+
+	edt_keys("\032");
+	edt_keys("q!\r");
+
+	edt_stop();
+
+	snprintf(path, sizeof(path), "rm -rf %s", dir);
+	system(path);
+
+	return	!ok;
+}
@@ -0,0 +1,1918 @@
+#define	__MODULE__	"EDT_GZIP"
+
+/*
+**++
+**
+**  FACILITY:  EDT
+**
+**  ABSTRACT: Simple text editor emulates VAX VMS EDT
+**
+**  DESCRIPTION: This module is a part of the EDT project, contains a gzip (RFC 1952)
+**	streams reader and writer with own DEFLATE (RFC 1951) decoder and encoder, so
+**	compressed files go into/out of the editing buffer without gzip/gunzip.
+**
+**  AUTHORS: agent <agent@local>
+**
+**  CREATION DATE:  19-OCT-2026
+**
+**  MODIFICATION HISTORY:
+**
+**	19-OCT-2026	agent	Random access index: access points with 32K windows every 4M
+**				of the output, saved in a sidecar file, to read from a line.
+**
+**	19-OCT-2026	agent	Parallel deflate: independent chunks are compressed by a pool of
+**				threads (the way pigz does), primed with a 32K dictionary each.
+**
+**	19-OCT-2026	agent	Created.
+**
+**
+*/
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<string.h>
+#include	<sys/types.h>
+#include	<unistd.h>
+#include	<errno.h>
+#include	<setjmp.h>
+#include	<pthread.h>
+#include	<fcntl.h>
+#include	<limits.h>
+#include	<sys/stat.h>
+
+
+/*
+ * CRC-32 of the gzip trailer
+ */
+static	unsigned	crc_table[256];
+
+unsigned long	gz_crc32	(unsigned long crc, const unsigned char *buf, long len)
+{
+unsigned	c, i, k;
+
+	if ( !crc_table[1] )
+		for (i = 0; i < 256; i++)
+			{
+			for (c = i, k = 0; k < 8; k++)
+				c = (c & 1) ? (0xedb88320U ^ (c >> 1)) : (c >> 1);
+
+			crc_table[i] = c;
+			}
+
+	c = crc ^ 0xffffffffU;
+
+	while ( len-- )
+		c = crc_table[(c ^ *(buf++)) & 0xff] ^ (c >> 8);
+
+	return	c ^ 0xffffffffU;
+}
+
+
+/*
+ * CRC-32 of two pieces glued together from CRCs of them, len2 - length of the second
+ * one (zlib's crc32_combine(): the first CRC is run through len2 zero bytes by the
+ * GF(2) matrix squaring)
+ */
+static	unsigned	gf2_times	(const unsigned *mat, unsigned vec)
+{
+unsigned	sum = 0;
+
+	for ( ; vec; vec >>= 1, mat++)
+		if ( vec & 1 )
+			sum ^= *mat;
+
+	return	sum;
+}
+
+static	void	gf2_square	(unsigned *square, const unsigned *mat)
+{
+int	n;
+
+	for (n = 0; n < 32; n++)
+		square[n] = gf2_times(mat, mat[n]);
+}
+
+unsigned long	gz_crc32_combine	(unsigned long crc1, unsigned long crc2, long len2)
+{
+unsigned even[32], odd[32], row;
+int	n;
+
+	if ( len2 <= 0 )
+		return	crc1;
+
+	odd[0] = 0xedb88320U;		/* A zero bit operator */
+
+	for (n = 1, row = 1; n < 32; n++, row <<= 1)
+		odd[n] = row;
+
+	gf2_square(even, odd);		/* Two zero bits */
+	gf2_square(odd, even);		/* Four zero bits */
+
+	do	{
+		gf2_square(even, odd);
+
+		if ( len2 & 1 )
+			crc1 = gf2_times(even, crc1);
+
+		if ( !(len2 >>= 1) )
+			break;
+
+		gf2_square(odd, even);
+
+		if ( len2 & 1 )
+			crc1 = gf2_times(odd, crc1);
+
+	} while ( len2 >>= 1 );
+
+	return	crc1 ^ crc2;
+}
+
+
+/*
+ * DEFLATE tables: base values and extra bits for length (257..285) and distance codes
+ */
+static	const unsigned short len_base[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+
+static	const unsigned char len_extra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+static	const unsigned short dist_base[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+
+static	const unsigned char dist_extra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+/* Order of the code length code lengths */
+static	const unsigned char cl_order[19] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+
+static	unsigned	bit_reverse	(unsigned code, int len)
+{
+unsigned	r = 0;
+
+	while ( len-- )
+		{
+		r = (r << 1) | (code & 1);
+		code >>= 1;
+		}
+
+	return	r;
+}
+
+
+
+/*
+ *	INFLATE
+ */
+#define	GZ_INSZ		(64 * 1024)
+#define	GZ_WSIZE	32768
+#define	GZ_OUTSZ	(256 * 1024)
+#define	GZ_FASTBITS	10
+
+typedef	struct __huff__ {
+	short		count[16];		/* Number of codes of each length */
+	short		symbol[288];		/* Symbols ordered by code */
+	unsigned short	fast[1 << GZ_FASTBITS];	/* (length << 9) | symbol, 0 - not a short code */
+} HUFF;
+
+typedef	struct __inflate__ {
+	int		fd;
+	unsigned char	in[GZ_INSZ];
+	long		in_pos, in_len;
+	long long	in_off;			/* File offset of in[] */
+	unsigned long long bitbuf;
+	int		bitcnt;
+
+	unsigned char	out[GZ_OUTSZ];		/* Last 32K is kept as the window */
+	long		out_pos, out_base;
+	unsigned long	crc, size;
+	int		check;			/* Member is decoded from its start, the trailer is checked */
+
+	unsigned long long total, lines;	/* All members, while an index is built */
+	struct __gz_index__ *idx;
+
+	int		(*put)(void *ctx, unsigned char *buf, long len);
+	void		*ctx;
+
+	jmp_buf		env;
+	int		err;
+
+	HUFF		lit, dist;
+} INFLATE;
+
+
+static	void	inf_error	(INFLATE *s, int err)
+{
+	s->err = err;
+	longjmp(s->env, 1);
+}
+
+/* Get more input, 0 - end of file */
+static	int	inf_fill	(INFLATE *s)
+{
+ssize_t	n;
+
+	s->in_off += s->in_len;
+
+	while ( 0 > (n = read(s->fd, s->in, GZ_INSZ)) )
+		if ( errno != EINTR )
+			inf_error(s, errno);
+
+	s->in_pos = 0;
+	s->in_len = n;
+
+	return	n > 0;
+}
+
+static	inline	void	inf_need	(INFLATE *s, int n)
+{
+	while ( s->bitcnt < n )
+		{
+		if ( (s->in_pos == s->in_len) && !inf_fill(s) )
+			inf_error(s, -1);	/* Truncated */
+
+		s->bitbuf |= (unsigned long long) s->in[s->in_pos++] << s->bitcnt;
+		s->bitcnt += 8;
+		}
+}
+
+static	inline	unsigned	inf_bits	(INFLATE *s, int n)
+{
+unsigned	v;
+
+	if ( !n )
+		return	0;
+
+	inf_need(s, n);
+
+	v = s->bitbuf & ((1U << n) - 1);
+	s->bitbuf >>= n;
+	s->bitcnt -= n;
+
+	return	v;
+}
+
+/* Is there anything left: another gzip member may follow */
+static	int	inf_more	(INFLATE *s)
+{
+	return	s->bitcnt || (s->in_pos < s->in_len) || inf_fill(s);
+}
+
+static	void	inf_flush	(INFLATE *s)
+{
+long	n = s->out_pos - s->out_base;
+unsigned char *cp, *end;
+int	err;
+
+	if ( !n )
+		return;
+
+	if ( s->check )
+		s->crc = gz_crc32(s->crc, s->out + s->out_base, n);
+
+	s->size += n;
+
+	if ( s->idx )
+		{
+		s->total += n;
+
+		for (cp = s->out + s->out_base, end = s->out + s->out_pos; (cp = memchr(cp, '\n', end - cp)); cp++)
+			s->lines++;
+		}
+
+	if ( (err = s->put(s->ctx, s->out + s->out_base, n)) )
+		inf_error(s, err);
+
+	s->out_base = s->out_pos;
+
+	/* Keep the window at the start of the buffer */
+	if ( s->out_pos > GZ_OUTSZ - 2 * 258 )
+		{
+		memmove(s->out, s->out + s->out_pos - GZ_WSIZE, GZ_WSIZE);
+		s->out_pos = s->out_base = GZ_WSIZE;
+		}
+}
+
+
+/*
+ * Make a decoding table from code lengths, 0 or -1 - over-subscribed/incomplete set
+ */
+static	int	huff_build	(HUFF *h, const unsigned char *lens, int n)
+{
+short	offs[16];
+unsigned code, len, sym, i;
+int	left;
+
+	memset(h->count, 0, sizeof(h->count));
+	memset(h->fast, 0, sizeof(h->fast));
+
+	for (sym = 0; sym < (unsigned) n; sym++)
+		h->count[lens[sym]]++;
+
+	if ( h->count[0] == n )
+		return	0;	/* No codes - fine for an unused distance tree */
+
+	for (left = 1, len = 1; len < 16; len++)
+		{
+		left <<= 1;
+
+		if ( 0 > (left -= h->count[len]) )
+			return	-1;
+		}
+
+	for (offs[1] = 0, len = 1; len < 15; len++)
+		offs[len + 1] = offs[len] + h->count[len];
+
+	for (sym = 0; sym < (unsigned) n; sym++)
+		if ( lens[sym] )
+			h->symbol[offs[lens[sym]]++] = sym;
+
+	/* Short codes go to the table directly, bits are reversed as they come LSB first */
+	for (code = 0, i = 0, len = 1; len <= GZ_FASTBITS; len++)
+		{
+		for (left = h->count[len]; left; left--, i++, code++)
+			{
+			unsigned r = bit_reverse(code, len), k;
+
+			for (k = r; k < (1U << GZ_FASTBITS); k += 1U << len)
+				h->fast[k] = (len << 9) | h->symbol[i];
+			}
+
+		code <<= 1;
+		}
+
+	return	0;
+}
+
+static	int	huff_decode	(INFLATE *s, HUFF *h)
+{
+unsigned e;
+int	code, first, index, count, len;
+
+	if ( s->bitcnt < 15 )
+		{
+		/* Near the end of the input there may be less than 15 bits, that is fine for a short code */
+		while ( (s->bitcnt < 15) && ((s->in_pos < s->in_len) || inf_fill(s)) )
+			{
+			s->bitbuf |= (unsigned long long) s->in[s->in_pos++] << s->bitcnt;
+			s->bitcnt += 8;
+			}
+		}
+
+	if ( (e = h->fast[s->bitbuf & ((1U << GZ_FASTBITS) - 1)]) && ((e >> 9) <= (unsigned) s->bitcnt) )
+		{
+		s->bitbuf >>= e >> 9;
+		s->bitcnt -= e >> 9;
+
+		return	e & 0x1ff;
+		}
+
+	/* Long code: canonical decoding bit by bit */
+	code = first = index = 0;
+
+	for (len = 1; len < 16; len++)
+		{
+		code |= inf_bits(s, 1);
+		count = h->count[len];
+
+		if ( code - count < first )
+			return	h->symbol[index + (code - first)];
+
+		index += count;
+		first += count;
+		first <<= 1;
+		code <<= 1;
+		}
+
+	inf_error(s, -1);
+	return	-1;
+}
+
+static	void	inf_codes	(INFLATE *s)
+{
+int	sym, len, dist;
+unsigned char *from, *to;
+
+	for ( ; ; )
+		{
+		if ( 256 > (sym = huff_decode(s, &s->lit)) )
+			{
+			s->out[s->out_pos++] = sym;
+			}
+		else if ( sym == 256 )
+			return;
+		else	{
+			if ( (sym -= 257) >= 29 )
+				inf_error(s, -1);
+
+			len = len_base[sym] + inf_bits(s, len_extra[sym]);
+
+			if ( (sym = huff_decode(s, &s->dist)) >= 30 )
+				inf_error(s, -1);
+
+			dist = dist_base[sym] + inf_bits(s, dist_extra[sym]);
+
+			if ( dist > s->out_pos )
+				inf_error(s, -1);
+
+			/* Byte by byte: source and destination may overlap */
+			for (from = s->out + s->out_pos - dist, to = s->out + s->out_pos, s->out_pos += len; len; len--)
+				*(to++) = *(from++);
+			}
+
+		if ( s->out_pos > GZ_OUTSZ - 2 * 258 )
+			inf_flush(s);
+		}
+}
+
+static	void	inf_stored	(INFLATE *s)
+{
+unsigned len, nlen;
+
+	/* Drop bits up to the byte boundary */
+	inf_bits(s, s->bitcnt & 7);
+
+	len = inf_bits(s, 16);
+	nlen = inf_bits(s, 16);
+
+	if ( len != (~nlen & 0xffff) )
+		inf_error(s, -1);
+
+	while ( len-- )
+		{
+		s->out[s->out_pos++] = inf_bits(s, 8);
+
+		if ( s->out_pos > GZ_OUTSZ - 2 * 258 )
+			inf_flush(s);
+		}
+}
+
+static	void	inf_fixed	(INFLATE *s)
+{
+unsigned char lens[320];
+int	i;
+
+	for (i = 0; i < 144; i++)
+		lens[i] = 8;
+	for ( ; i < 256; i++)
+		lens[i] = 9;
+	for ( ; i < 280; i++)
+		lens[i] = 7;
+	for ( ; i < 288; i++)
+		lens[i] = 8;
+
+	huff_build(&s->lit, lens, 288);
+
+	for (i = 0; i < 30; i++)
+		lens[i] = 5;
+
+	huff_build(&s->dist, lens, 30);
+}
+
+static	void	inf_dynamic	(INFLATE *s)
+{
+unsigned char lens[320];
+int	nlen, ndist, ncode, i, sym, len, rep;
+
+	nlen = inf_bits(s, 5) + 257;
+	ndist = inf_bits(s, 5) + 1;
+	ncode = inf_bits(s, 4) + 4;
+
+	if ( (nlen > 286) || (ndist > 30) )
+		inf_error(s, -1);
+
+	memset(lens, 0, 19);
+
+	for (i = 0; i < ncode; i++)
+		lens[cl_order[i]] = inf_bits(s, 3);
+
+	if ( huff_build(&s->lit, lens, 19) )
+		inf_error(s, -1);
+
+	for (i = 0; i < nlen + ndist; )
+		{
+		if ( 16 > (sym = huff_decode(s, &s->lit)) )
+			{
+			lens[i++] = sym;
+			continue;
+			}
+
+		if ( sym == 16 )
+			{
+			if ( !i )
+				inf_error(s, -1);
+
+			len = lens[i - 1];
+			rep = 3 + inf_bits(s, 2);
+			}
+		else	{
+			len = 0;
+			rep = (sym == 17) ? 3 + inf_bits(s, 3) : 11 + inf_bits(s, 7);
+			}
+
+		if ( i + rep > nlen + ndist )
+			inf_error(s, -1);
+
+		while ( rep-- )
+			lens[i++] = len;
+		}
+
+	if ( !lens[256] || huff_build(&s->lit, lens, nlen) || huff_build(&s->dist, lens + nlen, ndist) )
+		inf_error(s, -1);
+}
+
+static	void	inf_header	(INFLATE *s)
+{
+int	flags, n;
+
+	if ( (inf_bits(s, 8) != 0x1f) || (inf_bits(s, 8) != 0x8b) || (inf_bits(s, 8) != 8) )
+		inf_error(s, -1);
+
+	flags = inf_bits(s, 8);
+	inf_bits(s, 16);	/* MTIME */
+	inf_bits(s, 16);
+	inf_bits(s, 16);	/* XFL, OS */
+
+	if ( flags & 4 )	/* FEXTRA */
+		for (n = inf_bits(s, 16); n; n--)
+			inf_bits(s, 8);
+
+	if ( flags & 8 )	/* FNAME */
+		while ( inf_bits(s, 8) );
+
+	if ( flags & 16 )	/* FCOMMENT */
+		while ( inf_bits(s, 8) );
+
+	if ( flags & 2 )	/* FHCRC */
+		inf_bits(s, 16);
+}
+
+
+static	void	inf_point	(INFLATE *s);
+
+/*
+ * Decode members up to the end of the file; head - 0: the first member goes on from
+ * a block boundary (an access point of the index). An error longjmp()-s out of it.
+ */
+static	void	inf_members	(INFLATE *s, int head)
+{
+unsigned lo, hi;
+int	last, type;
+
+	do	{
+		if ( head )
+			{
+			inf_header(s);
+			s->crc = s->size = 0;
+			s->check = 1;
+			}
+
+		head = 1;
+
+		do	{
+			last = inf_bits(s, 1);
+			type = inf_bits(s, 2);
+
+			if ( type == 0 )
+				inf_stored(s);
+			else if ( type == 1 )
+				{
+				inf_fixed(s);
+				inf_codes(s);
+				}
+			else if ( type == 2 )
+				{
+				inf_dynamic(s);
+				inf_codes(s);
+				}
+			else	inf_error(s, -1);
+
+			if ( s->idx && !last )
+				inf_point(s);
+
+		} while ( !last );
+
+		inf_flush(s);
+
+		/* Trailer is byte aligned */
+		inf_bits(s, s->bitcnt & 7);
+
+		lo = inf_bits(s, 16);
+		hi = inf_bits(s, 16);
+
+		if ( s->check && ((lo | (hi << 16)) != (s->crc & 0xffffffffU)) )
+			inf_error(s, -1);
+
+		lo = inf_bits(s, 16);
+		hi = inf_bits(s, 16);
+
+		if ( s->check && ((lo | (hi << 16)) != (s->size & 0xffffffffU)) )
+			inf_error(s, -1);
+
+		/* Members start over with an empty window */
+		s->out_pos = s->out_base = 0;
+	} while ( inf_more(s) );
+}
+
+/* Nothing of inf_members() is live across the setjmp() */
+static	int	inf_run	(INFLATE *s, int head)
+{
+	if ( !setjmp(s->env) )
+		inf_members(s, head);
+
+	return	s->err;
+}
+
+
+/*
+ * Decompress gzip file (all members of it) from fd, the data is passed to put() by
+ * chunks, a non-zero from put() stops it and is returned.
+ * Returns 0, -1 - bad/truncated data, or errno.
+ */
+int	gz_inflate_fd	(int fd, int (*put)(void *ctx, unsigned char *buf, long len), void *ctx)
+{
+INFLATE	*s;
+int	err;
+
+	if ( !(s = calloc(1, sizeof(INFLATE))) )
+		return	ENOMEM;
+
+	s->fd = fd;
+	s->put = put;
+	s->ctx = ctx;
+
+	err = inf_run(s, 1);
+	free(s);
+
+	return	err;
+}
+
+
+/*
+ *	RANDOM ACCESS INDEX
+ *
+ * Access points are taken between deflate blocks every GZ_SPAN of the output (like
+ * zlib's zran example): an input position with a bit offset and the last 32K of the
+ * output, so decoding can start there. The index lives in a sidecar file:
+ *
+ *	GZI_HDR | windows ... | GZ_POINT table
+ *
+ * it is valid while the size and the mtime of the gzip'd file are the same.
+ */
+#define	GZ_SPAN		(4 * 1024 * 1024)
+#define	GZI_MAGIC	"EDT-GZI1"
+
+typedef	struct __gz_point__ {
+	unsigned long long out, in;		/* Output offset, input byte */
+	unsigned long long lines;		/* New lines before the point */
+	unsigned long long woff;		/* The window in the sidecar */
+	int		bits, wlen;		/* Bits of the input byte not used yet */
+} GZ_POINT;
+
+typedef	struct __gzi_hdr__ {
+	char		magic[8];
+	unsigned long long gz_size, gz_mtime;
+	unsigned long long total, lines;
+	unsigned long long npoints, ptoff;
+} GZI_HDR;
+
+typedef	struct __gz_index__ {
+	GZI_HDR		hdr;
+	GZ_POINT	*point;
+	long		maxpoints;
+	int		wfd;			/* Sidecar file, -1 - there is the start point only */
+	unsigned long long woff;
+} GZ_INDEX;
+
+
+static	void	inf_point	(INFLATE *s)
+{
+GZ_INDEX *x = s->idx;
+GZ_POINT *p;
+
+	inf_flush(s);
+
+	if ( (x->wfd < 0) || (s->total - x->point[x->hdr.npoints - 1].out < GZ_SPAN) )
+		return;
+
+	if ( x->hdr.npoints == (unsigned long long) x->maxpoints )
+		{
+		if ( !(p = realloc(x->point, 2 * x->maxpoints * sizeof(GZ_POINT))) )
+			return;
+
+		x->point = p;
+		x->maxpoints *= 2;
+		}
+
+	p = &x->point[x->hdr.npoints];
+	p->out = s->total;
+	p->lines = s->lines;
+	p->in = s->in_off + s->in_pos - (s->bitcnt + 7) / 8;
+	p->bits = s->bitcnt & 7;
+	p->wlen = (s->out_pos < GZ_WSIZE) ? s->out_pos : GZ_WSIZE;
+	p->woff = x->woff;
+
+	if ( p->wlen != pwrite(x->wfd, s->out + s->out_pos - p->wlen, p->wlen, p->woff) )
+		return;
+
+	x->woff += p->wlen;
+	x->hdr.npoints++;
+}
+
+static	int	inf_null	(void *ctx, unsigned char *buf, long len)
+{
+	(void) ctx;
+	(void) buf;
+	(void) len;
+
+	return	0;
+}
+
+/*
+ * Get the index of the gzip'd file on fd: from the sidecar, or it's built by decoding
+ * the whole file and saved there. Returns NULL if the file can't be decoded.
+ */
+GZ_INDEX *gz_index_open	(int fd, char *sidecar)
+{
+GZ_INDEX *x;
+INFLATE	*s;
+struct stat st;
+char	tmpname[PATH_MAX + 8];
+long	n;
+
+	if ( fstat(fd, &st) || !(x = calloc(1, sizeof(GZ_INDEX))) )
+		return	NULL;
+
+	/* Saved one is still good? */
+	if ( 0 <= (x->wfd = open(sidecar, O_RDONLY)) )
+		{
+		if ( (sizeof(GZI_HDR) == pread(x->wfd, &x->hdr, sizeof(GZI_HDR), 0))
+			&& !memcmp(x->hdr.magic, GZI_MAGIC, 8)
+			&& (x->hdr.gz_size == (unsigned long long) st.st_size)
+			&& (x->hdr.gz_mtime == (unsigned long long) st.st_mtime)
+			&& (x->hdr.npoints > 0) && (x->point = malloc(x->hdr.npoints * sizeof(GZ_POINT))) )
+			{
+			n = x->hdr.npoints * sizeof(GZ_POINT);
+
+			if ( n == pread(x->wfd, x->point, n, x->hdr.ptoff) )
+				return	x;
+			}
+
+		free(x->point);
+		close(x->wfd);
+		}
+
+	/* Build it */
+	memset(x, 0, sizeof(GZ_INDEX));
+
+	if ( !(x->point = calloc(x->maxpoints = 64, sizeof(GZ_POINT))) || !(s = calloc(1, sizeof(INFLATE))) )
+		{
+		free(x->point);
+		free(x);
+		return	NULL;
+		}
+
+	x->hdr.npoints = 1;			/* Start of the file */
+	x->woff = sizeof(GZI_HDR);
+
+	sprintf(tmpname, "%s.tmp", sidecar);
+	x->wfd = open(tmpname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	s->fd = fd;
+	s->put = inf_null;
+	s->idx = x;
+
+	lseek(fd, 0, SEEK_SET);
+
+	if ( inf_run(s, 1) )
+		{
+		if ( 0 <= x->wfd )
+			{
+			close(x->wfd);
+			unlink(tmpname);
+			}
+
+		free(s);
+		free(x->point);
+		free(x);
+
+		return	NULL;
+		}
+
+	memcpy(&x->hdr, GZI_MAGIC, 8);		/* hdr.magic, the header is written whole */
+	x->hdr.gz_size = st.st_size;
+	x->hdr.gz_mtime = st.st_mtime;
+	x->hdr.total = s->total;
+	x->hdr.lines = s->lines;
+	x->hdr.ptoff = x->woff;
+	free(s);
+
+	if ( 0 <= x->wfd )
+		{
+		n = x->hdr.npoints * sizeof(GZ_POINT);
+
+		if ( (n != pwrite(x->wfd, x->point, n, x->hdr.ptoff))
+			|| (sizeof(GZI_HDR) != pwrite(x->wfd, &x->hdr, sizeof(GZI_HDR), 0))
+			|| rename(tmpname, sidecar) )
+			unlink(tmpname);
+		}
+
+	return	x;
+}
+
+void	gz_index_close	(GZ_INDEX *x)
+{
+	if ( 0 <= x->wfd )
+		close(x->wfd);
+
+	free(x->point);
+	free(x);
+}
+
+/*
+ * Number of lines (new line characters), of bytes
+ */
+unsigned long long gz_index_lines	(GZ_INDEX *x)
+{
+	return	x->hdr.lines;
+}
+
+unsigned long long gz_index_size	(GZ_INDEX *x)
+{
+	return	x->hdr.total;
+}
+
+
+/*
+ * Reading from a line: new lines to skip before, bytes to pass
+ */
+typedef	struct __gz_extract__ {
+	unsigned long long skip;
+	long		left;
+	int		(*put)(void *ctx, unsigned char *buf, long len);
+	void		*ctx;
+} GZ_EXTRACT;
+
+#define	GZ_DONE		(-2)
+
+static	int	ext_put	(void *ctx, unsigned char *buf, long len)
+{
+GZ_EXTRACT *e = ctx;
+unsigned char *cp, *end = buf + len;
+long	n, k;
+int	err;
+
+	for ( ; e->skip && (cp = memchr(buf, '\n', end - buf)); e->skip--)
+		buf = cp + 1;
+
+	if ( e->skip )
+		return	0;
+
+	/* Enough is here - up to the end of the line */
+	n = end - buf;
+	k = e->left ? e->left - 1 : 0;
+
+	if ( (k < n) && (cp = memchr(buf + k, '\n', n - k)) )
+		return	(err = e->put(e->ctx, buf, cp + 1 - buf)) ? err : GZ_DONE;
+
+	e->left = (e->left > n) ? e->left - n : 0;
+
+	return	n ? e->put(e->ctx, buf, n) : 0;
+}
+
+/*
+ * Decompress from the line (1 - the first one) of the file on fd, at least len bytes up to
+ * the end of a line are passed to put(). Returns 0, -1 - bad data, or errno.
+ */
+int	gz_index_read	(GZ_INDEX *x, int fd, unsigned long long line, long len,
+		int (*put)(void *ctx, unsigned char *buf, long len), void *ctx)
+{
+GZ_EXTRACT e;
+GZ_POINT *p;
+INFLATE	*s;
+long	lo = 0, hi = x->hdr.npoints - 1, mid;
+unsigned char c = 0;
+int	err;
+
+	line = line ? line - 1 : 0;
+
+	/* The last point before the line */
+	while ( lo < hi )
+		{
+		mid = (lo + hi + 1) / 2;
+
+		if ( x->point[mid].lines <= line )
+			lo = mid;
+		else	hi = mid - 1;
+		}
+
+	p = &x->point[lo];
+
+	if ( !(s = calloc(1, sizeof(INFLATE))) )
+		return	ENOMEM;
+
+	e.skip = line - p->lines;
+	e.left = len;
+	e.put = put;
+	e.ctx = ctx;
+
+	s->fd = fd;
+	s->put = ext_put;
+	s->ctx = &e;
+	s->in_off = p->in + !!p->bits;
+
+	/* Rest of the byte the point is in the middle of goes to the bit buffer */
+	if ( lo && (p->wlen != pread(x->wfd, s->out, p->wlen, p->woff)) )
+		err = errno ? errno : -1;
+	else if ( p->bits && (1 != pread(fd, &c, 1, p->in)) )
+		err = errno ? errno : -1;
+	else if ( s->in_off != lseek(fd, s->in_off, SEEK_SET) )
+		err = errno;
+	else	{
+		s->out_pos = s->out_base = lo ? p->wlen : 0;
+		s->bitbuf = c >> (8 - p->bits);
+		s->bitcnt = p->bits;
+
+		err = inf_run(s, !lo);
+		}
+
+	free(s);
+
+	return	(err == GZ_DONE) ? 0 : err;
+}
+
+
+/*
+ *	DEFLATE
+ */
+#define	GZ_MIN_MATCH	3
+#define	GZ_MAX_MATCH	258
+#define	GZ_MIN_LOOKAHEAD (GZ_MAX_MATCH + GZ_MIN_MATCH + 1)
+#define	GZ_MAX_DIST	(GZ_WSIZE - GZ_MIN_LOOKAHEAD)
+#define	GZ_HBITS	15
+#define	GZ_HSIZE	(1 << GZ_HBITS)
+#define	GZ_NIL		(-1)
+#define	GZ_SYMS		(32 * 1024)
+#define	GZ_OBUFSZ	(64 * 1024)
+
+typedef	struct __gz_stream__ {
+	int		fd, err;
+	int		level;
+	struct __gz_par__ *par;			/* Parallel deflate, NULL - serial */
+	int		max_chain, max_lazy, nice;	/* Compression level parameters */
+
+	unsigned char	win[2 * GZ_WSIZE + GZ_MAX_MATCH];	/* Slack for a match scan at the end */
+	long		strstart, lookahead, block_start, block_len;
+	int		head[GZ_HSIZE], prev[GZ_WSIZE];
+	int		match_length, match_start, prev_length, prev_match, match_available;
+
+	unsigned short	sym_ll[GZ_SYMS], sym_dist[GZ_SYMS];	/* Literal/length, distance (0 - literal) */
+	int		nsym;
+
+	unsigned char	obuf[GZ_OBUFSZ];
+	long		opos;
+	unsigned long long bitbuf;
+	int		bitcnt;
+
+	unsigned char	*mem;			/* Output to memory when fd < 0 */
+	long		mlen, mcap;
+
+	unsigned long	crc, size;
+} GZ_STREAM;
+
+void	gz_deflate_sync	(GZ_STREAM *z, int last);
+
+
+static	void	out_write	(GZ_STREAM *z, const unsigned char *cp, long len)
+{
+ssize_t	n;
+
+	if ( (z->fd < 0) && !z->err )
+		{
+		if ( (z->mlen + len > z->mcap) && !(z->mem = realloc(z->mem, z->mcap = 2 * (z->mlen + len))) )
+			{
+			z->err = ENOMEM;
+			return;
+			}
+
+		memcpy(z->mem + z->mlen, cp, len);
+		z->mlen += len;
+
+		return;
+		}
+
+	while ( len && !z->err )
+		{
+		if ( 0 > (n = write(z->fd, cp, len)) )
+			{
+			if ( errno != EINTR )
+				z->err = errno;
+
+			continue;
+			}
+
+		cp += n;
+		len -= n;
+		}
+}
+
+static	void	out_flush	(GZ_STREAM *z)
+{
+	out_write(z, z->obuf, z->opos);
+	z->opos = 0;
+}
+
+static	inline	void	put_bits	(GZ_STREAM *z, unsigned v, int n)
+{
+	z->bitbuf |= (unsigned long long) v << z->bitcnt;
+	z->bitcnt += n;
+
+	while ( z->bitcnt >= 8 )
+		{
+		if ( z->opos == GZ_OBUFSZ )
+			out_flush(z);
+
+		z->obuf[z->opos++] = z->bitbuf;
+		z->bitbuf >>= 8;
+		z->bitcnt -= 8;
+		}
+}
+
+static	void	put_align	(GZ_STREAM *z)
+{
+	if ( z->bitcnt & 7 )
+		put_bits(z, 0, 8 - (z->bitcnt & 7));
+}
+
+static	void	put_byte	(GZ_STREAM *z, unsigned char c)
+{
+	if ( z->opos == GZ_OBUFSZ )
+		out_flush(z);
+
+	z->obuf[z->opos++] = c;
+}
+
+
+/*
+ * Huffman code lengths for given frequencies, at most maxbits long. When the tree is too
+ * deep frequencies are flattened and it is built again.
+ */
+static	void	huff_lengths	(unsigned *freq, int n, int maxbits, unsigned char *len)
+{
+unsigned weight[2 * 288], f[288];
+int	parent[2 * 288], sym[288], nsym, i, j, k, a, b, leaf, node, nodes, depth, maxd;
+
+	memcpy(f, freq, n * sizeof(unsigned));
+
+	for ( ; ; )
+		{
+		memset(len, 0, n);
+
+		for (nsym = i = 0; i < n; i++)
+			if ( f[i] )
+				sym[nsym++] = i;
+
+		if ( nsym == 0 )
+			return;
+
+		if ( nsym == 1 )
+			{
+			len[sym[0]] = 1;
+			return;
+			}
+
+		/* Leaves sorted by weight (insertion sort is enough for 288) */
+		for (i = 1; i < nsym; i++)
+			for (j = i; (j > 0) && (f[sym[j - 1]] > f[sym[j]]); j--)
+				k = sym[j], sym[j] = sym[j - 1], sym[j - 1] = k;
+
+		for (i = 0; i < nsym; i++)
+			weight[i] = f[sym[i]];
+
+		/* Two queues: sorted leaves and internal nodes (which come out sorted) */
+		for (leaf = 0, node = nodes = nsym; nodes < 2 * nsym - 1; nodes++)
+			{
+			if ( (leaf < nsym) && ((node == nodes) || (weight[leaf] <= weight[node])) )
+				a = leaf++;
+			else	a = node++;
+
+			if ( (leaf < nsym) && ((node == nodes) || (weight[leaf] <= weight[node])) )
+				b = leaf++;
+			else	b = node++;
+
+			weight[nodes] = weight[a] + weight[b];
+			parent[a] = parent[b] = nodes;
+			}
+
+		for (maxd = 0, i = 0; i < nsym; i++)
+			{
+			for (depth = 0, k = i; k != nodes - 1; k = parent[k])
+				depth++;
+
+			len[sym[i]] = depth;
+
+			if ( depth > maxd )
+				maxd = depth;
+			}
+
+		if ( maxd <= maxbits )
+			return;
+
+		for (i = 0; i < n; i++)
+			if ( f[i] )
+				f[i] = (f[i] >> 1) | 1;
+		}
+}
+
+static	void	huff_codes	(const unsigned char *len, int n, unsigned short *code)
+{
+unsigned short	bl_count[16], next[16];
+int	i, c;
+
+	memset(bl_count, 0, sizeof(bl_count));
+
+	for (i = 0; i < n; i++)
+		bl_count[len[i]]++;
+
+	bl_count[0] = 0;
+
+	for (c = 0, i = 1; i < 16; i++)
+		next[i] = c = (c + bl_count[i - 1]) << 1;
+
+	for (i = 0; i < n; i++)
+		if ( len[i] )
+			code[i] = bit_reverse(next[len[i]]++, len[i]);
+}
+
+static	int	len_code	(int len)
+{
+int	i;
+
+	for (i = 28; len_base[i] > len; i--);
+
+	return	i;
+}
+
+static	int	dist_code	(int dist)
+{
+int	i;
+
+	for (i = 29; dist_base[i] > dist; i--);
+
+	return	i;
+}
+
+
+/*
+ * Emit the collected symbols as a block: dynamic Huffman or stored, what is smaller
+ */
+static	void	flush_block	(GZ_STREAM *z, int last)
+{
+unsigned freq_ll[286], freq_d[30], freq_cl[19];
+unsigned char len_ll[286], len_d[30], len_cl[19], lens[316], rle[316], rle_x[316];
+unsigned short code_ll[286], code_d[30], code_cl[19];
+int	i, k, n, nlen, ndist, ncl, nrle, run;
+long	dyn_bits, stored_bits, off, chunk;
+
+	memset(freq_ll, 0, sizeof(freq_ll));
+	memset(freq_d, 0, sizeof(freq_d));
+	memset(freq_cl, 0, sizeof(freq_cl));
+
+	for (i = 0; i < z->nsym; i++)
+		if ( z->sym_dist[i] )
+			{
+			freq_ll[257 + len_code(z->sym_ll[i])]++;
+			freq_d[dist_code(z->sym_dist[i])]++;
+			}
+		else	freq_ll[z->sym_ll[i]]++;
+
+	freq_ll[256] = 1;
+
+	/* Decoders want two codes at least in the trees */
+	for (n = 0, i = 0; i < 30; i++)
+		n += !!freq_d[i];
+
+	if ( n < 2 )
+		freq_d[0] = freq_d[1] = 1;
+
+	huff_lengths(freq_ll, 286, 15, len_ll);
+	huff_lengths(freq_d, 30, 15, len_d);
+
+	if ( len_ll[256] == 1 )		/* The only literal - add a companion */
+		{
+		freq_ll[0] = 1;
+		huff_lengths(freq_ll, 286, 15, len_ll);
+		}
+
+	for (nlen = 286; !len_ll[nlen - 1]; nlen--);
+	for (ndist = 30; !len_d[ndist - 1]; ndist--);
+
+	/* Run length encoding of the code lengths */
+	memcpy(lens, len_ll, nlen);
+	memcpy(lens + nlen, len_d, ndist);
+
+	for (nrle = 0, i = 0; i < nlen + ndist; i += run)
+		{
+		for (run = 1; (i + run < nlen + ndist) && (lens[i + run] == lens[i]); run++);
+
+		if ( !lens[i] && (run >= 3) )
+			{
+			if ( run > 138 )
+				run = 138;
+
+			rle[nrle] = (run <= 10) ? 17 : 18;
+			rle_x[nrle++] = (run <= 10) ? run - 3 : run - 11;
+			}
+		else if ( lens[i] && (run >= 4) )
+			{
+			rle[nrle] = lens[i];
+			rle_x[nrle++] = 0;
+
+			run = (run - 1 > 6) ? 7 : run;
+			rle[nrle] = 16;
+			rle_x[nrle++] = run - 4;
+			}
+		else	{
+			run = 1;
+			rle[nrle] = lens[i];
+			rle_x[nrle++] = 0;
+			}
+		}
+
+	for (i = 0; i < nrle; i++)
+		freq_cl[rle[i]]++;
+
+	for (n = 0, i = 0; i < 19; i++)
+		n += !!freq_cl[i];
+
+	if ( n < 2 )
+		freq_cl[rle[0] ? 0 : 1]++;
+
+	huff_lengths(freq_cl, 19, 7, len_cl);
+
+	for (ncl = 19; (ncl > 4) && !len_cl[cl_order[ncl - 1]]; ncl--);
+
+	/* Sizes of both forms */
+	dyn_bits = 3 + 14 + 3 * ncl;
+
+	for (i = 0; i < nrle; i++)
+		dyn_bits += len_cl[rle[i]] + ((rle[i] == 16) ? 2 : (rle[i] == 17) ? 3 : (rle[i] == 18) ? 7 : 0);
+
+	for (i = 0; i < 286; i++)
+		dyn_bits += (long) freq_ll[i] * (len_ll[i] + ((i > 256) ? len_extra[i - 257] : 0));
+
+	for (i = 0; i < 30; i++)
+		dyn_bits += (long) freq_d[i] * (len_d[i] + dist_extra[i]);
+
+	stored_bits = 8 * (z->block_len + 5 * (z->block_len / 65535 + 1)) + 8;
+
+	if ( stored_bits < dyn_bits )
+		{
+		for (off = 0; (off < z->block_len) || !off; off += chunk)
+			{
+			chunk = z->block_len - off;
+
+			if ( chunk > 65535 )
+				chunk = 65535;
+
+			put_bits(z, last && (off + chunk == z->block_len), 1);
+			put_bits(z, 0, 2);
+			put_align(z);
+			put_bits(z, chunk, 16);
+			put_bits(z, ~chunk & 0xffff, 16);
+
+			for (k = 0; k < chunk; k++)
+				put_byte(z, z->win[z->block_start + off + k]);
+
+			if ( !chunk )
+				break;
+			}
+		}
+	else	{
+		huff_codes(len_ll, 286, code_ll);
+		huff_codes(len_d, 30, code_d);
+		huff_codes(len_cl, 19, code_cl);
+
+		put_bits(z, last, 1);
+		put_bits(z, 2, 2);
+		put_bits(z, nlen - 257, 5);
+		put_bits(z, ndist - 1, 5);
+		put_bits(z, ncl - 4, 4);
+
+		for (i = 0; i < ncl; i++)
+			put_bits(z, len_cl[cl_order[i]], 3);
+
+		for (i = 0; i < nrle; i++)
+			{
+			put_bits(z, code_cl[rle[i]], len_cl[rle[i]]);
+
+			if ( rle[i] >= 16 )
+				put_bits(z, rle_x[i], (rle[i] == 16) ? 2 : (rle[i] == 17) ? 3 : 7);
+			}
+
+		for (i = 0; i < z->nsym; i++)
+			{
+			if ( z->sym_dist[i] )
+				{
+				n = z->sym_ll[i];
+				k = len_code(n);
+				put_bits(z, code_ll[257 + k], len_ll[257 + k]);
+				put_bits(z, n - len_base[k], len_extra[k]);
+
+				n = z->sym_dist[i];
+				k = dist_code(n);
+				put_bits(z, code_d[k], len_d[k]);
+				put_bits(z, n - dist_base[k], dist_extra[k]);
+				}
+			else	put_bits(z, code_ll[z->sym_ll[i]], len_ll[z->sym_ll[i]]);
+			}
+
+		put_bits(z, code_ll[256], len_ll[256]);
+		}
+
+	z->block_start += z->block_len;
+	z->block_len = 0;
+	z->nsym = 0;
+}
+
+
+static	inline	void	tally	(GZ_STREAM *z, int ll, int dist, int len)
+{
+	z->sym_ll[z->nsym] = ll;
+	z->sym_dist[z->nsym++] = dist;
+	z->block_len += len;
+
+	if ( z->nsym == GZ_SYMS )
+		flush_block(z, 0);
+}
+
+static	inline	int	hash_insert	(GZ_STREAM *z, long pos)
+{
+unsigned h = ((z->win[pos] << 10) ^ (z->win[pos + 1] << 5) ^ z->win[pos + 2]) & (GZ_HSIZE - 1);
+int	cand = z->head[h];
+
+	z->prev[pos & (GZ_WSIZE - 1)] = cand;
+	z->head[h] = pos;
+
+	return	cand;
+}
+
+static	int	longest_match	(GZ_STREAM *z, int cand)
+{
+unsigned char *scan = z->win + z->strstart, *match;
+int	chain = z->max_chain, best = z->prev_length, len, maxlen;
+long	limit = z->strstart - GZ_MAX_DIST;
+
+	maxlen = (z->lookahead < GZ_MAX_MATCH) ? z->lookahead : GZ_MAX_MATCH;
+
+	if ( best >= z->max_lazy )
+		chain >>= 2;
+
+	do	{
+		match = z->win + cand;
+
+		if ( (match[best] != scan[best]) || (match[0] != scan[0]) || (match[1] != scan[1]) )
+			continue;
+
+		for (len = 2; (len < maxlen) && (match[len] == scan[len]); len++);
+
+		if ( len > best )
+			{
+			z->match_start = cand;
+			best = len;
+
+			if ( len >= z->nice || len >= maxlen )
+				break;
+			}
+	} while ( (0 <= (cand = z->prev[cand & (GZ_WSIZE - 1)])) && (cand > limit) && --chain );
+
+	return	best;
+}
+
+
+/*
+ * LZ77 with a lazy match evaluation (as in zlib deflate_slow)
+ */
+static	void	deflate_run	(GZ_STREAM *z, int flush)
+{
+int	cand, max_insert;
+
+	while ( z->lookahead >= (flush ? 1 : GZ_MIN_LOOKAHEAD) )
+		{
+		cand = GZ_NIL;
+
+		if ( z->lookahead >= GZ_MIN_MATCH )
+			cand = hash_insert(z, z->strstart);
+
+		z->prev_length = z->match_length;
+		z->prev_match = z->match_start;
+		z->match_length = GZ_MIN_MATCH - 1;
+
+		if ( (cand != GZ_NIL) && (z->prev_length < z->max_lazy) && (z->strstart - cand <= GZ_MAX_DIST) )
+			{
+			z->match_length = longest_match(z, cand);
+
+			if ( z->match_length > z->lookahead )
+				z->match_length = z->lookahead;
+
+			if ( (z->match_length == GZ_MIN_MATCH) && (z->strstart - z->match_start > 4096) )
+				z->match_length = GZ_MIN_MATCH - 1;
+			}
+
+		if ( (z->prev_length >= GZ_MIN_MATCH) && (z->match_length <= z->prev_length) )
+			{
+			max_insert = z->strstart + z->lookahead - GZ_MIN_MATCH;
+
+			tally(z, z->prev_length, z->strstart - 1 - z->prev_match, z->prev_length);
+
+			z->lookahead -= z->prev_length - 1;
+			z->prev_length -= 2;
+
+			do	{
+				if ( ++z->strstart <= max_insert )
+					hash_insert(z, z->strstart);
+			} while ( --z->prev_length );
+
+			z->match_available = 0;
+			z->match_length = GZ_MIN_MATCH - 1;
+			z->strstart++;
+			}
+		else if ( z->match_available )
+			{
+			tally(z, z->win[z->strstart - 1], 0, 1);
+			z->strstart++;
+			z->lookahead--;
+			}
+		else	{
+			z->match_available = 1;
+			z->strstart++;
+			z->lookahead--;
+			}
+		}
+
+	if ( flush && z->match_available )
+		{
+		tally(z, z->win[z->strstart - 1], 0, 1);
+		z->match_available = 0;
+		}
+}
+
+/*
+ * Move the upper half of the window down. The current block is flushed first,
+ * so stored blocks always have their data in the window.
+ */
+static	void	slide_window	(GZ_STREAM *z)
+{
+int	i;
+
+	if ( z->nsym )
+		flush_block(z, 0);
+
+	memmove(z->win, z->win + GZ_WSIZE, GZ_WSIZE);
+	z->strstart -= GZ_WSIZE;
+	z->block_start -= GZ_WSIZE;
+	z->match_start -= GZ_WSIZE;
+
+	for (i = 0; i < GZ_HSIZE; i++)
+		z->head[i] = (z->head[i] >= GZ_WSIZE) ? z->head[i] - GZ_WSIZE : GZ_NIL;
+
+	for (i = 0; i < GZ_WSIZE; i++)
+		z->prev[i] = (z->prev[i] >= GZ_WSIZE) ? z->prev[i] - GZ_WSIZE : GZ_NIL;
+}
+
+
+/*
+ * Set up an empty window and the level parameters
+ */
+static	void	def_reset	(GZ_STREAM *z)
+{
+int	i, level = z->level;
+
+	z->max_chain = (level <= 1) ? 4 : (level >= 9) ? 4096 : 16 << (level / 2);
+	z->max_lazy = (level <= 1) ? 4 : (level >= 9) ? 258 : 8 << (level / 2);
+	z->nice = (level <= 1) ? 8 : (level >= 9) ? 258 : 16 << (level / 2);
+
+	z->strstart = z->lookahead = z->block_start = z->block_len = 0;
+	z->match_length = z->prev_length = GZ_MIN_MATCH - 1;
+	z->match_start = z->prev_match = z->match_available = 0;
+	z->nsym = z->opos = z->bitcnt = z->err = 0;
+	z->bitbuf = 0;
+
+	for (i = 0; i < GZ_HSIZE; i++)
+		z->head[i] = GZ_NIL;
+}
+
+/*
+ * Run data through the window
+ */
+static	void	def_feed	(GZ_STREAM *z, const unsigned char *buf, long len)
+{
+long	n;
+
+	while ( len && !z->err )
+		{
+		if ( z->strstart >= 2 * GZ_WSIZE - GZ_MIN_LOOKAHEAD )
+			slide_window(z);
+
+		n = 2 * GZ_WSIZE - (z->strstart + z->lookahead);
+
+		if ( n > len )
+			n = len;
+
+		memcpy(z->win + z->strstart + z->lookahead, buf, n);
+		z->lookahead += n;
+		buf += n;
+		len -= n;
+
+		deflate_run(z, 0);
+		}
+}
+
+
+/*
+ *	Parallel DEFLATE
+ *
+ * The input is cut into chunks, each one is compressed by a worker thread on its own:
+ * the window is primed with the last 32K of the previous chunk as a dictionary and
+ * the output ends with an empty stored block, so it's byte aligned and the pieces are
+ * simply concatenated into one deflate stream. CRC of the chunks are combined.
+ */
+#define	GZ_CHUNK	(256 * 1024)
+#define	GZ_MAXTHR	32
+
+enum	{ GZ_JOB_FREE, GZ_JOB_READY, GZ_JOB_BUSY, GZ_JOB_DONE };
+
+typedef	struct __gz_job__ {
+	unsigned char	*in;			/* Dictionary + data */
+	long		dlen, len;
+	unsigned char	*out;
+	long		olen, ocap;
+	unsigned long	crc;
+	int		state, err;
+} GZ_JOB;
+
+typedef	struct __gz_par__ {
+	pthread_mutex_t	mtx;
+	pthread_cond_t	work, done;
+	pthread_t	thr[GZ_MAXTHR];
+	int		ncpu, nthr, njob, started, stop;
+	long		submit, take, written;	/* Sequence numbers of the chunks */
+	GZ_STREAM	*z;
+	GZ_JOB		job[2 * GZ_MAXTHR];
+} GZ_PAR;
+
+
+static	void	par_deflate	(GZ_STREAM *z, GZ_JOB *j)
+{
+long	i;
+
+	def_reset(z);
+
+	memcpy(z->win, j->in, j->dlen);
+
+	for (i = 0; i + GZ_MIN_MATCH <= j->dlen; i++)
+		hash_insert(z, i);
+
+	z->strstart = z->block_start = j->dlen;
+
+	z->mem = j->out;
+	z->mlen = 0;
+	z->mcap = j->ocap;
+
+	j->crc = gz_crc32(0, j->in + j->dlen, j->len);
+
+	def_feed(z, j->in + j->dlen, j->len);
+	gz_deflate_sync(z, 0);
+	out_flush(z);
+
+	j->out = z->mem;
+	j->olen = z->mlen;
+	j->ocap = z->mcap;
+	j->err = z->err;
+}
+
+static	void	*par_worker	(void *arg)
+{
+GZ_PAR	*p = arg;
+GZ_STREAM *z;
+GZ_JOB	*j;
+
+	if ( (z = calloc(1, sizeof(GZ_STREAM))) )
+		{
+		z->fd = -1;
+		z->level = p->z->level;
+		}
+
+	pthread_mutex_lock(&p->mtx);
+
+	for ( ; ; )
+		{
+		while ( !p->stop && (p->take == p->submit) )
+			pthread_cond_wait(&p->work, &p->mtx);
+
+		if ( p->take == p->submit )
+			break;
+
+		j = &p->job[p->take++ % p->njob];
+		j->state = GZ_JOB_BUSY;
+		pthread_mutex_unlock(&p->mtx);
+
+		if ( z )
+			par_deflate(z, j);
+		else	j->err = ENOMEM;
+
+		pthread_mutex_lock(&p->mtx);
+		j->state = GZ_JOB_DONE;
+		pthread_cond_broadcast(&p->done);
+		}
+
+	pthread_mutex_unlock(&p->mtx);
+	free(z);
+
+	return	NULL;
+}
+
+/*
+ * Write out the oldest chunk when it is done
+ */
+static	void	par_write_job	(GZ_STREAM *z)
+{
+GZ_PAR	*p = z->par;
+GZ_JOB	*j = &p->job[p->written++ % p->njob];
+
+	pthread_mutex_lock(&p->mtx);
+
+	while ( j->state != GZ_JOB_DONE )
+		pthread_cond_wait(&p->done, &p->mtx);
+
+	pthread_mutex_unlock(&p->mtx);
+
+	if ( j->err && !z->err )
+		z->err = j->err;
+
+	out_flush(z);
+	out_write(z, j->out, j->olen);
+
+	z->crc = gz_crc32_combine(z->crc, j->crc, j->len);
+	j->state = GZ_JOB_FREE;
+}
+
+/*
+ * Get the slot of the next chunk ready for the data: the last 32K of the previous one
+ * is the dictionary
+ */
+static	void	par_next_job	(GZ_STREAM *z, GZ_JOB *prv)
+{
+GZ_PAR	*p = z->par;
+GZ_JOB	*j = &p->job[p->submit % p->njob];
+long	n;
+
+	if ( p->submit - p->written == p->njob )
+		par_write_job(z);
+
+	if ( !j->in && !(j->in = malloc(GZ_WSIZE + GZ_CHUNK)) )
+		{
+		z->err = ENOMEM;
+		return;
+		}
+
+	j->dlen = j->len = 0;
+
+	if ( prv )
+		{
+		n = (prv->dlen + prv->len < GZ_WSIZE) ? prv->dlen + prv->len : GZ_WSIZE;
+		memcpy(j->in, prv->in + prv->dlen + prv->len - n, n);
+		j->dlen = n;
+		}
+}
+
+/*
+ * Pass the filled chunk to the workers, threads are started by the first one
+ */
+static	void	par_submit	(GZ_STREAM *z)
+{
+GZ_PAR	*p = z->par;
+GZ_JOB	*j = &p->job[p->submit % p->njob];
+
+	if ( !p->started++ )
+		while ( (p->nthr < p->ncpu) && !pthread_create(&p->thr[p->nthr], NULL, par_worker, p) )
+			p->nthr++;
+
+	pthread_mutex_lock(&p->mtx);
+	j->state = GZ_JOB_READY;
+	p->submit++;
+	pthread_cond_signal(&p->work);
+	pthread_mutex_unlock(&p->mtx);
+
+	/* No threads - do it here */
+	if ( !p->nthr )
+		{
+		GZ_STREAM *w;
+
+		p->take++;
+
+		if ( (w = calloc(1, sizeof(GZ_STREAM))) )
+			{
+			w->fd = -1;
+			w->level = z->level;
+			par_deflate(w, j);
+			free(w);
+			}
+		else	j->err = ENOMEM;
+
+		j->state = GZ_JOB_DONE;
+		}
+
+	par_next_job(z, j);
+}
+
+static	GZ_PAR	*par_open	(GZ_STREAM *z)
+{
+GZ_PAR	*p;
+long	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if ( (ncpu < 2) || !(p = calloc(1, sizeof(GZ_PAR))) )
+		return	NULL;
+
+	pthread_mutex_init(&p->mtx, NULL);
+	pthread_cond_init(&p->work, NULL);
+	pthread_cond_init(&p->done, NULL);
+
+	p->ncpu = (ncpu < GZ_MAXTHR) ? ncpu : GZ_MAXTHR;
+	p->njob = 2 * p->ncpu;
+	p->z = z;
+
+	z->par = p;
+	par_next_job(z, NULL);
+
+	if ( z->err )
+		{
+		free(p);
+		z->par = NULL;
+		z->err = 0;
+
+		return	NULL;
+		}
+
+	return	p;
+}
+
+/*
+ * Flush the rest and stop the workers. Nothing has been submitted yet: the data are
+ * compressed by the stream itself, so small files don't pay for the threads.
+ */
+static	void	par_close	(GZ_STREAM *z)
+{
+GZ_PAR	*p = z->par;
+GZ_JOB	*j = &p->job[p->submit % p->njob];
+int	i;
+
+	if ( !p->submit )
+		{
+		z->crc = gz_crc32(z->crc, j->in, j->len);
+		def_feed(z, j->in, j->len);
+		}
+	else	{
+		if ( j->len && !z->err )
+			par_submit(z);
+
+		while ( p->written < p->submit )
+			par_write_job(z);
+		}
+
+	z->par = NULL;
+
+	pthread_mutex_lock(&p->mtx);
+	p->stop = 1;
+	pthread_cond_broadcast(&p->work);
+	pthread_mutex_unlock(&p->mtx);
+
+	for (i = 0; i < p->nthr; i++)
+		pthread_join(p->thr[i], NULL);
+
+	for (i = 0; i < p->njob; i++)
+		{
+		free(p->job[i].in);
+		free(p->job[i].out);
+		}
+
+	pthread_mutex_destroy(&p->mtx);
+	pthread_cond_destroy(&p->work);
+	pthread_cond_destroy(&p->done);
+	free(p);
+}
+
+static	void	par_write	(GZ_STREAM *z, const unsigned char *buf, long len)
+{
+GZ_PAR	*p = z->par;
+GZ_JOB	*j;
+long	n;
+
+	while ( len && !z->err )
+		{
+		j = &p->job[p->submit % p->njob];
+
+		n = (GZ_CHUNK - j->len < len) ? GZ_CHUNK - j->len : len;
+		memcpy(j->in + j->dlen + j->len, buf, n);
+		j->len += n;
+		buf += n;
+		len -= n;
+
+		if ( j->len == GZ_CHUNK )
+			par_submit(z);
+		}
+}
+
+
+/*
+ * Start a gzip stream on fd; level 1 - fast .. 9 - best. Big data are compressed in
+ * parallel when there are more CPUs.
+ */
+GZ_STREAM *gz_deflate_open	(int fd, int level)
+{
+static	const unsigned char hdr[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3 };
+GZ_STREAM *z;
+int	i;
+
+	if ( !(z = calloc(1, sizeof(GZ_STREAM))) )
+		return	NULL;
+
+	z->fd = fd;
+	z->level = level;
+	def_reset(z);
+
+	gz_crc32(0, NULL, 0);		/* CRC table is built before any worker runs */
+	par_open(z);
+
+	for (i = 0; i < 10; i++)
+		put_byte(z, hdr[i]);
+
+	return	z;
+}
+
+/*
+ * Compress some more data. Returns 0 or errno.
+ */
+int	gz_deflate_write	(GZ_STREAM *z, const unsigned char *buf, long len)
+{
+	z->size += len;
+
+	if ( z->par )
+		par_write(z, buf, len);
+	else	{
+		z->crc = gz_crc32(z->crc, buf, len);
+		def_feed(z, buf, len);
+		}
+
+	return	z->err;
+}
+
+/*
+ * Compress everything pending and write out a byte aligned end of the deflate data
+ * (an empty stored block, final or not); the trailer is not written.
+ */
+void	gz_deflate_sync	(GZ_STREAM *z, int last)
+{
+	if ( z->par )
+		par_close(z);
+
+	deflate_run(z, 1);
+
+	if ( z->nsym )
+		flush_block(z, 0);
+
+	put_bits(z, last, 1);
+	put_bits(z, 0, 2);
+	put_align(z);
+	put_bits(z, 0, 16);
+	put_bits(z, 0xffff, 16);
+}
+
+/*
+ * Finish the stream: the last block and the trailer. The stream is freed.
+ * Returns 0 or errno; fd is not closed.
+ */
+int	gz_deflate_close	(GZ_STREAM *z)
+{
+int	i, err;
+
+	gz_deflate_sync(z, 1);
+
+	for (i = 0; i < 4; i++)
+		put_byte(z, (z->crc >> (8 * i)) & 0xff);
+
+	for (i = 0; i < 4; i++)
+		put_byte(z, (z->size >> (8 * i)) & 0xff);
+
+	out_flush(z);
+	err = z->err;
+	free(z);
+
+	return	err;
+}
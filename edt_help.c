@@ -121,6 +121,8 @@ char	tcline[260];
 	fprintf(fz,"\n");
 	fprintf(fz,"	-readonly\n");
 	fprintf(fz,"	-encode\n");
+	fprintf(fz,"	-recover\n");
+	fprintf(fz,"	-view\n");
 	fprintf(fz,"\n");
 	fprintf(fz,"When the '-read_only' or '-read' command-line option is placed\n");
 	fprintf(fz,"anywhere on the command-line when the editor is invoked, then \n");
@@ -135,6 +137,12 @@ char	tcline[260];
 	fprintf(fz,"may write to any arbitrary file name using the 'w' (write\n");
 	fprintf(fz,"to file-name) command.\n");
 	fprintf(fz,"\n");
+	fprintf(fz,"The '-view' option is for big gzip'd files, such as logs.\n");
+	fprintf(fz,"Only a part of the file (a few megabytes from the line\n");
+	fprintf(fz,"given as 'file.gz:line') is loaded, read-only.  An index\n");
+	fprintf(fz,"of the file is saved as 'file.gzi' on the first view, so\n");
+	fprintf(fz,"later views start quickly anywhere in the file.\n");
+	fprintf(fz,"\n");
 	fprintf(fz,"When invoked in the '-encode' mode, the editor will ask\n");
 	fprintf(fz,"for a unique encode key, or password, used for encoding\n");
 	fprintf(fz,"and decoding the document when stored as a file.  This\n");
@@ -491,6 +499,20 @@ char	tcline[260];
 	fprintf(fz,"crash or system-shutdown during editing, the journal file\n");
 	fprintf(fz,"will remain.\n");
 	fprintf(fz,"\n");
+	fprintf(fz,"The easiest way to recover is to restart the editor on the\n");
+	fprintf(fz,"edited file with the '-recover' option:\n");
+	fprintf(fz,"\n");
+	fprintf(fz,"	ed -recover text.doc\n");
+	fprintf(fz,"\n");
+	fprintf(fz,"The journal is replayed without displaying it, and you are left\n");
+	fprintf(fz,"in the editor where the crashed session stopped, in line or\n");
+	fprintf(fz,"screen mode, to check the result and to save it.\n");
+	fprintf(fz,"On long sessions the editor periodically saves a checkpoint\n");
+	fprintf(fz,"of the buffer (text.ckp) and starts the journal over, so the\n");
+	fprintf(fz,"replay takes only the keystrokes typed after the checkpoint.\n");
+	fprintf(fz,"The manual way described below works only when there is\n");
+	fprintf(fz,"no checkpoint file.\n");
+	fprintf(fz,"\n");
 	fprintf(fz,"To recover from a journal file, restart the editor on the \n");
 	fprintf(fz,"edited file as before, but with the input directed from a\n");
 	fprintf(fz,"copy of the journal file.  You will see the editing session \n");
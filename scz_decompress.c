@@ -1,9 +1,11 @@
-/****************************************************************************/ 
+/****************************************************************************/
 /* SCZ_Decompress.c - Decompresses what SCZ_Compress.c produces.
    A simple compression/decompression algorithm/utility.
+   The decompression itself is done by scz_routines.c, the segments of
+   the file are decompressed in parallel.
 
   Compile:
-    cc -O scz_decompress.c -o scz_decompress
+    cc -O scz_decompress.c -o scz_decompress -lpthread
 
   Usage:
     scz_decompress  file.dat.scz		-- Produces "file.dat"
@@ -12,112 +14,21 @@
 *****************************************************************************/
 
 #include <stdio.h>
-
-struct scz_item		/* Data structure for holding buffer items. */
- {
-   char ch;
-   struct scz_item *nxt;
- };
-
-/*-----------------------*/
-/* Add item to a buffer. */
-/*-----------------------*/
-void scz_add_item( struct scz_item **hd, struct scz_item **tl, char ch )
-{
- struct scz_item *tmppt;
- tmppt = (struct scz_item *)malloc(sizeof(struct scz_item));
- tmppt->ch = ch;
- tmppt->nxt = 0;
- if (*hd==0) *hd = tmppt; else (*tl)->nxt = tmppt;
- *tl = tmppt;
-}
-
-
-/****************************************************************/
-/* Decompress - Decompress a buffer.  Returns 1 on success, 0 	*/
-/*  if failure.							*/
-/****************************************************************/
-int scz_decompress( struct scz_item **buffer0_hd )
-{
- char forcingchar, marker[257], phrase[256][256];
- int i, j, k, nreplace=40, nreplaced, replaced, iterations, iter;
- struct scz_item *bufpt, *tmpbuf;
- char ch;
-
- /* Expect magic number(s). */
- bufpt = *buffer0_hd;
- if ((bufpt==0) || (bufpt->ch!=101))
-  {printf("Error1: This does not look like a compressed file.\n"); return(0);}
- bufpt = bufpt->nxt;
- if ((bufpt==0) || (bufpt->ch!=99))
-  {printf("Error2: This does not look like a compressed file.\n");  return(0);}
- bufpt = bufpt->nxt;
-
- /* Get the compression iterations count. */
- iterations = 255 & bufpt->ch;
- bufpt = bufpt->nxt;
- *buffer0_hd = bufpt;
-
- for (iter=0; iter<iterations; iter++)
-  { /*iter*/
-    bufpt = *buffer0_hd;
-    forcingchar = bufpt->ch;	bufpt = bufpt->nxt;
-    nreplaced = 255 & (int)(bufpt->ch);	  bufpt = bufpt->nxt;
-    for (j=0; j<nreplaced; j++)   /* Accept the markers and phrases. */
-     {
-      marker[j] =    bufpt->ch;	bufpt = bufpt->nxt;
-      phrase[j][0] = bufpt->ch;	bufpt = bufpt->nxt;
-      phrase[j][1] = bufpt->ch;	bufpt = bufpt->nxt;
-     }
-    ch = bufpt->ch; 		bufpt = bufpt->nxt;
-    if (ch!=91) /* Boundary marker. */
-      {
-	printf("Error3: Corrupted compressed file. (%d)\n", 255 & (int)ch); 
-	return(0);
-      }
-
-    /* Remove the header. */
-    *buffer0_hd = bufpt;
-
-   /* Replace chars. */
-   while (bufpt!=0)
-    {
-     if (bufpt->ch == forcingchar)
-      {
-	bufpt->ch = bufpt->nxt->ch;	/* Remove the forcing char. */
-	bufpt->nxt = bufpt->nxt->nxt;
-	bufpt = bufpt->nxt;
-      }
-     else
-      { /* Check for match to marker characters. */
-       j = 0;
-       while ((j<nreplaced) && (bufpt->ch != marker[j])) j++;
-       if (j<nreplaced)
-        {	/* If match, insert the phrase. */
-  	  bufpt->ch = phrase[j][0];
-          tmpbuf = (struct scz_item *)malloc(sizeof(struct scz_item));
-          tmpbuf->ch = phrase[j][1];
-          tmpbuf->nxt = bufpt->nxt;
-          bufpt->nxt = tmpbuf;
-          bufpt = tmpbuf->nxt;
-        }
-       else bufpt = bufpt->nxt;
-      }
-    }
-  } /*iter*/
- return 1;
-}
+#include <strings.h>
+#include "scz_routines.c"
 
 
 /************************************************/
 /*  Main  - Simple DeCompression Utility. (SCZ) */
 /************************************************/
-main( int argc, char *argv[] )
+int main( int argc, char *argv[] )
 {
- struct scz_item *buffer0_hd=0, *buffer0_tl=0, *bufpt, *bufprv;
- FILE *infile=0, *outfile;
- char fname[3][1024], ch;
- int i, j, k, verbose=0, success, sz1=0, sz2=0;
+ unsigned char *buffer;
+ int infile=-1, outfile;
+ char fname[3][1024];
+ int j, k, verbose=0;
+ long sz2;
+ struct stat st;
 
  /* Get the command-line arguments. */
  j = 1;  k = 0;  fname[1][0] = '\0';
@@ -130,19 +41,18 @@ main( int argc, char *argv[] )
     } /*optionflag*/
    else
     { /*file*/
+     if (k>1) { printf("\nERROR: Too many file names on command line.\n"); exit(0); }
      strcpy(fname[k],argv[j]);
      if (k==0)
-      { 
-	infile = fopen(fname[k],"rb");
-	if (infile==0) {printf("ERROR: Cannot open input file '%s'.  Exiting\n", fname[k]); exit(1);}
+      {
+	infile = open(fname[k], O_RDONLY);
+	if (infile<0) {printf("ERROR: Cannot open input file '%s'.  Exiting\n", fname[k]); exit(1);}
       }
-     else
-     if (k>1) { printf("\nERROR: Too many file names on command line.\n"); exit(0); }
      k = k + 1;
     } /*file*/
    j = j + 1;
   } /*argument*/
- if (infile==0) { printf("Error: Missing file name. Exiting."); exit(0); }
+ if (infile<0) { printf("Error: Missing file name. Exiting."); exit(0); }
 
  /* Allow user to specify an optional destination file name. */
  if (fname[1][0] == '\0')
@@ -153,43 +63,27 @@ main( int argc, char *argv[] )
     while ((fname[1][j]!='.') && (j>0)) j = j - 1;
     if (fname[1][j]!='.') j = strlen(fname[1]);
     if (strcmp(&(fname[1][j]),".scz")==0)
-      fname[1][j] = '\0'; 
+      fname[1][j] = '\0';
     else
      { fname[1][j] = '\0';  strcat(fname[1], ".uscz"); }
   }
  if (strcmp(fname[0],fname[1])==0) {printf("ERROR: Attempt to write over source file. Exiting\n"); exit(1);}
- 
- /* Read file into linked list. */
- ch = getc(infile);  bufprv = 0;
- while (!feof(infile))
-  {
-   bufprv = buffer0_tl;
-   scz_add_item( &buffer0_hd, &buffer0_tl, ch );
-   sz1++;
-   ch = getc(infile);
-  }
- fclose(infile);
 
- if (buffer0_tl==0) {printf("Empty file.\n"); exit(0);}
- if (buffer0_tl->ch!=']') {printf("Error4: Reading compressed file. (%x)\n", ch);  exit(0); }
- bufprv->nxt = 0;	/* Remove the end marker. */
- buffer0_tl = bufprv;
+ fstat(infile, &st);
+ if (st.st_size==0) {printf("Empty file.\n"); exit(0);}
 
- success = scz_decompress( &buffer0_hd );	/* Decompress the buffer !!! */
- if (!success) exit(0);
+ if (!Scz_Decompress_Fd2Buffer( infile, &buffer, &sz2 ))	/* Decompress the file !!! */
+  exit(0);
+ close(infile);
 
 /* Write the file the decompressed out. */
  printf("\n Writing output to file %s\n", fname[1]);
- outfile = fopen(fname[1],"wb");
- if (outfile==0) {printf("ERROR: Cannot open output file '%s' for writing.  Exiting\n", fname[1]); exit(1);}
- sz2 = 0;
- bufpt = buffer0_hd;
- while (bufpt!=0)
-  {
-   fputc( bufpt->ch, outfile );
-   sz2++;
-   bufpt = bufpt->nxt;
-  }
- fclose(outfile);
- printf("Decompression ratio = %g\n", (float)sz2 / (float)sz1 );
+ outfile = open(fname[1], O_WRONLY | O_CREAT | O_TRUNC, 0666);
+ if (outfile<0) {printf("ERROR: Cannot open output file '%s' for writing.  Exiting\n", fname[1]); exit(1);}
+ if (!scz_write( outfile, buffer, sz2 ) || close(outfile))
+  {printf("ERROR: Writing output file '%s'.\n", fname[1]); exit(1);}
+ free(buffer);
+ if (verbose) printf("%ld bytes\n", sz2);
+ printf("Decompression ratio = %g\n", (float)sz2 / (float)st.st_size );
+ return 0;
 }
@@ -8,17 +8,19 @@
 #include	<stdio.h>
 #include	<stdlib.h>
 #include	<string.h>
+#include	<fcntl.h>
+#include	<unistd.h>
+#include	<errno.h>
+#include	<sys/stat.h>
+#include	<pthread.h>
 
 #define	SCZ_MAX_BUF	16777215
-#define	SCZFREELSTSZ	2048
-#define	nil		0
-int	sczbuflen = 4 * 1048576;
+#define	SCZ_NREPLACE	250		/* Markers/phrases of one iteration at most */
+#define	SCZ_MAXITER	255
+#define	SCZ_NOPAIR	0xff		/* No phrase for the pair in scz_pairj[] */
+#define	SCZ_MAXTHR	32		/* Segments are (de)compressed by so many threads at most */
 
-struct scz_item		/* Data structure for holding buffer items. */
-{
-	unsigned char ch;
-	struct scz_item *nxt;
-} *sczfreelist1 = NULL;
+int	sczbuflen = 4 * 1048576;
 
 struct scz_amalgam	/* Data structure for holding markers and phrases. */
 {
@@ -26,98 +28,209 @@ struct scz_amalgam	/* Data structure for holding markers and phrases. */
 	int value;
 };
 
-struct scz_item2		/* Data structure for holding buffer items with index. */
+/*
+ * Working arrays of the codec: the segment is a flat byte array which is rewritten
+ * into the second one by each pass, then they are swapped.
+ */
+typedef	struct __scz_seg__ {
+	unsigned char	*buf, *tmp;
+	long		len, cap;
+} SCZ_SEG;
+
+
+/*
+ * Make room for len bytes of output in the second array of the segment
+ */
+static	int	scz_reserve	(SCZ_SEG *seg, long len)
 {
-	unsigned char ch;
-	int j;
-	struct scz_item2 *nxt;
-} *sczphrasefreq[256], *scztmpphrasefreq, *sczfreelist2 = NULL;
+unsigned char *cp;
+
+	if ( len <= seg->cap )
+		return	1;
+
+	if ( !(cp = realloc(seg->buf, len)) )
+		return	0;
+
+	seg->buf = cp;
 
+	if ( !(cp = realloc(seg->tmp, len)) )
+		return	0;
 
+	seg->tmp = cp;
+	seg->cap = len;
+
+	return	1;
+}
+
+static	void	scz_swap	(SCZ_SEG *seg, long len)
+{
+unsigned char *cp = seg->buf;
 
+	seg->buf = seg->tmp;
+	seg->tmp = cp;
+	seg->len = len;
+}
 
+static	void	scz_free	(SCZ_SEG *seg)
+{
+	free(seg->buf);
+	free(seg->tmp);
+	seg->buf = seg->tmp = NULL;
+	seg->len = seg->cap = 0;
+}
 
-struct scz_item *new_scz_item()
+/*
+ * Segments are independent, they are compressed or decompressed on a pool of threads
+ * and taken in order by the caller.  Workers run ahead of it by 2 segments per thread
+ * at most, that is what keeps the memory in use.
+ */
+typedef	struct __scz_job__ {
+	unsigned char	*in;		/* Segment data */
+	long		len;
+	int		iter;		/* Iterations, decompression */
+	unsigned char	chksum;
+	SCZ_SEG		seg;		/* Result */
+	int		ok, done;
+} SCZ_JOB;
+
+typedef	struct __scz_pool__ {
+	pthread_mutex_t	mtx;
+	pthread_cond_t	work, done;
+	SCZ_JOB		*job;
+	long		njob, take, taken;	/* Next to run, consumed by the caller */
+	int		window, stop;
+	int		(*run) (SCZ_JOB *j);
+} SCZ_POOL;
+
+static	void	*scz_worker	(void *arg)
 {
-int j;
-struct scz_item *tmppt;
+SCZ_POOL *p = arg;
+long	i;
+
+	pthread_mutex_lock(&p->mtx);
 
-	if ( !sczfreelist1 )
+	for ( ; ; )
 		{
-		sczfreelist1 = (struct scz_item *) malloc(SCZFREELSTSZ * sizeof(struct scz_item));
+		while ( !p->stop && (p->take < p->njob) && (p->take >= p->taken + p->window) )
+			pthread_cond_wait(&p->work, &p->mtx);
 
-		tmppt = sczfreelist1;
+		if ( p->stop || (p->take == p->njob) )
+			break;
 
-		for (j = SCZFREELSTSZ - 1; j; j--)
-			{
-			tmppt->nxt = tmppt + 1;	/* Pointer arithmetic. */
-			tmppt = tmppt->nxt;
-			}
+		i = p->take++;
+		pthread_mutex_unlock(&p->mtx);
 
-		tmppt->nxt = NULL;
-		}
+		p->job[i].ok = p->run(&p->job[i]);
 
+		pthread_mutex_lock(&p->mtx);
+		p->job[i].done = 1;
+		pthread_cond_broadcast(&p->done);
+		}
 
-	tmppt = sczfreelist1;
-	sczfreelist1 = sczfreelist1->nxt;
+	pthread_mutex_unlock(&p->mtx);
 
-	return tmppt;
+	return	NULL;
 }
 
-void sczfree( struct scz_item *tmppt )
+/*
+ * Run the jobs, put() is called for each one in order from the calling thread, it
+ * gets the result of the job and releases it.  0 from put() stops the pool.
+ * Returns 1 - all the jobs are done and taken, 0 - otherwise.
+ */
+static	int	scz_pool_run	(SCZ_JOB *job, long njob, int (*run) (SCZ_JOB *j),
+			int (*put) (void *ctx, SCZ_JOB *j), void *ctx)
 {
-	tmppt->nxt = sczfreelist1;
-	sczfreelist1 = tmppt;
-}
+SCZ_POOL pool = {0}, *p = &pool;
+pthread_t thr[SCZ_MAXTHR];
+long	ncpu = sysconf(_SC_NPROCESSORS_ONLN), i;
+int	nthr, ok = 1;
 
-struct scz_item2 *new_scz_item2()
-{
-int	j;
-struct scz_item2 *tmppt;
+	nthr = (ncpu < SCZ_MAXTHR) ? ncpu : SCZ_MAXTHR;
+	nthr = (njob < nthr) ? njob : nthr;
 
-	if ( !sczfreelist2 )
+	if ( nthr < 2 )
 		{
-		sczfreelist2 = (struct scz_item2 *) malloc(SCZFREELSTSZ * sizeof(struct scz_item2));
-		tmppt = sczfreelist2;
-
-		for (j = SCZFREELSTSZ-1; j; j--)
+		for (i = 0; ok && (i < njob); i++)
 			{
-			tmppt->nxt = tmppt + 1;	/* Pointer arithmetic. */
-			tmppt = tmppt->nxt;
+			job[i].ok = run(&job[i]);
+			ok = put(ctx, &job[i]);
+			scz_free(&job[i].seg);
 			}
 
-		tmppt->nxt = nil;
+		return	ok;
 		}
 
-	tmppt = sczfreelist2;
-	sczfreelist2 = sczfreelist2->nxt;
+	pthread_mutex_init(&p->mtx, NULL);
+	pthread_cond_init(&p->work, NULL);
+	pthread_cond_init(&p->done, NULL);
+	p->job = job;
+	p->njob = njob;
+	p->window = 2 * nthr;
+	p->run = run;
 
-	return tmppt;
-}
+	for (i = 0; i < nthr; i++)
+		if ( pthread_create(&thr[i], NULL, scz_worker, p) )
+			break;
 
-void sczfree2( struct scz_item2 *tmppt )
-{
-	tmppt->nxt = sczfreelist2;
-	sczfreelist2 = tmppt;
+	if ( !(nthr = i) )
+		{
+		p->window = njob;	/* No threads, do it here */
+		scz_worker(p);
+		}
+
+	for (i = 0; ok && (i < njob); i++)
+		{
+		pthread_mutex_lock(&p->mtx);
+
+		while ( !job[i].done )
+			pthread_cond_wait(&p->done, &p->mtx);
+
+		pthread_mutex_unlock(&p->mtx);
+
+		ok = put(ctx, &job[i]);
+		scz_free(&job[i].seg);
+
+		pthread_mutex_lock(&p->mtx);
+		p->taken = i + 1;
+		p->stop = !ok;
+		pthread_cond_broadcast(&p->work);
+		pthread_mutex_unlock(&p->mtx);
+		}
+
+	for (i = 0; i < nthr; i++)
+		pthread_join(thr[i], NULL);
+
+	for (i = 0; i < njob; i++)	/* Done after a stop */
+		scz_free(&job[i].seg);
+
+	pthread_mutex_destroy(&p->mtx);
+	pthread_cond_destroy(&p->work);
+	pthread_cond_destroy(&p->done);
+
+	return	ok;
 }
 
 
-/*-----------------------*/
-/* Add item to a buffer. */
-/*-----------------------*/
-void scz_add_item( struct scz_item **hd, struct scz_item **tl, unsigned char ch )
+/* Write all of it, 0 - error */
+static	int	scz_write	(int fd, unsigned char *buf, long len)
 {
-struct scz_item *tmppt;
+long	n;
+
+	while ( len )
+		{
+		if ( 0 > (n = write(fd, buf, len)) )
+			{
+			if ( errno == EINTR )
+				continue;
 
-	tmppt = new_scz_item();
-	tmppt->ch = ch;
-	tmppt->nxt = 0;
+			return	0;
+			}
 
-	if (*hd == 0)
-		*hd = tmppt;
-	else	(*tl)->nxt = tmppt;
+		buf += n;
+		len -= n;
+		}
 
-	*tl = tmppt;
+	return	1;
 }
 
 
@@ -128,9 +241,8 @@ struct scz_item *tmppt;
    Simple decompression algorithms for SCZ compressed data.
 
    This file contains the following user-callable routines:
-     Scz_Decompress_File( *infilename, *outfilename );
      Scz_Decompress_File2Buffer( *infilename, **outbuffer, *M );
-     Scz_Decompress_Buffer2Buffer( *inbuffer, *N, **outbuffer, *M );
+     Scz_Decompress_Fd2Buffer( fd, **outbuffer, *M );
   See below for formal definitions and comments.
 
  SCZ_Compress - LGPL License:
@@ -151,91 +263,289 @@ struct scz_item *tmppt;
 
   Carl Kindman 11-21-2004     carlkindman@yahoo.com
 		7-5-2005        Added checksums and blocking.
+		19-OCT-2026	agent	Flat arrays instead of the linked lists.
 *****************************************************************************/
 
 
 
 /****************************************************************/
-/* Decompress - Decompress a buffer.  Returns 1 on success, 0 	*/
-/*  if failure.							*/
+/* Decompress - Decompress a segment: iteration count, then	*/
+/*  the data with the headers of the iterations.  The result	*/
+/*  replaces the data.  Returns 1 on success, 0 if failure.	*/
 /****************************************************************/
-int Scz_Decompress_Seg( struct scz_item **buffer0_hd )
+int Scz_Decompress_Seg( SCZ_SEG *seg, int iterations )
 {
- unsigned char forcingchar, marker[257], phrase[256][256];
- int i, j, k, nreplace=40, nreplaced, replaced, iterations, iter, markerlist[256];
- struct scz_item *bufpt, *tmpbuf;
- unsigned char ch;
-
- /* Expect magic number(s). */
- bufpt = *buffer0_hd;
- if ((bufpt==0) || (bufpt->ch!=101))
-  {printf("Error1a: This does not look like a compressed file.\n"); return 0;}
- bufpt = bufpt->nxt;
- if ((bufpt==0) || (bufpt->ch!=98))
-  {printf("Error2a: This does not look like a compressed file.\n");  return 0;}
- bufpt = bufpt->nxt;
-
- /* Get the compression iterations count. */
- iterations = bufpt->ch;
- bufpt = bufpt->nxt;
- *buffer0_hd = bufpt;
-
- for (iter=0; iter<iterations; iter++)
-  { /*iter*/
-    bufpt = *buffer0_hd;
-    forcingchar = bufpt->ch;	bufpt = bufpt->nxt;
-    nreplaced = bufpt->ch;	bufpt = bufpt->nxt;
-    for (j=0; j<nreplaced; j++)   /* Accept the markers and phrases. */
-     {
-      marker[j] =    bufpt->ch;	bufpt = bufpt->nxt;
-      phrase[j][0] = bufpt->ch;	bufpt = bufpt->nxt;
-      phrase[j][1] = bufpt->ch;	bufpt = bufpt->nxt;
-     }
-    ch = bufpt->ch; 		bufpt = bufpt->nxt;
-    if (ch!=91) /* Boundary marker. */
-     {
-      printf("Error3: Corrupted compressed file. (%d)\n", ch);
-      return 0;
-     }
-
-    for (j=0; j!=256; j++) markerlist[j] = nreplaced;
-    for (j=0; j!=nreplaced; j++) markerlist[ marker[j] ] = j;
-
-
-    /* Remove the header. */
-    *buffer0_hd = bufpt;
-
-   /* Replace chars. */
-   if (nreplaced>0)
-    while (bufpt!=0)
-    {
-     if (bufpt->ch == forcingchar)
-      {
-	bufpt->ch = bufpt->nxt->ch;	/* Remove the forcing char. */
-	bufpt->nxt = bufpt->nxt->nxt;
-	bufpt = bufpt->nxt;
-      }
-     else
-      { /* Check for match to marker characters. */
-       j = markerlist[ bufpt->ch ];
-       if (j<nreplaced)
-	{	/* If match, insert the phrase. */
-	  bufpt->ch = phrase[j][0];
-	  tmpbuf = new_scz_item();
-	  tmpbuf->ch = phrase[j][1];
-	  tmpbuf->nxt = bufpt->nxt;
-	  bufpt->nxt = tmpbuf;
-	  bufpt = tmpbuf->nxt;
-	}
-       else bufpt = bufpt->nxt;
-      }
-    }
-  } /*iter*/
- return 1;
+unsigned char forcingchar, marker[256], phrase[256][2], *in, *end, *out;
+int	j, nreplaced, iter, markerlist[256];
+
+	for (iter = 0; iter < iterations; iter++)
+		{ /*iter*/
+		in = seg->buf;
+		end = seg->buf + seg->len;
+
+		if ( end - in < 3 )
+			{
+			printf("Error3: Corrupted compressed file.\n");
+			return	0;
+			}
+
+		forcingchar = *(in++);
+		nreplaced = *(in++);
+
+		if ( end - in < 3 * nreplaced + 1 )
+			{
+			printf("Error3: Corrupted compressed file.\n");
+			return	0;
+			}
+
+		for (j = 0; j < nreplaced; j++)   /* Accept the markers and phrases. */
+			{
+			marker[j] = *(in++);
+			phrase[j][0] = *(in++);
+			phrase[j][1] = *(in++);
+			}
+
+		if ( *in != 91 ) /* Boundary marker. */
+			{
+			printf("Error3: Corrupted compressed file. (%d)\n", *in);
+			return	0;
+			}
+
+		in++;
+
+		for (j = 0; j != 256; j++)
+			markerlist[j] = nreplaced;
+
+		for (j = 0; j != nreplaced; j++)
+			markerlist[ marker[j] ] = j;
+
+		/* A phrase is two bytes for one, so output is twice the input at most */
+		j = in - seg->buf;
+
+		if ( !scz_reserve(seg, 2 * (end - in)) )
+			{
+			printf("Error: Out of memory.\n");
+			return	0;
+			}
+
+		in = seg->buf + j;
+		end = seg->buf + seg->len;
+
+		if ( !nreplaced )	/* Nothing was replaced, drop the header only */
+			{
+			memmove(seg->buf, in, end - in);
+			seg->len = end - in;
+			continue;
+			}
+
+		/* Replace chars. */
+		for (out = seg->tmp; in < end; in++)
+			{
+			if ( *in == forcingchar )
+				{
+				if ( ++in == end )	/* Forcing char must have a char after it */
+					{
+					printf("Error3: Corrupted compressed file.\n");
+					return	0;
+					}
+
+				*(out++) = *in;
+				}
+			else if ( (j = markerlist[*in]) < nreplaced )
+				{	/* If match, insert the phrase. */
+				*(out++) = phrase[j][0];
+				*(out++) = phrase[j][1];
+				}
+			else	*(out++) = *in;
+			}
+
+		scz_swap(seg, out - seg->tmp);
+		} /*iter*/
+
+	return	1;
 }
 
 
 
+/*
+ * Decompress a segment of the file, a pool job
+ */
+static	int	scz_decompress_job	(SCZ_JOB *j)
+{
+unsigned char chksum;
+long	i;
+
+	if ( !scz_reserve(&j->seg, j->len) )
+		{
+		printf("Error: Out of memory.\n");
+		return	0;
+		}
+
+	memcpy(j->seg.buf, j->in, j->seg.len = j->len);
+
+	if ( !Scz_Decompress_Seg( &j->seg, j->iter ) )	/* Decompress the buffer !!! */
+		return	0;
+
+	/* Check checksum */
+	for (chksum = 0, i = 0; i < j->seg.len; i++)
+		chksum += j->seg.buf[i];
+
+	if ( chksum != j->chksum )
+		printf("Error: Checksum mismatch (%dvs%d)\n", chksum, j->chksum);
+
+	return	1;
+}
+
+typedef	struct __scz_out__ {
+	unsigned char	*buf;
+	long		len, cap;
+} SCZ_OUT;
+
+/* Attach a decompressed segment to tail of the output. */
+static	int	scz_decompress_put	(void *ctx, SCZ_JOB *j)
+{
+SCZ_OUT	*o = ctx;
+unsigned char *cp;
+
+	if ( !j->ok )
+		return	0;
+
+	if ( o->len + j->seg.len > o->cap )
+		{
+		if ( !(cp = realloc(o->buf, o->cap = 2 * (o->len + j->seg.len) + 1)) )
+			{
+			printf("Error: Out of memory.\n");
+			return	0;
+			}
+
+		o->buf = cp;
+		}
+
+	memcpy(o->buf + o->len, j->seg.buf, j->seg.len);
+	o->len += j->seg.len;
+
+	return	1;
+}
+
+
+/***************************************************************************/
+/* Scz_Decompress_Fd2Buffer - Decompresses input file on fd to an output   */
+/*  buffer.  The output array is allocated, the size is passed back.	   */
+/*  The segments are decompressed in parallel.				   */
+/*  Returns 1 on success, 0 if failure.					   */
+/***************************************************************************/
+int Scz_Decompress_Fd2Buffer( int fd, unsigned char **outbuffer, long *M )
+{
+unsigned char *in = NULL, *cp, *end;
+long	n, len = 0, cap = 0, buflen, njob = 0, jcap = 0;
+int	continuation, success = 0;
+SCZ_JOB	*job = NULL, *jp;
+SCZ_OUT	out = {0};
+
+	/* The file is read in */
+	for ( ; ; )
+		{
+		if ( len == cap )
+			{
+			if ( !(cp = realloc(in, cap = 2 * cap + 65536)) )
+				{
+				printf("Error: Out of memory.\n");
+				free(in);
+				return	0;
+				}
+
+			in = cp;
+			}
+
+		if ( 0 > (n = read(fd, in + len, cap - len)) )
+			{
+			if ( errno == EINTR )
+				continue;
+
+			printf("Error: Reading compressed file (%s).\n", strerror(errno));
+			free(in);
+			return	0;
+			}
+
+		if ( !n )
+			break;
+
+		len += n;
+		}
+
+	cp = in;
+	end = in + len;
+
+	/* The segments are found by the headers */
+	do	{ /*Segment*/
+
+		/* 6-byte header: magic number (101), magic number (98), iter-count, seg-size (MSB), seg-size, seg-size (LSB). */
+		if ( (end - cp < 6) || (cp[0] != 101) || (cp[1] != 98) )
+			{
+			printf("Error1: This does not look like a compressed file.\n");
+			break;
+			}
+
+		buflen = (cp[3] << 16) | (cp[4] << 8) | cp[5];
+
+		if ( end - cp - 6 < buflen + 2 )
+			{
+			printf("Error: Unexpectedly short file.\n");
+			break;
+			}
+
+		/* Decode the 'end-marker'. */
+		if ( cp[6 + buflen + 1] == ']' )
+			continuation = 0;
+		else if ( cp[6 + buflen + 1] == '[' )
+			continuation = 1;
+		else	{
+			printf("Error4: Reading compressed file. (%d)\n", cp[6 + buflen + 1]);
+			break;
+			}
+
+		if ( njob == jcap )
+			{
+			if ( !(jp = realloc(job, (jcap = 2 * jcap + 16) * sizeof(SCZ_JOB))) )
+				{
+				printf("Error: Out of memory.\n");
+				break;
+				}
+
+			job = jp;
+			}
+
+		jp = &job[njob++];
+		memset(jp, 0, sizeof(SCZ_JOB));
+		jp->iter = cp[2];
+		jp->in = cp + 6;
+		jp->len = buflen;
+		jp->chksum = cp[6 + buflen];
+
+		cp += 6 + buflen + 2;
+		success = !continuation;
+		} /*Segment*/
+	while ( continuation );
+
+	if ( success )
+		success = scz_pool_run(job, njob, scz_decompress_job, scz_decompress_put, &out);
+
+	free(job);
+	free(in);
+
+	if ( !success )
+		{
+		free(out.buf);
+		return	0;
+		}
+
+	*outbuffer = out.buf ? out.buf : malloc(1);
+	*M = out.len;
+
+	return	1;
+}
+
+
 
 /***************************************************************************/
 /* Scz_Decompress_File2Buffer - Decompresses input file to output buffer.  */
@@ -249,107 +559,28 @@ int Scz_Decompress_Seg( struct scz_item **buffer0_hd )
 /**************************************************************************/
 int Scz_Decompress_File2Buffer( char *infilename, char **outbuffer, int *M )
 {
- int j, k, success, sz1=0, sz2=0, buflen, continuation, totalin=0, totalout=0;
- unsigned char ch, chksum, chksum0;
- struct scz_item *buffer0_hd, *buffer0_tl, *bufpt, *bufprv, *sumlst_hd=0, *sumlst_tl=0;
- FILE *infile=0;
-
- infile = fopen(infilename,"rb");
- if (infile==0) {printf("ERROR: Cannot open input file '%s'.  Exiting\n", infilename);  return 0;}
-
- do
-  { /*Segment*/
-
-   /* Read file segment into linked list for expansion. */
-   /* Get the 6-byte header to find the number of chars to read in this segment. */
-   /*  (magic number (101), magic number (98), iter-count, seg-size (MBS), seg-size, seg-size (LSB). */
-   buffer0_hd = 0;  buffer0_tl = 0;
-
-   ch = getc(infile);   sz1++;		/* Byte 1, expect magic numeral 101. */
-   if ((feof(infile)) || (ch!=101)) {printf("Error1: This does not look like a compressed file.\n"); return 0;}
-   scz_add_item( &buffer0_hd, &buffer0_tl, ch );
-
-   ch = getc(infile);  sz1++;		/* Byte 2, expect magic numeral 98. */
-   if ((feof(infile)) || (ch!=98)) {printf("Error2: This does not look like a compressed file. (%d)\n", ch); return 0;}
-   scz_add_item( &buffer0_hd, &buffer0_tl, ch );
-
-   ch = getc(infile);  sz1++;		/* Byte 3, iteration-count. */
-   if (feof(infile)) {printf("Error3: This does not look like a compressed file.\n"); return 0;}
-   scz_add_item( &buffer0_hd, &buffer0_tl, ch );
-
-   ch = getc(infile);			/* Byte 4, MSB of segment buffer length. */
-   if (feof(infile)) {printf("Error3: This does not look like a compressed file.\n"); return 0;}
-   buflen = ch << 16;
-   ch = getc(infile);			/* Byte 5, middle byte of segment buffer length. */
-   if (feof(infile)) {printf("Error3: This does not look like a compressed file.\n"); return 0;}
-   buflen = (ch << 8) | buflen;
-   ch = getc(infile);			/* Byte 6, LSB of segment buffer length. */
-   if (feof(infile)) {printf("Error3: This does not look like a compressed file.\n"); return 0;}
-   buflen = ch | buflen;
-
-   k = 0;
-   ch = getc(infile);
-   while ((!feof(infile)) && (k<buflen))
-    {
-     scz_add_item( &buffer0_hd, &buffer0_tl, ch );
-     sz1++;  k++;
-     ch = getc(infile);
-    }
-
-   chksum0 = ch;
-   ch = getc(infile);
-   // printf("End ch = '%c'\n", ch);
-
-   if (k<buflen) {printf("Error: Unexpectedly short file.\n");}
-   totalin = totalin + sz1 + 4;		/* (+4, because chksum+3buflen chars not counted above.) */
-   /* Decode the 'end-marker'. */
-   if (ch==']') continuation = 0;
-   else
-   if (ch=='[') continuation = 1;
-   else {printf("Error4: Reading compressed file. (%d)\n", ch);  return 0; }
-
-   success = Scz_Decompress_Seg( &buffer0_hd );	/* Decompress the buffer !!! */
-   if (!success) return 0;
-
-   /* Check checksum and sum length. */
-   sz2 = 0;       /* Get buffer size. */
-   bufpt = buffer0_hd;
-   chksum = 0;
-   bufprv = 0;
-   while (bufpt!=0)
-    {
-     chksum += bufpt->ch;
-     sz2++;  bufprv = bufpt;
-     bufpt = bufpt->nxt;
-    }
-   if (chksum != chksum0) {printf("Error: Checksum mismatch (%dvs%d)\n", chksum, chksum0);}
+int	fd, success;
+long	totalout;
+struct stat st;
 
-   /* Attach to tail of main list. */
-   totalout = totalout + sz2;
-   if (sumlst_hd==0) sumlst_hd = buffer0_hd;
-   else sumlst_tl->nxt = buffer0_hd;
-   sumlst_tl = bufprv;
+	if ( 0 > (fd = open(infilename, O_RDONLY)) )
+		{
+		printf("ERROR: Cannot open input file '%s'.  Exiting\n", infilename);
+		return	0;
+		}
 
-  } /*Segment*/
- while (continuation);
+	success = Scz_Decompress_Fd2Buffer( fd, (unsigned char **) outbuffer, &totalout );
 
- /* Convert list into buffer. */
- *outbuffer = (char *)malloc((totalout)*sizeof(char));
- sz2 = 0;
- while (sumlst_hd!=0)
-  {
-   bufpt = sumlst_hd;
-   (*outbuffer)[sz2++] = bufpt->ch;
-   sumlst_hd = bufpt->nxt;
-   sczfree(bufpt);
-  }
- if (sz2 > totalout) printf("Unexpected overrun error\n");
+	if ( success )
+		{
+		*M = totalout;
+		fstat(fd, &st);
+		printf("Decompression ratio = %g\n", (float)totalout / (float)st.st_size );
+		}
 
- *M = totalout;
+	close(fd);
 
- fclose(infile);
- printf("Decompression ratio = %g\n", (float)totalout / (float)totalin );
- return 1;
+	return	success;
 }
 
 
@@ -363,9 +594,8 @@ int Scz_Decompress_File2Buffer( char *infilename, char **outbuffer, int *M )
 /* SCZ_Compress_Lib.c - Compress files or buffers.  Simple compression.	*/
 /*
 /  This file contains the following user-callable routines:
-/    Scz_Compress_File( *infilename, *outfilename );
 /    Scz_Compress_Buffer2File( *buffer, N, *outfilename );
-/    Scz_Compress_Buffer2Buffer( *inbuffer, N, **outbuffer, *M, lastbuf_flag );
+/    Scz_Compress_Buffer2Fd( *buffer, N, fd );
 /
 /  See below for formal definitions.
 
@@ -388,6 +618,10 @@ int Scz_Decompress_File2Buffer( char *infilename, char **outbuffer, int *M )
    67 MB.  Recommend going to trees after that.  But have not found
    advantages to going above pairs. On the contrary, pairs are faster
    to search and allow lower granularity replacement (compression).
+
+   The segment is kept in a flat array, an iteration is one sweep over it
+   to count chars and pairs, and one or two passes to replace, pairs are
+   looked up in a 64K table of phrase indices.
  ---
 
  SCZ_Compress - LGPL License:
@@ -408,9 +642,16 @@ int Scz_Decompress_File2Buffer( char *infilename, char **outbuffer, int *M )
 
   Carl Kindman 11-21-2004     carlkindman@yahoo.com
 		7-5-2005	Added checksums and blocking.
+		19-OCT-2026	agent	Flat arrays instead of the linked lists.
 *************************************************************************/
 
-int *scz_freq2=0;
+/*
+ * Counters of an iteration, and the pair -> phrase index table
+ */
+typedef	struct __scz_work__ {
+	int		freq1[256], freq2[256 * 256];
+	unsigned char	pairj[256 * 256];
+} SCZ_WORK;
 
 
 /*------------------------------------------------------------*/
@@ -421,6 +662,7 @@ void scz_add_sorted_nmax( struct scz_amalgam *list, unsigned char *phrase, int l
 {
  int j, k=0, m;
 
+ if (list[N-1].value >= value) return;	/* Would not get into the list anyway. */
  while ((k<N) && (list[k].value >= value)) k++;
  if (k==N) return;
  j = N-2;
@@ -460,26 +702,26 @@ void scz_add_sorted_nmin( struct scz_amalgam *list, unsigned char *phrase, int l
 /*----------------------------------------------------------------------*/
 /* Analyze a buffer to determine the frequency of characters and pairs. */
 /*----------------------------------------------------------------------*/
-void scz_analyze( struct scz_item *buffer0_hd, int *freq1, int *freq2 )
+void scz_analyze( unsigned char *buf, long len, int *freq1, int *freq2 )
 {
- int j, k;
- struct scz_item *ptr;
-
- memset( freq1, 0, sizeof(int)*256 );
- memset( freq2, 0, sizeof(int)*256*256 );
- ptr = buffer0_hd;
- if (ptr==0) return;
- k = ptr->ch;
- freq1[k]++;
- ptr = ptr->nxt;
- while (ptr!=0)
-  {
-   j = k;
-   k = ptr->ch;
-   freq1[k]++;
-   freq2[j*256+k]++;
-   ptr = ptr->nxt;
-  }
+unsigned char *end = buf + len;
+unsigned	prv;
+
+	memset( freq1, 0, sizeof(int)*256 );
+	memset( freq2, 0, sizeof(int)*256*256 );
+
+	if ( !len )
+		return;
+
+	prv = *(buf++);
+	freq1[prv]++;
+
+	for ( ; buf < end; buf++)
+		{
+		freq1[*buf]++;
+		freq2[(prv << 8) | *buf]++;
+		prv = *buf;
+		}
 }
 
 
@@ -487,25 +729,23 @@ void scz_analyze( struct scz_item *buffer0_hd, int *freq1, int *freq2 )
 
 /*------------------------------------------------------*/
 /* Compress a buffer, step.  Called iteratively.	*/
+/* Returns the new size, 0 - buffer unchanged.		*/
 /*------------------------------------------------------*/
-int scz_compress_iter( struct scz_item **buffer0_hd )
+int scz_compress_iter( SCZ_SEG *seg, SCZ_WORK *w )
 {
- int nreplace=250;
- int freq1[256], markerlist[256];
- int i, j, k, replaced, nreplaced, sz3=0, saved=0, saved_pairfreq[256], saved_charfreq[257];
- struct scz_item *head1, *head2, *bufpt, *tmpbuf, *cntpt;
- unsigned char word[10], forcingchar;
+ int nreplace=SCZ_NREPLACE;
+ int markerlist[256];
+ int i, j, k, nreplaced, saved=0, saved_pairfreq[256], saved_charfreq[257];
+ unsigned char word[10], forcingchar, *in, *end, *out;
  struct scz_amalgam char_freq[257], phrase_freq_max[256];
- FILE *outfile;
 
  /* Examine the buffer. */
  /* Determine histogram of character usage, and pair-frequencies. */
- if (scz_freq2==0) scz_freq2 = (int *)malloc(256*256*sizeof(int));
- scz_analyze( *buffer0_hd, freq1, scz_freq2 );
+ scz_analyze( seg->buf, seg->len, w->freq1, w->freq2 );
 
  /* Initialize rank vectors. */
  memset( saved_pairfreq, 0, 256 * sizeof(int) );
- memset( saved_charfreq, 0, 256 * sizeof(int) );
+ memset( saved_charfreq, 0, 257 * sizeof(int) );
  for (k=0; k<256; k++)
   {
    char_freq[k].value = 1073741824;
@@ -516,17 +756,16 @@ int scz_compress_iter( struct scz_item **buffer0_hd )
  for (j=0; j!=256; j++)
   {
    word[0] = j;
-   scz_add_sorted_nmin( char_freq, word, 1, freq1[j], nreplace+1 );
+   scz_add_sorted_nmin( char_freq, word, 1, w->freq1[j], nreplace+1 );
   }
 
  /* Sort and rank pairs. */
- i = 0;
  for (k=0; k!=256; k++)
   for (j=0; j!=256; j++)
-   if (scz_freq2[j*256+k]!=0)
+   if (w->freq2[j*256+k]!=0)
     {
      word[0] = j;  word[1] = k;
-     scz_add_sorted_nmax( phrase_freq_max, word, 2, scz_freq2[j*256+k], nreplace );
+     scz_add_sorted_nmax( phrase_freq_max, word, 2, w->freq2[j*256+k], nreplace );
     }
 
  /* Use the least-used character(s) for special expansion symbol(s). I.E. "markers". */
@@ -534,11 +773,10 @@ int scz_compress_iter( struct scz_item **buffer0_hd )
  /* And insert before any natural occurrences of the markers, the forcingchar. */
  /*  These two sets should be mutually exclusive, so it should not matter which order this is done. */
 
- head1 = 0;	head2 = 0;
  forcingchar = char_freq[0].phrase[0];
- k = -1;  j = 0;
+ j = 0;
  while ((j<nreplace) && (char_freq[j+1].value < phrase_freq_max[j].value - 3))
-  { j++;   k = k + phrase_freq_max[j].value - char_freq[j+1].value; }
+  j++;
  nreplaced = j;
 
  if (nreplaced == 0) return 0; /* Not able to compress this data further with this method. */
@@ -547,183 +785,105 @@ int scz_compress_iter( struct scz_item **buffer0_hd )
     - If equals forcingchar or any of the other maker-chars, then insert forcing char in front of them.
     - If the next pair match any of the frequent_phrases, then replace the phrase by the corresponding marker.
  */
-
-
-/* Define a new array, phrase_freq_max2[256], which is a lookup array for the first character of
-   a two-character phrase.  Each element points to a list of second characters with "j" indices.
-   First chars which have none are null, stopping the search immediately.
-*/
-memset( sczphrasefreq, 0, 256 * sizeof(struct scz_item2 *) );
-for (j=0; j!=256; j++) markerlist[j] = nreplaced+1;
-for (j=0; j!=nreplaced+1; j++) markerlist[ char_freq[j].phrase[0] ] = j;
-for (j=0; j!=nreplaced; j++)
- if (phrase_freq_max[j].value>0)
-  {
-   scztmpphrasefreq = new_scz_item2();
-   scztmpphrasefreq->ch = phrase_freq_max[j].phrase[1];
-   scztmpphrasefreq->j = j;
-   k = phrase_freq_max[j].phrase[0];
-   scztmpphrasefreq->nxt = sczphrasefreq[k];
-   sczphrasefreq[k] = scztmpphrasefreq;
-  }
-
+ for (j=0; j!=256; j++) markerlist[j] = nreplaced+1;
+ for (j=0; j!=nreplaced+1; j++) markerlist[ char_freq[j].phrase[0] ] = j;
+ for (j=0; j!=nreplaced; j++)
+  w->pairj[ phrase_freq_max[j].phrase[0] * 256 + phrase_freq_max[j].phrase[1] ] = j;
 
  /* First do a tentative check. */
- bufpt = *buffer0_hd;
- if (nreplaced>0)
- while (bufpt!=0)
+ in = seg->buf;
+ end = seg->buf + seg->len;
+ while (in < end)
   {
-   replaced = 0;
-   if (bufpt->nxt!=0)
-    {  /* Check for match to frequent phrases. */
-     k = bufpt->ch;
-     if (sczphrasefreq[k]==0) j = nreplaced;
-     else
-      { unsigned char tmpch;
-	tmpch = bufpt->nxt->ch;
-	scztmpphrasefreq = sczphrasefreq[k];
-	while ((scztmpphrasefreq!=0) && (scztmpphrasefreq->ch != tmpch)) scztmpphrasefreq = scztmpphrasefreq->nxt;
-	if (scztmpphrasefreq==0) j = nreplaced; else j = scztmpphrasefreq->j;
-      }
-
-     if (j<nreplaced)
-      { /* If match, the phrase would be replaced with corresponding marker. */
-	saved++;
-	saved_pairfreq[j]++;		/* Keep track of how many times this phrase occured. */
-	bufpt = bufpt->nxt->nxt;	/* Skip over. */
-	replaced = 1;
-      }
+   if ((in + 1 < end) && ((j = w->pairj[ in[0] * 256 + in[1] ]) < nreplaced))
+    { /* If match, the phrase would be replaced with corresponding marker. */
+     saved++;
+     saved_pairfreq[j]++;		/* Keep track of how many times this phrase occured. */
+     in += 2;				/* Skip over. */
     }
-   if (!replaced)
+   else
     {  /* Check for match of marker characters. */
-     j = markerlist[ bufpt->ch ];
+     j = markerlist[ *in ];
      if (j<=nreplaced)
       {	/* If match, insert forcing character. */
 	saved--;
 	saved_charfreq[j]--;		/* Keep track of how many 'collisions' this marker-char caused. */
       }
-     bufpt = bufpt->nxt;
+     in++;
     }
   }
 
- // printf("%d saved\n", saved);
+ for (j=0; j!=nreplaced; j++)
+  w->pairj[ phrase_freq_max[j].phrase[0] * 256 + phrase_freq_max[j].phrase[1] ] = SCZ_NOPAIR;
+
  if (saved<=1) return 0; /* Not able to compress this data further with this method. Buffer unchanged. */
 
+ /* Forcing char before every byte at most, and the header */
+ if (!scz_reserve( seg, 2 * seg->len + 3 * (SCZ_NREPLACE + 1) )) return 0;
+ end = seg->buf + seg->len;
+
  /* Now we know which marker/phrase combinations do not actually pay. */
  /* Reformulate the marker list with reduced set. */
  /* The least frequent chars become the forcing char and the marker characters. */
  /* Store out the forcing-char, markers and replacement phrases after a magic number. */
- scz_add_item( &head1, &head2, char_freq[0].phrase[0] );	/* First add forcing-marker (escape-like) value. */
- scz_add_item( &head1, &head2, 0 );	/* Next, leave place-holder for header-symbol-count. */
- cntpt = head2;
+ out = seg->tmp;
+ *(out++) = char_freq[0].phrase[0];	/* First add forcing-marker (escape-like) value. */
+ *(out++) = 0;				/* Next, leave place-holder for header-symbol-count. */
  k = 0;  saved = 0;
  for (j=0; j<nreplaced; j++)
   if (saved_pairfreq[j] + saved_charfreq[j+1] > 3)
    { unsigned char ch;
     saved = saved + saved_pairfreq[j] + saved_charfreq[j+1] - 3;
     ch = char_freq[j+1].phrase[0];
-    scz_add_item( &head1, &head2, ch );  /* Add phrase-marker. */
+    *(out++) = ch;			/* Add phrase-marker. */
     char_freq[k+1].phrase[0] = ch;
 
     ch = phrase_freq_max[j].phrase[0];
-    scz_add_item( &head1, &head2, ch );	 /* Add phrase 1st char. */
+    *(out++) = ch;			/* Add phrase 1st char. */
     phrase_freq_max[k].phrase[0] = ch;
 
     ch = phrase_freq_max[j].phrase[1];
-    scz_add_item( &head1, &head2, ch );	 /* Add phrase 2nd char. */
+    *(out++) = ch;			/* Add phrase 2nd char. */
     phrase_freq_max[k].phrase[1] = ch;
     k++;
    }
  saved = saved + saved_charfreq[0];
  if ((k == 0) || (saved < 6))
-  { /* Not able to compress this data further with this method. Leave buffer basically unchanged. */
-   /* Free the old lists. */
-   for (j=0; j!=256; j++)
-    while (sczphrasefreq[j] != 0)
-     { scztmpphrasefreq = sczphrasefreq[j]; sczphrasefreq[j] = sczphrasefreq[j]->nxt; sczfree2(scztmpphrasefreq); }
-   return 0;
-  }
+  return 0; /* Not able to compress this data further with this method. Leave buffer basically unchanged. */
 
- sz3 = 3*(k+1);
- cntpt->ch = k;		/* Place the header-symbol-count. */
+ seg->tmp[1] = k;		/* Place the header-symbol-count. */
  nreplaced = k;
- scz_add_item( &head1, &head2, 91 );	/* Magic barrier. */
+ *(out++) = 91;			/* Magic barrier. */
 
- /* Update the phrase_freq tree. */
- /* First free the old list. */
- for (j=0; j!=256; j++)
-  while (sczphrasefreq[j] != 0)
-   { scztmpphrasefreq = sczphrasefreq[j]; sczphrasefreq[j] = sczphrasefreq[j]->nxt; sczfree2(scztmpphrasefreq); }
- /* Now make the new list. */
+ /* The reduced set of phrases and markers. */
  for (j=0; j!=nreplaced; j++)
-  if (phrase_freq_max[j].value>0)
-   {
-    scztmpphrasefreq = new_scz_item2();
-    scztmpphrasefreq->ch = phrase_freq_max[j].phrase[1];
-    scztmpphrasefreq->j = j;
-    k = phrase_freq_max[j].phrase[0];
-    scztmpphrasefreq->nxt = sczphrasefreq[k];
-    sczphrasefreq[k] = scztmpphrasefreq;
-   }
-
-for (j=0; j!=256; j++) markerlist[j] = nreplaced+1;
-for (j=0; j!=nreplaced+1; j++) markerlist[ char_freq[j].phrase[0] ] = j;
-// printf("Replacing %d\n", nreplaced);
+  w->pairj[ phrase_freq_max[j].phrase[0] * 256 + phrase_freq_max[j].phrase[1] ] = j;
+ for (j=0; j!=256; j++) markerlist[j] = nreplaced+1;
+ for (j=0; j!=nreplaced+1; j++) markerlist[ char_freq[j].phrase[0] ] = j;
 
- bufpt = *buffer0_hd;
- while (bufpt!=0)
+ in = seg->buf;
+ while (in < end)
   {
-   sz3++;
-   replaced = 0;
-   if (bufpt->nxt!=0)
-    {  /* Check for match to frequent phrases. */
-     k = bufpt->ch;
-     if (sczphrasefreq[k]==0) j = nreplaced;
-     else
-      { unsigned char tmpch;
-	tmpch = bufpt->nxt->ch;
-	scztmpphrasefreq = sczphrasefreq[k];
-	while ((scztmpphrasefreq!=0) && (scztmpphrasefreq->ch != tmpch)) scztmpphrasefreq = scztmpphrasefreq->nxt;
-	if (scztmpphrasefreq==0) j = nreplaced; else j = scztmpphrasefreq->j;
-      }
-
-     if (j<nreplaced)
-      { /* If match, replace phrase with corresponding marker. */
-	bufpt->ch = char_freq[j+1].phrase[0];
-	tmpbuf = bufpt->nxt;
-	bufpt->nxt = tmpbuf->nxt;
-	sczfree( tmpbuf );
-	replaced = 1;
-      }
+   if ((in + 1 < end) && ((j = w->pairj[ in[0] * 256 + in[1] ]) < nreplaced))
+    { /* If match, replace phrase with corresponding marker. */
+     *(out++) = char_freq[j+1].phrase[0];
+     in += 2;
     }
-   if (!replaced)
+   else
     {  /* Check for match of marker characters. */
-     j = markerlist[ bufpt->ch ];
-     if (j<=nreplaced)
-      {	/* If match, insert forcing character. */
-       tmpbuf = new_scz_item();
-       tmpbuf->ch = bufpt->ch;
-       tmpbuf->nxt = bufpt->nxt;
-       bufpt->nxt = tmpbuf;
-       bufpt->ch = forcingchar;
-       bufpt = tmpbuf;
-       sz3 = sz3 + 1;
-      }
+     if (markerlist[ *in ] <= nreplaced)
+      *(out++) = forcingchar;	/* If match, insert forcing character. */
+     *(out++) = *(in++);
     }
-
-   bufpt = bufpt->nxt;
   }
 
- /* Now attach header to main buffer. */
- head2->nxt = *buffer0_hd;
- *buffer0_hd = head1;
+ for (j=0; j!=nreplaced; j++)
+  w->pairj[ phrase_freq_max[j].phrase[0] * 256 + phrase_freq_max[j].phrase[1] ] = SCZ_NOPAIR;
 
- /* Free the old list. */
- for (j=0; j!=256; j++)
-  while (sczphrasefreq[j] != 0)
-   { scztmpphrasefreq = sczphrasefreq[j]; sczphrasefreq[j] = sczphrasefreq[j]->nxt; sczfree2(scztmpphrasefreq); }
+ i = out - seg->tmp;
+ scz_swap( seg, i );
 
- return sz3;
+ return i;
 }
 
 
@@ -732,102 +892,144 @@ for (j=0; j!=nreplaced+1; j++) markerlist[ char_freq[j].phrase[0] ] = j;
 
 /*******************************************************************/
 /* Scz_Compress - Compress a buffer.  Entry-point to Scz_Compress. */
-/*  Compresses the buffer passed in.				   */
-/* Pass-in the buffer and its initial size, as sz1. 		   */
+/*  Compresses the segment passed in, it is replaced by the	   */
+/*  compressed one with the 6-byte segment header.		   */
 /* Returns 1 on success, 0 on failure.				   */
 /*******************************************************************/
-int Scz_Compress_Seg( struct scz_item **buffer0_hd, int sz1 )
+int Scz_Compress_Seg( SCZ_SEG *seg )
 {
- struct scz_item *tmpbuf_hd=0, *tmpbuf_tl=0;
- int sz2, iter=0;
+ SCZ_WORK *w;
+ int iter=0;
+
+ if ((w = malloc(sizeof(SCZ_WORK))) == 0) return 0;
+ memset( w->pairj, SCZ_NOPAIR, sizeof(w->pairj) );
 
  /* Compress. */
- sz2 = scz_compress_iter( buffer0_hd );
- while ((sz2!=0) && (iter<255))
-  {
-   sz1 = sz2;
-   sz2 = scz_compress_iter( buffer0_hd );
-   iter++;
-  }
+ while ((iter<SCZ_MAXITER) && scz_compress_iter( seg, w ))
+  iter++;
+
+ free(w);
 
- scz_add_item( &tmpbuf_hd, &tmpbuf_tl, 101 );   /* Place magic start-number(s). */
- scz_add_item( &tmpbuf_hd, &tmpbuf_tl, 98 );
- scz_add_item( &tmpbuf_hd, &tmpbuf_tl, iter );  /* Place compression count. */
- scz_add_item( &tmpbuf_hd, &tmpbuf_tl, sz1>>16 );         /* Place size count (MSB). */
- scz_add_item( &tmpbuf_hd, &tmpbuf_tl, (sz1>>8) & 255 );  /* Place size count. */
- scz_add_item( &tmpbuf_hd, &tmpbuf_tl, sz1 & 255 );       /* Place size count (LSB). */
+ if (!scz_reserve( seg, seg->len + 6 )) return 0;
+
+ seg->tmp[0] = 101;			/* Place magic start-number(s). */
+ seg->tmp[1] = 98;
+ seg->tmp[2] = iter;			/* Place compression count. */
+ seg->tmp[3] = seg->len>>16;		/* Place size count (MSB). */
+ seg->tmp[4] = (seg->len>>8) & 255;	/* Place size count. */
+ seg->tmp[5] = seg->len & 255;		/* Place size count (LSB). */
+ memcpy( seg->tmp + 6, seg->buf, seg->len );
+ scz_swap( seg, seg->len + 6 );
 
- tmpbuf_tl->nxt = *buffer0_hd;
- *buffer0_hd = tmpbuf_hd;
  return 1;
 }
 
 
 
 
+/*
+ * Compress a segment of the buffer, a pool job
+ */
+static	int	scz_compress_job	(SCZ_JOB *j)
+{
+long	i;
+
+	if ( !scz_reserve(&j->seg, j->len + 6) )
+		return	0;
+
+	for (j->chksum = 0, i = 0; i < j->len; i++)
+		j->chksum += j->in[i];
+
+	memcpy(j->seg.buf, j->in, j->seg.len = j->len);
+
+	return	Scz_Compress_Seg( &j->seg );
+}
+
+typedef	struct __scz_wr__ {
+	int		fd;
+	long		njob, nput, len;
+} SCZ_WR;
+
+/* Write the segment out, checksum and continuation marker. */
+static	int	scz_compress_put	(void *ctx, SCZ_JOB *j)
+{
+SCZ_WR	*w = ctx;
+unsigned char trailer[2];
+
+	if ( !j->ok )
+		return	0;
+
+	trailer[0] = j->chksum;
+	trailer[1] = (++w->nput == w->njob) ? ']' : '[';
+
+	if ( !scz_write( w->fd, j->seg.buf, j->seg.len ) || !scz_write( w->fd, trailer, 2 ) )
+		return	0;
+
+	w->len += j->seg.len + 2;
+
+	return	1;
+}
+
+
+/************************************************************************/
+/* Scz_Compress_Buffer2Fd - Compresses character array input buffer	*/
+/*  to an output file open on fd.  The data is compressed and written	*/
+/*  in segments of sczbuflen for very large data sets, the segments	*/
+/*  are compressed in parallel.  The compressed size is passed back.	*/
+/*  Returns 1 on success, 0 on failure.					*/
+/************************************************************************/
+int Scz_Compress_Buffer2Fd( unsigned char *buffer, long N, int fd, long *outlen )
+{
+ SCZ_JOB *job;
+ SCZ_WR wr = {0};
+ long sz1=0, buflen, i;
+ int success;
+
+ buflen = N / sczbuflen + 1;
+ buflen = N / buflen + 1;
+ if (buflen>=SCZ_MAX_BUF) {printf("Error: Buffer length too large.\n"); return 0;}
+
+ wr.fd = fd;
+ wr.njob = N ? (N + buflen - 1) / buflen : 1;	/* An empty segment for nothing */
+ if ((job = calloc(wr.njob, sizeof(SCZ_JOB))) == 0) return 0;
+
+ for (i=0; i<wr.njob; i++)
+  {
+    job[i].in = buffer + sz1;
+    job[i].len = (N-sz1 < buflen) ? N-sz1 : buflen;
+    sz1 = sz1 + job[i].len;
+  }
+
+ success = scz_pool_run( job, wr.njob, scz_compress_job, scz_compress_put, &wr );
+
+ free( job );
+ *outlen = wr.len;
+
+ return success;
+}
+
+
 /************************************************************************/
 /* Scz_Compress_Buffer2File - Compresses character array input buffer	*/
 /*  to an output file.  This routine is handy for applications wishing	*/
 /*  to compress their output directly while saving to disk.		*/
 /*  First argument is input array, second is the array's length, and	*/
 /*  third is the output file name to store to.				*/
-/*  (It also shows how to compress and write data out in segments for	*/
-/*   very large data sets.)						*/
 /*									*/
 /************************************************************************/
 int Scz_Compress_Buffer2File( unsigned char *buffer, int N, char *outfilename )
 {
- struct scz_item *buffer0_hd=0, *buffer0_tl=0, *bufpt;
- int sz1=0, sz2=0, szi, success=1, flen, buflen;
- unsigned char ch, chksum;
- FILE *outfile=0;
+ int fd, success;
+ long sz2;
 
- outfile = fopen(outfilename,"wb");
- if (outfile==0) {printf("ERROR: Cannot open output file '%s' for writing.  Exiting\n", outfilename); exit(1);}
+ fd = open(outfilename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+ if (fd<0) {printf("ERROR: Cannot open output file '%s' for writing.  Exiting\n", outfilename); exit(1);}
 
- buflen = N / sczbuflen + 1;
- buflen = N / buflen + 1;
- if (buflen>=SCZ_MAX_BUF) {printf("Error: Buffer length too large.\n"); exit(0);}
-
- while (sz1 < N)
-  { /*outerloop*/
-
-    chksum = 0;  szi = 0;
-    if (N-sz1 < buflen) buflen = N-sz1;
-
-    /* Convert buffer into linked list. */
-    buffer0_hd = 0;   buffer0_tl = 0;
-    while (szi < buflen)
-     {
-      scz_add_item( &buffer0_hd, &buffer0_tl, buffer[sz1] );
-      chksum += buffer[sz1];
-      sz1++;  szi++;
-     }
+ success = Scz_Compress_Buffer2Fd( buffer, N, fd, &sz2 );
+ if (close(fd)) success = 0;
 
-   success = success & Scz_Compress_Seg( &buffer0_hd, szi );
-
-   /* Write the file out. */
-   while (buffer0_hd!=0)
-    {
-     fputc( buffer0_hd->ch, outfile );
-     sz2++;
-     bufpt = buffer0_hd;
-     buffer0_hd = buffer0_hd->nxt;
-     sczfree(bufpt);
-    }
-   fprintf(outfile,"%c", chksum);
-   sz2++;
-   if (sz1 >= N) fprintf(outfile,"]");	/* Place no-continuation marker. */
-   else fprintf(outfile,"[");		/* Place continuation marker. */
-   sz2++;
-
-  } /*outerloop*/
- fclose(outfile);
-
- printf("Initial size = %d,  Final size = %d\n", sz1, sz2);
- printf("Compression ratio = %g : 1\n", (float)sz1 / (float)sz2 );
- free(scz_freq2);
- scz_freq2 = 0;
+ printf("Initial size = %d,  Final size = %ld\n", N, sz2);
+ printf("Compression ratio = %g : 1\n", (float)N / (float)sz2 );
  return success;
 }
 